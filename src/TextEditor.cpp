@@ -37,10 +37,9 @@ TextEditor::TextEditor()
 	, mTextStart(20.0f)
 	, mLeftMargin(0)
 	, mCursorPositionChanged(false)
-	, mColorRangeMin(0)
-	, mColorRangeMax(0)
 	, mSelectionMode(SelectionMode::Normal)
 	, mCheckComments(true)
+	, mCheckCommentsFrom(0)
 	, mLastClick(-1.0f)
 	, mHandleKeyboardInputs(true)
 	, mHandleMouseInputs(true)
@@ -49,8 +48,9 @@ TextEditor::TextEditor()
 	, mStartTime(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count())
 {
 	SetPalette(GetDarkPalette());
-	SetLanguageDefinition(LanguageDefinition::HLSL());
 	mLines.push_back(Line());
+	mLineNeedsColor.push_back(true);
+	SetLanguageDefinition(LanguageDefinition::HLSL());
 }
 
 TextEditor::~TextEditor()
@@ -597,6 +597,8 @@ void TextEditor::RemoveLine(int aStart, int aEnd)
 	mBreakpoints = std::move(btmp);
 
 	mLines.erase(mLines.begin() + aStart, mLines.begin() + aEnd);
+	mLineNeedsColor.erase(mLineNeedsColor.begin() + aStart, mLineNeedsColor.begin() + aEnd);
+	InvalidateComments(aStart);
 	assert(!mLines.empty());
 
 	mTextChanged = true;
@@ -627,6 +629,8 @@ void TextEditor::RemoveLine(int aIndex)
 	mBreakpoints = std::move(btmp);
 
 	mLines.erase(mLines.begin() + aIndex);
+	mLineNeedsColor.erase(mLineNeedsColor.begin() + aIndex);
+	InvalidateComments(aIndex);
 	assert(!mLines.empty());
 
 	mTextChanged = true;
@@ -637,6 +641,8 @@ TextEditor::Line& TextEditor::InsertLine(int aIndex)
 	assert(!mReadOnly);
 
 	auto& result = *mLines.insert(mLines.begin() + aIndex, Line());
+	mLineNeedsColor.insert(mLineNeedsColor.begin() + aIndex, true);
+	InvalidateComments(aIndex);
 
 	ErrorMarkers etmp;
 	for (auto& i : mErrorMarkers)
@@ -890,6 +896,14 @@ void TextEditor::Render()
 	snprintf(buf, 16, "%d ", globalLineMax);
 	mTextStart = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, buf, nullptr, nullptr).x + mLeftMargin;
 
+	// Tokens are only refreshed for the visible lines plus a margin, so huge buffers cost
+	// nothing for the parts that are never scrolled into view
+	if (mColorizerEnabled)
+	{
+		const int colorizeMargin = 64;
+		ColorizeDirtyLines(lineNo - colorizeMargin, lineMax + 1 + colorizeMargin);
+	}
+
 	if (!mLines.empty())
 	{
 		float spaceSize = ImGui::GetFont()->CalcTextSizeA(ImGui::GetFontSize(), FLT_MAX, -1.0f, " ", nullptr, nullptr).x;
@@ -1155,51 +1169,89 @@ void TextEditor::Render(const char* aTitle, const ImVec2& aSize, bool aBorder)
 
 void TextEditor::SetText(const std::string & aText)
 {
-	mLines.clear();
-	mLines.emplace_back(Line());
-	for (auto chr : aText)
+	// ignore the carriage return characters
+	std::string stripped;
+	const std::string* text = &aText;
+	if (aText.find('\r') != std::string::npos)
 	{
-		if (chr == '\r')
-		{
-			// ignore the carriage return character
-		}
-		else if (chr == '\n')
-			mLines.emplace_back(Line());
-		else
+		stripped.reserve(aText.size());
+		for (auto chr : aText)
+			if (chr != '\r')
+				stripped.push_back(chr);
+		text = &stripped;
+	}
+
+	std::vector<std::string_view> lines;
+	size_t start = 0;
+	for (;;)
+	{
+		size_t end = text->find('\n', start);
+		if (end == std::string::npos)
 		{
-			mLines.back().emplace_back(Glyph(chr, PaletteIndex::Default));
+			lines.emplace_back(text->data() + start, text->size() - start);
+			break;
 		}
+		lines.emplace_back(text->data() + start, end - start);
+		start = end + 1;
 	}
 
-	mTextChanged = true;
-	mScrollToTop = true;
+	ApplyTextLines(lines);
+}
 
-	mUndoBuffer.clear();
-	mUndoIndex = 0;
+void TextEditor::SetTextLines(const std::vector<std::string> & aLines)
+{
+	std::vector<std::string_view> lines(aLines.begin(), aLines.end());
+	if (lines.empty())
+		lines.emplace_back();
 
-	Colorize();
+	ApplyTextLines(lines);
 }
 
-void TextEditor::SetTextLines(const std::vector<std::string> & aLines)
+void TextEditor::ApplyTextLines(const std::vector<std::string_view>& aLines)
 {
-	mLines.clear();
+	// Only the lines between the unchanged head and tail are rebuilt, so a big buffer that
+	// changes a little (e.g. a growing multi-selection) keeps its glyphs and colors
+	auto sameLine = [](const Line& aLine, std::string_view aText)
+	{
+		if (aLine.size() != aText.size())
+			return false;
+		for (size_t j = 0; j < aText.size(); ++j)
+			if (aLine[j].mChar != (Char)aText[j])
+				return false;
+		return true;
+	};
 
-	if (aLines.empty())
+	const size_t oldCount = mLines.size();
+	const size_t newCount = aLines.size();
+	size_t head = 0;
+	while (head < oldCount && head < newCount && sameLine(mLines[head], aLines[head]))
+		++head;
+	size_t tail = 0;
+	while (tail < oldCount - head && tail < newCount - head &&
+		sameLine(mLines[oldCount - 1 - tail], aLines[newCount - 1 - tail]))
+		++tail;
+
+	const size_t oldMid = oldCount - head - tail;
+	const size_t newMid = newCount - head - tail;
+	if (newMid > oldMid)
 	{
-		mLines.emplace_back(Line());
+		mLines.insert(mLines.begin() + head + oldMid, newMid - oldMid, Line());
+		mLineNeedsColor.insert(mLineNeedsColor.begin() + head + oldMid, newMid - oldMid, true);
 	}
-	else
+	else if (newMid < oldMid)
 	{
-		mLines.resize(aLines.size());
-
-		for (size_t i = 0; i < aLines.size(); ++i)
-		{
-			const std::string & aLine = aLines[i];
+		mLines.erase(mLines.begin() + head + newMid, mLines.begin() + head + oldMid);
+		mLineNeedsColor.erase(mLineNeedsColor.begin() + head + newMid, mLineNeedsColor.begin() + head + oldMid);
+	}
 
-			mLines[i].reserve(aLine.size());
-			for (size_t j = 0; j < aLine.size(); ++j)
-				mLines[i].emplace_back(Glyph(aLine[j], PaletteIndex::Default));
-		}
+	for (size_t i = head; i < head + newMid; ++i)
+	{
+		auto& line = mLines[i];
+		const auto& text = aLines[i];
+		line.clear();
+		line.reserve(text.size());
+		for (auto chr : text)
+			line.emplace_back(Glyph((Char)chr, PaletteIndex::Default));
 	}
 
 	mTextChanged = true;
@@ -1208,7 +1260,8 @@ void TextEditor::SetTextLines(const std::vector<std::string> & aLines)
 	mUndoBuffer.clear();
 	mUndoIndex = 0;
 
-	Colorize();
+	if (newMid > 0 || oldMid > 0)
+		Colorize((int)head, (int)newMid);
 }
 
 void TextEditor::EnterCharacter(ImWchar aChar, bool aShift)
@@ -2134,10 +2187,18 @@ void TextEditor::ProcessInputs()
 void TextEditor::Colorize(int aFromLine, int aLines)
 {
 	int toLine = aLines == -1 ? (int)mLines.size() : std::min((int)mLines.size(), aFromLine + aLines);
-	mColorRangeMin = std::min(mColorRangeMin, aFromLine);
-	mColorRangeMax = std::max(mColorRangeMax, toLine);
-	mColorRangeMin = std::max(0, mColorRangeMin);
-	mColorRangeMax = std::max(mColorRangeMin, mColorRangeMax);
+	if (mLineNeedsColor.size() != mLines.size())
+		mLineNeedsColor.resize(mLines.size(), true);
+	for (int i = std::max(0, aFromLine); i < toLine; ++i)
+		mLineNeedsColor[i] = true;
+	InvalidateComments(aFromLine);
+}
+
+void TextEditor::InvalidateComments(int aFromLine)
+{
+	aFromLine = std::max(0, aFromLine);
+	if (!mCheckComments || aFromLine < mCheckCommentsFrom)
+		mCheckCommentsFrom = aFromLine;
 	mCheckComments = true;
 }
 
@@ -2246,6 +2307,32 @@ void TextEditor::ColorizeRange(int aFromLine, int aToLine)
 	}
 }
 
+void TextEditor::ColorizeDirtyLines(int aFromLine, int aToLine)
+{
+	if (mLineNeedsColor.size() != mLines.size())
+		mLineNeedsColor.resize(mLines.size(), true);
+
+	const int from = std::max(0, aFromLine);
+	const int to = std::min((int)mLines.size(), aToLine);
+	int runStart = -1;
+	for (int i = from; i < to; ++i)
+	{
+		if (mLineNeedsColor[i])
+		{
+			mLineNeedsColor[i] = false;
+			if (runStart < 0)
+				runStart = i;
+		}
+		else if (runStart >= 0)
+		{
+			ColorizeRange(runStart, i);
+			runStart = -1;
+		}
+	}
+	if (runStart >= 0)
+		ColorizeRange(runStart, to);
+}
+
 void TextEditor::ColorizeInternal()
 {
 	if (mLines.empty() || !mColorizerEnabled)
@@ -2253,6 +2340,10 @@ void TextEditor::ColorizeInternal()
 
 	if (mCheckComments)
 	{
+		// Lines before the first edited one keep their flags; resume from the lexer state
+		// recorded at the start of that line
+		enum : uint8_t { StateComment = 1, StateString = 2, StateSingleLine = 4, StatePreproc = 8, StateFirstChar = 16, StateConcatenate = 32 };
+
 		auto endLine = mLines.size();
 		auto endIndex = 0;
 		auto commentStartLine = endLine;
@@ -2262,12 +2353,37 @@ void TextEditor::ColorizeInternal()
 		auto withinPreproc = false;
 		auto firstChar = true;			// there is no other non-whitespace characters in the line before
 		auto concatenate = false;		// '\' on the very end of the line
-		auto currentLine = 0;
+		auto currentLine = std::min(mCheckCommentsFrom, (int)endLine);
 		auto currentIndex = 0;
+		if (currentLine > 0 && currentLine < (int)mLineCommentState.size())
+		{
+			const uint8_t state = mLineCommentState[currentLine];
+			if (state & StateComment)
+			{
+				commentStartLine = currentLine - 1;
+				commentStartIndex = 0;
+			}
+			withinString = (state & StateString) != 0;
+			withinSingleLineComment = (state & StateSingleLine) != 0;
+			withinPreproc = (state & StatePreproc) != 0;
+			firstChar = (state & StateFirstChar) != 0;
+			concatenate = (state & StateConcatenate) != 0;
+		}
+		// One extra entry holds the state after the last line, where appended lines resume
+		mLineCommentState.resize(mLines.size() + 1, 0);
+		auto recordState = [&](int aLine)
+		{
+			mLineCommentState[aLine] = (uint8_t)((commentStartLine < (size_t)aLine ? StateComment : 0) |
+				(withinString ? StateString : 0) | (withinSingleLineComment ? StateSingleLine : 0) |
+				(withinPreproc ? StatePreproc : 0) | (firstChar ? StateFirstChar : 0) | (concatenate ? StateConcatenate : 0));
+		};
 		while (currentLine < endLine || currentIndex < endIndex)
 		{
 			auto& line = mLines[currentLine];
 
+			if (currentIndex == 0)
+				recordState(currentLine);
+
 			if (currentIndex == 0 && !concatenate)
 			{
 				withinSingleLineComment = false;
@@ -2370,23 +2486,9 @@ void TextEditor::ColorizeInternal()
 				++currentLine;
 			}
 		}
+		recordState((int)endLine);
 		mCheckComments = false;
 	}
-
-	if (mColorRangeMin < mColorRangeMax)
-	{
-		const int increment = (mLanguageDefinition.mTokenize == nullptr) ? 10 : 10000;
-		const int to = std::min(mColorRangeMin + increment, mColorRangeMax);
-		ColorizeRange(mColorRangeMin, to);
-		mColorRangeMin = to;
-
-		if (mColorRangeMax == mColorRangeMin)
-		{
-			mColorRangeMin = std::numeric_limits<int>::max();
-			mColorRangeMax = 0;
-		}
-		return;
-	}
 }
 
 float TextEditor::TextDistanceToLineStart(const Coordinates& aFrom) const
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <array>
 #include <memory>
@@ -315,7 +316,10 @@ private:
 	void ProcessInputs();
 	void Colorize(int aFromLine = 0, int aCount = -1);
 	void ColorizeRange(int aFromLine = 0, int aToLine = 0);
+	void ColorizeDirtyLines(int aFromLine, int aToLine);
 	void ColorizeInternal();
+	void InvalidateComments(int aFromLine);
+	void ApplyTextLines(const std::vector<std::string_view>& aLines);
 	float TextDistanceToLineStart(const Coordinates& aFrom) const;
 	void EnsureCursorVisible();
 	int GetPageSize() const;
@@ -366,7 +370,7 @@ private:
 	float mTextStart;                   // position (in pixels) where a code line starts relative to the left of the TextEditor.
 	int  mLeftMargin;
 	bool mCursorPositionChanged;
-	int mColorRangeMin, mColorRangeMax;
+	std::vector<bool> mLineNeedsColor;  // parallel to mLines: token colors are stale and get refreshed when the line is near the view
 	SelectionMode mSelectionMode;
 	bool mHandleKeyboardInputs;
 	bool mHandleMouseInputs;
@@ -379,6 +383,8 @@ private:
 	RegexList mRegexList;
 
 	bool mCheckComments;
+	int mCheckCommentsFrom;                   // first line whose comment/preprocessor flags are stale
+	std::vector<uint8_t> mLineCommentState;   // lexer state at the start of each line, valid before mCheckCommentsFrom
 	Breakpoints mBreakpoints;
 	ErrorMarkers mErrorMarkers;
 	ImVec2 mCharAdvance;
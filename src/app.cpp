@@ -1,4 +1,5 @@
 #include "app.h"
+#include "frame_profiler.h"
 
 #include <GLFW/glfw3.h>
 #include <imgui.h>
@@ -13,8 +14,8 @@
 #include <cstring>
 #include <vector>
 #include <cmath>
-#include "embedded_resources.h"
 #include <deque>
+#include <memory>
 
 #include <cstdio>
 #include <cstdlib>
@@ -132,38 +133,10 @@ bool App::init() {
     ImGui_ImplGlfw_InitForOpenGL(m_window, true);
     ImGui_ImplOpenGL3_Init(glsl_version);
 
-    // Load a secondary font with Cyrillic support (for Russian lyrics only)
-    // The default ImGui font is kept for all other UI elements.
-    {
-        io.Fonts->AddFontDefault(); // slot 0: default UI font
-        const char* fontPaths[] = {
-            // Linux
-            "/usr/share/fonts/TTF/DejaVuSans.ttf",
-            "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf",
-            "/usr/share/fonts/dejavu-sans-fonts/DejaVuSans.ttf",
-            "/usr/share/fonts/truetype/liberation/LiberationSans-Regular.ttf",
-            // Windows
-            "C:\\Windows\\Fonts\\arial.ttf",
-            "C:\\Windows\\Fonts\\segoeui.ttf",
-            "C:\\Windows\\Fonts\\tahoma.ttf",
-            // macOS
-            "/System/Library/Fonts/Helvetica.ttc",
-            "/Library/Fonts/Arial.ttf",
-            "/System/Library/Fonts/Supplemental/Arial.ttf",
-        };
-        for (const char* fp : fontPaths) {
-            try {
-                if (std::filesystem::exists(fp)) {
-                    ImFontConfig cfg;
-                    cfg.MergeMode = false;
-                    cfg.GlyphRanges = io.Fonts->GetGlyphRangesCyrillic();
-                    m_cyrillicFont = io.Fonts->AddFontFromFileTTF(fp, 15.0f, &cfg);
-                    if (m_cyrillicFont) break;
-                }
-            } catch (...) {}
-        }
-        io.Fonts->Build();
-    }
+    // Only the default UI font is built up front; the Cyrillic font used for the Russian
+    // lyrics is added when the secret music player first needs it (loadLyricsFont)
+    io.Fonts->AddFontDefault();
+    io.Fonts->Build();
     
     // Initialize SDL audio subsystem (used by MusicPlayer) if available
 #ifdef HAVE_SDL2
@@ -172,8 +145,8 @@ bool App::init() {
     }
 #endif
 
-    // Load About image (initial attempt)
-    loadAboutImage();
+    // Textures, music and fonts for the About dialog are loaded when it first shows them
+    registerResources();
 
 
 // Note: The JSON data is not embedded in the executable by design; the app will load
@@ -182,6 +155,16 @@ bool App::init() {
 
     // Attempt to load saved user type colors from disk (non-fatal)
     loadTypeColorsFromDisk();
+    // Editor settings (autosave interval, undo memory) are optional as well
+    loadSettingsFromDisk();
+    // Names learned in earlier sessions, for "Fix name by ID"
+    loadNameIndexFromDisk();
+    if (m_nameIndex.isDirty()) saveNameIndexToDisk();
+    m_treeManager.setUndoBudget((size_t)m_undoBudgetMB << 20);
+    // Let the save worker wake the idle main loop when it reports progress or finishes
+    m_saver.setWakeCallback([]() { glfwPostEmptyEvent(); });
+    m_dirCache.setWakeCallback([]() { glfwPostEmptyEvent(); });
+    m_prefetcher.setWakeCallback([]() { glfwPostEmptyEvent(); });
     // Initialize saved feedback timer to past time
     m_typeColorsSavedUntil = std::chrono::steady_clock::time_point::min();
 
@@ -193,6 +176,24 @@ void App::run() {
     double lastTime = glfwGetTime();
     
     while (m_running && !glfwWindowShouldClose(m_window)) {
+        // Idle mode: while nothing animates, block until input or the next UI timer instead
+        // of redrawing at vsync rate. A few grace frames after any activity let ImGui settle
+        // hover/popup state before we go back to sleep.
+        if (m_treeRenderer.isAwake() || needsContinuousRedraw()) {
+            m_idleGraceFrames = IDLE_GRACE_FRAMES;
+            glfwPollEvents();
+        } else if (m_idleGraceFrames > 0) {
+            --m_idleGraceFrames;
+            glfwPollEvents();
+        } else {
+            glfwWaitEventsTimeout(secondsUntilNextUiTimer());
+            m_idleGraceFrames = IDLE_GRACE_FRAMES;
+            // Time spent asleep must not be fed to the physics step
+            lastTime = glfwGetTime();
+        }
+        FrameProfiler& profiler = FrameProfiler::instance();
+        profiler.beginFrame();
+
         // Calculate delta time
         double currentTime = glfwGetTime();
         float deltaTime = (float)(currentTime - lastTime);
@@ -201,14 +202,19 @@ void App::run() {
         // Clamp delta time to avoid physics explosions after pause
         if (deltaTime > 0.1f) deltaTime = 0.1f;
 
-        // Poll events so the UI remains responsive even while dialogs are open
-        glfwPollEvents();
-
 
         // Update physics for elastic node dragging and collision
+        WATERCAN_PROFILE_SCOPE(physicsScope, "updatePhysics");
         const SpiritTree* currentTree = m_selectedSpirit.empty() ? nullptr : m_treeManager.getTree(m_selectedSpirit);
         m_treeRenderer.updatePhysics(deltaTime, currentTree);
+        physicsScope.end();
         
+        // Fonts can only be added to the atlas between frames
+        if (m_wantLyricsFont) {
+            m_wantLyricsFont = false;
+            m_resources.require("lyrics-font");
+        }
+
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
@@ -218,6 +224,7 @@ void App::run() {
         renderUI();
 
         // Render internal file-open dialog if requested
+        WATERCAN_PROFILE_SCOPE(dialogsScope, "file dialogs");
         if (m_showInternalOpenDialog) {
             // We'll render this as a modal
             ImGui::OpenPopup("Open JSON file");
@@ -301,32 +308,27 @@ void App::run() {
                     }
                 }
 
-                // Prepare sorted directory and file lists
-                std::vector<std::string> dirs;
-                std::vector<std::string> files;
+                // Sorted directory and file lists (with stat info) come from the background cache
+                const DirectoryListing* listing = m_dirCache.get(m_internalDialogPath);
+                static const std::vector<DirectoryEntryInfo> noEntries;
+                const auto& dirs = (listing && listing->ok) ? listing->dirs : noEntries;
+                const auto& files = (listing && listing->ok) ? listing->files : noEntries;
+                auto isListedDir = [&](const std::string& name) { return listing && listing->findDir(name) != nullptr; };
 
                 ImGui::BeginChild("file_list", ImVec2(600, 300), true);
                 try {
-                    // Collect directories and files and sort them for a stable, user-friendly order
-                    for (const auto& entry : std::filesystem::directory_iterator(m_internalDialogPath)) {
-                        try {
-                            if (entry.is_directory()) {
-                                dirs.push_back(entry.path().filename().string());
-                            } else if (entry.path().extension() == ".json") {
-                                files.push_back(entry.path().filename().string());
-                            }
-                        } catch (...) {
-                            // ignore entries we can't stat
-                        }
+                    if (!listing) {
+                        ImGui::TextDisabled("Loading...");
+                    } else if (!listing->ok) {
+                        ImGui::TextColored(ImVec4(1,0.6f,0.3f,1), "Failed to list directory");
                     }
-                    std::sort(dirs.begin(), dirs.end(), [](const std::string&a,const std::string&b){return strcasecmp(a.c_str(), b.c_str())<0;});
-                    std::sort(files.begin(), files.end(), [](const std::string&a,const std::string&b){return strcasecmp(a.c_str(), b.c_str())<0;});
 
                     // Ensure icons exist
                     if (!m_iconFolderTexture || !m_iconFileTexture) createIconTextures();
 
                     // Directories first (icon + selectable)
-                    for (const auto& name : dirs) {
+                    for (const auto& entry : dirs) {
+                        const std::string& name = entry.name;
                         bool selected = (std::string(m_internalSelectedFilename) == name);
                         ImGui::PushID(name.c_str());
                         ImGui::Image((void*)(intptr_t)m_iconFolderTexture, ImVec2(16,16));
@@ -357,27 +359,27 @@ void App::run() {
                         // Show last-modified timestamp aligned to the right
                         try {
                             std::filesystem::path p = std::filesystem::path(m_internalDialogPath) / name;
-                            std::time_t cftime = 0;
+                            bool haveTime = entry.hasModified;
+                            std::time_t cftime = entry.modified;
                             auto it = m_forcedTimestamps.find(p.string());
                             if (it != m_forcedTimestamps.end()) {
                                 cftime = it->second;
-                            } else {
-                                auto ftime = std::filesystem::last_write_time(p);
-                                auto sctp = std::chrono::time_point_cast<std::chrono::system_clock::duration>(
-                                    ftime - decltype(ftime)::clock::now() + std::chrono::system_clock::now());
-                                cftime = std::chrono::system_clock::to_time_t(sctp);
+                                haveTime = true;
+                            }
+                            if (haveTime) {
+                                char timestr[64];
+                                std::strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M", std::localtime(&cftime));
+                                float dateX = ImGui::GetWindowContentRegionMax().x - 140.0f;
+                                ImGui::SameLine(dateX);
+                                ImGui::TextUnformatted(timestr);
                             }
-                            char timestr[64];
-                            std::strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M", std::localtime(&cftime));
-                            float dateX = ImGui::GetWindowContentRegionMax().x - 140.0f;
-                            ImGui::SameLine(dateX);
-                            ImGui::TextUnformatted(timestr);
                         } catch (...) {}
                         ImGui::PopID();
                     }
 
                     // Then files (file icon + selectable)
-                    for (const auto& name : files) {
+                    for (const auto& entry : files) {
+                        const std::string& name = entry.name;
                         bool selected = (std::string(m_internalSelectedFilename) == name);
                         ImGui::PushID(name.c_str());
                         ImGui::Image((void*)(intptr_t)m_iconFileTexture, ImVec2(16,16));
@@ -413,18 +415,14 @@ void App::run() {
                             }
                         }
                         // Show last-modified timestamp aligned to the right
-                        try {
-                            std::filesystem::path p = std::filesystem::path(m_internalDialogPath) / name;
-                            auto ftime = std::filesystem::last_write_time(p);
-                            auto sctp = std::chrono::time_point_cast<std::chrono::system_clock::duration>(
-                                ftime - decltype(ftime)::clock::now() + std::chrono::system_clock::now());
-                            std::time_t cftime = std::chrono::system_clock::to_time_t(sctp);
+                        if (entry.hasModified) {
+                            std::time_t cftime = entry.modified;
                             char timestr[64];
                             std::strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M", std::localtime(&cftime));
                             float dateX = ImGui::GetWindowContentRegionMax().x - 140.0f;
                             ImGui::SameLine(dateX);
                             ImGui::TextUnformatted(timestr);
-                        } catch (...) {}
+                        }
                         ImGui::PopID();
                     }
 
@@ -433,7 +431,7 @@ void App::run() {
                         if (m_internalSelectedFilename[0] != '\0') {
                             std::string sel(m_internalSelectedFilename);
                             // If selection matches a directory, enter it
-                            if (std::find(dirs.begin(), dirs.end(), sel) != dirs.end()) {
+                            if (isListedDir(sel)) {
                                 if (m_internalDialogPath.back() != '/') m_internalDialogPath += '/';
                                 m_internalDialogPath += sel;
                                 m_internalSelectedFilename[0] = '\0';
@@ -461,7 +459,7 @@ void App::run() {
                     if (m_internalSelectedFilename[0] != '\0') {
                         std::string sel(m_internalSelectedFilename);
                         // If selection is a directory, enter it
-                        if (std::find(dirs.begin(), dirs.end(), sel) != dirs.end()) {
+                        if (isListedDir(sel)) {
                             if (m_internalDialogPath.back() != '/') m_internalDialogPath += '/';
                             m_internalDialogPath += sel;
                             m_internalSelectedFilename[0] = '\0';
@@ -566,28 +564,26 @@ void App::run() {
                     }
                 }
 
-                // Directory and file listing (select a filename to save)
-                std::vector<std::string> dirs;
-                std::vector<std::string> files;
+                // Directory and file listing (select a filename to save), served from the background cache
+                const DirectoryListing* listing = m_dirCache.get(m_internalSavePath);
+                static const std::vector<DirectoryEntryInfo> noEntries;
+                const auto& dirs = (listing && listing->ok) ? listing->dirs : noEntries;
+                const auto& files = (listing && listing->ok) ? listing->files : noEntries;
+                auto isListedDir = [&](const std::string& name) { return listing && listing->findDir(name) != nullptr; };
 
                 ImGui::BeginChild("save_file_list", ImVec2(600, 300), true);
                 try {
-                    for (const auto& entry : std::filesystem::directory_iterator(m_internalSavePath)) {
-                        try {
-                            if (entry.is_directory()) {
-                                dirs.push_back(entry.path().filename().string());
-                            } else if (entry.path().extension() == ".json") {
-                                files.push_back(entry.path().filename().string());
-                            }
-                        } catch (...) {}
+                    if (!listing) {
+                        ImGui::TextDisabled("Loading...");
+                    } else if (!listing->ok) {
+                        ImGui::TextColored(ImVec4(1,0.6f,0.3f,1), "Failed to list directory");
                     }
-                    std::sort(dirs.begin(), dirs.end(), [](const std::string&a,const std::string&b){return strcasecmp(a.c_str(), b.c_str())<0;});
-                    std::sort(files.begin(), files.end(), [](const std::string&a,const std::string&b){return strcasecmp(a.c_str(), b.c_str())<0;});
 
                     // Ensure icons exist
                     if (!m_iconFolderTexture || !m_iconFileTexture) createIconTextures();
 
-                    for (const auto& name : dirs) {
+                    for (const auto& entry : dirs) {
+                        const std::string& name = entry.name;
                         bool selected = (std::string(m_internalSaveSelectedFilename) == name);
                         ImGui::PushID(name.c_str());
                         ImGui::Image((void*)(intptr_t)m_iconFolderTexture, ImVec2(16,16));
@@ -617,26 +613,26 @@ void App::run() {
                         // Show last-modified timestamp aligned to the right
                         try {
                             std::filesystem::path p = std::filesystem::path(m_internalSavePath) / name;
-                            std::time_t cftime = 0;
+                            bool haveTime = entry.hasModified;
+                            std::time_t cftime = entry.modified;
                             auto it = m_forcedTimestamps.find(p.string());
                             if (it != m_forcedTimestamps.end()) {
                                 cftime = it->second;
-                            } else {
-                                auto ftime = std::filesystem::last_write_time(p);
-                                auto sctp = std::chrono::time_point_cast<std::chrono::system_clock::duration>(
-                                    ftime - decltype(ftime)::clock::now() + std::chrono::system_clock::now());
-                                cftime = std::chrono::system_clock::to_time_t(sctp);
+                                haveTime = true;
+                            }
+                            if (haveTime) {
+                                char timestr[64];
+                                std::strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M", std::localtime(&cftime));
+                                float dateX = ImGui::GetWindowContentRegionMax().x - 140.0f;
+                                ImGui::SameLine(dateX);
+                                ImGui::TextUnformatted(timestr);
                             }
-                            char timestr[64];
-                            std::strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M", std::localtime(&cftime));
-                            float dateX = ImGui::GetWindowContentRegionMax().x - 140.0f;
-                            ImGui::SameLine(dateX);
-                            ImGui::TextUnformatted(timestr);
                         } catch (...) {}
                         ImGui::PopID();
                     }
 
-                    for (const auto& name : files) {
+                    for (const auto& entry : files) {
+                        const std::string& name = entry.name;
                         bool selected = (std::string(m_internalSaveSelectedFilename) == name);
                         ImGui::PushID(name.c_str());
                         ImGui::Image((void*)(intptr_t)m_iconFileTexture, ImVec2(16,16));
@@ -694,18 +690,14 @@ void App::run() {
                             }
                         }
                         // Show last-modified timestamp aligned to the right
-                        try {
-                            std::filesystem::path p = std::filesystem::path(m_internalSavePath) / name;
-                            auto ftime = std::filesystem::last_write_time(p);
-                            auto sctp = std::chrono::time_point_cast<std::chrono::system_clock::duration>(
-                                ftime - decltype(ftime)::clock::now() + std::chrono::system_clock::now());
-                            std::time_t cftime = std::chrono::system_clock::to_time_t(sctp);
+                        if (entry.hasModified) {
+                            std::time_t cftime = entry.modified;
                             char timestr[64];
                             std::strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M", std::localtime(&cftime));
                             float dateX = ImGui::GetWindowContentRegionMax().x - 140.0f;
                             ImGui::SameLine(dateX);
                             ImGui::TextUnformatted(timestr);
-                        } catch (...) {}
+                        }
                         ImGui::PopID();
                     }
 
@@ -746,7 +738,7 @@ void App::run() {
                     if (ImGui::IsWindowFocused() && ImGui::IsKeyPressed(ImGuiKey_Enter)) {
                         if (m_internalSaveSelectedFilename[0] != '\0') {
                             std::string sel(m_internalSaveSelectedFilename);
-                            if (std::find(dirs.begin(), dirs.end(), sel) != dirs.end()) {
+                            if (isListedDir(sel)) {
                                 if (m_internalSavePath.back() != '/') m_internalSavePath += '/';
                                 m_internalSavePath += sel;
                                 m_internalSaveSelectedFilename[0] = '\0';
@@ -810,8 +802,10 @@ void App::run() {
                 bool selectedExists = false;
                 bool isSelectedCurrent = false;
                 if (canSave) {
+                    // Answered from the cached listing; the click handlers still check the disk
                     try {
-                        selectedExists = std::filesystem::exists(selectedFullPath);
+                        std::string fn = std::filesystem::path(selectedFullPath).filename().string();
+                        selectedExists = listing && listing->ok && (listing->findFile(fn) || listing->findDir(fn));
                     } catch (...) {
                         selectedExists = false;
                     }
@@ -865,10 +859,7 @@ void App::run() {
                 // Detect if the selected entry is a directory so the Save button can act as "Open?"
                 bool selectedIsDirectory = false;
                 if (canSave && m_internalSaveSelectedFilename[0] != '\0') {
-                    try {
-                        std::filesystem::path cand = std::filesystem::path(m_internalSavePath) / m_internalSaveSelectedFilename;
-                        selectedIsDirectory = std::filesystem::is_directory(cand);
-                    } catch (...) { selectedIsDirectory = false; }
+                    selectedIsDirectory = isListedDir(m_internalSaveSelectedFilename);
                 }
 
                 const char* saveLabel = "Save";
@@ -980,27 +971,53 @@ void App::run() {
                 ImGui::EndPopup();
             }
         }
+        dialogsScope.end();
+        // Overlay last, so it stays in front of the dialogs it measures
+        renderProfilerOverlay();
+
+        WATERCAN_PROFILE_SCOPE(imguiRenderScope, "ImGui::Render");
         ImGui::Render();
+        imguiRenderScope.end();
+        if (profiler.isEnabled()) {
+            static const int drawListsCounter = profiler.registerCounter("draw lists");
+            static const int drawCmdsCounter = profiler.registerCounter("draw commands");
+            static const int verticesCounter = profiler.registerCounter("vertices");
+            const ImDrawData* drawData = ImGui::GetDrawData();
+            int drawCmds = 0;
+            for (int i = 0; drawData && i < drawData->CmdListsCount; ++i) drawCmds += drawData->CmdLists[i]->CmdBuffer.Size;
+            profiler.setCounter(drawListsCounter, drawData ? drawData->CmdListsCount : 0);
+            profiler.setCounter(drawCmdsCounter, drawCmds);
+            profiler.setCounter(verticesCounter, drawData ? drawData->TotalVtxCount : 0);
+        }
+        WATERCAN_PROFILE_SCOPE(glScope, "OpenGL draw");
         int display_w, display_h;
         glfwGetFramebufferSize(m_window, &display_w, &display_h);
         glViewport(0, 0, display_w, display_h);
         glClearColor(0.1f, 0.1f, 0.12f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        glScope.end();
         
+        // Includes waiting for vsync
+        WATERCAN_PROFILE_SCOPE(swapScope, "swap buffers");
         glfwSwapBuffers(m_window);
+        swapScope.end();
+        profiler.endFrame();
     }
 }
 
 void App::shutdown() {
     // Signal any background threads to stop or finish
-    // No background file dialog threads are used.
-
-    // Cleanup About image texture
-    if (m_aboutImageTexture) {
-        glDeleteTextures(1, &m_aboutImageTexture);
-        m_aboutImageTexture = 0;
-    }
+    // Let queued saves reach disk before the window (and glfwPostEmptyEvent) goes away
+    m_saver.waitIdle();
+    m_saver.setWakeCallback(nullptr);
+    m_dirCache.setWakeCallback(nullptr);
+    m_prefetcher.setWakeCallback(nullptr);
+    m_prefetcher.cancel();
+    processSaveResults();
+
+    // Cleanup the About image texture and music, if they were ever loaded
+    m_resources.releaseAll();
     // Cleanup icon textures
     if (m_iconFolderTexture) {
         glDeleteTextures(1, &m_iconFolderTexture);
@@ -1011,9 +1028,6 @@ void App::shutdown() {
         m_iconFileTexture = 0;
     }
     
-    // Ensure audio is stopped and resources are freed
-    m_musicPlayer.stop();
-    m_musicPlayer.unload();
 #ifdef HAVE_SDL2
     SDL_Quit();
 #endif
@@ -1029,70 +1043,146 @@ void App::shutdown() {
     }
 }
 
-void App::loadAboutImage(const std::string& imageName) {
+bool App::loadAboutImage(const std::string& imageName) {
     // If already loaded with the same image, nothing to do
-    if (m_aboutImageTexture && m_currentAboutImageName == imageName) return;
-    
+    if (m_aboutImageTexture && m_currentAboutImageName == imageName) return true;
+
     // If switching images, delete existing texture first
     if (m_aboutImageTexture) {
         glDeleteTextures(1, &m_aboutImageTexture);
         m_aboutImageTexture = 0;
     }
 
-#if defined(BUILD_SINGLE_EXE) || defined(BUILD_WINDOWS_SINGLE_EXE)
-    // For single-exe builds, use the generated embedded resource accessor instead of direct symbols
-    size_t embeddedLen = 0;
-    const unsigned char* embeddedData = embedded_resource_data(imageName.c_str(), &embeddedLen);
-    if (embeddedData && embeddedLen > 0) {
-        int width = 0, height = 0, channels = 0;
-        unsigned char* data = stbi_load_from_memory(const_cast<unsigned char*>(embeddedData), (int)embeddedLen, &width, &height, &channels, 4);
-        if (data) {
-            fprintf(stderr, "[loadAboutImage] loaded embedded image %dx%d\n", width, height);
-            glGenTextures(1, &m_aboutImageTexture);
-            glBindTexture(GL_TEXTURE_2D, m_aboutImageTexture);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-            m_aboutImageWidth = width;
-            m_aboutImageHeight = height;
-            stbi_image_free(data);
-            m_currentAboutImageName = imageName;
-            return;
-        } else {
-            fprintf(stderr, "[loadAboutImage] failed to decode embedded image\n");
-        }
+    // Embedded copy (single-exe builds) first, then res/ on disk for development builds
+    ResourceLocation loc = locateResource(imageName);
+    int width = 0, height = 0, channels = 0;
+    unsigned char* data = nullptr;
+    if (loc.embedded()) {
+        data = stbi_load_from_memory(loc.data, (int)loc.size, &width, &height, &channels, 4);
+    } else if (loc.found()) {
+        data = stbi_load(loc.path.c_str(), &width, &height, &channels, 4);
+    }
+    if (!data) {
+        fprintf(stderr, "[loadAboutImage] no about image available\n");
+        return false;
     }
-#endif
 
-    // Fall back to loading from disk (useful for development builds)
-    std::string candidates[] = {
-        "../res/" + imageName,
-        "res/" + imageName,
-        "./res/" + imageName
-    };
+    fprintf(stderr, "[loadAboutImage] loaded %s image %dx%d\n", loc.embedded() ? "embedded" : loc.path.c_str(), width, height);
+    glGenTextures(1, &m_aboutImageTexture);
+    glBindTexture(GL_TEXTURE_2D, m_aboutImageTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    m_aboutImageWidth = width;
+    m_aboutImageHeight = height;
+    stbi_image_free(data);
+    m_currentAboutImageName = imageName;
+    return true;
+}
 
-    for (const std::string& path : candidates) {
-        int width = 0, height = 0, channels = 0;
-        unsigned char* data = stbi_load(path.c_str(), &width, &height, &channels, 4);
-        fprintf(stderr, "[loadAboutImage] trying disk path '%s'... %s\n", path.c_str(), data ? "found" : "not found");
-        if (!data) continue;
+void App::registerResources() {
+    m_resources.add("about-image", [this]() { return loadAboutImage(); }, [this]() {
+        if (m_aboutImageTexture) {
+            glDeleteTextures(1, &m_aboutImageTexture);
+            m_aboutImageTexture = 0;
+        }
+        m_currentAboutImageName.clear();
+    });
+    m_resources.add("about-music", [this]() { return loadAboutMusic(); }, [this]() {
+        m_musicPlayer.stop();
+        m_musicPlayer.unload();
+    });
+    m_resources.add("lyrics", [this]() { return loadLyrics(); }, [this]() { m_lrcLines.clear(); });
+    // The font stays in the atlas once added (ImGui has no cheap way to drop one)
+    m_resources.add("lyrics-font", [this]() { return loadLyricsFont(); });
+}
 
-        fprintf(stderr, "[loadAboutImage] loaded disk image %dx%d from '%s'\n", width, height, path.c_str());
-        glGenTextures(1, &m_aboutImageTexture);
-        glBindTexture(GL_TEXTURE_2D, m_aboutImageTexture);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        m_aboutImageWidth = width;
-        m_aboutImageHeight = height;
-        stbi_image_free(data);
-        m_currentAboutImageName = imageName;
-        break;
+bool App::loadAboutMusic() {
+    ResourceLocation loc = locateResource("inneruniverse.ogg");
+    // Embedded tracks are streamed straight from the executable image
+    if (loc.embedded()) return m_musicPlayer.loadFromMemory(loc.data, loc.size);
+    return loc.found() && m_musicPlayer.load(loc.path);
+}
+
+bool App::loadLyrics() {
+    ResourceLocation loc = locateResource("inneruniverse.lrc");
+    std::string text;
+    if (loc.embedded()) {
+        text.assign(reinterpret_cast<const char*>(loc.data), loc.size);
+    } else if (loc.found()) {
+        std::ifstream lf(loc.path);
+        if (!lf.is_open()) return false;
+        std::stringstream ss;
+        ss << lf.rdbuf();
+        text = ss.str();
+    } else {
+        return false;
     }
 
-    if (!m_aboutImageTexture) {
-        fprintf(stderr, "[loadAboutImage] no about image available\n");
+    m_lrcLines.clear();
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+        // Parse [mm:ss.xx] text
+        if (line.size() < 10 || line[0] != '[') continue;
+        size_t cb = line.find(']');
+        if (cb == std::string::npos || cb < 9) continue;
+        std::string ts = line.substr(1, cb - 1);
+        std::string txt = (cb + 1 < line.size()) ? line.substr(cb + 1) : "";
+        // Trim leading space from text
+        if (!txt.empty() && txt[0] == ' ') txt = txt.substr(1);
+        // Parse mm:ss.xx
+        size_t colon = ts.find(':');
+        size_t dot = ts.find('.');
+        if (colon == std::string::npos) continue;
+        try {
+            int mins = std::stoi(ts.substr(0, colon));
+            int secs = std::stoi(ts.substr(colon + 1, (dot != std::string::npos ? dot : ts.size()) - colon - 1));
+            int hundredths = 0;
+            if (dot != std::string::npos) hundredths = std::stoi(ts.substr(dot + 1));
+            double t = mins * 60.0 + secs + hundredths / 100.0;
+            m_lrcLines.push_back({t, txt});
+        } catch (...) {}
+    }
+    return !m_lrcLines.empty();
+}
+
+bool App::loadLyricsFont() {
+    ImGuiIO& io = ImGui::GetIO();
+    const char* fontPaths[] = {
+        // Linux
+        "/usr/share/fonts/TTF/DejaVuSans.ttf",
+        "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf",
+        "/usr/share/fonts/dejavu-sans-fonts/DejaVuSans.ttf",
+        "/usr/share/fonts/truetype/liberation/LiberationSans-Regular.ttf",
+        // Windows
+        "C:\\Windows\\Fonts\\arial.ttf",
+        "C:\\Windows\\Fonts\\segoeui.ttf",
+        "C:\\Windows\\Fonts\\tahoma.ttf",
+        // macOS
+        "/System/Library/Fonts/Helvetica.ttc",
+        "/Library/Fonts/Arial.ttf",
+        "/System/Library/Fonts/Supplemental/Arial.ttf",
+    };
+    for (const char* fp : fontPaths) {
+        try {
+            if (std::filesystem::exists(fp)) {
+                ImFontConfig cfg;
+                cfg.MergeMode = false;
+                cfg.GlyphRanges = io.Fonts->GetGlyphRangesCyrillic();
+                m_cyrillicFont = io.Fonts->AddFontFromFileTTF(fp, 15.0f, &cfg);
+                if (m_cyrillicFont) break;
+            }
+        } catch (...) {}
     }
+    if (!m_cyrillicFont) return false;
+#if IMGUI_VERSION_NUM < 19200
+    // Older renderer backends upload the atlas once; rebuild and re-upload it with the new font
+    io.Fonts->Build();
+    ImGui_ImplOpenGL3_DestroyFontsTexture();
+    ImGui_ImplOpenGL3_CreateFontsTexture();
+#endif
+    return true;
 }
 
 void App::openUrl(const std::string& url) {
@@ -1157,6 +1247,37 @@ void App::createIconTextures() {
 }
 
 void App::renderUI() {
+    // Set again below while the About modal is open (it animates credits/oscilloscope)
+    m_aboutVisible = false;
+
+    WATERCAN_PROFILE_SCOPE(upkeepScope, "SpiritTreeManager upkeep");
+    processSaveResults();
+    tickAutosave();
+    pumpTreePrefetch();
+
+    // Opening a spirit builds its tree; trim trees nobody looks at once that happened. The
+    // selected tree is pinned while selected: the renderer keeps pointers into it.
+    if (m_selectedSpirit != m_evictCheckedSpirit) {
+        m_treeManager.pinTree(m_evictCheckedSpirit, false);
+        m_treeManager.pinTree(m_selectedSpirit, true);
+        m_evictCheckedSpirit = m_selectedSpirit;
+        m_treeManager.evictIdleTrees(m_selectedSpirit, TREE_MEMORY_CAP_BYTES);
+    }
+
+    // Edits recorded since the last frame form one undo step; a held mouse button keeps
+    // drags and drops together. Text fields own Ctrl+Z while they have the keyboard.
+    if (!ImGui::IsMouseDown(ImGuiMouseButton_Left)) m_treeManager.commitUndoStep();
+    upkeepScope.end();
+    const ImGuiIO& frameIo = ImGui::GetIO();
+    if (frameIo.KeyCtrl && !frameIo.WantTextInput) {
+        if (ImGui::IsKeyPressed(ImGuiKey_Z, false)) applyUndo(frameIo.KeyShift);
+        else if (ImGui::IsKeyPressed(ImGuiKey_Y, false)) applyUndo(true);
+    }
+    if (!frameIo.WantTextInput && ImGui::IsKeyPressed(ImGuiKey_F3, false)) {
+        m_showProfiler = !m_showProfiler;
+        FrameProfiler::instance().setEnabled(m_showProfiler);
+    }
+
     // Full window docking space
     ImGuiViewport* viewport = ImGui::GetMainViewport();
     ImGui::SetNextWindowPos(viewport->WorkPos);
@@ -1197,7 +1318,10 @@ void App::renderUI() {
     
     // Left panel - Spirit list
     ImGui::BeginChild("SpiritListPanel", ImVec2(m_sidebarWidth, contentSize.y), true);
-    renderSpiritList();
+    {
+        WATERCAN_PROFILE_SCOPE(spiritListScope, "spirit list");
+        renderSpiritList();
+    }
     ImGui::EndChild();
     
     // Splitter (left)
@@ -1247,7 +1371,10 @@ void App::renderUI() {
     
     // Top: Node details panel
     ImGui::BeginChild("NodeDetailsPanel", ImVec2(0, m_nodeDetailsHeight), true);
-    renderNodeDetails();
+    {
+        WATERCAN_PROFILE_SCOPE(detailsScope, "node details");
+        renderNodeDetails();
+    }
     ImGui::EndChild();
     
     // Horizontal splitter
@@ -1262,7 +1389,10 @@ void App::renderUI() {
     
     // Bottom: JSON editor panel - use 0 height to fill remaining space
     ImGui::BeginChild("JsonEditorPanel", ImVec2(0, 0), true);
-    renderNodeJsonEditor();
+    {
+        WATERCAN_PROFILE_SCOPE(jsonEditorScope, "renderNodeJsonEditor");
+        renderNodeJsonEditor();
+    }
     ImGui::EndChild();
     
     ImGui::EndChild();  // End RightPanelContainer
@@ -1275,34 +1405,10 @@ void App::renderUI() {
     // About dialog
     if (m_showAbout) {
         // Ensure the image is loaded before opening the popup
-        loadAboutImage();
+        m_resources.require("about-image");
 
-        // Attempt to load the embedded About music (res/inneruniverse.ogg) only if the secret has been unlocked
-        if (m_aboutMusicUnlocked && !m_aboutMusicLoaded) {
-            bool loadedFromDisk = false;
-            std::vector<std::string> candidates = {"../res/inneruniverse.ogg", "res/inneruniverse.ogg", "./res/inneruniverse.ogg"};
-            for (const auto &c : candidates) {
-                try {
-                    if (std::filesystem::exists(c)) {
-                        if (m_musicPlayer.load(c)) {
-                            m_aboutMusicLoaded = true;
-                            loadedFromDisk = true;
-                            break;
-                        }
-                    }
-                } catch (...) {}
-            }
-            // If not found on disk, try embedded resource
-            if (!loadedFromDisk && !m_aboutMusicLoaded) {
-                size_t elen = 0;
-                const unsigned char* em = embedded_resource_data("inneruniverse.ogg", &elen);
-                if (em && elen > 0) {
-                    if (m_musicPlayer.loadFromMemory(em, elen)) {
-                        m_aboutMusicLoaded = true;
-                    }
-                }
-            }
-        }
+        // The About music (res/inneruniverse.ogg) is only loaded once the secret has been unlocked
+        if (m_aboutMusicUnlocked) m_resources.require("about-music");
 
         ImGui::OpenPopup("About Watercan");
         m_showAbout = false;
@@ -1373,14 +1479,10 @@ void App::renderUI() {
         // Collect all types found in the currently loaded file
         std::vector<std::string> types;
         for (const auto& s : m_treeManager.getSpiritNames()) {
-            const SpiritTree* t = m_treeManager.getTree(s);
-            if (!t) continue;
-            for (const auto& n : t->nodes) if (!n.type.empty()) types.push_back(n.type);
+            for (const auto& n : m_treeManager.getSpiritNodes(s)) if (!n.type.empty()) types.push_back(n.type);
         }
         for (const auto& s : m_treeManager.getGuideNames()) {
-            const SpiritTree* t = m_treeManager.getTree(s);
-            if (!t) continue;
-            for (const auto& n : t->nodes) if (!n.type.empty()) types.push_back(n.type);
+            for (const auto& n : m_treeManager.getSpiritNodes(s)) if (!n.type.empty()) types.push_back(n.type);
         }
         std::sort(types.begin(), types.end());
         types.erase(std::unique(types.begin(), types.end()), types.end());
@@ -1523,6 +1625,8 @@ void App::renderUI() {
                     }
                 }
 
+                preview.reindex();
+
                 TreeRenderer previewRenderer;
                 previewRenderer.resetView();
                 float zoom = 0.75f;
@@ -1632,6 +1736,7 @@ void App::renderUI() {
 
     ImGui::SetNextWindowSize(ImVec2(winW, winH), ImGuiCond_FirstUseEver);
     if (ImGui::BeginPopupModal("About Watercan", nullptr, ImGuiWindowFlags_NoResize)) {
+        m_aboutVisible = true;
         ImGui::Text("Watercan %s - Vibecoded by Dusk//Night with Copilot wheelchair assistance", WATERCAN_VERSION);
         ImGui::Separator();
         ImGui::Text("JSON-based dependency tree viewer and editor specialized for Sky: Children of the Light");
@@ -1709,58 +1814,9 @@ void App::renderUI() {
                         secretProgress = std::chrono::duration<double>(now - m_ctrlAltSHoldStart).count() / 5.0;
                         if (secretProgress >= 1.0 && !m_aboutMusicUnlocked) {
                             m_aboutMusicUnlocked = true;
-                            // attempt to load music immediately
-                            std::vector<std::string> candidates = {"../res/inneruniverse.ogg", "res/inneruniverse.ogg", "./res/inneruniverse.ogg"};
-                            for (const auto &c : candidates) {
-                                try {
-                                    if (std::filesystem::exists(c)) {
-                                        if (m_musicPlayer.load(c)) { m_aboutMusicLoaded = true; break; }
-                                    }
-                                } catch (...) {}
-                            }
-                            // If not found on disk, try embedded music
-                            if (!m_aboutMusicLoaded) {
-                                size_t elen = 0;
-                                const unsigned char* em = embedded_resource_data("inneruniverse.ogg", &elen);
-                                if (em && elen > 0) {
-                                    if (m_musicPlayer.loadFromMemory(em, elen)) m_aboutMusicLoaded = true;
-                                }
-                            }
-                            // Load LRC lyrics file alongside the music
-                            if (!m_lrcLoaded) {
-                                std::vector<std::string> lrcCandidates = {"../res/inneruniverse.lrc", "res/inneruniverse.lrc", "./res/inneruniverse.lrc"};
-                                for (const auto &lp : lrcCandidates) {
-                                    try {
-                                        if (!std::filesystem::exists(lp)) continue;
-                                        std::ifstream lf(lp);
-                                        if (!lf.is_open()) continue;
-                                        m_lrcLines.clear();
-                                        std::string line;
-                                        while (std::getline(lf, line)) {
-                                            // Parse [mm:ss.xx] text
-                                            if (line.size() < 10 || line[0] != '[') continue;
-                                            size_t cb = line.find(']');
-                                            if (cb == std::string::npos || cb < 9) continue;
-                                            std::string ts = line.substr(1, cb - 1);
-                                            std::string txt = (cb + 1 < line.size()) ? line.substr(cb + 1) : "";
-                                            // Trim leading space from text
-                                            if (!txt.empty() && txt[0] == ' ') txt = txt.substr(1);
-                                            // Parse mm:ss.xx
-                                            size_t colon = ts.find(':');
-                                            size_t dot = ts.find('.');
-                                            if (colon == std::string::npos) continue;
-                                            int mins = std::stoi(ts.substr(0, colon));
-                                            int secs = std::stoi(ts.substr(colon + 1, (dot != std::string::npos ? dot : ts.size()) - colon - 1));
-                                            int hundredths = 0;
-                                            if (dot != std::string::npos) hundredths = std::stoi(ts.substr(dot + 1));
-                                            double t = mins * 60.0 + secs + hundredths / 100.0;
-                                            m_lrcLines.push_back({t, txt});
-                                        }
-                                        m_lrcLoaded = true;
-                                        break;
-                                    } catch (...) {}
-                                }
-                            }
+                            // attempt to load music immediately, with the lyrics and their font
+                            m_resources.require("about-music");
+                            if (m_resources.require("lyrics")) m_wantLyricsFont = true;
                         }
                     }
                 } else {
@@ -1877,18 +1933,13 @@ void App::renderUI() {
                 ImVec2 scMin = ImGui::GetItemRectMin();
                 ImVec2 scMax = ImGui::GetItemRectMax();
                 dl->AddRectFilled(scMin, scMax, ImColor(0.02f, 0.02f, 0.02f, 1.0f));
-                const auto& samps = m_musicPlayer.samples();
+                // The player only keeps a short history of the stream, ending at the playhead
+                m_musicPlayer.recentSamples((size_t)m_scopeWindowSamples, m_scopeSamples);
+                const auto& samps = m_scopeSamples;
                 if (!samps.empty()) {
-                    size_t sr = (size_t)m_musicPlayer.sampleRate();
                     size_t n = samps.size();
-                    size_t center = (size_t)std::lround(pos * sr);
-                    if (center >= n) center = n ? (n - 1) : 0;
-                    size_t window = std::min<size_t>((size_t)m_scopeWindowSamples, n);
+                    size_t window = n;
                     size_t start = 0;
-                    if (center >= window/2) {
-                        start = center - window/2;
-                        if (start + window > n) start = (n > window) ? (n - window) : 0;
-                    }
 
                     float w = scMax.x - scMin.x;
                     float h = scMax.y - scMin.y;
@@ -2086,13 +2137,10 @@ void App::renderUI() {
                 ImGui::Dummy(ImVec2(availW, 60));
                 ImVec2 scMin = ImGui::GetItemRectMin(); ImVec2 scMax = ImGui::GetItemRectMax();
                 dl->AddRectFilled(scMin, scMax, ImColor(0.02f, 0.02f, 0.02f, 1.0f));
-                const auto& samps = m_musicPlayer.samples();
+                m_musicPlayer.recentSamples((size_t)m_scopeWindowSamples, m_scopeSamples);
+                const auto& samps = m_scopeSamples;
                 if (!samps.empty()) {
-                    size_t sr = (size_t)m_musicPlayer.sampleRate(); size_t n = samps.size();
-                    size_t center = (size_t)std::lround(pos * sr); if (center >= n) center = n ? (n-1) : 0;
-                    size_t window = std::min<size_t>((size_t)m_scopeWindowSamples, n);
-                    size_t start = (center >= window/2) ? (center - window/2) : 0;
-                    if (start + window > n) start = (n > window) ? (n - window) : 0;
+                    size_t n = samps.size(); size_t window = n; size_t start = 0;
                     float w = scMax.x - scMin.x; float h = scMax.y - scMin.y; float midY = scMin.y + h*0.5f;
                     int pixelCount = (int)std::clamp((int)std::round(w), 16, 512); if (pixelCount > (int)window) pixelCount = (int)window;
                     std::vector<ImVec2> pts; pts.reserve(pixelCount);
@@ -2113,25 +2161,19 @@ void App::renderUI() {
         
 
         if (ImGui::Button("Close", ImVec2(120, 0))) {
-            m_musicPlayer.stop();
-            m_musicPlayer.unload();
-            m_aboutMusicLoaded = false;
+            m_resources.release("about-music");
             ImGui::CloseCurrentPopup();
         }
         ImGui::SameLine();
         if (ImGui::Button("License", ImVec2(120, 0))) {
-            m_musicPlayer.stop();
-            m_musicPlayer.unload();
-            m_aboutMusicLoaded = false;
+            m_resources.release("about-music");
             m_showLicense = true;
             ImGui::CloseCurrentPopup();
         }
         ImGui::EndPopup();
     } else {
         // Popup was closed (Escape key or clicked outside)
-        m_musicPlayer.stop();
-        m_musicPlayer.unload();
-        m_aboutMusicLoaded = false;
+        m_resources.release("about-music");
     }
     
     // License window
@@ -2168,9 +2210,16 @@ void App::renderMenuBar() {
             if (ImGui::MenuItem("Open...", "Ctrl+O")) {
                 openFileDialog();
             }
+            if (ImGui::MenuItem("Add to workspace...", nullptr, false, m_treeManager.isLoaded())) {
+                openFileDialog(true);
+            }
             if (ImGui::MenuItem("Reload", "Ctrl+R", false, !m_currentFilePath.empty())) {
                 loadFile(m_currentFilePath);
             }
+            if (ImGui::MenuItem("Close file", nullptr, false, m_treeManager.isLoaded())) {
+                if (workspaceFileUnsaved(m_activeFile)) m_showCloseFileConfirm = true;
+                else closeActiveFile();
+            }
             if (ImGui::MenuItem("Save As...", "Ctrl+Shift+S", false, m_treeManager.isLoaded())) {
                 saveFileDialog();
             }
@@ -2181,18 +2230,80 @@ void App::renderMenuBar() {
                 saveFileDialog();
             }
             ImGui::Separator();
+            if (ImGui::BeginMenu("Autosave")) {
+                static const int intervals[] = { 0, 60, 120, 300, 600 };
+                static const char* labels[] = { "Off", "Every minute", "Every 2 minutes", "Every 5 minutes", "Every 10 minutes" };
+                for (int i = 0; i < IM_ARRAYSIZE(intervals); ++i) {
+                    if (ImGui::MenuItem(labels[i], nullptr, m_autosaveIntervalSeconds == intervals[i])) {
+                        m_autosaveIntervalSeconds = intervals[i];
+                        saveSettingsToDisk();
+                    }
+                }
+                ImGui::Separator();
+                std::string recovery = autosavePath();
+                bool hasRecovery = false;
+                try { hasRecovery = !recovery.empty() && std::filesystem::exists(recovery); } catch (...) {}
+                if (ImGui::MenuItem("Open last autosave", nullptr, false, hasRecovery)) {
+                    loadFile(recovery);
+                }
+                ImGui::EndMenu();
+            }
+            if (ImGui::MenuItem("Cache opened files", nullptr, &m_binaryCacheEnabled)) {
+                saveSettingsToDisk();
+            }
+            if (ImGui::IsItemHovered()) {
+                ImGui::SetTooltip("Keep a binary copy of each opened file in the config directory so reopening it skips JSON parsing and layout");
+            }
+            ImGui::Separator();
             if (ImGui::MenuItem("Exit", "Alt+F4")) {
                 m_running = false;
             }
             ImGui::EndMenu();
         }
         
+        if (ImGui::BeginMenu("Edit")) {
+            if (ImGui::MenuItem("Undo", "Ctrl+Z", false, m_treeManager.canUndo())) {
+                applyUndo(false);
+            }
+            if (ImGui::MenuItem("Redo", "Ctrl+Y", false, m_treeManager.canRedo())) {
+                applyUndo(true);
+            }
+            ImGui::Separator();
+            if (ImGui::BeginMenu("Undo memory")) {
+                static const int budgets[] = { 8, 32, 128, 512 };
+                static const char* labels[] = { "8 MB", "32 MB", "128 MB", "512 MB" };
+                for (int i = 0; i < IM_ARRAYSIZE(budgets); ++i) {
+                    if (ImGui::MenuItem(labels[i], nullptr, m_undoBudgetMB == budgets[i])) {
+                        m_undoBudgetMB = budgets[i];
+                        m_treeManager.setUndoBudget((size_t)m_undoBudgetMB << 20);
+                        saveSettingsToDisk();
+                    }
+                }
+                ImGui::Separator();
+                ImGui::TextDisabled("In use: %.1f MB", (double)m_treeManager.getUndoBytes() / (1024.0 * 1024.0));
+                ImGui::EndMenu();
+            }
+            ImGui::EndMenu();
+        }
+
         if (ImGui::BeginMenu("Tools")) {
             if (ImGui::MenuItem("ID Finder")) {
                 m_showFNVDialog = true;
                 // initialize input buffer
                 m_fnvNameBuf[0] = '\0';
             }
+            bool hasMismatches = !m_selectedSpirit.empty() &&
+                                 !m_treeManager.getAnalysis(m_selectedSpirit).mismatchedIds.empty();
+            if (ImGui::MenuItem("Fix all names by ID", nullptr, false, hasMismatches)) {
+                fixAllMismatchedNames();
+            }
+            if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled)) {
+                ImGui::SetTooltip("Rename every node of this spirit whose id does not match its name, using the %zu names\n"
+                                  "known from opened files and name lists (config dir: name_lists/*.txt)", m_nameIndex.size());
+            }
+            if (ImGui::MenuItem("Frame profiler", "F3", &m_showProfiler)) {
+                FrameProfiler::instance().setEnabled(m_showProfiler);
+            }
             if (ImGui::MenuItem("Color codes")) {
                 // open the color codes modal
                 m_showColorCodes = true;
@@ -2233,6 +2344,45 @@ void App::renderMenuBar() {
 }
 
 void App::renderSpiritList() {
+    // Open files, when there is more than one ('*' = unsaved edits)
+    if (m_workspace.size() > 1) {
+        auto fileLabel = [&](size_t i) {
+            std::string label = std::filesystem::path(m_workspace[i].path).filename().string();
+            if (workspaceFileUnsaved(i)) label += " *";
+            return label + "##file" + std::to_string(i);
+        };
+        ImGui::PushItemWidth(-1);
+        if (ImGui::BeginCombo("##WorkspaceFile", fileLabel(m_activeFile).c_str())) {
+            for (size_t i = 0; i < m_workspace.size(); ++i) {
+                if (ImGui::Selectable(fileLabel(i).c_str(), i == m_activeFile) && i != m_activeFile) {
+                    switchWorkspaceFile(i);
+                }
+                if (ImGui::IsItemHovered()) ImGui::SetTooltip("%s", m_workspace[i].path.c_str());
+            }
+            ImGui::EndCombo();
+        }
+        ImGui::PopItemWidth();
+    }
+
+    if (m_showCloseFileConfirm) {
+        ImGui::OpenPopup("CloseFilePopup");
+        m_showCloseFileConfirm = false;
+    }
+    if (ImGui::BeginPopupModal("CloseFilePopup", nullptr, ImGuiWindowFlags_AlwaysAutoResize)) {
+        ImGui::Text("'%s' has unsaved edits. Close it anyway?",
+                    std::filesystem::path(m_currentFilePath).filename().string().c_str());
+        ImGui::Separator();
+        if (ImGui::Button("Close without saving")) {
+            closeActiveFile();
+            ImGui::CloseCurrentPopup();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Cancel")) {
+            ImGui::CloseCurrentPopup();
+        }
+        ImGui::EndPopup();
+    }
+
     // Tabs for Spirits and Guides
     if (ImGui::BeginTabBar("SpiritListTabs")) {
         if (ImGui::BeginTabItem("Spirits")) {
@@ -2398,10 +2548,52 @@ void App::renderSpiritList() {
         }
 
     }
+
+    // Matching nodes of every spirit (name, type or id)
+    if (!filterLower.empty()) {
+        m_searchIndex.sync(m_treeManager);
+        if (m_searchQuery != filterLower || m_searchVersion != m_searchIndex.version()) {
+            m_searchTotal = m_searchIndex.query(filterLower, SEARCH_MAX_HITS, m_searchHits);
+            m_searchQuery = filterLower;
+            m_searchVersion = m_searchIndex.version();
+        }
+        ImGui::Spacing();
+        ImGui::Separator();
+        if (m_searchTotal > m_searchHits.size()) {
+            ImGui::TextColored(ImVec4(0.6f, 0.6f, 0.6f, 1.0f), "Nodes (%zu of %zu)", m_searchHits.size(), m_searchTotal);
+        } else {
+            ImGui::TextColored(ImVec4(0.6f, 0.6f, 0.6f, 1.0f), "Nodes (%zu)", m_searchTotal);
+        }
+        int clicked = -1;
+        for (int i = 0; i < (int)m_searchHits.size(); ++i) {
+            const SearchIndex::Hit& hit = m_searchHits[i];
+            char label[320];
+            snprintf(label, sizeof(label), "%s  [%s]##hit%d",
+                     hit.name.empty() ? "(unnamed)" : hit.name.c_str(), hit.spirit.c_str(), i);
+            bool isSelected = (m_selectedSpirit == hit.spirit.str() && m_treeRenderer.getSelectedNodeId() == hit.nodeId);
+            if (ImGui::Selectable(label, isSelected)) clicked = i;
+            if (ImGui::IsItemHovered()) {
+                ImGui::SetTooltip("typ: %s\nid: %llu (0x%llx)", hit.type.empty() ? "-" : hit.type.c_str(),
+                                  (unsigned long long)hit.nodeId, (unsigned long long)hit.nodeId);
+            }
+        }
+        if (clicked >= 0) jumpToNode(m_searchHits[clicked].spirit.str(), m_searchHits[clicked].nodeId);
+    }
     
     ImGui::EndChild();
 }
 
+void App::jumpToNode(const std::string& spiritName, uint64_t nodeId) {
+    if (m_selectedSpirit != spiritName) {
+        m_selectedSpirit = spiritName;
+        m_treeRenderer.resetView();
+    }
+    const SpiritTree* tree = m_treeManager.getTree(spiritName);
+    if (!tree) return;
+    m_treeRenderer.setSelectedNodeId(nodeId);
+    m_treeRenderer.centerOnNode(tree, nodeId);
+}
+
 void App::renderTreeViewport() {
     // Header with spirit name on left, controls on right
     float windowWidth = ImGui::GetWindowWidth();
@@ -2540,7 +2732,6 @@ void App::renderTreeViewport() {
                     for (uint64_t cid : oldChildren) {
                         SpiritNode* ch = m_treeManager.getNode(m_selectedSpirit, cid);
                         if (ch) {
-                            ch->dep = 0;
                             m_treeRenderer.setFreeFloating(cid);
                         }
                     }
@@ -2554,8 +2745,7 @@ void App::renderTreeViewport() {
                     m_treeRenderer.removeNodeFromSelection(m_deleteNodeId);
                 }
 
-                // Rebuild relationships only (no layout recomputation)
-                m_treeManager.rebuildTree(m_selectedSpirit);
+                // deleteNode already orphaned the children and relinked the tree (no layout recomputation)
 
                 // Smoothly update positions for any surviving siblings by computing layout changes
                 if (oldParent != 0) {
@@ -2613,8 +2803,7 @@ void App::renderTreeViewport() {
                 m_reorderMode = false;
                 m_reorderNodeId = TreeRenderer::NO_NODE_ID;
                 m_reorderSelectedLeafId = TreeRenderer::NO_NODE_ID;
-                m_treeRenderer.clearHighlightedNodes();
-                m_treeRenderer.clearSelectableNodes();
+                clearReorderTargets();
             }
             ImGui::PopStyleColor(4);
 
@@ -2761,6 +2950,7 @@ void App::renderTreeViewport() {
                             // Clear any offending markers since reload restores original structure
                             for (auto &kv : m_parentOffendingChild) m_treeRenderer.clearOffendingNode(kv.second);
                             m_parentOffendingChild.clear();
+                            m_redStateDirty = true;
                             m_offendingParents.clear();
                             // Clear any top-of-viewer message when user confirmed Restore
                             clearTreeMessage();
@@ -2834,18 +3024,7 @@ void App::renderTreeViewport() {
 
     // Reorder mode: highlight all direct children of the reorder node and draw yellow border
     if (m_reorderMode && !m_selectedSpirit.empty()) {
-        std::unordered_set<uint64_t> leaves;
-        if (tree) {
-            std::unordered_map<uint64_t, const SpiritNode*> idToNode;
-            for (const auto& n : tree->nodes) idToNode[n.id] = &n;
-            auto pit = idToNode.find(m_reorderNodeId);
-            if (pit != idToNode.end()) {
-                for (uint64_t cid : pit->second->children)
-                    leaves.insert(cid);
-            }
-        }
-        m_treeRenderer.setHighlightedNodes(leaves);
-        m_treeRenderer.setSelectableNodes(leaves);
+        syncReorderTargets(tree);
 
         // Renderer will draw the canvas-level yellow border; avoid drawing a full-window border here.
     }
@@ -2858,11 +3037,25 @@ void App::renderTreeViewport() {
     ImVec2 dragFinalOffset = ImVec2(0.0f, 0.0f);
     uint64_t draggingTreeId = TreeRenderer::NO_NODE_ID;
     ImVec2 dragTreeDelta = ImVec2(0.0f, 0.0f);
+    // Cached node labels are re-checked whenever the tree has been edited
+    m_treeRenderer.setEditGeneration(m_treeManager.getEditGeneration());
+    m_treeRenderer.setLayoutGeneration(m_treeManager.getLayoutGeneration());
     // Pass the user's type colors to the main renderer so changes apply immediately
+    WATERCAN_PROFILE_SCOPE(treeRenderScope, "TreeRenderer::render");
     bool clicked = m_treeRenderer.render(tree, m_createMode, &clickPos, 
                                           m_linkMode, &linkTargetId, 
                                           &rightClickedNodeId, m_deleteConfirmMode, false, &m_typeColors,
                                           &dragReleasedId, &dragFinalOffset, &draggingTreeId, &dragTreeDelta, m_reorderMode);
+    treeRenderScope.end();
+    if (FrameProfiler::instance().isEnabled()) {
+        FrameProfiler& profiler = FrameProfiler::instance();
+        static const int treeNodesCounter = profiler.registerCounter("tree nodes");
+        static const int drawnNodesCounter = profiler.registerCounter("nodes drawn");
+        static const int drawnLinksCounter = profiler.registerCounter("connections drawn");
+        profiler.setCounter(treeNodesCounter, tree ? (int64_t)tree->nodes.size() : 0);
+        profiler.setCounter(drawnNodesCounter, (int64_t)m_treeRenderer.lastDrawStats().nodes);
+        profiler.setCounter(drawnLinksCounter, (int64_t)m_treeRenderer.lastDrawStats().connections);
+    }
 
     // If the user left-clicked on the canvas (clickPos set) in normal mode and the click
     // was on empty space (no node under the cursor), then deselect nodes.
@@ -2885,10 +3078,9 @@ void App::renderTreeViewport() {
             if (childNode) {
                 // Record snap mapping BEFORE we change the tree so we capture original index
                 m_treeManager.recordSnap(m_selectedSpirit, s.childId, s.parentId);
-                childNode->dep = 0;
                 m_treeRenderer.setFreeFloating(s.childId);
-                // Rebuild relationships so the parent no longer lists this child
-                m_treeManager.rebuildTree(m_selectedSpirit);
+                // Detach so the parent no longer lists this child
+                m_treeManager.relinkNode(m_selectedSpirit, s.childId, 0);
 
                 // Recompute layout only for the subtree rooted at the old parent (where the child was detached)
                 std::unordered_map<uint64_t, std::pair<float,float>> shifts;
@@ -2918,33 +3110,31 @@ void App::renderTreeViewport() {
 
     // Persistent duplicate-name detection: ensure offending nodes pulse until fixed and message stays
     if (!m_selectedSpirit.empty()) {
-        auto dupIds = m_treeManager.getDuplicateNodeIds(m_selectedSpirit);
+        const std::string dupMsg = "Node with same name found.";
+        const auto& analysis = m_treeManager.getAnalysis(m_selectedSpirit);
+        const auto& dupIds = analysis.duplicateIds;
         if (!dupIds.empty()) {
             // Set persistent message (error)
-            setTreeMessage("Node with same name found.", TreeMessageType::Error, std::chrono::seconds(0));
-            // Mark nodes as red-pulsing
-            for (uint64_t id : dupIds) m_treeRenderer.setNodeRedState(id, true);
-            // Also ensure any nodes no longer duplicates are cleared
+            if (m_treeMessage != dupMsg) setTreeMessage(dupMsg, TreeMessageType::Error, std::chrono::seconds(0));
+        } else if (m_treeMessage == dupMsg) {
+            // No duplicates: clear message if it matches our duplicate message
+            clearTreeMessageIfMatches(dupMsg);
+        }
+
+        // Re-apply red pulses only when the duplicate set or the offending children changed
+        if (m_redStateDirty || analysis.version != m_redStateVersion || m_redStateSpirit != m_selectedSpirit) {
+            m_redStateDirty = false;
+            m_redStateVersion = analysis.version;
+            m_redStateSpirit = m_selectedSpirit;
+            std::unordered_set<uint64_t> offendingChildren;
+            for (const auto &kv : m_parentOffendingChild) offendingChildren.insert(kv.second);
             const SpiritTree* tptr = m_treeManager.getTree(m_selectedSpirit);
             if (tptr) {
                 for (const auto& n : tptr->nodes) {
-                    if (dupIds.count(n.id) == 0) {
+                    bool red = dupIds.count(n.id) > 0;
                     // Do not clear the red pulse if this node is currently flagged as offending
-                    bool isOffendingChild = false;
-                    for (const auto &kv : m_parentOffendingChild) { if (kv.second == n.id) { isOffendingChild = true; break; } }
-                    if (!isOffendingChild) m_treeRenderer.setNodeRedState(n.id, false);
-                }
-                }
-            }
-        } else {
-            // No duplicates: clear message if it matches our duplicate message and clear pulses
-            if (m_treeMessage == "Node with same name found.") clearTreeMessageIfMatches("Node with same name found.");
-            const SpiritTree* tptr = m_treeManager.getTree(m_selectedSpirit);
-            if (tptr) {
-                for (const auto& n : tptr->nodes) {
-                    bool isOffendingChild = false;
-                    for (const auto &kv : m_parentOffendingChild) { if (kv.second == n.id) { isOffendingChild = true; break; } }
-                    if (!isOffendingChild) m_treeRenderer.setNodeRedState(n.id, false);
+                    if (red) m_treeRenderer.setNodeRedState(n.id, true);
+                    else if (offendingChildren.count(n.id) == 0) m_treeRenderer.setNodeRedState(n.id, false);
                 }
             }
         }
@@ -2959,11 +3149,8 @@ void App::renderTreeViewport() {
             // Recompute the reorder node's direct children
             std::unordered_set<uint64_t> leaves;
             if (tree) {
-                std::unordered_map<uint64_t, const SpiritNode*> idToNode;
-                for (const auto& n : tree->nodes) idToNode[n.id] = &n;
-                auto pit = idToNode.find(m_reorderNodeId);
-                if (pit != idToNode.end()) {
-                    for (uint64_t cid : pit->second->children)
+                if (const SpiritNode* reorderNode = tree->findNode(m_reorderNodeId)) {
+                    for (uint64_t cid : reorderNode->children)
                         leaves.insert(cid);
                 }
             }
@@ -2982,11 +3169,12 @@ void App::renderTreeViewport() {
                     // inside the parent so the selected leaf takes the clicked node's slot.
                     SpiritNode* parent = m_treeManager.getNode(m_selectedSpirit, m_reorderNodeId);
                     if (parent) {
-                        auto &children = parent->children;
+                        std::vector<uint64_t> children = parent->children;
                         auto itA = std::find(children.begin(), children.end(), m_reorderSelectedLeafId);
                         auto itB = std::find(children.begin(), children.end(), hit);
                         if (itA != children.end() && itB != children.end()) {
                             std::iter_swap(itA, itB);
+                            m_treeManager.setChildOrder(m_selectedSpirit, m_reorderNodeId, children);
 
                             // Reposition direct children and rigidly shift their subtrees
                             repositionChildrenOfNode(m_reorderNodeId);
@@ -3000,8 +3188,7 @@ void App::renderTreeViewport() {
                     m_reorderMode = false;
                     m_reorderNodeId = TreeRenderer::NO_NODE_ID;
                     m_reorderSelectedLeafId = TreeRenderer::NO_NODE_ID;
-                    m_treeRenderer.clearHighlightedNodes();
-                    m_treeRenderer.clearSelectableNodes();
+                    clearReorderTargets();
                 }
             } else {
                 setTreeMessage("Select a highlighted leaf node to reorder", TreeMessageType::Warning, std::chrono::seconds(3));
@@ -3057,9 +3244,6 @@ void App::renderTreeViewport() {
             const SpiritTree* treePtr = m_treeManager.getTree(m_selectedSpirit);
             if (treePtr) {
                 // BFS *downward only* from dragged node to compute graph distances within the subtree
-                std::unordered_map<uint64_t, const SpiritNode*> idToNode;
-                for (const auto &n : treePtr->nodes) idToNode[n.id] = &n;
-
                 std::unordered_map<uint64_t, int> dist;
                 std::deque<uint64_t> q;
                 dist[draggingTreeId] = 0;
@@ -3067,10 +3251,10 @@ void App::renderTreeViewport() {
                 int maxDepth = 0;
                 while (!q.empty()) {
                     uint64_t cur = q.front(); q.pop_front();
-                    auto it = idToNode.find(cur);
-                    if (it == idToNode.end()) continue;
+                    const SpiritNode* curNode = treePtr->findNode(cur);
+                    if (!curNode) continue;
                     // Only traverse children (descendants), not parent
-                    for (uint64_t c : it->second->children) {
+                    for (uint64_t c : curNode->children) {
                         if (dist.find(c) == dist.end()) {
                             dist[c] = dist[cur] + 1;
                             maxDepth = std::max(maxDepth, dist[c]);
@@ -3128,6 +3312,18 @@ void App::renderTreeViewport() {
             }
         }
         
+        bool hasSource = !m_selectedSpirit.empty() &&
+                         m_treeManager.hasOriginalNodeSource(m_selectedSpirit, m_contextMenuNodeId);
+        if (ImGui::MenuItem("Copy Original JSON", nullptr, false, hasSource)) {
+            // The item as written in the opened file, not as edited since
+            std::string source;
+            if (m_treeManager.getOriginalNodeSource(m_selectedSpirit, m_contextMenuNodeId, &source)) {
+                ImGui::SetClipboardText(source.c_str());
+            } else {
+                setTreeMessage("The file changed on disk since it was opened.", TreeMessageType::Warning);
+            }
+        }
+
         if (ImGui::MenuItem("Paste Node", nullptr, false, m_hasClipboardNode)) {
             // Parse and create a new node from clipboard
             if (!m_selectedSpirit.empty() && m_hasClipboardNode) {
@@ -3233,12 +3429,10 @@ void App::renderTreeViewport() {
                 // Record snap mapping BEFORE changing the tree so we capture the original index
                 m_treeManager.recordSnap(m_selectedSpirit, m_contextMenuNodeId, oldParent);
 
-                // Remove parent dependency and mark as free-floating (like a snap)
-                node->dep = 0;
+                // Remove parent dependency and mark as free-floating (like a snap);
+                // the parent no longer lists this node as a child
                 m_treeRenderer.setFreeFloating(m_contextMenuNodeId);
-
-                // Rebuild relationships so the parent no longer lists this node as a child
-                m_treeManager.rebuildTree(m_selectedSpirit);
+                m_treeManager.relinkNode(m_selectedSpirit, m_contextMenuNodeId, 0);
 
                 // Recompute layout just for the subtree rooted at the old parent (less disruptive than full reshape)
                 std::unordered_map<uint64_t, std::pair<float,float>> shifts;
@@ -3286,20 +3480,8 @@ void App::renderTreeViewport() {
             // Ensure other modes are off
             m_linkMode = false; m_createMode = false; m_deleteConfirmMode = false;
 
-            // Compute the reorder node's direct children only
-            std::unordered_set<uint64_t> leaves;
-            const SpiritTree* tree = m_treeManager.getTree(m_selectedSpirit);
-            if (tree) {
-                std::unordered_map<uint64_t, const SpiritNode*> idToNode;
-                for (const auto& n : tree->nodes) idToNode[n.id] = &n;
-                auto pit = idToNode.find(m_reorderNodeId);
-                if (pit != idToNode.end()) {
-                    for (uint64_t cid : pit->second->children)
-                        leaves.insert(cid);
-                }
-            }
-            m_treeRenderer.setHighlightedNodes(leaves);
-            m_treeRenderer.setSelectableNodes(leaves);
+            // Highlight the reorder node's direct children only
+            syncReorderTargets(m_treeManager.getTree(m_selectedSpirit));
         }
         
         ImGui::Separator();
@@ -3365,36 +3547,40 @@ bool App::performLinkToTarget(uint64_t targetId) {
         return false;
     }
 
-    // Perform linking: set dependency, clear flags
-    sourceNode->dep = targetId;
-    if (sourceNode->isNew && !targetNode->isNew) sourceNode->isNew = false;
+    // Perform linking: clear flags, then set the dependency (patches parent->children)
+    if (sourceNode->isNew && !targetNode->isNew) {
+        const NodeFields before = SpiritTreeManager::fieldsOf(*sourceNode);
+        sourceNode->isNew = false;
+        m_treeManager.recordNodeFields(m_selectedSpirit, m_linkSourceNodeId, before);
+    }
 
     // Clear free-floating and any recorded snap info since the user manually reattached it
     m_treeRenderer.clearFreeFloating(m_linkSourceNodeId);
     m_treeManager.clearSnap(m_selectedSpirit, m_linkSourceNodeId);
 
-    // Rebuild tree relationships so parent->children reflects current deps
-    m_treeManager.rebuildTree(m_selectedSpirit);
+    m_treeManager.relinkNode(m_selectedSpirit, m_linkSourceNodeId, targetId);
 
     // Smart insertion: compute desired child index based on source node position so
     // linking to an occupied slot will shift existing children as appropriate.
     SpiritNode* parent = m_treeManager.getNode(m_selectedSpirit, targetId);
     if (parent) {
         // Remove any existing instance of the source id from parent's children
-        parent->children.erase(std::remove(parent->children.begin(), parent->children.end(), m_linkSourceNodeId), parent->children.end());
+        std::vector<uint64_t> children = parent->children;
+        children.erase(std::remove(children.begin(), children.end(), m_linkSourceNodeId), children.end());
 
         // Determine insertion index using deterministic cardinal rules:
         //  - 0 children: insert at 0
         //  - 1 child (currently N): push the existing to NW and insert new at N (index 1)
         //  - 2+ children: append as NE
-        size_t childCountBefore = parent->children.size();
+        size_t childCountBefore = children.size();
         size_t insertIdx = childCountBefore; // default append
         if (childCountBefore == 0) insertIdx = 0;
         else if (childCountBefore == 1) insertIdx = 1; // push existing to NW, new becomes N
         else insertIdx = childCountBefore; // append as NE (or after existing children)
 
-        if (insertIdx > parent->children.size()) insertIdx = parent->children.size();
-        parent->children.insert(parent->children.begin() + insertIdx, m_linkSourceNodeId);
+        if (insertIdx > children.size()) insertIdx = children.size();
+        children.insert(children.begin() + insertIdx, m_linkSourceNodeId);
+        m_treeManager.setChildOrder(m_selectedSpirit, targetId, children);
     }
 
     // Reposition the direct children of the target to their cardinal slots.
@@ -3421,6 +3607,38 @@ bool App::performLinkToTarget(uint64_t targetId) {
 // (NW / N / NE etc.) and rigidly shift each child's entire descendant subtree
 // by the same delta so manually-arranged deeper nodes are preserved.
 // ---------------------------------------------------------------------------
+void App::applyUndo(bool redo) {
+    std::string spirit;
+    std::unordered_map<uint64_t, std::pair<float,float>> shifts;
+    bool ok = redo ? m_treeManager.redo(&spirit, &shifts) : m_treeManager.undo(&spirit, &shifts);
+    if (!ok) return;
+
+    if (spirit != m_selectedSpirit) {
+        // Show the spirit that changed; its nodes start at rest, so nothing to animate
+        m_selectedSpirit = spirit;
+        m_treeRenderer.resetView();
+        m_treeRenderer.clearSelection();
+    } else {
+        for (const auto& kv : shifts) {
+            m_treeRenderer.applyBaseShift(kv.first, kv.second.first, kv.second.second);
+            m_treeRenderer.thawNode(kv.first);
+        }
+        m_treeRenderer.suppressCollisions(1.0f);
+    }
+
+    if (const SpiritTree* tree = m_treeManager.getTree(spirit)) {
+        // Nodes the step re-attached no longer float free
+        for (const auto& n : tree->nodes) {
+            if (n.dep != 0 && m_treeRenderer.isFreeFloating(n.id)) m_treeRenderer.clearFreeFloating(n.id);
+        }
+        uint64_t sel = m_treeRenderer.getSelectedNodeId();
+        if (sel != TreeRenderer::NO_NODE_ID && !tree->findNode(sel)) m_treeRenderer.clearSelection();
+    }
+    // Refresh the JSON editor and red-state markers from the restored data
+    m_lastEditedNodeId = TreeRenderer::NO_NODE_ID;
+    m_redStateDirty = true;
+}
+
 void App::repositionChildrenOfNode(uint64_t parentId) {
     SpiritNode* parent = m_treeManager.getNode(m_selectedSpirit, parentId);
     if (!parent) return;
@@ -3459,28 +3677,17 @@ void App::repositionChildrenOfNode(uint64_t parentId) {
         // Skip children that are already at the correct position
         if (std::fabs(dx) < 0.01f && std::fabs(dy) < 0.01f) continue;
 
-        // Move the child to its new cardinal position
-        child->x = newX;
-        child->y = newY;
-        m_treeRenderer.applyBaseShift(child->id, dx, dy);
-        m_treeRenderer.thawNode(child->id);
-
-        // Rigidly shift ALL descendants of this child by the same delta
-        // so their relative arrangement is preserved (they "follow along").
-        std::vector<uint64_t> stack;
-        for (uint64_t gc : child->children) stack.push_back(gc);
-        while (!stack.empty()) {
-            uint64_t cur = stack.back(); stack.pop_back();
-            SpiritNode* desc = m_treeManager.getNode(m_selectedSpirit, cur);
-            if (!desc) continue;
-            // Move by the same vector as the parent child: (newX - oldX) = -dx
-            desc->x -= dx;
-            desc->y -= dy;
-            m_treeRenderer.applyBaseShift(desc->id, dx, dy);
-            m_treeRenderer.thawNode(desc->id);
-            for (uint64_t gc2 : desc->children) stack.push_back(gc2);
+        // Move the child to its new cardinal position and rigidly shift ALL its descendants
+        // by the same delta so their relative arrangement is preserved (they "follow along")
+        std::unordered_set<uint64_t> movedIds;
+        m_treeManager.moveSubtreeBase(m_selectedSpirit, child->id, -dx, -dy, &movedIds);
+        for (uint64_t id : movedIds) {
+            m_treeRenderer.applyBaseShift(id, dx, dy);
+            m_treeRenderer.thawNode(id);
         }
     }
+    // Only this parent's children (and their subtrees) moved
+    m_treeManager.markSubtreeDirty(m_selectedSpirit, parentId);
 }
 
 // Update offending parent status (too many children > 4).
@@ -3503,6 +3710,7 @@ void App::updateOffendingStatusForParent(uint64_t parentId, uint64_t offendingCh
         // Mark offending parent and offending child node
         m_offendingParents.insert(parentId);
         m_parentOffendingChild[parentId] = offending;
+        m_redStateDirty = true;
         m_treeRenderer.setOffendingNode(offending);
         // Also pulse the node red ring for visibility
         m_treeRenderer.setNodeRedState(offending, true);
@@ -3516,6 +3724,7 @@ void App::updateOffendingStatusForParent(uint64_t parentId, uint64_t offendingCh
             // Also clear red pulse state
             m_treeRenderer.setNodeRedState(pit->second, false);
             m_parentOffendingChild.erase(pit);
+            m_redStateDirty = true;
         }
         // Clear offending parent set
         m_offendingParents.erase(parentId);
@@ -3559,19 +3768,20 @@ void App::performReorderInsert(size_t index) {
     SpiritNode* leaf = m_treeManager.getNode(m_selectedSpirit, m_reorderSelectedLeafId);
     if (!leaf) return;
 
-    // Make the leaf a child of the reorder target
-    leaf->dep = m_reorderNodeId;
     // Clear any recorded snap info since the user manually reattached
     m_treeManager.clearSnap(m_selectedSpirit, m_reorderSelectedLeafId);
-    m_treeManager.rebuildTree(m_selectedSpirit);
+    // Make the leaf a child of the reorder target
+    m_treeManager.relinkNode(m_selectedSpirit, m_reorderSelectedLeafId, m_reorderNodeId);
 
     SpiritNode* parent = m_treeManager.getNode(m_selectedSpirit, m_reorderNodeId);
     if (parent) {
         // Remove from any existing position
-        parent->children.erase(std::remove(parent->children.begin(), parent->children.end(), m_reorderSelectedLeafId), parent->children.end());
+        std::vector<uint64_t> children = parent->children;
+        children.erase(std::remove(children.begin(), children.end(), m_reorderSelectedLeafId), children.end());
         // Clamp index to [0, size]
-        size_t idx = std::min(index, parent->children.size());
-        parent->children.insert(parent->children.begin() + idx, m_reorderSelectedLeafId);
+        size_t idx = std::min(index, children.size());
+        children.insert(children.begin() + idx, m_reorderSelectedLeafId);
+        m_treeManager.setChildOrder(m_selectedSpirit, m_reorderNodeId, children);
 
         // Reposition direct children and rigidly shift their subtrees
         repositionChildrenOfNode(m_reorderNodeId);
@@ -3582,8 +3792,30 @@ void App::performReorderInsert(size_t index) {
     m_reorderMode = false;
     m_reorderNodeId = TreeRenderer::NO_NODE_ID;
     m_reorderSelectedLeafId = TreeRenderer::NO_NODE_ID;
+    clearReorderTargets();
+}
+
+void App::syncReorderTargets(const SpiritTree* tree) {
+    static const std::vector<uint64_t> noChildren;
+    const SpiritNode* reorderNode = tree ? tree->findNode(m_reorderNodeId) : nullptr;
+    const std::vector<uint64_t>& children = reorderNode ? reorderNode->children : noChildren;
+    if (children == m_reorderTargets) return;
+    for (uint64_t id : m_reorderTargets) {
+        if (std::find(children.begin(), children.end(), id) != children.end()) continue;
+        m_treeRenderer.setNodeHighlighted(id, false);
+        m_treeRenderer.setNodeSelectable(id, false);
+    }
+    for (uint64_t id : children) {
+        m_treeRenderer.setNodeHighlighted(id, true);
+        m_treeRenderer.setNodeSelectable(id, true);
+    }
+    m_reorderTargets = children;
+}
+
+void App::clearReorderTargets() {
     m_treeRenderer.clearHighlightedNodes();
     m_treeRenderer.clearSelectableNodes();
+    m_reorderTargets.clear();
 }
 
 void App::renderNodeDetails() {
@@ -3595,19 +3827,9 @@ void App::renderNodeDetails() {
     uint64_t selectedNodeId = m_treeRenderer.getSelectedNodeId();
     size_t selectedCount = m_treeRenderer.getSelectedNodeIds().size();
     bool showFixButton = false;
-    uint32_t expectedId = 0;
     
     if (selectedNodeId != TreeRenderer::NO_NODE_ID && !m_selectedSpirit.empty()) {
-        const SpiritTree* tree = m_treeManager.getTree(m_selectedSpirit);
-        if (tree) {
-            for (const auto& node : tree->nodes) {
-                if (node.id == selectedNodeId) {
-                    expectedId = fnv1a32(node.name);
-                    showFixButton = (node.id != expectedId);
-                    break;
-                }
-            }
-        }
+        showFixButton = m_treeManager.hasIdMismatch(m_selectedSpirit, selectedNodeId);
     }
     
     ImGui::Text("Node attribute viewer");
@@ -3646,14 +3868,17 @@ void App::renderNodeDetails() {
     
     ImGui::Spacing();
     
-    // Check if ID matches FNV-1a hash of name (reuse expectedId from earlier)
-    uint32_t nodeExpectedId = fnv1a32(selectedNode->name);
-    bool idMatches = (selectedNode->id == nodeExpectedId);
+    // Check if ID matches FNV-1a hash of name (answered by the manager's analysis cache;
+    // the expected id itself is only needed to offer a fix)
+    bool idMatches = !m_treeManager.hasIdMismatch(m_selectedSpirit, selectedNode->id);
+    uint32_t nodeExpectedId = idMatches ? (uint32_t)selectedNode->id : fnv1a32(selectedNode->name);
     
     ImVec4 matchColor = idMatches ? ImVec4(0.3f, 1.0f, 0.3f, 1.0f) : ImVec4(1.0f, 0.3f, 0.3f, 1.0f);
     
     // Track whether any attribute changed in this panel
     bool attrChanged = false;
+    // Fields as they were before this frame's edits, recorded as one undo delta below
+    const NodeFields fieldsBefore = SpiritTreeManager::fieldsOf(*selectedNode);
 
     
     // Display node attributes in JSON order: ap, cst, ctyp, dep, id, nm, spirit, typ
@@ -3695,14 +3920,10 @@ void App::renderNodeDetails() {
     ImGui::TextColored(ImVec4(0.7f, 0.9f, 1.0f, 1.0f), "Currency Type (ctyp):");
     std::vector<std::string> ctyps;
     for (const auto& s : m_treeManager.getSpiritNames()) {
-        const SpiritTree* t = m_treeManager.getTree(s);
-        if (!t) continue;
-        for (const auto& n : t->nodes) ctyps.push_back(n.costType);
+        for (const auto& n : m_treeManager.getSpiritNodes(s)) ctyps.push_back(n.costType);
     }
     for (const auto& s : m_treeManager.getGuideNames()) {
-        const SpiritTree* t = m_treeManager.getTree(s);
-        if (!t) continue;
-        for (const auto& n : t->nodes) ctyps.push_back(n.costType);
+        for (const auto& n : m_treeManager.getSpiritNodes(s)) ctyps.push_back(n.costType);
     }
     std::sort(ctyps.begin(), ctyps.end());
     ctyps.erase(std::unique(ctyps.begin(), ctyps.end()), ctyps.end());
@@ -3860,7 +4081,7 @@ void App::renderNodeDetails() {
             ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.0f, 0.0f, 0.0f, 1.0f));
             if (ImGui::Button("Fix name by ID", ImVec2(120, ImGui::GetFrameHeight()))) {
                 std::string restored;
-                if (m_treeManager.getNameFromLoadedFile(m_selectedSpirit, selectedNode->id, &restored)) {
+                if (m_treeManager.findNameForId(m_selectedSpirit, selectedNode->id, &m_nameIndex, &restored)) {
                     selectedNode->name = restored;
                     attrChanged = true;
                     // Remove any previously-recorded failure marker (if present)
@@ -3884,6 +4105,7 @@ void App::renderNodeDetails() {
         if (m_treeManager.isNameDuplicate(m_selectedSpirit, newName, selectedNode->id)) {
             // Revert to initial name and inform the user
             selectedNode->name = selectedNode->originalName;
+            m_treeManager.markSubtreeDirty(m_selectedSpirit, selectedNode->id);
             setTreeMessage("Node with same name found.", TreeMessageType::Error, std::chrono::seconds(3));
             // Visual pulse on offending node
             m_treeRenderer.pulseNodeRed(selectedNode->id);
@@ -4004,14 +4226,10 @@ void App::renderNodeDetails() {
     for (const auto& t : m_knownTypes) if (!t.empty()) types.push_back(t);
     // Also include current file's types (in case new file introduced new types)
     for (const auto& s : m_treeManager.getSpiritNames()) {
-        const SpiritTree* t = m_treeManager.getTree(s);
-        if (!t) continue;
-        for (const auto& n : t->nodes) if (!n.type.empty()) types.push_back(n.type);
+        for (const auto& n : m_treeManager.getSpiritNodes(s)) if (!n.type.empty()) types.push_back(n.type);
     }
     for (const auto& s : m_treeManager.getGuideNames()) {
-        const SpiritTree* t = m_treeManager.getTree(s);
-        if (!t) continue;
-        for (const auto& n : t->nodes) if (!n.type.empty()) types.push_back(n.type);
+        for (const auto& n : m_treeManager.getSpiritNodes(s)) if (!n.type.empty()) types.push_back(n.type);
     }
     std::sort(types.begin(), types.end());
     types.erase(std::unique(types.begin(), types.end()), types.end());
@@ -4067,7 +4285,9 @@ void App::renderNodeDetails() {
         m_jsonErrorMsg.clear();
         // Remember the current node type in known types so the dropdown preserves it across loads
         if (!selectedNode->type.empty()) addKnownType(selectedNode->type);
+        m_treeManager.markSubtreeDirty(m_selectedSpirit, selectedNode->id);
     }
+    m_treeManager.recordNodeFields(m_selectedSpirit, selectedNode->id, fieldsBefore);
     
     ImGui::Separator();
     ImGui::Spacing();
@@ -4108,14 +4328,14 @@ void App::renderNodeJsonEditor() {
     if (selectedIds.size() > 1) {
         // If selection changed, rebuild the JSON array buffer. Preserve original tree order
         // by iterating the spirit's nodes in their stored order and including only the
-        // selected ones. This prevents unordered_set iteration from changing ordering.
+        // selected ones, so the order doesn't depend on the order of selection.
         if (m_lastEditedNodeId != primaryId || m_lastEditedSelectionCount != (int)selectedIds.size()) {
             std::string arr = "[\n";
             bool first = true;
             const SpiritTree* tree = m_treeManager.getTree(m_selectedSpirit);
             if (tree) {
                 for (const auto& node : tree->nodes) {
-                    if (selectedIds.count(node.id) == 0) continue;
+                    if (!m_treeRenderer.isNodeSelected(node.id)) continue;
                     if (!first) arr += ",\n";
                     arr += SpiritTreeManager::nodeToJson(node);
                     first = false;
@@ -4172,7 +4392,9 @@ void App::renderNodeJsonEditor() {
         m_textEditor.SetShowWhitespaces(false);
     }
     
+    WATERCAN_PROFILE_SCOPE(textEditorScope, "TextEditor::Render");
     m_textEditor.Render("##jsoneditor", ImVec2(-1, availHeight), true);
+    textEditorScope.end();
     bool edited = !multiSelected && m_textEditor.IsTextChanged();
 
     // Handle edits
@@ -4305,6 +4527,25 @@ void App::renderStatusBar() {
         ImGui::Text("Ready - Open a JSON file to begin");
     }
 
+    // Background save progress
+    std::string savingPath;
+    float saveFraction = 0.0f;
+    if (m_saver.currentProgress(&savingPath, &saveFraction)) {
+        ImGui::SameLine();
+        ImGui::Text("|  Saving %s", std::filesystem::path(savingPath).filename().string().c_str());
+        ImGui::SameLine();
+        ImGui::ProgressBar(saveFraction, ImVec2(120.0f, 0.0f));
+    }
+
+    // Background tree building after a load
+    size_t treesBuilt = 0, treesTotal = 0;
+    if (m_prefetcher.progress(&treesBuilt, &treesTotal)) {
+        ImGui::SameLine();
+        ImGui::Text("|  Preparing trees %zu/%zu", treesBuilt, treesTotal);
+        ImGui::SameLine();
+        ImGui::ProgressBar((float)treesBuilt / (float)treesTotal, ImVec2(120.0f, 0.0f));
+    }
+
     // Show controls hint on the right
     ImGui::SameLine(ImGui::GetWindowWidth() - 450);
     ImGui::TextColored(ImVec4(0.5f, 0.5f, 0.5f, 1.0f), 
@@ -4314,8 +4555,106 @@ void App::renderStatusBar() {
 }
 
 
-void App::openFileDialog() {
+void App::renderProfilerOverlay() {
+    if (!m_showProfiler) return;
+    FrameProfiler& profiler = FrameProfiler::instance();
+    const ImGuiViewport* viewport = ImGui::GetMainViewport();
+    ImGui::SetNextWindowPos(ImVec2(viewport->WorkPos.x + viewport->WorkSize.x - 16.0f, viewport->WorkPos.y + 40.0f),
+                            ImGuiCond_FirstUseEver, ImVec2(1.0f, 0.0f));
+    ImGui::SetNextWindowSize(ImVec2(400.0f, 0.0f), ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowBgAlpha(0.88f);
+    if (ImGui::Begin("Frame profiler", &m_showProfiler, ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoDocking)) {
+        profiler.computeStats(m_profilerFrame, m_profilerScopes);
+        profiler.frameTimes(m_profilerFrameTimes);
+        profiler.counters(m_profilerCounters);
+
+        char overlay[64];
+        snprintf(overlay, sizeof(overlay), "avg %.2f ms  p99 %.2f ms", m_profilerFrame.avgMs, m_profilerFrame.p99Ms);
+        // Scale to at least 30 fps so a steady 60 fps frame sits mid-graph
+        float graphMax = std::max(33.3f, m_profilerFrame.maxMs * 1.1f);
+        ImGui::PlotLines("##frame_times", m_profilerFrameTimes.data(), (int)m_profilerFrameTimes.size(), 0, overlay,
+                         0.0f, graphMax, ImVec2(-1.0f, 64.0f));
+        ImGui::TextDisabled("Last %d frames, max %.2f ms (idle waits excluded)", profiler.frameCount(), m_profilerFrame.maxMs);
+
+        if (FrameProfiler::countsAllocations()) {
+            ImGui::Text("Allocations: %llu this frame (%.1f KB), %.1f avg", (unsigned long long)m_profilerFrame.lastAllocs,
+                        m_profilerFrame.lastAllocBytes / 1024.0, m_profilerFrame.avgAllocs);
+        } else {
+            ImGui::TextDisabled("Allocation counting is disabled in this build");
+        }
+        for (const auto& counter : m_profilerCounters) {
+            ImGui::Text("%s: %lld", counter.first, (long long)counter.second);
+        }
+
+        ImGui::Separator();
+        if (ImGui::BeginTable("profiler_scopes", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_SizingStretchProp)) {
+            ImGui::TableSetupColumn("Scope", ImGuiTableColumnFlags_WidthStretch);
+            ImGui::TableSetupColumn("avg ms", ImGuiTableColumnFlags_WidthFixed);
+            ImGui::TableSetupColumn("p99 ms", ImGuiTableColumnFlags_WidthFixed);
+            ImGui::TableSetupColumn("calls", ImGuiTableColumnFlags_WidthFixed);
+            ImGui::TableHeadersRow();
+            for (const auto& scope : m_profilerScopes) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(scope.name);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", scope.avgMs);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", scope.p99Ms);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f", scope.callsPerFrame);
+            }
+            ImGui::EndTable();
+        }
+
+        ImGui::Separator();
+        if (ImGui::Button("Save Chrome trace")) {
+            std::string path = profilerTracePath();
+            if (!path.empty() && profiler.writeChromeTrace(path)) {
+                m_profilerStatus = "Saved " + path;
+            } else {
+                m_profilerStatus = "Could not write the trace file";
+            }
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Write the frames above as JSON for chrome://tracing or ui.perfetto.dev");
+        }
+        if (!m_profilerStatus.empty()) ImGui::TextWrapped("%s", m_profilerStatus.c_str());
+    }
+    ImGui::End();
+    // Closed with the window's close button
+    if (!m_showProfiler) profiler.setEnabled(false);
+}
+
+bool App::needsContinuousRedraw() const {
+    // About modal scrolls credits and draws the live oscilloscope; music drives lyric updates
+    if (m_aboutVisible || m_musicPlayer.isPlaying()) return true;
+    // Ctrl+Alt+S unlock is a timed key hold
+    if (m_ctrlAltSHoldActive) return true;
+    // Status bar shows the progress of a background save
+    if (m_saver.isBusy()) return true;
+    return false;
+}
+
+double App::secondsUntilNextUiTimer() const {
+    double wait = IDLE_MAX_WAIT_SECONDS;
+    auto now = std::chrono::steady_clock::now();
+    auto consider = [&](std::chrono::steady_clock::time_point until) {
+        if (until == std::chrono::steady_clock::time_point::max() || until <= now) return;
+        double s = std::chrono::duration<double>(until - now).count();
+        if (s < wait) wait = s;
+    };
+    // Timed tree messages and the type-colors "Saved!" feedback expire on their own
+    if (!m_treeMessage.empty()) consider(m_treeMessageUntil);
+    consider(m_typeColorsSavedUntil);
+    double saveLeft = m_saveFeedbackUntil - glfwGetTime();
+    if (saveLeft > 0.0 && saveLeft < wait) wait = saveLeft;
+    return wait;
+}
+
+void App::openFileDialog(bool addToWorkspace) {
     m_showInternalOpenDialog = true;
+    m_openAddsToWorkspace = addToWorkspace;
     // Initialize path to the user's home directory when possible (cross-platform),
     // otherwise fall back to the current working directory. Clear selection.
     const char* home = nullptr;
@@ -4333,21 +4672,227 @@ void App::openFileDialog() {
 }
 
 void App::loadFile(const std::string& path) {
-    if (m_treeManager.loadFromFile(path)) {
-        m_currentFilePath = path;
+    // Only a pick from the open dialog started by "Add to workspace..." adds a file
+    bool addToWorkspace = m_openAddsToWorkspace && m_showInternalOpenDialog && m_treeManager.isLoaded();
+    m_openAddsToWorkspace = false;
+    // A file already open in another slot is brought forward rather than read twice
+    // (re-opening the active file reloads it)
+    for (size_t i = 0; i < m_workspace.size(); ++i) {
+        if (i != m_activeFile && m_workspace[i].path == path) {
+            switchWorkspaceFile(i);
+            return;
+        }
+    }
+
+    // Parse into a fresh manager so a failed load leaves the open file untouched
+    SpiritTreeManager loaded;
+    if (m_binaryCacheEnabled) loaded.setBinaryCacheDir(binaryCacheDir());
+    if (!loaded.loadFromFile(path)) return;
+    if (loaded.loadedFromBinaryCache()) fprintf(stderr, "[Watercan] '%s' loaded from its binary cache\n", path.c_str());
+    learnNamesFrom(loaded);
+    loaded.setUndoBudget((size_t)m_undoBudgetMB << 20);
+
+    // Saves in flight belong to the file they were started for
+    m_prefetcher.cancel();
+    m_saver.waitIdle();
+    processSaveResults();
+    if (addToWorkspace) {
+        parkActiveFile();
+        m_workspace.emplace_back();
+        m_activeFile = m_workspace.size() - 1;
+    } else if (m_workspace.empty()) {
+        m_workspace.emplace_back();
+        m_activeFile = 0;
+    }
+    m_workspace[m_activeFile].path = path;
+    m_treeManager = std::move(loaded);
+
+    m_currentFilePath = path;
+    m_selectedSpirit.clear();
+    m_searchFilter[0] = '\0';
+    resetFileViewState();
+
+    // Auto-select first spirit if available
+    const auto& spirits = m_treeManager.getSpiritNames();
+    if (!spirits.empty()) {
+        m_selectedSpirit = spirits[0];
+    }
+    // Update known types from loaded trees so typ dropdown remains aware of them
+    syncKnownTypesFromTrees();
+    // Freshly loaded data matches the file; autosave waits for the next edit
+    m_savedGeneration = m_autosavedGeneration = m_treeManager.getEditGeneration();
+    m_lastAutosaveTime = glfwGetTime();
+    startTreePrefetch();
+}
+
+void App::learnNamesFrom(const SpiritTreeManager& manager) {
+    std::vector<Symbol> names;
+    manager.collectLoadedNames(names);
+    size_t added = m_nameIndex.add(names);
+    if (added > 0) {
+        fprintf(stderr, "[Watercan] learned %zu new names (%zu known)\n", added, m_nameIndex.size());
+        saveNameIndexToDisk();
+    }
+}
+
+void App::fixAllMismatchedNames() {
+    if (m_selectedSpirit.empty()) return;
+    std::vector<uint64_t> unresolved;
+    size_t fixed = m_treeManager.fixMismatchedNames(m_selectedSpirit, m_nameIndex, &unresolved);
+    auto& failedSet = m_unknownNameFromLoadedFileIds[m_selectedSpirit];
+    failedSet.insert(unresolved.begin(), unresolved.end());
+    char msg[128];
+    if (unresolved.empty()) {
+        std::snprintf(msg, sizeof(msg), "Fixed %zu node name(s)", fixed);
+        setTreeMessage(msg, TreeMessageType::Warning, std::chrono::seconds(3));
+    } else {
+        std::snprintf(msg, sizeof(msg), "Fixed %zu node name(s); %zu id(s) unknown", fixed, unresolved.size());
+        setTreeMessage(msg, TreeMessageType::Error, std::chrono::seconds(4));
+    }
+    if (fixed > 0) {
+        // Refresh the JSON editor and duplicate markers from the renamed nodes
+        m_lastEditedNodeId = TreeRenderer::NO_NODE_ID;
+        m_redStateDirty = true;
+    }
+}
+
+void App::parkActiveFile() {
+    if (m_activeFile >= m_workspace.size()) return;
+    WorkspaceFile& slot = m_workspace[m_activeFile];
+    slot.path = m_currentFilePath;
+    slot.selectedSpirit = m_selectedSpirit;
+    slot.savedGeneration = m_savedGeneration;
+    slot.autosavedGeneration = m_autosavedGeneration;
+    m_prefetcher.cancel();
+    // A parked file keeps only what cannot be rebuilt from its load snapshot
+    m_treeManager.pinTree(m_evictCheckedSpirit, false);
+    m_treeManager.evictIdleTrees(std::string(), 0);
+    slot.manager = std::move(m_treeManager);
+    m_treeManager = SpiritTreeManager();
+}
+
+void App::switchWorkspaceFile(size_t index) {
+    if (index >= m_workspace.size() || index == m_activeFile) return;
+    m_treeManager.commitUndoStep();
+    m_saver.waitIdle();
+    processSaveResults();
+    parkActiveFile();
+
+    m_activeFile = index;
+    WorkspaceFile& slot = m_workspace[index];
+    m_treeManager = std::move(slot.manager);
+    slot.manager = SpiritTreeManager();
+    m_currentFilePath = slot.path;
+    m_selectedSpirit = slot.selectedSpirit;
+    m_savedGeneration = slot.savedGeneration;
+    m_autosavedGeneration = slot.autosavedGeneration;
+    resetFileViewState();
+    syncKnownTypesFromTrees();
+    startTreePrefetch();
+}
+
+void App::closeActiveFile() {
+    m_prefetcher.cancel();
+    m_saver.waitIdle();
+    processSaveResults();
+    if (m_activeFile < m_workspace.size()) {
+        m_workspace.erase(m_workspace.begin() + (std::ptrdiff_t)m_activeFile);
+    }
+    if (!m_workspace.empty()) {
+        // Bring the neighbouring file forward (its slot is parked, so nothing to save first)
+        m_activeFile = std::min(m_activeFile, m_workspace.size() - 1);
+        WorkspaceFile& slot = m_workspace[m_activeFile];
+        m_treeManager = std::move(slot.manager);
+        slot.manager = SpiritTreeManager();
+        m_currentFilePath = slot.path;
+        m_selectedSpirit = slot.selectedSpirit;
+        m_savedGeneration = slot.savedGeneration;
+        m_autosavedGeneration = slot.autosavedGeneration;
+    } else {
+        m_activeFile = 0;
+        m_treeManager = SpiritTreeManager();
+        m_treeManager.setUndoBudget((size_t)m_undoBudgetMB << 20);
+        m_currentFilePath.clear();
         m_selectedSpirit.clear();
-        m_searchFilter[0] = '\0';
-        
-        // Auto-select first spirit if available
-        const auto& spirits = m_treeManager.getSpiritNames();
-        if (!spirits.empty()) {
-            m_selectedSpirit = spirits[0];
+        m_savedGeneration = m_autosavedGeneration = m_treeManager.getEditGeneration();
+    }
+    resetFileViewState();
+    startTreePrefetch();
+}
+
+void App::startTreePrefetch() {
+    m_prefetcher.cancel();
+    m_prefetchedBytes = 0;
+    // List order: spirits first, then guides, so the visible tab fills in top-down
+    std::vector<SpiritTree> trees;
+    for (const auto* names : { &m_treeManager.getSpiritNames(), &m_treeManager.getGuideNames() }) {
+        for (const auto& name : *names) {
+            if (m_treeManager.isMaterialized(name)) continue;
+            SpiritTree tree;
+            tree.spiritName = name;
+            tree.nodes = m_treeManager.getSpiritNodes(name);
+            trees.push_back(std::move(tree));
+        }
+    }
+    m_prefetcher.start(std::move(trees), TreePrefetcher::defaultThreadCount());
+}
+
+void App::pumpTreePrefetch() {
+    // Sampled before polling: once false, every tree of the batch is adopted below
+    const bool running = m_prefetcher.progress(nullptr, nullptr);
+    SpiritTree tree;
+    while (m_prefetcher.poll(tree)) {
+        size_t bytes = SpiritTreeManager::estimateTreeBytes(tree);
+        if (m_treeManager.adoptTree(std::move(tree))) m_prefetchedBytes += bytes;
+        // Beyond the cap trees are built on first use and trimmed again, as without prefetching
+        if (m_prefetchedBytes >= TREE_MEMORY_CAP_BYTES) {
+            m_prefetcher.cancel();
+            break;
+        }
+    }
+    // With the trees laid out, cache the file (and those layouts) for the next open; the
+    // snapshot is serialized and written on the saver thread
+    if (!running && m_treeManager.binaryCacheStale()) {
+        auto cache = std::make_shared<SpiritTreeManager::BinaryCacheSnapshot>();
+        if (m_treeManager.takeBinaryCache(*cache)) {
+            std::string path = cache->path;
+            m_saver.enqueue(path, [cache](std::string& out, std::string&) { cache->serialize(out); return true; },
+                            AsyncSaver::Kind::Cache, m_treeManager.getEditGeneration(), m_activeFileSerial);
         }
-        // Update known types from loaded trees so typ dropdown remains aware of them
-        syncKnownTypesFromTrees();
     }
 }
 
+void App::resetFileViewState() {
+    // Called whenever another file (or a fresh load) becomes the active one
+    ++m_activeFileSerial;
+    m_treeRenderer.resetView();
+    m_treeRenderer.clearSelection();
+    m_treeRenderer.clearBoxSelection();
+    m_treeRenderer.resetNodeOffsets();
+    m_offendingParents.clear();
+    m_parentOffendingChild.clear();
+    m_unknownNameFromLoadedFileIds.clear();
+    m_linkMode = false;
+    m_reorderMode = false;
+    clearReorderTargets();
+    m_deleteConfirmMode = false;
+    m_restoreConfirmPending = false;
+    m_lastEditedNodeId = TreeRenderer::NO_NODE_ID;
+    m_redStateDirty = true;
+    m_evictCheckedSpirit.clear();
+    m_searchIndex.clear();
+    m_searchHits.clear();
+    m_searchTotal = 0;
+    m_searchQuery.clear();
+}
+
+bool App::workspaceFileUnsaved(size_t index) const {
+    if (index >= m_workspace.size()) return false;
+    if (index == m_activeFile) return m_treeManager.getEditGeneration() != m_savedGeneration;
+    const WorkspaceFile& slot = m_workspace[index];
+    return slot.manager.getEditGeneration() != slot.savedGeneration;
+}
+
 void App::saveFileDialog() {
     // Show internal save modal
     m_showInternalSaveDialog = true;
@@ -4376,43 +4921,89 @@ void App::saveFileDialog() {
 
 }
 
+// Serializes a JSON snapshot on the saver thread
+static AsyncSaver::Producer jsonProducer(std::shared_ptr<SpiritTreeManager::JsonSnapshot> snapshot) {
+    return [snapshot](std::string& out, std::string& error) {
+        if (snapshot->serialize(out)) return true;
+        error = "node data is not valid UTF-8";
+        return false;
+    };
+}
+
 void App::saveFile(const std::string& path) {
-    if (m_treeManager.saveToFile(path)) {
-        m_currentFilePath = path;
-        try {
-            std::time_t now = std::time(nullptr);
-            m_forcedTimestamps[path] = now;
-        } catch (...) {}
-    }
+    // Only a flat copy of the node fields is taken on the UI thread; serialization and disk
+    // I/O run on the worker
+    auto snapshot = std::make_shared<SpiritTreeManager::JsonSnapshot>();
+    m_treeManager.takeJsonSnapshot(*snapshot);
+    m_saver.enqueue(path, jsonProducer(std::move(snapshot)), AsyncSaver::Kind::Full, m_treeManager.getEditGeneration(),
+                    m_activeFileSerial);
 }
 
 // Save a single spirit (only nodes from one SpiritTree) into a JSON file
 void App::saveSingleSpiritToPath(const std::string& path, const std::string& spiritName) {
-    try {
-        const SpiritTree* tree = m_treeManager.getTree(spiritName);
-        if (!tree) return;
-        nlohmann::json output = nlohmann::json::array();
-        for (const auto& node : tree->nodes) {
-            nlohmann::json nodeJson;
-            nodeJson["ap"] = node.isAdventurePass;
-            nodeJson["cst"] = node.cost;
-            nodeJson["ctyp"] = node.costType;
-            nodeJson["dep"] = node.dep;
-            nodeJson["id"] = node.id;
-            nodeJson["nm"] = node.name;
-            nodeJson["spirit"] = node.spirit;
-            nodeJson["typ"] = node.type;
-            output.push_back(nodeJson);
-            // Remember this type as a known type
-            if (!node.type.empty()) addKnownType(node.type);
+    const SpiritTree* tree = m_treeManager.getTree(spiritName);
+    if (!tree) return;
+    // Remember this spirit's types as known types
+    for (const auto& node : tree->nodes) {
+        if (!node.type.empty()) addKnownType(node.type);
+    }
+    auto snapshot = std::make_shared<SpiritTreeManager::JsonSnapshot>();
+    SpiritTreeManager::takeNodesSnapshot({tree}, *snapshot);
+    m_saver.enqueue(path, jsonProducer(std::move(snapshot)), AsyncSaver::Kind::SingleSpirit,
+                    m_treeManager.getEditGeneration(), m_activeFileSerial);
+}
+
+void App::processSaveResults() {
+    AsyncSaver::Result result;
+    while (m_saver.pollResult(result)) {
+        // A failed cache write only costs the next open its speed-up (already logged)
+        if (result.kind == AsyncSaver::Kind::Cache) continue;
+        if (!result.ok) {
+            std::string name = std::filesystem::path(result.path).filename().string();
+            setTreeMessage("Save failed (" + name + "): " + result.error, TreeMessageType::Error, std::chrono::seconds(6));
+            continue;
+        }
+        // Generations and the file path belong to the file the save was started for; once
+        // another file is active they would mark the wrong one saved
+        const bool forActiveFile = result.owner == m_activeFileSerial;
+        switch (result.kind) {
+            case AsyncSaver::Kind::Full:
+                if (!forActiveFile) break;
+                m_currentFilePath = result.path;
+                m_savedGeneration = std::max(m_savedGeneration, result.generation);
+                break;
+            case AsyncSaver::Kind::Autosave:
+                if (!forActiveFile) break;
+                m_autosavedGeneration = std::max(m_autosavedGeneration, result.generation);
+                break;
+            case AsyncSaver::Kind::SingleSpirit:
+            case AsyncSaver::Kind::Cache:
+                break;
         }
-        std::ofstream file(path);
-        if (!file.is_open()) return;
-        file << output.dump(3);
-        file.close();
         // Update forced timestamp map so UI shows immediate modification time
-        try { m_forcedTimestamps[path] = std::time(nullptr); } catch(...){}
-    } catch (...) {}
+        if (result.kind != AsyncSaver::Kind::Autosave) {
+            try { m_forcedTimestamps[result.path] = std::time(nullptr); } catch(...){}
+            // The saved file may be new to the listing the dialog is showing
+            m_dirCache.invalidate();
+        }
+    }
+}
+
+void App::tickAutosave() {
+    if (m_autosaveIntervalSeconds <= 0 || !m_treeManager.isLoaded()) return;
+    uint64_t generation = m_treeManager.getEditGeneration();
+    // Only when something changed since the last save or autosave
+    if (generation == m_savedGeneration || generation == m_autosavedGeneration) return;
+    double now = glfwGetTime();
+    if (now - m_lastAutosaveTime < (double)m_autosaveIntervalSeconds) return;
+    if (m_saver.isBusy()) return;
+    m_lastAutosaveTime = now;
+
+    std::string path = autosavePath();
+    if (path.empty()) return;
+    auto snapshot = std::make_shared<SpiritTreeManager::JsonSnapshot>();
+    m_treeManager.takeJsonSnapshot(*snapshot);
+    m_saver.enqueue(path, jsonProducer(std::move(snapshot)), AsyncSaver::Kind::Autosave, generation, m_activeFileSerial);
 }
 
 void App::addKnownType(const std::string& t) {
@@ -4422,14 +5013,10 @@ void App::addKnownType(const std::string& t) {
 
 void App::syncKnownTypesFromTrees() {
     for (const auto& s : m_treeManager.getSpiritNames()) {
-        const SpiritTree* t = m_treeManager.getTree(s);
-        if (!t) continue;
-        for (const auto& n : t->nodes) if (!n.type.empty()) m_knownTypes.insert(n.type);
+        for (const auto& n : m_treeManager.getSpiritNodes(s)) if (!n.type.empty()) m_knownTypes.insert(n.type);
     }
     for (const auto& s : m_treeManager.getGuideNames()) {
-        const SpiritTree* t = m_treeManager.getTree(s);
-        if (!t) continue;
-        for (const auto& n : t->nodes) if (!n.type.empty()) m_knownTypes.insert(n.type);
+        for (const auto& n : m_treeManager.getSpiritNodes(s)) if (!n.type.empty()) m_knownTypes.insert(n.type);
     }
 }
 } // namespace Watercan
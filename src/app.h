@@ -1,9 +1,17 @@
 #pragma once
 
 #include "spirit_tree.h"
+#include "name_index.h"
+#include "search_index.h"
 #include "tree_renderer.h"
 #include "TextEditor.h"
 #include "music_player.h"
+#include "async_saver.h"
+#include "tree_prefetcher.h"
+#include "directory_cache.h"
+#include "resource_registry.h"
+#include "frame_profiler.h"
+#include <filesystem>
 #include <vector>
 #include <string>
 #include <unordered_map>
@@ -30,14 +38,20 @@ public:
     // Cleanup
     void shutdown();
 
-    // Try loading about image (used to lazily reload if missing at runtime)
+    // Try loading about image; returns true if a texture is available
     // imageName: "TheBrokenMind.png" (default) or "TheBrokenClip.png" (while video plays)
-    void loadAboutImage(const std::string& imageName = "TheBrokenMind.png");
+    bool loadAboutImage(const std::string& imageName = "TheBrokenMind.png");
     // Open a URL in the default browser (platform-dependent)
     void openUrl(const std::string& url);
     
 private:
     void renderUI();
+    // Register the lazily loaded resources (About image, music, lyrics and lyrics font)
+    void registerResources();
+    bool loadAboutMusic();
+    bool loadLyrics();
+    // Add the Cyrillic lyrics font to the atlas; only valid between frames
+    bool loadLyricsFont();
     void renderMenuBar();
     void renderSpiritList();
     void renderTreeViewport();
@@ -45,22 +59,71 @@ private:
     void renderNodeJsonEditor();
     void renderStatusBar();
     
-    void openFileDialog();
+    // Idle mode helpers for run(): whether the UI itself animates this frame, and how long
+    // the loop may block waiting for events before a UI timer (messages, feedback) expires
+    bool needsContinuousRedraw() const;
+    double secondsUntilNextUiTimer() const;
+
+    // addToWorkspace: the chosen file opens next to the current one instead of replacing it
+    void openFileDialog(bool addToWorkspace = false);
     void saveFileDialog();
     void loadFile(const std::string& path);
+
+    // Workspace of open files. The active file's data lives in m_treeManager; the others
+    // are parked in their slot with only their edited trees built.
+    void switchWorkspaceFile(size_t index);
+    void closeActiveFile();
+    // Move the active file's state into its slot (m_treeManager is left empty)
+    void parkActiveFile();
+    // Forget per-file UI state (selection, warnings, offsets) after the active file changed
+    void resetFileViewState();
+    bool workspaceFileUnsaved(size_t index) const;
+    // Background tree building for the active file: queue every spirit not built yet, and
+    // adopt finished trees each frame until TREE_MEMORY_CAP_BYTES worth were added
+    void startTreePrefetch();
+    void pumpTreePrefetch();
     void saveFile(const std::string& path);
     void saveSingleSpiritToPath(const std::string& path, const std::string& spiritName);
+
+    // Background saving: apply finished save jobs (current path, timestamps, errors) and
+    // queue a periodic autosave snapshot while there are unsaved edits
+    void processSaveResults();
+    void tickAutosave();
     
     // Window handle
     GLFWwindow* m_window = nullptr;
     
     // Application state
     bool m_running = false;
+
+    // Idle mode: frames still rendered after activity stops, and the longest event wait
+    // (bounded so cursor blink and other slow UI updates still happen while idle)
+    static constexpr int IDLE_GRACE_FRAMES = 3;
+    static constexpr double IDLE_MAX_WAIT_SECONDS = 0.5;
+    int m_idleGraceFrames = IDLE_GRACE_FRAMES;
+    bool m_aboutVisible = false; // About modal was drawn during the last frame
     std::string m_selectedSpirit;
     std::string m_currentFilePath;
     
     // Core components
     SpiritTreeManager m_treeManager;
+
+    struct WorkspaceFile {
+        std::string path;
+        SpiritTreeManager manager;     // parked data; empty while this is the active file
+        std::string selectedSpirit;
+        uint64_t savedGeneration = 0;
+        uint64_t autosavedGeneration = 0;
+    };
+    std::vector<WorkspaceFile> m_workspace;
+    size_t m_activeFile = 0;
+    bool m_openAddsToWorkspace = false;   // the open dialog was started by "Add to workspace..."
+    bool m_showCloseFileConfirm = false;
+    // Built trees of the active file are trimmed to this when the selected spirit changes
+    static constexpr size_t TREE_MEMORY_CAP_BYTES = 64u << 20;
+    std::string m_evictCheckedSpirit;
+    TreePrefetcher m_prefetcher;
+    size_t m_prefetchedBytes = 0;
     TreeRenderer m_treeRenderer;
     
     // UI state
@@ -71,6 +134,16 @@ private:
     bool m_showLicense = false;
     char m_searchFilter[256] = "";
     int m_spiritListTab = 0;  // 0 = Spirits, 1 = Guides
+    // Node search over every spirit, fed by the same filter; only built and kept in sync
+    // while the filter is not empty
+    static constexpr size_t SEARCH_MAX_HITS = 200;
+    SearchIndex m_searchIndex;
+    std::vector<SearchIndex::Hit> m_searchHits;
+    size_t m_searchTotal = 0;
+    std::string m_searchQuery;       // query m_searchHits were computed for
+    uint64_t m_searchVersion = 0;    // index version they were computed against
+    // Select a node of any spirit and center the view on it
+    void jumpToNode(const std::string& spiritName, uint64_t nodeId);
     
     // About image texture
     unsigned int m_aboutImageTexture = 0;
@@ -79,10 +152,9 @@ private:
     std::string m_currentAboutImageName;  // Track which image is loaded
 
     // In-app music player for the About dialog (plays res/inneruniverse.ogg)
-    // Implemented with stb_vorbis decode + SDL2 queue playback. The player is
+    // Implemented with stb_vorbis streaming + SDL2 callback playback. The player is
     // normally hidden; it is unlocked by the secret "Shell" interaction.
     MusicPlayer m_musicPlayer;
-    bool m_aboutMusicLoaded = false;
     bool m_aboutMusicUnlocked = false; // becomes true after secret is activated
 
     // "Shell" secret UI state: per-letter colors and click progress
@@ -96,16 +168,21 @@ private:
     // Parsed LRC lyrics: timestamp (seconds) -> line text
     struct LrcLine { double time; std::string text; };
     std::vector<LrcLine> m_lrcLines;
-    bool m_lrcLoaded = false;
 
-    // Secondary font with Cyrillic support (used only for lyric display)
+    // Secondary font with Cyrillic support (used only for lyric display). Added to the
+    // atlas before the next frame once the lyrics are wanted.
     ImFont* m_cyrillicFont = nullptr;
+    bool m_wantLyricsFont = false;
+
+    // On-demand textures, audio and fonts (see registerResources)
+    ResourceRegistry m_resources;
 
     // Credits scroll offset (pixels, auto-incremented each frame)
     float m_creditsScrollY = 0.0f;
 
     // Oscilloscope smoothing state: per-pixel previous values to blend frames smoothly
     std::vector<float> m_scopePrev; // previous frame values (length == last pixel count)
+    std::vector<float> m_scopeSamples; // recent stream samples copied from the player each frame
     float m_scopeSmoothAlpha = 0.68f; // blending factor (0..1), higher==more smoothing
     float m_scopeGain = 2.2f; // visual amplification of waveform (1.0 = none) - increased to make waveform more visible
     // Number of decoded samples shown in oscilloscope window (smaller => more zoom)
@@ -155,6 +232,24 @@ private:
     // Forced timestamps for files we've just overwritten (path -> epoch seconds)
     std::unordered_map<std::string, std::time_t> m_forcedTimestamps;
 
+    // Saves are serialized on the UI thread and written by this worker (temp file + rename)
+    AsyncSaver m_saver;
+    // Background listings for the internal open/save dialogs
+    DirectoryCache m_dirCache;
+    // Edit generation (SpiritTreeManager::getEditGeneration) last written to the main file / autosave
+    uint64_t m_savedGeneration = 0;
+    uint64_t m_autosavedGeneration = 0;
+    // Bumped whenever another file becomes the active one; tags saves (AsyncSaver owner) so
+    // results that arrive late never update the state of the file shown now
+    uint64_t m_activeFileSerial = 1;
+    // Autosave period in seconds (0 = off), persisted in settings.json; time of the last autosave
+    int m_autosaveIntervalSeconds = 120;
+    // Memory allowed for the undo history in MiB, persisted in settings.json
+    int m_undoBudgetMB = 32;
+    // Keep a binary cache of opened files (in the config directory) for fast reopening
+    bool m_binaryCacheEnabled = false;
+    double m_lastAutosaveTime = 0.0;
+
     // Create procedural icons (folder/file)
     void createIconTextures();
 
@@ -169,6 +264,8 @@ private:
     // Reposition only the direct children of parentId to their cardinal slots
     // and rigidly shift each child's entire descendant subtree by the same delta.
     void repositionChildrenOfNode(uint64_t parentId);
+    // Undo (or redo) the newest edit step, switching to its spirit and animating moved nodes
+    void applyUndo(bool redo);
     
     // Delete confirmation state
     bool m_deleteConfirmMode = false;
@@ -178,6 +275,11 @@ private:
     std::unordered_set<uint64_t> m_offendingParents;
     // Map parent->offending child id (when a parent has 4+ children the offending child is highlighted)
     std::unordered_map<uint64_t, uint64_t> m_parentOffendingChild;
+    // Duplicate-name red pulses are re-applied only when the analysis version, the spirit or
+    // the offending children above change (m_redStateDirty)
+    std::string m_redStateSpirit;
+    uint64_t m_redStateVersion = 0;
+    bool m_redStateDirty = true;
 
     // Check and update offending status for a parent (too many children). Shows persistent message.
     // If offendingChildId != 0, that child will be marked as the offending node when threshold is reached.
@@ -211,6 +313,12 @@ private:
     bool m_reorderMode = false;
     uint64_t m_reorderNodeId = TreeRenderer::NO_NODE_ID; // the node for which we're reordering
     uint64_t m_reorderSelectedLeafId = TreeRenderer::NO_NODE_ID; // selected leaf to move
+    // Children of the reorder node currently highlighted (and selectable) in the renderer
+    std::vector<uint64_t> m_reorderTargets;
+    // Bring the renderer's highlight/selectable flags in line with the reorder node's
+    // children, passing only the nodes that changed
+    void syncReorderTargets(const SpiritTree* tree);
+    void clearReorderTargets();
 
     // Helper to perform a reorder insertion at a given child index and exit reorder mode
     void performReorderInsert(size_t index);
@@ -219,6 +327,14 @@ private:
     bool m_showFNVDialog = false;
     char m_fnvNameBuf[256] = "";
     uint32_t m_fnvResult = 0;
+    // Tools -> Frame profiler overlay (F3); recording only runs while it is shown
+    bool m_showProfiler = false;
+    void renderProfilerOverlay();
+    std::string m_profilerStatus;  // outcome of the last trace dump
+    FrameProfiler::FrameStats m_profilerFrame;
+    std::vector<FrameProfiler::ScopeStats> m_profilerScopes;
+    std::vector<float> m_profilerFrameTimes;
+    std::vector<std::pair<const char*, int64_t>> m_profilerCounters;
     // Tools -> Color codes dialog
     bool m_showColorCodes = false;
     // Mapping from node type (typ) to RGBA color
@@ -244,6 +360,13 @@ private:
 
     // Track node IDs for which 'Fix name by ID' failed to find a name in the loaded file (spirit -> set of node ids)
     std::unordered_map<std::string, std::unordered_set<uint64_t>> m_unknownNameFromLoadedFileIds;
+    // Every nm seen in any file opened so far plus the external name lists, by fnv1a32 id.
+    // Persisted in the config directory so "Fix name by ID" works in any later session.
+    NameIndex m_nameIndex;
+    // Learn the names of a freshly loaded file and persist the index if it grew
+    void learnNamesFrom(const SpiritTreeManager& manager);
+    // Fix every fixable id/name mismatch of the selected spirit in one step
+    void fixAllMismatchedNames();
 
     // Reshape confirm state: When restoring from snaps, require explicit confirmation
     bool m_restoreConfirmPending = false;
@@ -258,6 +381,20 @@ private:
     // Persist and load user-saved type colors
     bool saveTypeColorsToDisk();
     bool loadTypeColorsFromDisk();
+    // Watercan config directory (~/.config/watercan), created if asked; empty on failure
+    static std::filesystem::path getConfigDir(bool createIfMissing = false);
+    // Persist and load editor settings (autosave interval, undo budget, binary cache)
+    bool saveSettingsToDisk();
+    bool loadSettingsFromDisk();
+    // Recovery file written by autosave (inside the config directory); empty if unavailable
+    std::string autosavePath() const;
+    // Directory for binary spirit caches (inside the config directory); empty if unavailable
+    std::string binaryCacheDir() const;
+    // New Chrome trace file in the config directory; empty if unavailable
+    std::string profilerTracePath() const;
+    // Known-names index (known_names.txt) plus every *.txt list in the name_lists directory
+    bool loadNameIndexFromDisk();
+    bool saveNameIndexToDisk();
 
 
 };
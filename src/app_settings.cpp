@@ -0,0 +1,149 @@
+#include "app.h"
+#include <fstream>
+#include <filesystem>
+#include <nlohmann/json.hpp>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <ctime>
+#include <cstdio>
+
+namespace Watercan {
+
+// Return the Watercan config directory (~/.config/watercan), creating it if needed.
+// Returns empty path on failure.
+std::filesystem::path App::getConfigDir(bool createIfMissing) {
+    std::filesystem::path configDir;
+    const char* xdg = std::getenv("XDG_CONFIG_HOME");
+    if (xdg && std::strlen(xdg) > 0) configDir = xdg;
+    else {
+        const char* home = std::getenv("HOME");
+        if (!home) return {};
+        configDir = std::filesystem::path(home) / ".config";
+    }
+    configDir /= "watercan";
+    if (createIfMissing) std::filesystem::create_directories(configDir);
+    return configDir;
+}
+
+bool App::saveSettingsToDisk() {
+    try {
+        auto configDir = getConfigDir(true);
+        if (configDir.empty()) return false;
+        std::filesystem::path file = configDir / "settings.json";
+
+        nlohmann::json j;
+        j["autosave_interval_seconds"] = m_autosaveIntervalSeconds;
+        j["undo_budget_mb"] = m_undoBudgetMB;
+        j["binary_cache"] = m_binaryCacheEnabled;
+
+        std::ofstream ofs(file);
+        if (!ofs.is_open()) return false;
+        ofs << j.dump(4);
+        ofs.close();
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+bool App::loadSettingsFromDisk() {
+    try {
+        auto configDir = getConfigDir();
+        if (configDir.empty()) return false;
+        std::filesystem::path file = configDir / "settings.json";
+        if (!std::filesystem::exists(file)) return false;
+
+        std::ifstream ifs(file);
+        if (!ifs.is_open()) return false;
+        nlohmann::json j;
+        ifs >> j;
+        ifs.close();
+
+        m_autosaveIntervalSeconds = std::max(0, j.value("autosave_interval_seconds", m_autosaveIntervalSeconds));
+        m_undoBudgetMB = std::max(1, j.value("undo_budget_mb", m_undoBudgetMB));
+        m_binaryCacheEnabled = j.value("binary_cache", m_binaryCacheEnabled);
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+std::string App::autosavePath() const {
+    try {
+        auto configDir = getConfigDir(true);
+        if (configDir.empty()) return {};
+        return (configDir / "autosave.json").string();
+    } catch (...) {
+        return {};
+    }
+}
+
+std::string App::binaryCacheDir() const {
+    try {
+        auto configDir = getConfigDir(true);
+        if (configDir.empty()) return {};
+        std::filesystem::path dir = configDir / "cache";
+        std::filesystem::create_directories(dir);
+        return dir.string();
+    } catch (...) {
+        return {};
+    }
+}
+
+std::string App::profilerTracePath() const {
+    try {
+        auto configDir = getConfigDir(true);
+        if (configDir.empty()) return {};
+        std::time_t now = std::time(nullptr);
+        char name[64];
+        std::strftime(name, sizeof(name), "trace-%Y%m%d-%H%M%S.json", std::localtime(&now));
+        return (configDir / name).string();
+    } catch (...) {
+        return {};
+    }
+}
+
+bool App::loadNameIndexFromDisk() {
+    try {
+        auto configDir = getConfigDir();
+        if (configDir.empty()) return false;
+        std::filesystem::path file = configDir / "known_names.txt";
+        if (std::filesystem::exists(file)) m_nameIndex.loadFile(file.string());
+
+        // External lists (e.g. names dumped from the game) are read but never rewritten;
+        // what they add is saved into known_names.txt
+        std::filesystem::path listDir = configDir / "name_lists";
+        if (std::filesystem::is_directory(listDir)) {
+            std::vector<std::filesystem::path> lists;
+            for (const auto& entry : std::filesystem::directory_iterator(listDir)) {
+                if (entry.is_regular_file() && entry.path().extension() == ".txt") lists.push_back(entry.path());
+            }
+            std::sort(lists.begin(), lists.end());
+            for (const auto& list : lists) {
+                size_t added = 0;
+                if (m_nameIndex.loadFile(list.string(), &added) && added > 0) {
+                    fprintf(stderr, "[Watercan] %zu new names from '%s'\n", added, list.string().c_str());
+                }
+            }
+        }
+        if (m_nameIndex.collisions() > 0) {
+            fprintf(stderr, "[Watercan] %zu names share an id with another name and were ignored\n", m_nameIndex.collisions());
+        }
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+bool App::saveNameIndexToDisk() {
+    try {
+        auto configDir = getConfigDir(true);
+        if (configDir.empty()) return false;
+        return m_nameIndex.saveFile((configDir / "known_names.txt").string());
+    } catch (...) {
+        return false;
+    }
+}
+
+} // namespace Watercan
@@ -2,26 +2,9 @@
 #include <fstream>
 #include <filesystem>
 #include <nlohmann/json.hpp>
-#include <cstring>
 
 namespace Watercan {
 
-// Return the Watercan config directory (~/.config/watercan), creating it if needed.
-// Returns empty path on failure.
-static std::filesystem::path getConfigDir(bool createIfMissing = false) {
-    std::filesystem::path configDir;
-    const char* xdg = std::getenv("XDG_CONFIG_HOME");
-    if (xdg && std::strlen(xdg) > 0) configDir = xdg;
-    else {
-        const char* home = std::getenv("HOME");
-        if (!home) return {};
-        configDir = std::filesystem::path(home) / ".config";
-    }
-    configDir /= "watercan";
-    if (createIfMissing) std::filesystem::create_directories(configDir);
-    return configDir;
-}
-
 bool App::saveTypeColorsToDisk() {
     try {
         auto configDir = getConfigDir(true);
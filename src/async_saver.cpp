@@ -0,0 +1,202 @@
+#include "async_saver.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <system_error>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace Watercan {
+
+namespace {
+// Write in slices so progress can be reported for large files
+constexpr size_t WRITE_CHUNK_BYTES = 1u << 20;
+
+// Push a written file's data to the disk, so the rename that follows never exposes a file
+// whose contents are still only in the page cache
+bool syncToDisk(FILE* file) {
+    if (std::fflush(file) != 0) return false;
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+}
+
+AsyncSaver::~AsyncSaver() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable()) m_thread.join();
+}
+
+void AsyncSaver::setWakeCallback(std::function<void()> cb) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_wake = std::move(cb);
+}
+
+void AsyncSaver::enqueue(const std::string& path, std::string data, Kind kind, uint64_t generation, uint64_t owner) {
+    push(Job{path, std::move(data), nullptr, kind, generation, owner});
+}
+
+void AsyncSaver::enqueue(const std::string& path, Producer produce, Kind kind, uint64_t generation, uint64_t owner) {
+    push(Job{path, std::string(), std::move(produce), kind, generation, owner});
+}
+
+void AsyncSaver::push(Job job) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = std::find_if(m_queue.begin(), m_queue.end(),
+                               [&](const Job& j) { return j.path == job.path; });
+        if (it != m_queue.end()) {
+            *it = std::move(job);
+        } else {
+            m_queue.push_back(std::move(job));
+        }
+        if (!m_thread.joinable()) m_thread = std::thread(&AsyncSaver::workerLoop, this);
+    }
+    m_cv.notify_one();
+}
+
+bool AsyncSaver::isBusy() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_writing || !m_queue.empty();
+}
+
+bool AsyncSaver::currentProgress(std::string* outPath, float* outFraction) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_writing || m_currentKind == Kind::Cache) return false;
+    if (outPath) *outPath = m_currentPath;
+    if (outFraction) {
+        size_t total = m_bytesTotal.load();
+        *outFraction = total > 0 ? (float)((double)m_bytesWritten.load() / (double)total) : 1.0f;
+    }
+    return true;
+}
+
+bool AsyncSaver::pollResult(Result& out) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_results.empty()) return false;
+    out = std::move(m_results.front());
+    m_results.pop_front();
+    return true;
+}
+
+void AsyncSaver::waitIdle() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idleCv.wait(lock, [this] { return !m_writing && m_queue.empty(); });
+}
+
+void AsyncSaver::wake() {
+    std::function<void()> cb;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        cb = m_wake;
+    }
+    if (cb) cb();
+}
+
+void AsyncSaver::workerLoop() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+            // Pending jobs are still written when stopping so no save is lost on exit
+            if (m_queue.empty()) return;
+            job = std::move(m_queue.front());
+            m_queue.pop_front();
+            m_writing = true;
+            m_currentPath = job.path;
+            m_currentKind = job.kind;
+            m_bytesWritten = 0;
+            m_bytesTotal = job.data.size();
+        }
+        Result result;
+        result.path = job.path;
+        result.kind = job.kind;
+        result.generation = job.generation;
+        result.owner = job.owner;
+        bool produced = true;
+        if (job.produce) {
+            produced = job.produce(job.data, result.error);
+            job.produce = nullptr;  // release the snapshot it owns before writing
+            m_bytesTotal = job.data.size();
+        }
+        result.ok = produced && writeAtomically(job, &result.error);
+        if (!result.ok) {
+            fprintf(stderr, "[Watercan] save to '%s' failed: %s\n", job.path.c_str(), result.error.c_str());
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_results.push_back(std::move(result));
+            m_writing = false;
+            m_currentPath.clear();
+        }
+        m_idleCv.notify_all();
+        wake();
+    }
+}
+
+bool AsyncSaver::writeAtomically(const Job& job, std::string* outError) {
+    namespace fs = std::filesystem;
+    const std::string tmpPath = job.path + ".tmp";
+    {
+        // Text mode on purpose for spirit files: line endings match what the synchronous
+        // save produced
+        FILE* file = std::fopen(tmpPath.c_str(), job.kind == Kind::Cache ? "wb" : "w");
+        if (!file) {
+            if (outError) *outError = "cannot open temporary file";
+            return false;
+        }
+        bool ok = true;
+        size_t offset = 0;
+        while (offset < job.data.size()) {
+            size_t n = std::min(WRITE_CHUNK_BYTES, job.data.size() - offset);
+            if (std::fwrite(job.data.data() + offset, 1, n, file) != n) {
+                ok = false;
+                break;
+            }
+            offset += n;
+            m_bytesWritten = offset;
+            wake();
+        }
+        ok = ok && syncToDisk(file);
+        ok = (std::fclose(file) == 0) && ok;
+        if (!ok) {
+            std::error_code ec;
+            fs::remove(tmpPath, ec);
+            if (outError) *outError = "write failed";
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(tmpPath, job.path, ec);
+#if defined(_WIN32)
+    // Some runtimes refuse to rename over an existing file; replace it explicitly
+    if (ec) {
+        std::error_code rmEc;
+        fs::remove(job.path, rmEc);
+        ec.clear();
+        fs::rename(tmpPath, job.path, ec);
+    }
+#endif
+    if (ec) {
+        std::error_code rmEc;
+        fs::remove(tmpPath, rmEc);
+        if (outError) *outError = ec.message();
+        return false;
+    }
+    return true;
+}
+
+} // namespace Watercan
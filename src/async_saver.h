@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace Watercan {
+
+// Writes serialized spirit files on a background thread so the UI never blocks on disk I/O.
+// Each job is written to "<path>.tmp", flushed to disk and then renamed over the target, so a
+// crash or a full disk never leaves a half-written file behind. The worker thread starts on first use and
+// drains every queued job before the saver is destroyed.
+class AsyncSaver {
+public:
+    // Cache: a binary spirit cache (written in binary mode and not reported as a save)
+    enum class Kind { Full, SingleSpirit, Autosave, Cache };
+
+    struct Result {
+        std::string path;
+        Kind kind = Kind::Full;
+        uint64_t generation = 0; // caller-supplied edit generation of the snapshot
+        uint64_t owner = 0;      // caller-supplied tag of what the snapshot was taken from
+        bool ok = false;
+        std::string error;
+    };
+
+    // Fills data on the worker; false (with error set) fails the job without writing anything
+    using Producer = std::function<bool(std::string& data, std::string& error)>;
+
+    AsyncSaver() = default;
+    ~AsyncSaver();
+
+    AsyncSaver(const AsyncSaver&) = delete;
+    AsyncSaver& operator=(const AsyncSaver&) = delete;
+
+    // Called from the worker after progress or completion (e.g. to wake an idle UI loop)
+    void setWakeCallback(std::function<void()> cb);
+
+    // Queue data (an already serialized snapshot) for writing to path. A job for the same
+    // path that has not started yet is replaced, since the newer snapshot supersedes it.
+    void enqueue(const std::string& path, std::string data, Kind kind, uint64_t generation, uint64_t owner = 0);
+    // Same, but the data is produced by produce on the worker (which owns everything it
+    // needs), for snapshots too costly to serialize on the UI thread
+    void enqueue(const std::string& path, Producer produce, Kind kind, uint64_t generation, uint64_t owner = 0);
+
+    // True while a job is queued or being written
+    bool isBusy() const;
+    // Target path and written fraction (0..1) of the save in flight; false when idle (cache
+    // writes are not reported)
+    bool currentProgress(std::string* outPath, float* outFraction) const;
+    // Pop the oldest finished job; returns false when none are pending
+    bool pollResult(Result& out);
+
+    // Block until every queued job has been written
+    void waitIdle();
+
+private:
+    struct Job {
+        std::string path;
+        std::string data;
+        Producer produce; // fills data on the worker when set
+        Kind kind = Kind::Full;
+        uint64_t generation = 0;
+        uint64_t owner = 0;
+    };
+
+    void push(Job job);
+    void workerLoop();
+    bool writeAtomically(const Job& job, std::string* outError);
+    void wake();
+
+    std::thread m_thread;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::condition_variable m_idleCv;
+    std::deque<Job> m_queue;
+    std::deque<Result> m_results;
+    std::string m_currentPath;
+    Kind m_currentKind = Kind::Full;
+    bool m_writing = false;
+    bool m_stop = false;
+    std::function<void()> m_wake;
+
+    std::atomic<size_t> m_bytesWritten{0};
+    std::atomic<size_t> m_bytesTotal{0};
+};
+
+} // namespace Watercan
@@ -0,0 +1,396 @@
+#include "spirit_tree.h"
+#include "frame_profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifdef WATERCAN_BENCH_RENDER
+#include "tree_renderer.h"
+#include <imgui.h>
+#endif
+
+#ifndef WATERCAN_VERSION
+#define WATERCAN_VERSION "unknown"
+#endif
+
+// watercan_bench: times the spirit model (and, in GUI builds, physics and offscreen draw-list
+// generation) on a synthetic file of configurable size. Results go to stdout as JSON or CSV
+// so they can be compared across releases; progress goes to stderr.
+
+using namespace Watercan;
+
+namespace {
+
+struct Options {
+    size_t spirits = 2000;
+    size_t nodes = 60;          // per spirit
+    std::string shape = "mixed";
+    int iterations = 5;
+    uint64_t seed = 1;
+    std::string input;          // benchmark this file instead of generating one
+    std::string keep;           // keep the generated file here
+    std::string format = "json";
+    std::string filter;
+};
+
+void printUsage() {
+    fprintf(stderr,
+        "usage: watercan_bench [options]\n"
+        "  --spirits N       synthetic spirits to generate (default 2000)\n"
+        "  --nodes N         nodes per spirit (default 60)\n"
+        "  --shape S         wide | deep | mixed tree shape (default mixed)\n"
+        "  --iterations N    timed runs per benchmark (default 5)\n"
+        "  --seed N          generator seed (default 1)\n"
+        "  --input FILE      benchmark an existing spirits file instead\n"
+        "  --keep FILE       write the generated file to FILE and keep it\n"
+        "  --format F        json | csv (default json)\n"
+        "  --filter TEXT     only run benchmarks whose name contains TEXT\n");
+}
+
+// xorshift64*: fixed sequence per seed on every platform
+struct Rng {
+    uint64_t state;
+    explicit Rng(uint64_t seed) : state(seed ? seed : 0x9E3779B97F4A7C15ull) {}
+    uint64_t next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1Dull;
+    }
+    size_t below(size_t n) { return n ? (size_t)(next() % n) : 0; }
+};
+
+// Parent index (into the spirit's nodes) for node i > 0
+size_t pickParent(const std::string& shape, size_t i, Rng& rng) {
+    if (shape == "wide") {
+        // A handful of hubs with very wide child lists
+        return rng.below(std::min<size_t>(i, 6));
+    }
+    if (shape == "deep") {
+        // Long chains with an occasional short side branch
+        return i - 1 - rng.below(std::min<size_t>(i, rng.below(8) == 0 ? 4 : 1));
+    }
+    // Random recursive tree: logarithmic depth, uneven fan-out
+    return rng.below(i);
+}
+
+bool generateFile(const Options& opt, const std::string& path) {
+    static const char* const types[] = {"outfit", "spirit_upgrade", "music", "lootbox", "emote", "stance", "call"};
+    static const char* const costTypes[] = {"candle", "heart", "season_candle", "ascended_candle"};
+    Rng rng(opt.seed);
+    std::vector<SpiritTree> trees(opt.spirits);
+    for (size_t s = 0; s < opt.spirits; ++s) {
+        SpiritTree& tree = trees[s];
+        tree.spiritName = "bench_" + std::to_string(s);
+        Symbol spirit(tree.spiritName);
+        tree.nodes.resize(opt.nodes);
+        for (size_t i = 0; i < opt.nodes; ++i) {
+            SpiritNode& n = tree.nodes[i];
+            std::string name = tree.spiritName + "_n" + std::to_string(i);
+            n.id = fnv1a32(name);
+            // About one node in 40 reuses an earlier name, so duplicate detection has work to do
+            if (i > 1 && rng.below(40) == 0) {
+                n.name = tree.nodes[rng.below(i)].name;
+                n.id = fnv1a32(name + "#dup");
+            } else {
+                n.name = name;
+            }
+            n.dep = i == 0 ? 0 : tree.nodes[pickParent(opt.shape, i, rng)].id;
+            n.spirit = spirit;
+            n.type = types[rng.below(sizeof(types) / sizeof(types[0]))];
+            n.costType = costTypes[rng.below(sizeof(costTypes) / sizeof(costTypes[0]))];
+            n.cost = (int)rng.below(120) + 1;
+            n.isAdventurePass = rng.below(10) == 0;
+        }
+    }
+    std::vector<const SpiritTree*> ptrs;
+    for (const auto& t : trees) ptrs.push_back(&t);
+    std::string json;
+    if (!SpiritTreeManager::writeNodesJson(ptrs, json)) return false;
+    std::ofstream file(path, std::ios::binary);
+    file.write(json.data(), (std::streamsize)json.size());
+    return (bool)file;
+}
+
+struct Result {
+    std::string name;
+    int iterations = 0;
+    double minMs = 0.0, medianMs = 0.0, meanMs = 0.0, maxMs = 0.0;
+    double allocsPerIter = 0.0;
+    uint64_t items = 0;   // units processed per iteration (nodes, spirits or steps)
+    std::string unit;
+};
+
+class Bench {
+public:
+    explicit Bench(const Options& opt) : m_opt(opt) {}
+
+    // setup runs untimed before every iteration; body is timed
+    void run(const std::string& name, uint64_t items, const std::string& unit,
+             const std::function<void()>& setup, const std::function<void()>& body) {
+        if (!m_opt.filter.empty() && name.find(m_opt.filter) == std::string::npos) return;
+        fprintf(stderr, "[Watercan] bench %s...\n", name.c_str());
+        std::vector<double> samples;
+        uint64_t allocs = 0;
+        for (int i = 0; i < m_opt.iterations; ++i) {
+            if (setup) setup();
+            uint64_t allocStart = FrameProfiler::allocationCount();
+            auto start = std::chrono::steady_clock::now();
+            body();
+            auto end = std::chrono::steady_clock::now();
+            allocs += FrameProfiler::allocationCount() - allocStart;
+            samples.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        }
+        Result r;
+        r.name = name;
+        r.iterations = (int)samples.size();
+        r.items = items;
+        r.unit = unit;
+        std::sort(samples.begin(), samples.end());
+        r.minMs = samples.front();
+        r.maxMs = samples.back();
+        r.medianMs = samples[samples.size() / 2];
+        double total = 0.0;
+        for (double v : samples) total += v;
+        r.meanMs = total / (double)samples.size();
+        r.allocsPerIter = (double)allocs / (double)samples.size();
+        m_results.push_back(r);
+    }
+
+    void print(const std::string& file, uint64_t fileBytes, size_t spirits, size_t nodes) const {
+        if (m_opt.format == "csv") {
+            printf("name,iterations,min_ms,median_ms,mean_ms,max_ms,allocs_per_iter,items,unit\n");
+            for (const auto& r : m_results) {
+                printf("%s,%d,%.4f,%.4f,%.4f,%.4f,%.1f,%llu,%s\n", r.name.c_str(), r.iterations, r.minMs, r.medianMs,
+                       r.meanMs, r.maxMs, r.allocsPerIter, (unsigned long long)r.items, r.unit.c_str());
+            }
+            return;
+        }
+        printf("{\n  \"watercan_version\": \"%s\",\n", WATERCAN_VERSION);
+        printf("  \"config\": {\"file\": \"%s\", \"file_bytes\": %llu, \"spirits\": %zu, \"total_nodes\": %zu, "
+               "\"shape\": \"%s\", \"seed\": %llu, \"iterations\": %d, \"counts_allocations\": %s},\n",
+               jsonEscape(file).c_str(), (unsigned long long)fileBytes, spirits, nodes,
+               m_opt.input.empty() ? m_opt.shape.c_str() : "input", (unsigned long long)m_opt.seed, m_opt.iterations,
+               FrameProfiler::countsAllocations() ? "true" : "false");
+        printf("  \"results\": [\n");
+        for (size_t i = 0; i < m_results.size(); ++i) {
+            const Result& r = m_results[i];
+            printf("    {\"name\": \"%s\", \"iterations\": %d, \"min_ms\": %.4f, \"median_ms\": %.4f, \"mean_ms\": %.4f, "
+                   "\"max_ms\": %.4f, \"allocs_per_iter\": %.1f, \"items\": %llu, \"unit\": \"%s\"}%s\n",
+                   r.name.c_str(), r.iterations, r.minMs, r.medianMs, r.meanMs, r.maxMs, r.allocsPerIter,
+                   (unsigned long long)r.items, r.unit.c_str(), i + 1 < m_results.size() ? "," : "");
+        }
+        printf("  ]\n}\n");
+    }
+
+private:
+    static std::string jsonEscape(const std::string& s) {
+        std::string out;
+        for (char c : s) {
+            if (c == '"' || c == '\\') out += '\\';
+            if ((unsigned char)c >= 0x20) out += c;
+        }
+        return out;
+    }
+
+    const Options& m_opt;
+    std::vector<Result> m_results;
+};
+
+std::vector<std::string> allSpirits(const SpiritTreeManager& manager) {
+    std::vector<std::string> names = manager.getSpiritNames();
+    const auto& guides = manager.getGuideNames();
+    names.insert(names.end(), guides.begin(), guides.end());
+    return names;
+}
+
+bool parseArgs(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&](std::string& out) {
+            if (i + 1 >= argc) return false;
+            out = argv[++i];
+            return true;
+        };
+        std::string v;
+        if (arg == "--help" || arg == "-h") return false;
+        if (!value(v)) {
+            fprintf(stderr, "[Watercan] missing value for %s\n", arg.c_str());
+            return false;
+        }
+        if (arg == "--spirits") opt.spirits = (size_t)std::strtoull(v.c_str(), nullptr, 10);
+        else if (arg == "--nodes") opt.nodes = (size_t)std::strtoull(v.c_str(), nullptr, 10);
+        else if (arg == "--shape") opt.shape = v;
+        else if (arg == "--iterations") opt.iterations = std::atoi(v.c_str());
+        else if (arg == "--seed") opt.seed = std::strtoull(v.c_str(), nullptr, 10);
+        else if (arg == "--input") opt.input = v;
+        else if (arg == "--keep") opt.keep = v;
+        else if (arg == "--format") opt.format = v;
+        else if (arg == "--filter") opt.filter = v;
+        else {
+            fprintf(stderr, "[Watercan] unknown option %s\n", arg.c_str());
+            return false;
+        }
+    }
+    if (opt.shape != "wide" && opt.shape != "deep" && opt.shape != "mixed") {
+        fprintf(stderr, "[Watercan] unknown shape '%s'\n", opt.shape.c_str());
+        return false;
+    }
+    if (opt.format != "json" && opt.format != "csv") {
+        fprintf(stderr, "[Watercan] unknown format '%s'\n", opt.format.c_str());
+        return false;
+    }
+    if (opt.iterations < 1 || opt.spirits < 1 || opt.nodes < 1) {
+        fprintf(stderr, "[Watercan] --spirits, --nodes and --iterations must be positive\n");
+        return false;
+    }
+    return true;
+}
+
+#ifdef WATERCAN_BENCH_RENDER
+void runRenderBenches(Bench& bench, const SpiritTree& tree) {
+    const int physicsSteps = 120;
+    TreeRenderer physicsRenderer;
+    bench.run("updatePhysics", (uint64_t)physicsSteps, "steps", nullptr, [&]() {
+        for (int i = 0; i < physicsSteps; ++i) physicsRenderer.updatePhysics(1.0f / 60.0f, &tree);
+    });
+
+    // Offscreen: no window or GL context, only ImGui draw-list generation
+    IMGUI_CHECKVERSION();
+    ImGui::CreateContext();
+    ImGuiIO& io = ImGui::GetIO();
+    io.IniFilename = nullptr;
+    io.DisplaySize = ImVec2(1920.0f, 1080.0f);
+    io.DeltaTime = 1.0f / 60.0f;
+    io.Fonts->AddFontDefault();
+    io.Fonts->Build();
+
+    TreeRenderer renderer;
+    size_t vertices = 0;
+    auto frame = [&]() {
+        ImGui::NewFrame();
+        ImGui::SetNextWindowPos(ImVec2(0.0f, 0.0f));
+        ImGui::SetNextWindowSize(io.DisplaySize);
+        ImGui::Begin("bench", nullptr, ImGuiWindowFlags_NoDecoration);
+        renderer.render(&tree);
+        ImGui::End();
+        ImGui::Render();
+        vertices = (size_t)ImGui::GetDrawData()->TotalVtxCount;
+    };
+    const float zooms[] = {1.0f, 0.3f};
+    const char* const names[] = {"TreeRenderer::render (full detail)", "TreeRenderer::render (overview)"};
+    const char* const panNames[] = {"TreeRenderer::render (full detail, panning)", "TreeRenderer::render (overview, panning)"};
+    for (int z = 0; z < 2; ++z) {
+        renderer.resetView();
+        renderer.setZoom(zooms[z]);
+        // Warm the label cache, as an interactive session would have
+        frame();
+        // A still view re-flushes the cached geometry; panning rebuilds it every frame
+        bench.run(names[z], (uint64_t)tree.nodes.size(), "nodes", nullptr, frame);
+        fprintf(stderr, "[Watercan]   %zu nodes drawn, %zu vertices\n", renderer.lastDrawStats().nodes, vertices);
+        int step = 0;
+        bench.run(panNames[z], (uint64_t)tree.nodes.size(), "nodes", nullptr, [&]() {
+            renderer.setPan(ImVec2((float)(++step & 1), 0.0f));
+            frame();
+        });
+    }
+    ImGui::DestroyContext();
+}
+#endif
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) {
+        printUsage();
+        return 2;
+    }
+
+    std::string path = opt.input;
+    bool removeAfter = false;
+    if (path.empty()) {
+        if (!opt.keep.empty()) {
+            path = opt.keep;
+        } else {
+            path = (std::filesystem::temp_directory_path() / ("watercan_bench_" + std::to_string(opt.seed) + ".json")).string();
+            removeAfter = true;
+        }
+        fprintf(stderr, "[Watercan] generating %zu %s spirits x %zu nodes into %s\n", opt.spirits, opt.shape.c_str(), opt.nodes, path.c_str());
+        if (!generateFile(opt, path)) {
+            fprintf(stderr, "[Watercan] cannot write '%s'\n", path.c_str());
+            return 2;
+        }
+    }
+    std::error_code ec;
+    uint64_t fileBytes = (uint64_t)std::filesystem::file_size(path, ec);
+
+    SpiritTreeManager reference;
+    if (!reference.loadFromFile(path)) {
+        fprintf(stderr, "[Watercan] cannot load '%s' (missing file or invalid JSON)\n", path.c_str());
+        return 2;
+    }
+    const std::vector<std::string> spirits = allSpirits(reference);
+    size_t totalNodes = 0;
+    std::string largest;
+    for (const auto& name : spirits) {
+        size_t count = reference.getNodeCount(name);
+        totalNodes += count;
+        if (largest.empty() || count > reference.getNodeCount(largest)) largest = name;
+    }
+
+    Bench bench(opt);
+    const std::string savePath = path + ".bench-save.json";
+    std::unique_ptr<SpiritTreeManager> manager;
+    auto freshLoad = [&]() {
+        manager = std::make_unique<SpiritTreeManager>();
+        manager->loadFromFile(path);
+    };
+    auto buildAll = [&]() {
+        for (const auto& name : spirits) manager->getTree(name);
+    };
+
+    bench.run("loadFromFile", totalNodes, "nodes", nullptr, [&]() {
+        SpiritTreeManager m;
+        m.loadFromFile(path);
+    });
+    bench.run("saveToFile", totalNodes, "nodes", nullptr, [&]() { reference.saveToFile(savePath); });
+    // Building a tree on first access links it and runs computeLayout
+    bench.run("buildTrees (computeLayout)", spirits.size(), "spirits", freshLoad, buildAll);
+    bench.run("reshapeTreeAndCollectShifts", spirits.size(), "spirits", [&]() {
+        if (!manager) freshLoad();
+        buildAll();
+    }, [&]() {
+        std::unordered_map<uint64_t, std::pair<float, float>> shifts;
+        for (const auto& name : spirits) manager->reshapeTreeAndCollectShifts(name, &shifts);
+    });
+    // First query after a load analyzes every node; later ones are served from the cache
+    bench.run("getDuplicateNodeIds (cold)", spirits.size(), "spirits", [&]() {
+        freshLoad();
+        buildAll();
+    }, [&]() {
+        for (const auto& name : spirits) manager->getDuplicateNodeIds(name);
+    });
+    bench.run("getDuplicateNodeIds (warm)", spirits.size(), "spirits", nullptr, [&]() {
+        for (const auto& name : spirits) manager->getDuplicateNodeIds(name);
+    });
+
+#ifdef WATERCAN_BENCH_RENDER
+    if (const SpiritTree* tree = reference.getTree(largest)) runRenderBenches(bench, *tree);
+#else
+    fprintf(stderr, "[Watercan] physics and render benchmarks need the GUI build (WATERCAN_BUILD_GUI)\n");
+#endif
+
+    std::filesystem::remove(savePath, ec);
+    if (removeAfter) std::filesystem::remove(path, ec);
+    bench.print(opt.input.empty() ? "generated" : opt.input, fileBytes, spirits.size(), totalNodes);
+    return 0;
+}
@@ -0,0 +1,235 @@
+#include "spirit_tree.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// watercan-cli: headless front end to SpiritTreeManager for batch pipelines (no window,
+// GL context or ImGui). Spirits are validated in parallel; output is in file order.
+
+using namespace Watercan;
+
+namespace {
+
+void printUsage() {
+    fprintf(stderr,
+        "usage: watercan-cli <command> [args]\n"
+        "  validate <file> [--threads N]   check every spirit; exit status 1 if problems were found\n"
+        "  list <file>                     spirit names, node counts and classification\n"
+        "  extract <file> <spirit> <out>   write one spirit's nodes as a JSON array ('-' = stdout)\n"
+        "  convert <file> <out>            re-serialize the whole file ('-' = stdout)\n");
+}
+
+// All spirit names in list order (regular spirits, then guides)
+std::vector<std::string> allSpirits(const SpiritTreeManager& manager) {
+    std::vector<std::string> names = manager.getSpiritNames();
+    const auto& guides = manager.getGuideNames();
+    names.insert(names.end(), guides.begin(), guides.end());
+    return names;
+}
+
+bool loadOrReport(SpiritTreeManager& manager, const std::string& path) {
+    if (manager.loadFromFile(path)) return true;
+    fprintf(stderr, "[Watercan] cannot load '%s' (missing file or invalid JSON)\n", path.c_str());
+    return false;
+}
+
+bool writeOutput(const std::string& path, const std::string& data) {
+    if (path == "-") {
+        return fwrite(data.data(), 1, data.size(), stdout) == data.size();
+    }
+    // Text mode, like the editor's saves
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        fprintf(stderr, "[Watercan] cannot open '%s' for writing\n", path.c_str());
+        return false;
+    }
+    file.write(data.data(), (std::streamsize)data.size());
+    file.flush();
+    if (!file) {
+        fprintf(stderr, "[Watercan] write to '%s' failed\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+struct SpiritReport {
+    bool isGuide = false;
+    bool isTravelling = false;
+    size_t problems = 0;
+    std::vector<std::string> lines;   // one per problem, ready to print
+};
+
+SpiritReport validateSpirit(const std::string& spiritName, const std::vector<SpiritNode>& nodes) {
+    SpiritReport report;
+    const SpiritTreeManager::SpiritAnalysis analysis = SpiritTreeManager::analyzeNodes(spiritName, nodes);
+    report.isGuide = analysis.isGuide;
+    report.isTravelling = analysis.isTravelling;
+
+    std::unordered_map<uint64_t, const SpiritNode*> byId;
+    std::unordered_map<uint64_t, uint32_t> idCounts;
+    byId.reserve(nodes.size());
+    for (const auto& n : nodes) {
+        byId.emplace(n.id, &n);
+        ++idCounts[n.id];
+    }
+    auto nameOf = [&](uint64_t id) -> std::string {
+        auto it = byId.find(id);
+        return it != byId.end() ? it->second->name.str() : std::string();
+    };
+    char buf[512];
+
+    // Duplicate names, grouped by name
+    std::unordered_map<std::string, std::vector<uint64_t>> dupGroups;
+    for (uint64_t id : analysis.duplicateIds) dupGroups[nameOf(id)].push_back(id);
+    std::vector<std::string> dupNames;
+    for (const auto& kv : dupGroups) dupNames.push_back(kv.first);
+    std::sort(dupNames.begin(), dupNames.end());
+    for (const auto& name : dupNames) {
+        auto ids = dupGroups[name];
+        std::sort(ids.begin(), ids.end());
+        std::string line = "duplicate name '" + name + "' on ids";
+        for (size_t i = 0; i < ids.size(); ++i) line += (i ? ", " : " ") + std::to_string(ids[i]);
+        report.lines.push_back(std::move(line));
+        ++report.problems;
+    }
+
+    std::vector<uint64_t> mismatched(analysis.mismatchedIds.begin(), analysis.mismatchedIds.end());
+    std::sort(mismatched.begin(), mismatched.end());
+    for (uint64_t id : mismatched) {
+        std::string name = nameOf(id);
+        snprintf(buf, sizeof(buf), "id %llu does not match name '%s' (fnv1a32 = %u)",
+                 (unsigned long long)id, name.c_str(), fnv1a32(name));
+        report.lines.push_back(buf);
+        ++report.problems;
+    }
+
+    std::vector<uint64_t> shared;
+    for (const auto& kv : idCounts) {
+        if (kv.second > 1) shared.push_back(kv.first);
+    }
+    std::sort(shared.begin(), shared.end());
+    for (uint64_t id : shared) {
+        snprintf(buf, sizeof(buf), "id %llu is used by %u nodes", (unsigned long long)id, idCounts[id]);
+        report.lines.push_back(buf);
+        ++report.problems;
+    }
+
+    for (const auto& n : nodes) {
+        if (n.dep == 0 || byId.count(n.dep)) continue;
+        snprintf(buf, sizeof(buf), "node %llu ('%s') depends on missing node %llu",
+                 (unsigned long long)n.id, n.name.c_str(), (unsigned long long)n.dep);
+        report.lines.push_back(buf);
+        ++report.problems;
+    }
+    return report;
+}
+
+int cmdValidate(const std::string& path, unsigned threads) {
+    SpiritTreeManager manager;
+    if (!loadOrReport(manager, path)) return 2;
+    const std::vector<std::string> names = allSpirits(manager);
+
+    // Spirits are independent: workers take the next unclaimed one until none are left
+    std::vector<SpiritReport> reports(names.size());
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i = next++; i < names.size(); i = next++) {
+            reports[i] = validateSpirit(names[i], manager.getSpiritNodes(names[i]));
+        }
+    };
+    threads = std::max(1u, std::min<unsigned>(threads, (unsigned)std::max<size_t>(1, names.size())));
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+
+    size_t nodes = 0, problems = 0, guides = 0, travelling = 0;
+    for (size_t i = 0; i < names.size(); ++i) {
+        const SpiritReport& r = reports[i];
+        nodes += manager.getNodeCount(names[i]);
+        problems += r.problems;
+        if (r.isGuide) ++guides;
+        if (r.isTravelling) ++travelling;
+        if (r.lines.empty()) continue;
+        printf("%s:\n", names[i].c_str());
+        for (const auto& line : r.lines) printf("  %s\n", line.c_str());
+    }
+    printf("%zu spirits (%zu guides, %zu travelling), %zu nodes, %zu problem%s\n",
+           names.size(), guides, travelling, nodes, problems, problems == 1 ? "" : "s");
+    return problems > 0 ? 1 : 0;
+}
+
+int cmdList(const std::string& path) {
+    SpiritTreeManager manager;
+    if (!loadOrReport(manager, path)) return 2;
+    for (const auto& name : allSpirits(manager)) {
+        const char* kind = manager.isGuide(name) ? "guide"
+                         : manager.isTravellingSpirit(name) ? "travelling" : "spirit";
+        printf("%s\t%zu\t%s\n", name.c_str(), manager.getNodeCount(name), kind);
+    }
+    return 0;
+}
+
+int cmdExtract(const std::string& path, const std::string& spiritName, const std::string& outPath) {
+    SpiritTreeManager manager;
+    if (!loadOrReport(manager, path)) return 2;
+    const SpiritTree* tree = manager.getTree(spiritName);
+    if (!tree) {
+        fprintf(stderr, "[Watercan] no spirit named '%s' in '%s'\n", spiritName.c_str(), path.c_str());
+        return 2;
+    }
+    std::string data;
+    if (!SpiritTreeManager::writeNodesJson({tree}, data)) {
+        fprintf(stderr, "[Watercan] node data is not valid UTF-8\n");
+        return 2;
+    }
+    return writeOutput(outPath, data) ? 0 : 2;
+}
+
+int cmdConvert(const std::string& path, const std::string& outPath) {
+    SpiritTreeManager manager;
+    if (!loadOrReport(manager, path)) return 2;
+    std::string data;
+    if (!manager.writeJson(data)) {
+        fprintf(stderr, "[Watercan] node data is not valid UTF-8\n");
+        return 2;
+    }
+    return writeOutput(outPath, data) ? 0 : 2;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        printUsage();
+        return 2;
+    }
+    const std::string command = argv[1];
+    const std::string path = argv[2];
+
+    if (command == "validate") {
+        unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+        for (int i = 3; i < argc; ++i) {
+            if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+                threads = (unsigned)std::max(1, std::atoi(argv[++i]));
+            } else {
+                printUsage();
+                return 2;
+            }
+        }
+        return cmdValidate(path, threads);
+    }
+    if (command == "list" && argc == 3) return cmdList(path);
+    if (command == "extract" && argc == 5) return cmdExtract(path, argv[3], argv[4]);
+    if (command == "convert" && argc == 4) return cmdConvert(path, argv[3]);
+
+    printUsage();
+    return 2;
+}
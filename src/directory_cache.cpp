@@ -0,0 +1,151 @@
+#include "directory_cache.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+namespace Watercan {
+
+namespace {
+
+bool lessNoCase(const DirectoryEntryInfo& a, const DirectoryEntryInfo& b) {
+    return strcasecmp(a.name.c_str(), b.name.c_str()) < 0;
+}
+
+const DirectoryEntryInfo* findByName(const std::vector<DirectoryEntryInfo>& entries, const std::string& name) {
+    for (const auto& e : entries) {
+        if (e.name == name) return &e;
+    }
+    return nullptr;
+}
+
+} // namespace
+
+const DirectoryEntryInfo* DirectoryListing::findDir(const std::string& name) const {
+    return findByName(dirs, name);
+}
+
+const DirectoryEntryInfo* DirectoryListing::findFile(const std::string& name) const {
+    return findByName(files, name);
+}
+
+DirectoryCache::~DirectoryCache() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable()) m_thread.join();
+}
+
+void DirectoryCache::setWakeCallback(std::function<void()> cb) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_wake = std::move(cb);
+}
+
+const DirectoryListing* DirectoryCache::get(const std::string& path) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    takeIncomingLocked();
+    auto now = std::chrono::steady_clock::now();
+    bool current = m_valid && m_listing.path == path;
+    bool pending = (m_hasRequest && m_requestedPath == path) || (m_loading && m_inFlightPath == path);
+    if ((!current || now - m_listedAt >= REFRESH_INTERVAL) && !pending) requestLocked(path);
+    if (current) return &m_listing;
+
+    // New path: give the worker a moment so quick listings appear in this very frame
+    m_doneCv.wait_for(lock, FIRST_LISTING_WAIT, [&] { return m_hasIncoming && m_incoming.path == path; });
+    takeIncomingLocked();
+    return (m_valid && m_listing.path == path) ? &m_listing : nullptr;
+}
+
+void DirectoryCache::invalidate() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Keep serving the old listing until the re-read lands, so the dialog never flickers
+    m_listedAt = std::chrono::steady_clock::time_point();
+}
+
+bool DirectoryCache::isLoading() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_loading || m_hasRequest;
+}
+
+void DirectoryCache::requestLocked(const std::string& path) {
+    m_requestedPath = path;
+    m_hasRequest = true;
+    if (!m_thread.joinable()) m_thread = std::thread(&DirectoryCache::workerLoop, this);
+    m_cv.notify_one();
+}
+
+void DirectoryCache::takeIncomingLocked() {
+    if (!m_hasIncoming) return;
+    m_listing = std::move(m_incoming);
+    m_incoming = DirectoryListing();
+    m_hasIncoming = false;
+    m_valid = true;
+    m_listedAt = std::chrono::steady_clock::now();
+}
+
+void DirectoryCache::workerLoop() {
+    for (;;) {
+        std::string path;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_stop || m_hasRequest; });
+            if (m_stop) return;
+            path = std::move(m_requestedPath);
+            m_hasRequest = false;
+            m_inFlightPath = path;
+            m_loading = true;
+        }
+
+        DirectoryListing listing = readDirectory(path);
+
+        std::function<void()> wake;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_incoming = std::move(listing);
+            m_hasIncoming = true;
+            m_loading = false;
+            m_inFlightPath.clear();
+            wake = m_wake;
+        }
+        m_doneCv.notify_all();
+        if (wake) wake();
+    }
+}
+
+DirectoryListing DirectoryCache::readDirectory(const std::string& path) {
+    namespace fs = std::filesystem;
+    DirectoryListing listing;
+    listing.path = path;
+    try {
+        for (const auto& entry : fs::directory_iterator(path)) {
+            try {
+                bool isDir = entry.is_directory();
+                if (!isDir && entry.path().extension() != ".json") continue;
+                DirectoryEntryInfo info;
+                info.name = entry.path().filename().string();
+                std::error_code ec;
+                auto ftime = entry.last_write_time(ec);
+                if (!ec) {
+                    auto sctp = std::chrono::time_point_cast<std::chrono::system_clock::duration>(
+                        ftime - decltype(ftime)::clock::now() + std::chrono::system_clock::now());
+                    info.modified = std::chrono::system_clock::to_time_t(sctp);
+                    info.hasModified = true;
+                }
+                (isDir ? listing.dirs : listing.files).push_back(std::move(info));
+            } catch (...) {
+                // ignore entries we can't stat
+            }
+        }
+        listing.ok = true;
+    } catch (...) {
+        listing.ok = false;
+        listing.dirs.clear();
+        listing.files.clear();
+    }
+    std::sort(listing.dirs.begin(), listing.dirs.end(), lessNoCase);
+    std::sort(listing.files.begin(), listing.files.end(), lessNoCase);
+    return listing;
+}
+
+} // namespace Watercan
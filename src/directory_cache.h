@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Watercan {
+
+// One entry of a cached directory listing, with the stat info the file dialogs display
+struct DirectoryEntryInfo {
+    std::string name;
+    std::time_t modified = 0;
+    bool hasModified = false;
+};
+
+// Sorted (case-insensitive) listing of a directory: sub-directories and .json files
+struct DirectoryListing {
+    std::string path;
+    bool ok = false;                      // false when the directory could not be read
+    std::vector<DirectoryEntryInfo> dirs;
+    std::vector<DirectoryEntryInfo> files;
+
+    const DirectoryEntryInfo* findDir(const std::string& name) const;
+    const DirectoryEntryInfo* findFile(const std::string& name) const;
+};
+
+// Directory listings for the internal open/save dialogs, read on a background thread so
+// slow or huge directories never stall a frame. A listing is re-read when the requested
+// path changes, when invalidate() is called (e.g. after a save) and periodically while the
+// dialog keeps asking for it, so external changes show up without a notification API.
+class DirectoryCache {
+public:
+    DirectoryCache() = default;
+    ~DirectoryCache();
+
+    DirectoryCache(const DirectoryCache&) = delete;
+    DirectoryCache& operator=(const DirectoryCache&) = delete;
+
+    // Called from the worker when a listing finished loading (e.g. to wake an idle UI loop)
+    void setWakeCallback(std::function<void()> cb);
+
+    // Return the cached listing for path, scheduling a background refresh if it is missing,
+    // invalidated or older than the refresh interval. When the path just changed this waits
+    // briefly for the first listing so fast local directories never flash a loading state.
+    // Returns nullptr while the first listing of path is still loading.
+    const DirectoryListing* get(const std::string& path);
+
+    // Mark the cached listing stale so the next get() re-reads it
+    void invalidate();
+
+    // True while the worker is reading a directory
+    bool isLoading() const;
+
+private:
+    void workerLoop();
+    // Ask the worker to read path (caller holds m_mutex)
+    void requestLocked(const std::string& path);
+    // Move a finished listing into m_listing (caller holds m_mutex)
+    void takeIncomingLocked();
+    static DirectoryListing readDirectory(const std::string& path);
+
+    static constexpr std::chrono::milliseconds FIRST_LISTING_WAIT{30};
+    static constexpr std::chrono::seconds REFRESH_INTERVAL{2};
+
+    std::thread m_thread;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;        // wakes the worker
+    std::condition_variable m_doneCv;    // signals a finished listing
+    std::string m_requestedPath;         // path the worker should read next (if m_hasRequest)
+    bool m_hasRequest = false;
+    std::string m_inFlightPath;          // path the worker is reading right now
+    bool m_loading = false;
+    bool m_stop = false;
+    std::function<void()> m_wake;
+
+    DirectoryListing m_listing;          // most recent finished listing (UI-facing copy)
+    DirectoryListing m_incoming;         // finished by the worker, not yet picked up by get()
+    bool m_hasIncoming = false;
+    bool m_valid = false;                // m_listing may be served for its path
+    std::chrono::steady_clock::time_point m_listedAt;
+};
+
+} // namespace Watercan
@@ -0,0 +1,267 @@
+#include "frame_profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace {
+
+// Heap allocations made by any thread since startup; relaxed, read once per frame
+std::atomic<uint64_t> s_allocCount{0};
+std::atomic<uint64_t> s_allocBytes{0};
+
+float percentile(std::vector<float>& samples, float q) {
+    if (samples.empty()) return 0.0f;
+    size_t k = (size_t)std::ceil(q * (float)samples.size());
+    k = k > 0 ? k - 1 : 0;
+    std::nth_element(samples.begin(), samples.begin() + (ptrdiff_t)k, samples.end());
+    return samples[k];
+}
+
+void writeJsonString(FILE* f, const char* s) {
+    fputc('"', f);
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\') fputc('\\', f);
+        if ((unsigned char)*s >= 0x20) fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+} // namespace
+
+#ifdef WATERCAN_COUNT_ALLOCATIONS
+// Replacing the global allocation functions is the only way to see every allocation (ImGui,
+// nlohmann::json, std containers) without touching call sites. The aligned overloads are
+// left to the runtime; nothing in the editor over-aligns.
+static void* countedNew(std::size_t size) {
+    if (size == 0) size = 1;
+    for (;;) {
+        if (void* p = std::malloc(size)) {
+            s_allocCount.fetch_add(1, std::memory_order_relaxed);
+            s_allocBytes.fetch_add(size, std::memory_order_relaxed);
+            return p;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) throw std::bad_alloc();
+        handler();
+    }
+}
+
+void* operator new(std::size_t size) { return countedNew(size); }
+void* operator new[](std::size_t size) { return countedNew(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try { return countedNew(size); } catch (...) { return nullptr; }
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    try { return countedNew(size); } catch (...) { return nullptr; }
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+#endif
+
+namespace Watercan {
+
+FrameProfiler& FrameProfiler::instance() {
+    static FrameProfiler profiler;
+    return profiler;
+}
+
+FrameProfiler::FrameProfiler() : m_epoch(std::chrono::steady_clock::now()), m_frames(HISTORY_FRAMES) {}
+
+bool FrameProfiler::countsAllocations() {
+#ifdef WATERCAN_COUNT_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+uint64_t FrameProfiler::allocationCount() { return s_allocCount.load(std::memory_order_relaxed); }
+
+uint64_t FrameProfiler::allocatedBytes() { return s_allocBytes.load(std::memory_order_relaxed); }
+
+void FrameProfiler::setEnabled(bool enabled) {
+    if (enabled == m_enabled) return;
+    m_enabled = enabled;
+    m_inFrame = false;
+    // History restarts so statistics and traces never span a gap
+    if (enabled) m_frameCount = 0;
+}
+
+int FrameProfiler::registerScope(const char* name) {
+    for (size_t i = 0; i < m_scopeNames.size(); ++i) {
+        if (std::strcmp(m_scopeNames[i], name) == 0) return (int)i;
+    }
+    m_scopeNames.push_back(name);
+    return (int)m_scopeNames.size() - 1;
+}
+
+int FrameProfiler::registerCounter(const char* name) {
+    for (size_t i = 0; i < m_counterNames.size(); ++i) {
+        if (std::strcmp(m_counterNames[i], name) == 0) return (int)i;
+    }
+    if (m_counterNames.size() >= (size_t)MAX_COUNTERS) return -1;
+    m_counterNames.push_back(name);
+    return (int)m_counterNames.size() - 1;
+}
+
+int64_t FrameProfiler::nowMicros() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_epoch).count();
+}
+
+void FrameProfiler::beginFrame() {
+    if (!m_enabled) return;
+    m_thread = std::this_thread::get_id();
+    m_inFrame = true;
+    Frame& f = m_frames[(size_t)m_current];
+    // Keeps its capacity: after the first pass around the ring recording does not allocate
+    f.events.clear();
+    f.startUs = nowMicros();
+    m_frameAllocStart = s_allocCount.load(std::memory_order_relaxed);
+    m_frameBytesStart = s_allocBytes.load(std::memory_order_relaxed);
+}
+
+void FrameProfiler::endFrame() {
+    if (!m_inFrame) return;
+    m_inFrame = false;
+    Frame& f = m_frames[(size_t)m_current];
+    f.durUs = nowMicros() - f.startUs;
+    f.allocs = s_allocCount.load(std::memory_order_relaxed) - m_frameAllocStart;
+    f.allocBytes = s_allocBytes.load(std::memory_order_relaxed) - m_frameBytesStart;
+    f.counters = m_counterValues;
+    f.counterMask = m_counterMask;
+    m_current = (m_current + 1) % HISTORY_FRAMES;
+    m_frameCount = std::min(m_frameCount + 1, HISTORY_FRAMES);
+}
+
+void FrameProfiler::recordScope(int id, int64_t startUs, int64_t endUs) {
+    if (!m_inFrame || id < 0 || std::this_thread::get_id() != m_thread) return;
+    m_frames[(size_t)m_current].events.push_back({id, startUs, endUs - startUs});
+}
+
+void FrameProfiler::setCounter(int id, int64_t value) {
+    if (id < 0 || id >= MAX_COUNTERS) return;
+    m_counterValues[(size_t)id] = value;
+    m_counterMask |= 1u << id;
+}
+
+const FrameProfiler::Frame* FrameProfiler::frameAt(int age) const {
+    if (age < 0 || age >= m_frameCount) return nullptr;
+    return &m_frames[(size_t)((m_current - 1 - age + 2 * HISTORY_FRAMES) % HISTORY_FRAMES)];
+}
+
+void FrameProfiler::computeStats(FrameStats& frame, std::vector<ScopeStats>& scopes) {
+    frame = FrameStats();
+    scopes.clear();
+    const size_t scopeCount = m_scopeNames.size();
+    if (m_scopeSamples.size() < scopeCount) m_scopeSamples.resize(scopeCount);
+    for (auto& s : m_scopeSamples) s.clear();
+    m_scopeCalls.assign(scopeCount, 0);
+
+    // Per-frame totals of each scope (nested scopes are inclusive)
+    std::vector<float>& sums = m_scopeSums;
+    std::vector<float>& frameMs = m_frameMs;
+    frameMs.clear();
+    uint64_t allocTotal = 0;
+    for (int age = 0; age < m_frameCount; ++age) {
+        const Frame* f = frameAt(age);
+        frameMs.push_back((float)f->durUs / 1000.0f);
+        allocTotal += f->allocs;
+        sums.assign(scopeCount, -1.0f);
+        for (const Event& e : f->events) {
+            if ((size_t)e.scope >= scopeCount) continue;
+            float& s = sums[(size_t)e.scope];
+            s = std::max(s, 0.0f) + (float)e.durUs / 1000.0f;
+            ++m_scopeCalls[(size_t)e.scope];
+        }
+        for (size_t i = 0; i < scopeCount; ++i) {
+            if (sums[i] >= 0.0f) m_scopeSamples[i].push_back(sums[i]);
+        }
+    }
+
+    if (m_frameCount > 0) {
+        const Frame* last = frameAt(0);
+        frame.lastAllocs = last->allocs;
+        frame.lastAllocBytes = last->allocBytes;
+        frame.avgAllocs = (float)allocTotal / (float)m_frameCount;
+        float total = 0.0f;
+        for (float v : frameMs) {
+            total += v;
+            frame.maxMs = std::max(frame.maxMs, v);
+        }
+        frame.avgMs = total / (float)frameMs.size();
+        frame.p99Ms = percentile(frameMs, 0.99f);
+    }
+
+    for (size_t i = 0; i < scopeCount; ++i) {
+        std::vector<float>& samples = m_scopeSamples[i];
+        if (samples.empty()) continue;
+        ScopeStats s;
+        s.name = m_scopeNames[i];
+        float total = 0.0f;
+        for (float v : samples) {
+            total += v;
+            s.maxMs = std::max(s.maxMs, v);
+        }
+        s.avgMs = total / (float)samples.size();
+        s.callsPerFrame = (float)m_scopeCalls[i] / (float)samples.size();
+        s.p99Ms = percentile(samples, 0.99f);
+        scopes.push_back(s);
+    }
+}
+
+void FrameProfiler::frameTimes(std::vector<float>& out) const {
+    out.clear();
+    for (int age = m_frameCount - 1; age >= 0; --age) out.push_back((float)frameAt(age)->durUs / 1000.0f);
+}
+
+void FrameProfiler::counters(std::vector<std::pair<const char*, int64_t>>& out) const {
+    out.clear();
+    for (size_t i = 0; i < m_counterNames.size(); ++i) {
+        if (m_counterMask & (1u << i)) out.emplace_back(m_counterNames[i], m_counterValues[i]);
+    }
+}
+
+bool FrameProfiler::writeChromeTrace(const std::string& path) const {
+    FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) {
+        fprintf(stderr, "[Watercan] cannot write trace '%s'\n", path.c_str());
+        return false;
+    }
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+    fputs("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"UI\"}}", f);
+    for (int age = m_frameCount - 1; age >= 0; --age) {
+        const Frame* fr = frameAt(age);
+        fprintf(f, ",\n{\"name\":\"frame\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%lld,\"dur\":%lld,"
+                   "\"args\":{\"allocations\":%llu,\"allocated_bytes\":%llu}}",
+                (long long)fr->startUs, (long long)fr->durUs, (unsigned long long)fr->allocs,
+                (unsigned long long)fr->allocBytes);
+        for (const Event& e : fr->events) {
+            fputs(",\n{\"name\":", f);
+            writeJsonString(f, m_scopeNames[(size_t)e.scope]);
+            fprintf(f, ",\"cat\":\"scope\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%lld,\"dur\":%lld}",
+                    (long long)e.startUs, (long long)e.durUs);
+        }
+        for (size_t i = 0; i < m_counterNames.size(); ++i) {
+            if (!(fr->counterMask & (1u << i))) continue;
+            fputs(",\n{\"name\":", f);
+            writeJsonString(f, m_counterNames[i]);
+            fprintf(f, ",\"ph\":\"C\",\"pid\":1,\"ts\":%lld,\"args\":{\"value\":%lld}}",
+                    (long long)fr->startUs, (long long)fr->counters[i]);
+        }
+    }
+    fputs("\n]}\n", f);
+    bool ok = std::ferror(f) == 0;
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok) fprintf(stderr, "[Watercan] failed writing trace '%s'\n", path.c_str());
+    return ok;
+}
+
+} // namespace Watercan
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Watercan {
+
+// Process-wide profiler for the UI thread. Scopes (WATERCAN_PROFILE_SCOPE) record their
+// start and duration into the current frame; the last HISTORY_FRAMES frames are kept for the
+// overlay statistics and the Chrome trace dump. While disabled a scope costs one branch.
+// Only the thread that called beginFrame() records; scopes on other threads are ignored.
+class FrameProfiler {
+public:
+    static constexpr int HISTORY_FRAMES = 240;
+    static constexpr int MAX_COUNTERS = 16;
+
+    static FrameProfiler& instance();
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return m_enabled; }
+
+    // Names must outlive the profiler (string literals); the same name returns the same id
+    int registerScope(const char* name);
+    int registerCounter(const char* name);
+
+    // Bracket one iteration of the main loop (excluding time spent asleep waiting for events)
+    void beginFrame();
+    void endFrame();
+
+    int64_t nowMicros() const;
+    void recordScope(int id, int64_t startUs, int64_t endUs);
+    // Value shown for this frame (e.g. nodes drawn); counters keep their last value
+    void setCounter(int id, int64_t value);
+
+    struct ScopeStats {
+        const char* name = nullptr;
+        float avgMs = 0.0f;      // per frame the scope ran in (all calls summed)
+        float p99Ms = 0.0f;
+        float maxMs = 0.0f;
+        float callsPerFrame = 0.0f;
+    };
+    struct FrameStats {
+        float avgMs = 0.0f;
+        float p99Ms = 0.0f;
+        float maxMs = 0.0f;
+        float avgAllocs = 0.0f;      // heap allocations per frame (all threads)
+        uint64_t lastAllocs = 0;
+        uint64_t lastAllocBytes = 0;
+    };
+    // Statistics over the retained frames; scopes in registration order, unused ones skipped
+    void computeStats(FrameStats& frame, std::vector<ScopeStats>& scopes);
+    // Frame times in ms, oldest first
+    void frameTimes(std::vector<float>& out) const;
+    // Latest value of every counter set at least once
+    void counters(std::vector<std::pair<const char*, int64_t>>& out) const;
+    int frameCount() const { return m_frameCount; }
+
+    // Write the retained frames as Chrome trace JSON (chrome://tracing, Perfetto)
+    bool writeChromeTrace(const std::string& path) const;
+
+    // True when heap allocations are being counted (WATERCAN_COUNT_ALLOCATIONS)
+    static bool countsAllocations();
+    // Heap allocations and bytes requested so far by all threads (0 unless counting)
+    static uint64_t allocationCount();
+    static uint64_t allocatedBytes();
+
+private:
+    FrameProfiler();
+
+    struct Event {
+        int scope;
+        int64_t startUs;
+        int64_t durUs;
+    };
+    struct Frame {
+        int64_t startUs = 0;
+        int64_t durUs = 0;
+        uint64_t allocs = 0;
+        uint64_t allocBytes = 0;
+        std::vector<Event> events;
+        std::array<int64_t, MAX_COUNTERS> counters{};
+        uint32_t counterMask = 0;
+    };
+
+    const Frame* frameAt(int age) const; // 0 = newest finished frame
+
+    std::chrono::steady_clock::time_point m_epoch;
+    std::thread::id m_thread;
+    bool m_enabled = false;
+    bool m_inFrame = false;
+
+    std::vector<const char*> m_scopeNames;
+    std::vector<const char*> m_counterNames;
+    std::array<int64_t, MAX_COUNTERS> m_counterValues{};
+    uint32_t m_counterMask = 0;
+
+    std::vector<Frame> m_frames; // ring of HISTORY_FRAMES
+    int m_current = 0;           // slot of the frame being recorded
+    int m_frameCount = 0;        // finished frames retained (<= HISTORY_FRAMES)
+    uint64_t m_frameAllocStart = 0;
+    uint64_t m_frameBytesStart = 0;
+
+    // Scratch for computeStats, reused so the overlay itself does not allocate per frame
+    std::vector<float> m_frameMs;
+    std::vector<float> m_scopeSums;
+    std::vector<std::vector<float>> m_scopeSamples;
+    std::vector<uint32_t> m_scopeCalls;
+};
+
+// Times its enclosing block (or until end()) as the given scope
+class ProfileScope {
+public:
+    explicit ProfileScope(int id) : m_id(id) {
+        FrameProfiler& p = FrameProfiler::instance();
+        if (p.isEnabled()) m_start = p.nowMicros();
+    }
+    ~ProfileScope() { end(); }
+    void end() {
+        if (m_start < 0) return;
+        FrameProfiler& p = FrameProfiler::instance();
+        p.recordScope(m_id, m_start, p.nowMicros());
+        m_start = -1;
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    int m_id;
+    int64_t m_start = -1;
+};
+
+} // namespace Watercan
+
+// Declares a ProfileScope named var timing the rest of the block under a literal name
+#define WATERCAN_PROFILE_SCOPE(var, name) \
+    static const int var##_profileId = ::Watercan::FrameProfiler::instance().registerScope(name); \
+    ::Watercan::ProfileScope var(var##_profileId)
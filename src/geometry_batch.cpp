@@ -0,0 +1,244 @@
+#include "geometry_batch.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace Watercan {
+
+namespace {
+
+// Width of the anti-aliasing fringe in pixels (ImDrawList::_FringeScale at 100% scale)
+constexpr float AA_SIZE = 1.0f;
+// Same default as ImGuiStyle::CircleTessellationMaxError
+constexpr float CIRCLE_MAX_ERROR = 0.30f;
+constexpr int CIRCLE_LODS[] = {8, 12, 16, 24, 32, 48, 64, 96, 128};
+constexpr int CIRCLE_LOD_COUNT = (int)(sizeof(CIRCLE_LODS) / sizeof(CIRCLE_LODS[0]));
+
+struct UnitCircles {
+    std::array<std::vector<ImVec2>, CIRCLE_LOD_COUNT> points;
+    UnitCircles() {
+        for (int lod = 0; lod < CIRCLE_LOD_COUNT; ++lod) {
+            const int n = CIRCLE_LODS[lod];
+            points[(size_t)lod].resize((size_t)n);
+            // Clockwise on screen (y down), like ImDrawList::PathArcTo from 0 to 2*pi, so
+            // the edge normals below point outward
+            for (int i = 0; i < n; ++i) {
+                float a = (float)i / (float)n * 6.28318530718f;
+                points[(size_t)lod][(size_t)i] = ImVec2(cosf(a), sinf(a));
+            }
+        }
+    }
+};
+
+const UnitCircles& unitCircles() {
+    static const UnitCircles circles;
+    return circles;
+}
+
+inline ImVec2 edgeNormal(ImVec2 a, ImVec2 b) {
+    float dx = b.x - a.x, dy = b.y - a.y;
+    float d2 = dx * dx + dy * dy;
+    if (d2 > 0.0f) {
+        float inv = 1.0f / sqrtf(d2);
+        dx *= inv;
+        dy *= inv;
+    }
+    return ImVec2(dy, -dx);
+}
+
+// Average of two unit edge normals, lengthened so joins keep the stroke width (ImGui's
+// IM_FIXNORMAL2F, capped for near-reversing edges)
+inline ImVec2 joinNormal(ImVec2 n0, ImVec2 n1) {
+    float x = (n0.x + n1.x) * 0.5f, y = (n0.y + n1.y) * 0.5f;
+    float d2 = x * x + y * y;
+    if (d2 > 0.000001f) {
+        float inv = std::min(1.0f / d2, 100.0f);
+        x *= inv;
+        y *= inv;
+    }
+    return ImVec2(x, y);
+}
+
+} // namespace
+
+int GeometryBatch::circleSegments(float radius) {
+    if (radius <= CIRCLE_MAX_ERROR) return CIRCLE_LODS[0];
+    float needed = 3.14159265359f / acosf(1.0f - CIRCLE_MAX_ERROR / radius);
+    for (int lod = 0; lod < CIRCLE_LOD_COUNT; ++lod) {
+        if ((float)CIRCLE_LODS[lod] >= needed) return CIRCLE_LODS[lod];
+    }
+    return CIRCLE_LODS[CIRCLE_LOD_COUNT - 1];
+}
+
+const ImVec2* GeometryBatch::unitCircle(float radius, int& count) {
+    const int segments = circleSegments(radius);
+    const UnitCircles& circles = unitCircles();
+    for (int lod = 0; lod < CIRCLE_LOD_COUNT; ++lod) {
+        if (CIRCLE_LODS[lod] == segments) {
+            count = segments;
+            return circles.points[(size_t)lod].data();
+        }
+    }
+    count = CIRCLE_LODS[0];
+    return circles.points[0].data();
+}
+
+void GeometryBatch::clear() {
+    m_vtx.clear();
+    m_idx.clear();
+    m_blocks.clear();
+}
+
+uint32_t GeometryBatch::reserve(size_t vtxCount) {
+    if (m_blocks.empty() || m_vtx.size() - m_blocks.back().firstVtx + vtxCount > MAX_BLOCK_VERTICES) {
+        Block block;
+        block.firstVtx = m_vtx.size();
+        block.firstIdx = m_idx.size();
+        m_blocks.push_back(block);
+    }
+    uint32_t first = (uint32_t)(m_vtx.size() - m_blocks.back().firstVtx);
+    m_vtx.resize(m_vtx.size() + vtxCount);
+    return first;
+}
+
+void GeometryBatch::fillConvex(const ImVec2* points, int count, ImU32 col) {
+    if (count < 3 || (col & IM_COL32_A_MASK) == 0) return;
+    const ImU32 colTrans = col & ~IM_COL32_A_MASK;
+    // Inner (opaque) and outer (transparent fringe) vertex per point, as ImGui's AA fill
+    const uint32_t base = reserve((size_t)count * 2);
+    Vertex* v = &m_vtx[m_vtx.size() - (size_t)count * 2];
+
+    m_normals.resize((size_t)count);
+    for (int i0 = count - 1, i1 = 0; i1 < count; i0 = i1++) m_normals[(size_t)i0] = edgeNormal(points[i0], points[i1]);
+
+    for (int i = 2; i < count; ++i) {
+        m_idx.push_back((ImDrawIdx)base);
+        m_idx.push_back((ImDrawIdx)(base + (uint32_t)(i - 1) * 2));
+        m_idx.push_back((ImDrawIdx)(base + (uint32_t)i * 2));
+    }
+    for (int i0 = count - 1, i1 = 0; i1 < count; i0 = i1++) {
+        ImVec2 dm = joinNormal(m_normals[(size_t)i0], m_normals[(size_t)i1]);
+        dm.x *= AA_SIZE * 0.5f;
+        dm.y *= AA_SIZE * 0.5f;
+        v[i1 * 2] = {ImVec2(points[i1].x - dm.x, points[i1].y - dm.y), col};
+        v[i1 * 2 + 1] = {ImVec2(points[i1].x + dm.x, points[i1].y + dm.y), colTrans};
+        const uint32_t in0 = base + (uint32_t)i0 * 2, in1 = base + (uint32_t)i1 * 2;
+        m_idx.push_back((ImDrawIdx)in1);
+        m_idx.push_back((ImDrawIdx)in0);
+        m_idx.push_back((ImDrawIdx)(in0 + 1));
+        m_idx.push_back((ImDrawIdx)(in0 + 1));
+        m_idx.push_back((ImDrawIdx)(in1 + 1));
+        m_idx.push_back((ImDrawIdx)in1);
+    }
+}
+
+void GeometryBatch::strokePolyline(const ImVec2* points, int count, bool closed, ImU32 col, float thickness) {
+    if (count < 2 || (col & IM_COL32_A_MASK) == 0) return;
+    const ImU32 colTrans = col & ~IM_COL32_A_MASK;
+    const int segments = closed ? count : count - 1;
+    // Thin strokes are a 1px core with a fringe each side; thick ones get a solid band
+    const bool thick = thickness > AA_SIZE;
+    const int columns = thick ? 4 : 3;
+    const float halfInner = thick ? (thickness - AA_SIZE) * 0.5f : 0.0f;
+
+    m_normals.resize((size_t)count);
+    for (int i = 0; i < segments; ++i) m_normals[(size_t)i] = edgeNormal(points[i], points[(i + 1) % count]);
+    if (!closed) m_normals[(size_t)count - 1] = m_normals[(size_t)count - 2];
+
+    const uint32_t base = reserve((size_t)count * (size_t)columns);
+    Vertex* v = &m_vtx[m_vtx.size() - (size_t)count * (size_t)columns];
+    for (int i = 0; i < count; ++i) {
+        ImVec2 n;
+        if (closed) n = joinNormal(m_normals[(size_t)((i + count - 1) % count)], m_normals[(size_t)i]);
+        else if (i == 0 || i == count - 1) n = m_normals[(size_t)i];
+        else n = joinNormal(m_normals[(size_t)i - 1], m_normals[(size_t)i]);
+        const ImVec2 p = points[i];
+        Vertex* pv = v + i * columns;
+        if (thick) {
+            const float outer = halfInner + AA_SIZE;
+            pv[0] = {ImVec2(p.x + n.x * outer, p.y + n.y * outer), colTrans};
+            pv[1] = {ImVec2(p.x + n.x * halfInner, p.y + n.y * halfInner), col};
+            pv[2] = {ImVec2(p.x - n.x * halfInner, p.y - n.y * halfInner), col};
+            pv[3] = {ImVec2(p.x - n.x * outer, p.y - n.y * outer), colTrans};
+        } else {
+            pv[0] = {ImVec2(p.x + n.x * AA_SIZE, p.y + n.y * AA_SIZE), colTrans};
+            pv[1] = {p, col};
+            pv[2] = {ImVec2(p.x - n.x * AA_SIZE, p.y - n.y * AA_SIZE), colTrans};
+        }
+    }
+    for (int i = 0; i < segments; ++i) {
+        const uint32_t a0 = base + (uint32_t)(i * columns);
+        const uint32_t b0 = base + (uint32_t)(((i + 1) % count) * columns);
+        for (int c = 0; c + 1 < columns; ++c) {
+            m_idx.push_back((ImDrawIdx)(a0 + c));
+            m_idx.push_back((ImDrawIdx)(a0 + c + 1));
+            m_idx.push_back((ImDrawIdx)(b0 + c + 1));
+            m_idx.push_back((ImDrawIdx)(a0 + c));
+            m_idx.push_back((ImDrawIdx)(b0 + c + 1));
+            m_idx.push_back((ImDrawIdx)(b0 + c));
+        }
+    }
+}
+
+void GeometryBatch::addLine(ImVec2 a, ImVec2 b, ImU32 col, float thickness) {
+    // Half-pixel shift onto pixel centres, as ImDrawList::AddLine does
+    const ImVec2 points[2] = {ImVec2(a.x + 0.5f, a.y + 0.5f), ImVec2(b.x + 0.5f, b.y + 0.5f)};
+    strokePolyline(points, 2, false, col, thickness);
+}
+
+void GeometryBatch::addTriangleFilled(ImVec2 a, ImVec2 b, ImVec2 c, ImU32 col) {
+    // The fringe goes outward only for clockwise (screen space) winding
+    float cross = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    const ImVec2 points[3] = {a, cross >= 0.0f ? b : c, cross >= 0.0f ? c : b};
+    fillConvex(points, 3, col);
+}
+
+void GeometryBatch::addCircleFilled(ImVec2 center, float radius, ImU32 col) {
+    if (radius < 0.5f) return;
+    int count = 0;
+    const ImVec2* unit = unitCircle(radius, count);
+    m_points.resize((size_t)count);
+    for (int i = 0; i < count; ++i) m_points[(size_t)i] = ImVec2(center.x + unit[i].x * radius, center.y + unit[i].y * radius);
+    fillConvex(m_points.data(), count, col);
+}
+
+void GeometryBatch::addCircle(ImVec2 center, float radius, ImU32 col, float thickness) {
+    if (radius < 0.5f) return;
+    int count = 0;
+    const ImVec2* unit = unitCircle(radius, count);
+    // Stroked half a pixel inside, matching ImDrawList::AddCircle
+    const float r = radius - 0.5f;
+    m_points.resize((size_t)count);
+    for (int i = 0; i < count; ++i) m_points[(size_t)i] = ImVec2(center.x + unit[i].x * r, center.y + unit[i].y * r);
+    strokePolyline(m_points.data(), count, true, col, thickness);
+}
+
+void GeometryBatch::flushTo(ImDrawList* drawList) const {
+    if (m_vtx.empty() || !drawList) return;
+    const ImVec2 uv = ImGui::GetFontTexUvWhitePixel();
+    for (size_t b = 0; b < m_blocks.size(); ++b) {
+        const Block& block = m_blocks[b];
+        const size_t vtxEnd = b + 1 < m_blocks.size() ? m_blocks[b + 1].firstVtx : m_vtx.size();
+        const size_t idxEnd = b + 1 < m_blocks.size() ? m_blocks[b + 1].firstIdx : m_idx.size();
+        const int vtxCount = (int)(vtxEnd - block.firstVtx);
+        const int idxCount = (int)(idxEnd - block.firstIdx);
+        if (vtxCount == 0) continue;
+
+        // One reservation per block; PrimReserve starts a new vertex offset for large lists
+        drawList->PrimReserve(idxCount, vtxCount);
+        const unsigned int baseIdx = drawList->_VtxCurrentIdx;
+        ImDrawVert* vw = drawList->_VtxWritePtr;
+        for (size_t i = block.firstVtx; i < vtxEnd; ++i, ++vw) {
+            vw->pos = m_vtx[i].pos;
+            vw->uv = uv;
+            vw->col = m_vtx[i].col;
+        }
+        ImDrawIdx* iw = drawList->_IdxWritePtr;
+        for (size_t i = block.firstIdx; i < idxEnd; ++i) *iw++ = (ImDrawIdx)(baseIdx + m_idx[i]);
+        drawList->_VtxWritePtr += vtxCount;
+        drawList->_IdxWritePtr += idxCount;
+        drawList->_VtxCurrentIdx += (unsigned int)vtxCount;
+    }
+}
+
+} // namespace Watercan
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <imgui.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Watercan {
+
+// Solid-colour, anti-aliased ImDrawList geometry (lines, filled triangles, filled and
+// stroked circles) built into a private buffer and appended to a draw list in a few large
+// PrimReserve blocks instead of one draw-list call per shape. The buffer survives flushTo(),
+// so a caller whose geometry did not change can flush the same batch again next frame.
+// Circles use shared unit-circle tables, one per level of detail, picked from the radius
+// with the tessellation error ImGui uses for its own circles.
+class GeometryBatch {
+public:
+    void clear();
+    bool empty() const { return m_vtx.empty(); }
+    size_t vertexCount() const { return m_vtx.size(); }
+    size_t indexCount() const { return m_idx.size(); }
+
+    void addLine(ImVec2 a, ImVec2 b, ImU32 col, float thickness);
+    void addTriangleFilled(ImVec2 a, ImVec2 b, ImVec2 c, ImU32 col);
+    void addCircleFilled(ImVec2 center, float radius, ImU32 col);
+    void addCircle(ImVec2 center, float radius, ImU32 col, float thickness);
+
+    // Append the batch to drawList under its current clip rect and texture (the font atlas,
+    // whose white pixel is sampled); the batch itself is left intact
+    void flushTo(ImDrawList* drawList) const;
+
+    // Segment count of the unit-circle table used for a circle of this screen radius
+    static int circleSegments(float radius);
+
+private:
+    struct Vertex {
+        ImVec2 pos;
+        ImU32 col;
+    };
+    // Vertices are split into blocks that 16-bit indices can address; each block becomes one
+    // PrimReserve and its indices are relative to the block's first vertex
+    struct Block {
+        size_t firstVtx = 0;
+        size_t firstIdx = 0;
+    };
+    static constexpr size_t MAX_BLOCK_VERTICES = 60000;
+
+    // Start a primitive of vtxCount vertices; returns its first index within the block
+    uint32_t reserve(size_t vtxCount);
+    void fillConvex(const ImVec2* points, int count, ImU32 col);
+    void strokePolyline(const ImVec2* points, int count, bool closed, ImU32 col, float thickness);
+    // Unit circle points for a radius (count is set to the table's segment count)
+    static const ImVec2* unitCircle(float radius, int& count);
+
+    std::vector<Vertex> m_vtx;
+    std::vector<ImDrawIdx> m_idx;
+    std::vector<Block> m_blocks;
+    // Per-primitive scratch (circle points and their normals)
+    std::vector<ImVec2> m_points;
+    std::vector<ImVec2> m_normals;
+};
+
+} // namespace Watercan
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+// Link a file into the executable as-is with an assembler .incbin directive, instead of
+// spelling it out as a C array the compiler has to parse. WATERCAN_INCBIN(sym, "path")
+// defines the read-only symbols
+//     extern "C" const unsigned char sym[];   // file contents, followed by a NUL byte
+//     extern "C" const uint32_t sym_size;     // file size in bytes (without the NUL)
+// The path is opened by the assembler, so pass an absolute one. Requires GCC or Clang.
+
+#define WATERCAN_INCBIN_STR2(x) #x
+#define WATERCAN_INCBIN_STR(x) WATERCAN_INCBIN_STR2(x)
+// Symbol prefix of the target ABI ("_" on Mach-O and 32-bit Windows, empty elsewhere)
+#define WATERCAN_INCBIN_PREFIX WATERCAN_INCBIN_STR(__USER_LABEL_PREFIX__)
+
+#if defined(__APPLE__)
+#define WATERCAN_INCBIN_SECTION ".const_data\n"
+#elif defined(_WIN32)
+#define WATERCAN_INCBIN_SECTION ".section .rdata,\"dr\"\n"
+#else
+#define WATERCAN_INCBIN_SECTION ".section .rodata\n"
+#endif
+
+#define WATERCAN_INCBIN(sym, file)                                                       \
+    __asm__(WATERCAN_INCBIN_SECTION                                                       \
+            ".global " WATERCAN_INCBIN_PREFIX #sym "\n"                                   \
+            ".balign 16\n"                                                                \
+            WATERCAN_INCBIN_PREFIX #sym ":\n"                                             \
+            ".incbin \"" file "\"\n"                                                      \
+            WATERCAN_INCBIN_PREFIX #sym "_end:\n"                                         \
+            ".byte 0\n"                                                                   \
+            ".global " WATERCAN_INCBIN_PREFIX #sym "_size\n"                              \
+            ".balign 4\n"                                                                 \
+            WATERCAN_INCBIN_PREFIX #sym "_size:\n"                                        \
+            ".long " WATERCAN_INCBIN_PREFIX #sym "_end - " WATERCAN_INCBIN_PREFIX #sym "\n" \
+            ".text\n");                                                                   \
+    extern "C" const unsigned char sym[];                                                 \
+    extern "C" const uint32_t sym##_size
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace Watercan {
+
+// Read-only memory mapping of a whole file (mmap on POSIX, MapViewOfFile on Windows). The
+// view stays valid until close() or destruction; an empty file opens with size() == 0.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    // Map path; false (and closed) when it cannot be opened or mapped
+    bool open(const std::string& path);
+    void close();
+
+    bool isOpen() const { return m_open; }
+    const unsigned char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    void moveFrom(MappedFile& other);
+
+    const unsigned char* m_data = nullptr;
+    size_t m_size = 0;
+    bool m_open = false;
+#ifdef _WIN32
+    void* m_file = nullptr;      // HANDLE
+    void* m_mapping = nullptr;   // HANDLE
+#endif
+};
+
+} // namespace Watercan
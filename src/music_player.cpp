@@ -1,4 +1,6 @@
 #include "music_player.h"
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -9,13 +11,28 @@
 #include <SDL2/SDL.h>
 #endif
 
-// We use stb_vorbis for OGG decoding. The implementation is provided in src/stb_vorbis.c
+// We use stb_vorbis for OGG decoding. The implementation is provided in src/stb_vorbis.c;
+// only the pull API used for streaming is declared here (layouts match stb_vorbis v1.22)
 extern "C" {
-    // stb_vorbis_decode_filename: returns number of samples per channel and writes malloc'd interleaved short* to *output
-    int stb_vorbis_decode_filename(const char* filename, int* channels, int* sample_rate, short** output);
-    // stb_vorbis_decode_memory: same as above but decodes from memory buffer
-    int stb_vorbis_decode_memory(const unsigned char *mem, int len, int *channels, int *sample_rate, short **output);
-} 
+    struct stb_vorbis_alloc;
+    struct stb_vorbis_info {
+        unsigned int sample_rate;
+        int channels;
+        unsigned int setup_memory_required;
+        unsigned int setup_temp_memory_required;
+        unsigned int temp_memory_required;
+        int max_frame_size;
+    };
+    stb_vorbis* stb_vorbis_open_filename(const char* filename, int* error, const stb_vorbis_alloc* alloc_buffer);
+    stb_vorbis* stb_vorbis_open_memory(const unsigned char* data, int len, int* error, const stb_vorbis_alloc* alloc_buffer);
+    void stb_vorbis_close(stb_vorbis* f);
+    stb_vorbis_info stb_vorbis_get_info(stb_vorbis* f);
+    unsigned int stb_vorbis_stream_length_in_samples(stb_vorbis* f);
+    // Interleaved shorts for `channels` channels; returns frames decoded (0 at end of stream)
+    int stb_vorbis_get_samples_short_interleaved(stb_vorbis* f, int channels, short* buffer, int num_shorts);
+    // Sample-accurate: the next get_samples call starts exactly at sample_number
+    int stb_vorbis_seek(stb_vorbis* f, unsigned int sample_number);
+}
 
 MusicPlayer::MusicPlayer() {}
 MusicPlayer::~MusicPlayer() { unload(); }
@@ -24,155 +41,192 @@ bool MusicPlayer::load(const std::string& path) {
     unload();
     if (!std::filesystem::exists(path)) return false;
 
-    int channels = 0;
-    int sr = 0;
-    short* data = nullptr;
-    int len = stb_vorbis_decode_filename(path.c_str(), &channels, &sr, &data); // returns samples per channel and sets data
-    if (!data || len <= 0 || channels <= 0 || sr <= 0) {
-        if (data) free(data);
+    int error = 0;
+    stb_vorbis* vorbis = stb_vorbis_open_filename(path.c_str(), &error, nullptr);
+    if (!vorbis) {
+        fprintf(stderr, "[music] cannot open '%s' (stb_vorbis error %d)\n", path.c_str(), error);
         return false;
     }
-
-    auto convert_and_free = [&](short* dataPtr, int length, int ch) {
-        m_sampleRate = sr;
-        m_samples.clear();
-        m_samples.reserve((size_t)length);
-        for (int i = 0; i < length; ++i) {
-            if (ch == 1) {
-                m_samples.push_back(dataPtr[i] / 32768.0f);
-            } else {
-                int idx = i * ch;
-                float sum = 0.0f;
-                for (int c = 0; c < ch; ++c) sum += dataPtr[idx + c];
-                m_samples.push_back((sum / ch) / 32768.0f);
-            }
-        }
-        free(dataPtr);
-    };
-
-    convert_and_free(data, len, channels);
-
-
-#ifdef HAVE_SDL2
-    // Fill s16 buffer for playback (mono)
-    m_s16buffer.resize(m_samples.size());
-    for (size_t i = 0; i < m_samples.size(); ++i) {
-        float v = m_samples[i];
-        if (v > 1.0f) v = 1.0f; if (v < -1.0f) v = -1.0f;
-        m_s16buffer[i] = (int16_t)std::lround(v * 32767.0f);
-    }
-#endif
-
-    m_playOffsetSamples = 0;
-    m_playing = false;
-    return true;
+    return openStream(vorbis);
 }
 
 bool MusicPlayer::loadFromMemory(const unsigned char* mem, size_t len) {
     unload();
     if (!mem || len == 0) return false;
 
-    int channels = 0;
-    int sr = 0;
-    short* data = nullptr;
-    int samples = stb_vorbis_decode_memory(mem, (int)len, &channels, &sr, &data);
-    if (!data || samples <= 0 || channels <= 0 || sr <= 0) {
-        if (data) free(data);
+    int error = 0;
+    stb_vorbis* vorbis = stb_vorbis_open_memory(mem, (int)len, &error, nullptr);
+    if (!vorbis) {
+        fprintf(stderr, "[music] cannot open in-memory track (stb_vorbis error %d)\n", error);
         return false;
     }
+    return openStream(vorbis);
+}
 
-    // Convert and free the decoded interleaved s16 buffer
-    m_sampleRate = sr;
-    m_samples.clear();
-    m_samples.reserve((size_t)samples);
-    for (int i = 0; i < samples; ++i) {
-        if (channels == 1) m_samples.push_back(data[i] / 32768.0f);
-        else {
-            int idx = i * channels; float sum = 0; for (int c = 0; c < channels; ++c) sum += data[idx + c];
-            m_samples.push_back((sum / channels) / 32768.0f);
-        }
-    }
-    free(data);
-
-#ifdef HAVE_SDL2
-    // Fill s16 buffer for playback (mono)
-    m_s16buffer.resize(m_samples.size());
-    for (size_t i = 0; i < m_samples.size(); ++i) {
-        float v = m_samples[i];
-        if (v > 1.0f) v = 1.0f; if (v < -1.0f) v = -1.0f;
-        m_s16buffer[i] = (int16_t)std::lround(v * 32767.0f);
+bool MusicPlayer::openStream(stb_vorbis* vorbis) {
+    stb_vorbis_info info = stb_vorbis_get_info(vorbis);
+    unsigned int total = stb_vorbis_stream_length_in_samples(vorbis);
+    if (info.channels <= 0 || info.sample_rate == 0 || total == 0) {
+        stb_vorbis_close(vorbis);
+        return false;
     }
-#endif
+    m_vorbis = vorbis;
+    m_channels = info.channels;
+    m_sampleRate = (int)info.sample_rate;
+    m_totalSamples = total;
 
-    m_playOffsetSamples = 0;
+    m_ring.assign(RING_SAMPLES, 0);
+    m_ringRead = 0;
+    m_ringWrite = 0;
+    m_streamBase = 0;
+    m_decodedToEnd = false;
+    m_stopDecoder = false;
     m_playing = false;
+    m_decoder = std::thread(&MusicPlayer::decodeLoop, this);
     return true;
 }
 
 void MusicPlayer::unload() {
     stop();
-    m_samples.clear();
-    m_sampleRate = 0;
 #ifdef HAVE_SDL2
+    // Close the device first so the callback no longer reads the ring
     if (m_dev) {
-        SDL_CloseAudioDevice(m_dev);
+        SDL_CloseAudioDevice((SDL_AudioDeviceID)m_dev);
         m_dev = 0;
     }
-    m_s16buffer.clear();
 #endif
+    stopDecoder();
+    if (m_vorbis) {
+        stb_vorbis_close(m_vorbis);
+        m_vorbis = nullptr;
+    }
+    m_ring.clear();
+    m_ring.shrink_to_fit();
+    m_channels = 0;
+    m_sampleRate = 0;
+    m_totalSamples = 0;
+}
+
+void MusicPlayer::stopDecoder() {
+    {
+        std::lock_guard<std::mutex> lock(m_decodeMutex);
+        m_stopDecoder = true;
+    }
+    m_decodeCv.notify_all();
+    if (m_decoder.joinable()) m_decoder.join();
 }
 
-bool MusicPlayer::hasAudio() const { return !m_samples.empty() && m_sampleRate > 0; }
+void MusicPlayer::decodeLoop() {
+    std::vector<short> chunk(DECODE_CHUNK_FRAMES * (size_t)m_channels);
+    std::unique_lock<std::mutex> lock(m_decodeMutex);
+    for (;;) {
+        auto hasRoom = [&] {
+            uint64_t filled = m_ringWrite.load(std::memory_order_relaxed) - m_ringRead.load(std::memory_order_acquire);
+            return filled + DECODE_CHUNK_FRAMES <= RING_SAMPLES - SCOPE_HISTORY_SAMPLES;
+        };
+        // The callback signals without the lock, so also wake up periodically
+        m_decodeCv.wait_for(lock, std::chrono::milliseconds(20),
+                            [&] { return m_stopDecoder || (!m_decodedToEnd && hasRoom()); });
+        if (m_stopDecoder) return;
+        if (m_decodedToEnd || !hasRoom()) continue;
 
-bool MusicPlayer::play() {
-    if (!hasAudio()) return false;
-#ifdef HAVE_SDL2
-    fprintf(stderr, "[music] play(): sampleRate=%d samples=%zu offset=%zu\n", m_sampleRate, m_s16buffer.size(), m_playOffsetSamples);
-    if (!m_dev) {
-        SDL_AudioSpec want;
-        SDL_zero(want);
-        want.freq = m_sampleRate;
-        want.format = AUDIO_S16SYS;
-        want.channels = 1;
-        want.samples = 4096;
-        want.callback = nullptr;
-        m_dev = SDL_OpenAudioDevice(NULL, 0, &want, NULL, 0);
-        if (!m_dev) {
-            fprintf(stderr, "[music] SDL_OpenAudioDevice failed (mono): %s\n", SDL_GetError());
-            // Try stereo as a fallback
-            want.channels = 2;
-            m_dev = SDL_OpenAudioDevice(NULL, 0, &want, NULL, 0);
-            if (!m_dev) {
-                fprintf(stderr, "[music] SDL_OpenAudioDevice failed (stereo fallback): %s\n", SDL_GetError());
-                return false;
-            } else {
-                fprintf(stderr, "[music] SDL_OpenAudioDevice succeeded with stereo fallback (dev=%u)\n", m_dev);
-            }
-        } else {
-            fprintf(stderr, "[music] SDL_OpenAudioDevice succeeded (dev=%u)\n", m_dev);
+        int frames = stb_vorbis_get_samples_short_interleaved(m_vorbis, m_channels, chunk.data(), (int)chunk.size());
+        if (frames <= 0) {
+            m_decodedToEnd = true;
+            continue;
         }
+        // Downmix to mono
+        uint64_t write = m_ringWrite.load(std::memory_order_relaxed);
+        for (int i = 0; i < frames; ++i) {
+            int sum = 0;
+            for (int c = 0; c < m_channels; ++c) sum += chunk[(size_t)i * m_channels + c];
+            m_ring[(write + i) & RING_MASK] = (int16_t)(sum / m_channels);
+        }
+        m_ringWrite.store(write + (uint64_t)frames, std::memory_order_release);
     }
-    // Clear any queued audio and queue from current offset
-    SDL_ClearQueuedAudio(m_dev);
-    size_t remaining = m_s16buffer.size() - m_playOffsetSamples;
-    if (remaining == 0) {
-        // restart from beginning
-        m_playOffsetSamples = 0;
-        remaining = m_s16buffer.size();
-    }
-    if (remaining > 0) {
-        const void* ptr = reinterpret_cast<const void*>(m_s16buffer.data() + m_playOffsetSamples);
-        Uint32 bytes = (Uint32)(remaining * sizeof(int16_t));
-        if (SDL_QueueAudio(m_dev, ptr, bytes) != 0) {
-            fprintf(stderr, "[music] SDL_QueueAudio failed: %s\n", SDL_GetError());
+}
+
+void MusicPlayer::restartAt(uint64_t sample) {
+    std::lock_guard<std::mutex> lock(m_decodeMutex);
+#ifdef HAVE_SDL2
+    if (m_dev) SDL_LockAudioDevice((SDL_AudioDeviceID)m_dev);
+#endif
+    stb_vorbis_seek(m_vorbis, (unsigned int)sample);
+    m_streamBase = sample;
+    m_ringRead = 0;
+    m_ringWrite = 0;
+    m_decodedToEnd = false;
+#ifdef HAVE_SDL2
+    if (m_dev) SDL_UnlockAudioDevice((SDL_AudioDeviceID)m_dev);
+#endif
+    m_decodeCv.notify_one();
+}
+
+bool MusicPlayer::hasAudio() const { return m_vorbis != nullptr && m_sampleRate > 0; }
+
+void MusicPlayer::audioCallback(void* userdata, uint8_t* stream, int len) {
+    static_cast<MusicPlayer*>(userdata)->fillDevice(stream, len);
+}
+
+bool MusicPlayer::openDevice() {
+#ifdef HAVE_SDL2
+    if (m_dev) return true;
+    SDL_AudioSpec want;
+    SDL_zero(want);
+    want.freq = m_sampleRate;
+    want.format = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples = 4096;
+    want.callback = audioCallback;
+    want.userdata = this;
+    SDL_AudioDeviceID dev = SDL_OpenAudioDevice(NULL, 0, &want, NULL, 0);
+    if (!dev) {
+        fprintf(stderr, "[music] SDL_OpenAudioDevice failed (mono): %s\n", SDL_GetError());
+        // Try stereo as a fallback (the callback duplicates the mono stream)
+        want.channels = 2;
+        dev = SDL_OpenAudioDevice(NULL, 0, &want, NULL, 0);
+        if (!dev) {
+            fprintf(stderr, "[music] SDL_OpenAudioDevice failed (stereo fallback): %s\n", SDL_GetError());
             return false;
-        } else {
-            fprintf(stderr, "[music] queued %u bytes for playback\n", bytes);
         }
+        fprintf(stderr, "[music] SDL_OpenAudioDevice succeeded with stereo fallback (dev=%u)\n", dev);
     } else {
-        fprintf(stderr, "[music] no audio to queue (remaining=0)\n");
+        fprintf(stderr, "[music] SDL_OpenAudioDevice succeeded (dev=%u)\n", dev);
     }
-    SDL_PauseAudioDevice(m_dev, 0); // start playback
+    m_deviceChannels = want.channels;
+    m_dev = dev;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void MusicPlayer::fillDevice(uint8_t* stream, int len) {
+    int16_t* out = reinterpret_cast<int16_t*>(stream);
+    const size_t ch = (size_t)m_deviceChannels;
+    const size_t frames = (size_t)len / (sizeof(int16_t) * ch);
+    const uint64_t read = m_ringRead.load(std::memory_order_relaxed);
+    const uint64_t avail = m_ringWrite.load(std::memory_order_acquire) - read;
+    const size_t n = (size_t)std::min<uint64_t>(avail, frames);
+    for (size_t i = 0; i < n; ++i) {
+        int16_t s = m_ring[(read + i) & RING_MASK];
+        for (size_t c = 0; c < ch; ++c) out[i * ch + c] = s;
+    }
+    // Underrun or end of track: silence
+    std::memset(out + n * ch, 0, (frames - n) * ch * sizeof(int16_t));
+    m_ringRead.store(read + n, std::memory_order_release);
+    m_decodeCv.notify_one();
+}
+
+bool MusicPlayer::play() {
+    if (!hasAudio()) return false;
+    // Finished tracks restart from the beginning
+    if (m_streamBase + m_ringRead >= m_totalSamples) restartAt(0);
+#ifdef HAVE_SDL2
+    fprintf(stderr, "[music] play(): sampleRate=%d samples=%llu offset=%llu\n", m_sampleRate,
+            (unsigned long long)m_totalSamples, (unsigned long long)(m_streamBase + m_ringRead));
+    if (!openDevice()) return false;
+    SDL_PauseAudioDevice((SDL_AudioDeviceID)m_dev, 0); // start playback
     m_playing = true;
     return true;
 #else
@@ -184,58 +238,31 @@ bool MusicPlayer::play() {
 
 void MusicPlayer::pause() {
 #ifdef HAVE_SDL2
-    if (m_dev) {
-        // compute how many samples are left in queue and update play offset so resume continues
-        Uint32 queued = SDL_GetQueuedAudioSize(m_dev);
-        Uint32 totalBytes = (Uint32)(m_s16buffer.size() * sizeof(int16_t));
-        // If queued >= totalBytes then nothing has been played yet (played = 0)
-        Uint32 played = (queued < totalBytes) ? (totalBytes - queued) : 0;
-        m_playOffsetSamples = (size_t)(played / sizeof(int16_t));
-        SDL_PauseAudioDevice(m_dev, 1);
-    }
-    m_playing = false;
-#else
-    m_playing = false;
+    // The callback stops draining the ring, so the position holds where it is
+    if (m_dev) SDL_PauseAudioDevice((SDL_AudioDeviceID)m_dev, 1);
 #endif
+    m_playing = false;
 }
 
 void MusicPlayer::stop() {
 #ifdef HAVE_SDL2
-    if (m_dev) {
-        SDL_ClearQueuedAudio(m_dev);
-        SDL_PauseAudioDevice(m_dev, 1);
-    }
-    m_playOffsetSamples = 0;
-    m_playing = false;
-#else
-    m_playOffsetSamples = 0;
-    m_playing = false;
+    if (m_dev) SDL_PauseAudioDevice((SDL_AudioDeviceID)m_dev, 1);
 #endif
+    m_playing = false;
+    if (hasAudio()) restartAt(0);
 }
 
 bool MusicPlayer::isPlaying() const { return m_playing; }
 
 double MusicPlayer::getDurationSeconds() const {
     if (!hasAudio()) return 0.0;
-    return (double)m_samples.size() / (double)m_sampleRate;
+    return (double)m_totalSamples / (double)m_sampleRate;
 }
 
 double MusicPlayer::getPositionSeconds() const {
     if (!hasAudio()) return 0.0;
-#ifdef HAVE_SDL2
-    if (m_dev) {
-        Uint32 queued = SDL_GetQueuedAudioSize(m_dev);
-        Uint64 totalBytes = (Uint64)(m_s16buffer.size() * sizeof(int16_t));
-        // If queued >= totalBytes then nothing has been played yet (played = 0)
-        Uint64 played = (queued < totalBytes) ? (totalBytes - queued) : 0ULL;
-        size_t playedSamples = (size_t)(played / sizeof(int16_t));
-        return (double)playedSamples / (double)m_sampleRate;
-    }
-    return (double)m_playOffsetSamples / (double)m_sampleRate;
-#else
-    // Best-effort: report offset
-    return (double)m_playOffsetSamples / (double)m_sampleRate;
-#endif
+    uint64_t played = std::min<uint64_t>(m_streamBase + m_ringRead, m_totalSamples);
+    return (double)played / (double)m_sampleRate;
 }
 
 void MusicPlayer::seekSeconds(double s) {
@@ -243,30 +270,21 @@ void MusicPlayer::seekSeconds(double s) {
     if (s < 0) s = 0;
     double dur = getDurationSeconds();
     if (s > dur) s = dur;
-    size_t target = (size_t)std::lround(s * m_sampleRate);
-    if (target >= m_samples.size()) target = m_samples.size() ? m_samples.size()-1 : 0;
-    m_playOffsetSamples = target;
-#ifdef HAVE_SDL2
-    if (m_dev) {
-        SDL_ClearQueuedAudio(m_dev);
-        size_t remaining = m_s16buffer.size() - m_playOffsetSamples;
-        if (remaining > 0) {
-            const void* ptr = m_s16buffer.data() + m_playOffsetSamples;
-            Uint32 bytes = (Uint32)(remaining * sizeof(int16_t));
-            SDL_QueueAudio(m_dev, ptr, bytes);
-        }
-        if (m_playing) SDL_PauseAudioDevice(m_dev, 0);
-    }
-#endif
+    uint64_t target = (uint64_t)std::llround(s * m_sampleRate);
+    if (target >= m_totalSamples) target = m_totalSamples - 1;
+    restartAt(target);
 }
 
-void MusicPlayer::clearPlayback() {
-#ifdef HAVE_SDL2
-    if (m_dev) {
-        SDL_ClearQueuedAudio(m_dev);
-        SDL_PauseAudioDevice(m_dev, 1);
-    }
-#endif
-    m_playing = false;
-    m_playOffsetSamples = 0;
+size_t MusicPlayer::recentSamples(size_t count, std::vector<float>& out) const {
+    out.clear();
+    if (!hasAudio()) return 0;
+    count = std::min(count, SCOPE_HISTORY_SAMPLES);
+    const uint64_t read = m_ringRead.load(std::memory_order_acquire);
+    const uint64_t write = m_ringWrite.load(std::memory_order_acquire);
+    // Everything from (read - SCOPE_HISTORY_SAMPLES) to write is still in the ring
+    uint64_t start = read >= count ? read - count : 0;
+    uint64_t end = std::min<uint64_t>(start + count, write);
+    out.reserve((size_t)(end - start));
+    for (uint64_t i = start; i < end; ++i) out.push_back(m_ring[i & RING_MASK] / 32768.0f);
+    return out.size();
 }
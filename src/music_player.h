@@ -1,18 +1,32 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
-#include <cstdint>
-#include <cstddef>
 
+struct stb_vorbis;
+
+// Streams an OGG track: a worker thread pulls small chunks from stb_vorbis into a ring
+// buffer (mono S16) that the SDL audio callback drains, so memory stays bounded no matter
+// how long the track is and playback starts without decoding everything first. Position
+// is counted in samples handed to the device and seeks are sample-accurate.
 class MusicPlayer {
 public:
     MusicPlayer();
     ~MusicPlayer();
 
+    MusicPlayer(const MusicPlayer&) = delete;
+    MusicPlayer& operator=(const MusicPlayer&) = delete;
+
     // Load an OGG file from disk; returns true on success
     bool load(const std::string& path);
-    // Load an OGG file from memory buffer; returns true on success
+    // Load an OGG file from memory buffer; returns true on success. The buffer is decoded
+    // in place while playing and must outlive the player (or the next load/unload).
     bool loadFromMemory(const unsigned char* data, size_t len);
     // Unload any loaded audio
     void unload();
@@ -30,23 +44,52 @@ public:
     double getPositionSeconds() const; // current playhead position
     void seekSeconds(double s);
 
-    // Raw decoded samples (mono, normalized -1..1)
-    const std::vector<float>& samples() const { return m_samples; }
+    // Copy up to count decoded samples (mono, normalized -1..1) around the playhead into out,
+    // ending at the playhead once that much has played; returns the number copied. At most
+    // SCOPE_HISTORY_SAMPLES are available.
+    size_t recentSamples(size_t count, std::vector<float>& out) const;
     int sampleRate() const { return m_sampleRate; }
 
+    static constexpr size_t SCOPE_HISTORY_SAMPLES = 4096;
+
 private:
-    std::vector<float> m_samples; // mono
+    static constexpr size_t RING_SAMPLES = 1u << 15;     // ~0.7 s at 44.1 kHz
+    static constexpr size_t RING_MASK = RING_SAMPLES - 1;
+    static constexpr size_t DECODE_CHUNK_FRAMES = 1024;
+
+    // Take ownership of an opened decoder and start the stream at sample 0
+    bool openStream(stb_vorbis* vorbis);
+    void decodeLoop();
+    void stopDecoder();
+    // Restart the stream at sample (decoder and ring), without touching the play state
+    void restartAt(uint64_t sample);
+    bool openDevice();
+    // SDL audio callback (audio thread): drain the ring into the device buffer
+    static void audioCallback(void* userdata, uint8_t* stream, int len);
+    void fillDevice(uint8_t* stream, int len);
+
+    stb_vorbis* m_vorbis = nullptr;
+    int m_channels = 0;
     int m_sampleRate = 0;
+    uint64_t m_totalSamples = 0;
 
     bool m_playing = false;
 
-// Audio device handle (opaque integer) - always present so header doesn't depend on SDL being available
+    // Audio device handle (opaque integer) - always present so header doesn't depend on SDL being available
     // When SDL2 is available, this will store the SDL_AudioDeviceID; otherwise it's unused.
     uintptr_t m_dev = 0;
-    std::vector<int16_t> m_s16buffer; // interleaved mono S16
-    // Current queued offset in samples (used for seeking)
-    size_t m_playOffsetSamples = 0;
+    int m_deviceChannels = 1;
+
+    // Ring of decoded samples, indexed by stream sample count modulo RING_SAMPLES. The
+    // decoder writes ahead of m_ringRead and leaves SCOPE_HISTORY_SAMPLES behind it intact.
+    std::vector<int16_t> m_ring;
+    std::atomic<uint64_t> m_ringRead{0};    // samples handed to the device since the last restart
+    std::atomic<uint64_t> m_ringWrite{0};   // samples decoded since the last restart
+    std::atomic<uint64_t> m_streamBase{0};  // track sample the last restart started at
+    bool m_decodedToEnd = false;            // guarded by m_decodeMutex
 
-    // Helpers
-    void clearPlayback();
+    std::thread m_decoder;
+    std::mutex m_decodeMutex;               // guards m_vorbis and ring restarts
+    std::condition_variable m_decodeCv;
+    bool m_stopDecoder = false;
 };
@@ -0,0 +1,133 @@
+#include "name_index.h"
+#include "spirit_tree.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+namespace Watercan {
+
+void fnv1a32Batch(const std::string* const* names, size_t count, uint32_t* out) {
+    constexpr uint32_t FNV_OFFSET_BASIS = 0x811C9DC5;
+    constexpr uint32_t FNV_PRIME = 0x01000193;
+    constexpr size_t LANES = 8;
+
+    size_t base = 0;
+    for (; base + LANES <= count; base += LANES) {
+        const unsigned char* p[LANES];
+        size_t common = names[base]->size();
+        for (size_t l = 0; l < LANES; ++l) {
+            p[l] = reinterpret_cast<const unsigned char*>(names[base + l]->data());
+            common = std::min(common, names[base + l]->size());
+        }
+        uint32_t h[LANES];
+        for (size_t l = 0; l < LANES; ++l) h[l] = FNV_OFFSET_BASIS;
+        // Fixed-width inner loop over the lanes: one column of bytes per step
+        for (size_t pos = 0; pos < common; ++pos) {
+            uint32_t bytes[LANES];
+            for (size_t l = 0; l < LANES; ++l) bytes[l] = p[l][pos];
+            for (size_t l = 0; l < LANES; ++l) h[l] = (h[l] ^ bytes[l]) * FNV_PRIME;
+        }
+        for (size_t l = 0; l < LANES; ++l) {
+            const size_t len = names[base + l]->size();
+            uint32_t v = h[l];
+            for (size_t pos = common; pos < len; ++pos) v = (v ^ p[l][pos]) * FNV_PRIME;
+            out[base + l] = v;
+        }
+    }
+    for (; base < count; ++base) out[base] = fnv1a32(*names[base]);
+}
+
+size_t NameIndex::add(const std::vector<Symbol>& names) {
+    m_batchNames.clear();
+    for (const Symbol& name : names) {
+        if (!name.empty()) m_batchNames.push_back(&name.str());
+    }
+    m_batchHashes.resize(m_batchNames.size());
+    fnv1a32Batch(m_batchNames.data(), m_batchNames.size(), m_batchHashes.data());
+
+    size_t added = 0;
+    m_names.reserve(m_names.size() + m_batchNames.size());
+    for (size_t i = 0; i < m_batchNames.size(); ++i) {
+        const std::string& name = *m_batchNames[i];
+        auto ins = m_names.emplace(m_batchHashes[i], Symbol(name));
+        if (ins.second) ++added;
+        else if (ins.first->second != name) ++m_collisions;
+    }
+    if (added > 0) m_dirty = true;
+    return added;
+}
+
+size_t NameIndex::add(const Symbol& name) {
+    if (name.empty()) return 0;
+    auto ins = m_names.emplace(fnv1a32(name), name);
+    if (!ins.second) {
+        if (ins.first->second != name) ++m_collisions;
+        return 0;
+    }
+    m_dirty = true;
+    return 1;
+}
+
+bool NameIndex::lookup(uint64_t id, std::string* outName) const {
+    if (id > 0xFFFFFFFFull) return false;
+    auto it = m_names.find((uint32_t)id);
+    if (it == m_names.end()) return false;
+    if (outName) *outName = it->second;
+    return true;
+}
+
+void NameIndex::clear() {
+    m_names.clear();
+    m_collisions = 0;
+    m_dirty = false;
+}
+
+bool NameIndex::loadFile(const std::string& path, size_t* outAdded) {
+    if (outAdded) *outAdded = 0;
+    try {
+        std::ifstream ifs(path, std::ios::binary);
+        if (!ifs.is_open()) return false;
+        std::vector<Symbol> names;
+        std::string line;
+        while (std::getline(ifs, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty() || line[0] == '#') continue;
+            names.emplace_back(line);
+        }
+        size_t added = add(names);
+        if (outAdded) *outAdded = added;
+        return true;
+    } catch (...) {
+        fprintf(stderr, "[Watercan] failed reading name list '%s'\n", path.c_str());
+        return false;
+    }
+}
+
+bool NameIndex::saveFile(const std::string& path) {
+    try {
+        std::vector<const std::string*> sorted;
+        sorted.reserve(m_names.size());
+        for (const auto& entry : m_names) sorted.push_back(&entry.second.str());
+        std::sort(sorted.begin(), sorted.end(),
+                  [](const std::string* a, const std::string* b) { return *a < *b; });
+
+        std::ofstream ofs(path, std::ios::binary);
+        if (!ofs.is_open()) return false;
+        ofs << "# Watercan known names: one nm per line, looked up by fnv1a32 id\n";
+        for (const std::string* name : sorted) {
+            // A line per name: anything spanning lines could not be read back
+            if (name->find('\n') == std::string::npos) ofs << *name << '\n';
+        }
+        ofs.close();
+        if (!ofs) {
+            fprintf(stderr, "[Watercan] failed writing name list '%s'\n", path.c_str());
+            return false;
+        }
+        m_dirty = false;
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+} // namespace Watercan
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "string_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Watercan {
+
+// fnv1a32 of count strings, several at a time: the strings are hashed in lockstep lanes up
+// to their common length so the per-byte step runs across lanes (vectorizable), then each
+// tail is finished on its own. out[i] == fnv1a32(*names[i]).
+void fnv1a32Batch(const std::string* const* names, size_t count, uint32_t* out);
+
+// Reverse index of fnv1a32. A node id is the hash of its nm, so any name seen once (in a
+// loaded file or an external name list) gives back the name of a node whose id no longer
+// matches it. The first name learned for a hash wins; other names with the same hash are
+// counted as collisions and ignored.
+class NameIndex {
+public:
+    // Learn names; returns how many ids were new
+    size_t add(const std::vector<Symbol>& names);
+    size_t add(const Symbol& name);
+
+    // Name whose fnv1a32 is id (ids above 32 bits never match). O(1).
+    bool lookup(uint64_t id, std::string* outName) const;
+
+    size_t size() const { return m_names.size(); }
+    size_t collisions() const { return m_collisions; }
+    // Names were added since the last saveFile / clearDirty
+    bool isDirty() const { return m_dirty; }
+    void clearDirty() { m_dirty = false; }
+    void clear();
+
+    // Name list files hold one name per line; blank lines and lines starting with '#' are
+    // skipped. loadFile adds to what is already known (outAdded: new ids).
+    bool loadFile(const std::string& path, size_t* outAdded = nullptr);
+    // Write every known name (sorted, so the file diffs cleanly) and clear the dirty flag
+    bool saveFile(const std::string& path);
+
+private:
+    std::unordered_map<uint32_t, Symbol> m_names;
+    size_t m_collisions = 0;
+    bool m_dirty = false;
+
+    // Scratch for add(), reused between calls
+    std::vector<const std::string*> m_batchNames;
+    std::vector<uint32_t> m_batchHashes;
+};
+
+} // namespace Watercan
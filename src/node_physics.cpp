@@ -0,0 +1,125 @@
+#include "node_physics.h"
+#include <algorithm>
+
+#if !defined(WATERCAN_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define WATERCAN_PHYSICS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace Watercan {
+
+uint32_t NodePhysicsStore::slotFor(uint64_t id) {
+    auto it = m_slotById.find(id);
+    if (it != m_slotById.end()) return it->second;
+    if (!m_freeSlots.empty()) {
+        uint32_t slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        m_slotById.emplace(id, slot);
+        ids[slot] = id;
+        return slot;
+    }
+    uint32_t slot = (uint32_t)ids.size();
+    m_slotById.emplace(id, slot);
+    ids.push_back(id);
+    offsetX.push_back(0.0f);
+    offsetY.push_back(0.0f);
+    velocityX.push_back(0.0f);
+    velocityY.push_back(0.0f);
+    collisionTime.push_back(0.0f);
+    flags.push_back(0);
+    return slot;
+}
+
+void NodePhysicsStore::release(uint64_t id) {
+    auto it = m_slotById.find(id);
+    if (it == m_slotById.end()) return;
+    uint32_t slot = it->second;
+    m_slotById.erase(it);
+    releaseSlot(slot);
+}
+
+void NodePhysicsStore::releaseResting(const std::vector<uint32_t>& keepSlots) {
+    m_keepScratch.assign(ids.size(), 0);
+    for (uint32_t slot : keepSlots) {
+        if (slot < m_keepScratch.size()) m_keepScratch[slot] = 1;
+    }
+    for (auto it = m_slotById.begin(); it != m_slotById.end();) {
+        const uint32_t slot = it->second;
+        const bool resting = flags[slot] == 0 && offsetX[slot] == 0.0f && offsetY[slot] == 0.0f &&
+                             velocityX[slot] == 0.0f && velocityY[slot] == 0.0f && collisionTime[slot] == 0.0f;
+        if (resting && !m_keepScratch[slot]) {
+            it = m_slotById.erase(it);
+            releaseSlot(slot);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void NodePhysicsStore::releaseSlot(uint32_t slot) {
+    // Zeroed now so the spring and collision passes, which walk every slot, skip it
+    ids[slot] = 0;
+    offsetX[slot] = offsetY[slot] = 0.0f;
+    velocityX[slot] = velocityY[slot] = 0.0f;
+    collisionTime[slot] = 0.0f;
+    flags[slot] = 0;
+    m_freeSlots.push_back(slot);
+    ++m_motionVersion;
+}
+
+void NodePhysicsStore::clearFlagAll(uint8_t f) {
+    for (auto& fl : flags) fl &= (uint8_t)~f;
+}
+
+void NodePhysicsStore::clearAllMotion() {
+    std::fill(offsetX.begin(), offsetX.end(), 0.0f);
+    std::fill(offsetY.begin(), offsetY.end(), 0.0f);
+    std::fill(velocityX.begin(), velocityX.end(), 0.0f);
+    std::fill(velocityY.begin(), velocityY.end(), 0.0f);
+    clearFlagAll(FLAG_ACTIVE);
+    ++m_motionVersion;
+}
+
+void NodePhysicsStore::integrateSprings(float stiffness, float damping, float dt) {
+    const size_t n = std::min(size(), springMask.size());
+    float* ox = offsetX.data();
+    float* oy = offsetY.data();
+    float* vx = velocityX.data();
+    float* vy = velocityY.data();
+    const float* m = springMask.data();
+    // At rest: nothing moves, so the motion version (and cached geometry) stays valid
+    if (std::find(m, m + n, 1.0f) == m + n) return;
+    ++m_motionVersion;
+    size_t i = 0;
+
+    // Both paths evaluate the same expression in the same order so results match exactly:
+    // a = (-k*o) + (-c*v);  v = v + (a*dt)*mask;  o = o + (v*dt)*mask
+#ifdef WATERCAN_PHYSICS_SSE2
+    const __m128 negK = _mm_set1_ps(-stiffness);
+    const __m128 negC = _mm_set1_ps(-damping);
+    const __m128 vdt = _mm_set1_ps(dt);
+    for (; i + 4 <= n; i += 4) {
+        __m128 mask = _mm_loadu_ps(m + i);
+        __m128 px = _mm_loadu_ps(ox + i), py = _mm_loadu_ps(oy + i);
+        __m128 qx = _mm_loadu_ps(vx + i), qy = _mm_loadu_ps(vy + i);
+        __m128 ax = _mm_add_ps(_mm_mul_ps(negK, px), _mm_mul_ps(negC, qx));
+        __m128 ay = _mm_add_ps(_mm_mul_ps(negK, py), _mm_mul_ps(negC, qy));
+        qx = _mm_add_ps(qx, _mm_mul_ps(_mm_mul_ps(ax, vdt), mask));
+        qy = _mm_add_ps(qy, _mm_mul_ps(_mm_mul_ps(ay, vdt), mask));
+        px = _mm_add_ps(px, _mm_mul_ps(_mm_mul_ps(qx, vdt), mask));
+        py = _mm_add_ps(py, _mm_mul_ps(_mm_mul_ps(qy, vdt), mask));
+        _mm_storeu_ps(vx + i, qx); _mm_storeu_ps(vy + i, qy);
+        _mm_storeu_ps(ox + i, px); _mm_storeu_ps(oy + i, py);
+    }
+#endif
+    for (; i < n; ++i) {
+        float ax = (-stiffness * ox[i]) + (-damping * vx[i]);
+        float ay = (-stiffness * oy[i]) + (-damping * vy[i]);
+        vx[i] = vx[i] + (ax * dt) * m[i];
+        vy[i] = vy[i] + (ay * dt) * m[i];
+        ox[i] = ox[i] + (vx[i] * dt) * m[i];
+        oy[i] = oy[i] + (vy[i] * dt) * m[i];
+    }
+}
+
+} // namespace Watercan
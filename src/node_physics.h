@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+namespace Watercan {
+
+// Dense structure-of-arrays store for per-node physics state (visual offset, velocity,
+// collision timer and flags). Each node id is mapped to a stable slot once; all hot loops
+// (spring integration, collision, rendering) then address the contiguous arrays by slot.
+// A slot index stays valid across frames until its id is released; released slots are
+// zeroed and handed out again by slotFor, so the arrays don't grow with every node seen.
+struct NodePhysicsStore {
+    static constexpr uint32_t NO_SLOT = std::numeric_limits<uint32_t>::max();
+
+    enum : uint8_t {
+        FLAG_ACTIVE        = 1u << 0, // slot carries a non-rest offset (spring integrates it)
+        FLAG_FREE_FLOATING = 1u << 1, // node doesn't snap back to its base position
+        FLAG_FROZEN        = 1u << 2, // node frozen due to sustained collision
+        FLAG_IN_COLLISION  = 1u << 3, // node overlapped another node during the current step
+    };
+
+    std::vector<uint64_t> ids;
+    std::vector<float> offsetX, offsetY;   // offset from computed base position
+    std::vector<float> velocityX, velocityY;
+    std::vector<float> collisionTime;      // time spent in collision with low velocity
+    std::vector<uint8_t> flags;
+    std::vector<float> springMask;         // scratch for integrateSprings: 1.0 = integrate, 0.0 = skip
+
+    size_t size() const { return ids.size(); }
+    // Bumped whenever any offset may have changed (geometry caches compare it)
+    uint64_t motionVersion() const { return m_motionVersion; }
+
+    // Return the slot for a node id, allocating a zeroed slot (a released one if any) on first use
+    uint32_t slotFor(uint64_t id);
+    // Forget a node id and put its slot on the free list
+    void release(uint64_t id);
+    // Release every slot at rest (no offset, velocity, timer or flags) that is not listed in
+    // keepSlots, e.g. the nodes of trees that are no longer shown
+    void releaseResting(const std::vector<uint32_t>& keepSlots);
+    // Return the slot for a node id or NO_SLOT when the id has never been seen
+    uint32_t findSlot(uint64_t id) const {
+        auto it = m_slotById.find(id);
+        return it == m_slotById.end() ? NO_SLOT : it->second;
+    }
+
+    bool hasFlag(uint32_t slot, uint8_t f) const { return slot != NO_SLOT && (flags[slot] & f) != 0; }
+    void setFlag(uint32_t slot, uint8_t f) { flags[slot] |= f; }
+    void clearFlag(uint32_t slot, uint8_t f) { flags[slot] &= (uint8_t)~f; }
+    void clearFlagAll(uint8_t f);
+
+    // Add to a slot's offset and mark it active
+    void addOffset(uint32_t slot, float dx, float dy) {
+        offsetX[slot] += dx; offsetY[slot] += dy; flags[slot] |= FLAG_ACTIVE;
+        ++m_motionVersion;
+    }
+    void setOffset(uint32_t slot, float x, float y) {
+        offsetX[slot] = x; offsetY[slot] = y; flags[slot] |= FLAG_ACTIVE;
+        ++m_motionVersion;
+    }
+    // Drop a slot's offset and velocity (node renders at its base position)
+    void clearMotion(uint32_t slot) {
+        offsetX[slot] = offsetY[slot] = 0.0f;
+        velocityX[slot] = velocityY[slot] = 0.0f;
+        flags[slot] &= (uint8_t)~FLAG_ACTIVE;
+        ++m_motionVersion;
+    }
+    // Drop offsets and velocities of every slot (flags other than ACTIVE are kept)
+    void clearAllMotion();
+
+    // Damped spring step toward zero offset for every slot whose springMask is 1.0
+    // (springMask must be sized to size()):  v += (-k*o - c*v) * dt;  o += v * dt.
+    // Does nothing when no slot is masked in.
+    // Uses an SSE2 kernel when available (disable with WATERCAN_NO_SIMD).
+    void integrateSprings(float stiffness, float damping, float dt);
+
+private:
+    void releaseSlot(uint32_t slot);
+
+    std::unordered_map<uint64_t, uint32_t> m_slotById;
+    std::vector<uint32_t> m_freeSlots;
+    std::vector<uint8_t> m_keepScratch;    // scratch for releaseResting
+    uint64_t m_motionVersion = 0;
+};
+
+} // namespace Watercan
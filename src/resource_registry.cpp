@@ -0,0 +1,76 @@
+#include "resource_registry.h"
+#include "embedded_resources.h"
+#include <cstdio>
+#include <filesystem>
+
+namespace Watercan {
+
+ResourceLocation locateResource(const std::string& name) {
+    ResourceLocation loc;
+#if defined(BUILD_SINGLE_EXE) || defined(BUILD_WINDOWS_SINGLE_EXE)
+    size_t len = 0;
+    const unsigned char* data = embedded_resource_data(name.c_str(), &len);
+    if (data && len > 0) {
+        loc.data = data;
+        loc.size = len;
+        return loc;
+    }
+#endif
+    const std::string candidates[] = {"../res/" + name, "res/" + name, "./res/" + name};
+    for (const std::string& path : candidates) {
+        try {
+            if (std::filesystem::is_regular_file(path)) {
+                loc.path = path;
+                return loc;
+            }
+        } catch (...) {}
+    }
+    return loc;
+}
+
+void ResourceRegistry::add(const std::string& id, Loader load, Releaser release) {
+    Entry& e = m_entries[id];
+    if (e.state == State::Loaded && e.release) e.release();
+    e.load = std::move(load);
+    e.release = std::move(release);
+    e.state = State::Unloaded;
+}
+
+bool ResourceRegistry::require(const std::string& id) {
+    auto it = m_entries.find(id);
+    if (it == m_entries.end()) return false;
+    Entry& e = it->second;
+    if (e.state == State::Unloaded) {
+        bool ok = false;
+        try {
+            ok = e.load && e.load();
+        } catch (...) {
+            ok = false;
+        }
+        e.state = ok ? State::Loaded : State::Failed;
+        if (!ok) fprintf(stderr, "[Watercan] resource '%s' is not available\n", id.c_str());
+    }
+    return e.state == State::Loaded;
+}
+
+bool ResourceRegistry::isLoaded(const std::string& id) const {
+    auto it = m_entries.find(id);
+    return it != m_entries.end() && it->second.state == State::Loaded;
+}
+
+void ResourceRegistry::release(const std::string& id) {
+    auto it = m_entries.find(id);
+    if (it == m_entries.end()) return;
+    Entry& e = it->second;
+    if (e.state == State::Loaded && e.release) e.release();
+    e.state = State::Unloaded;
+}
+
+void ResourceRegistry::releaseAll() {
+    for (auto& kv : m_entries) {
+        if (kv.second.state == State::Loaded && kv.second.release) kv.second.release();
+        kv.second.state = State::Unloaded;
+    }
+}
+
+} // namespace Watercan
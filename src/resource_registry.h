@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+namespace Watercan {
+
+// Where a file from res/ can be read from: bytes linked into a single-exe build, or a
+// path on disk (development builds run from the source or build directory)
+struct ResourceLocation {
+    const unsigned char* data = nullptr;   // embedded bytes (static; never freed)
+    size_t size = 0;
+    std::string path;                      // set instead of data when found on disk
+
+    bool embedded() const { return data != nullptr; }
+    bool found() const { return data != nullptr || !path.empty(); }
+};
+
+// Find res/<name>, preferring the copy embedded in the executable
+ResourceLocation locateResource(const std::string& name);
+
+// Named resources (textures, audio, fonts) that are materialized only when first needed.
+// Each is registered with a loader and an optional release function; require() runs the
+// loader once and remembers the outcome, so a missing or broken resource is not retried
+// every frame. release() frees it again and lets the next require() reload it.
+class ResourceRegistry {
+public:
+    using Loader = std::function<bool()>;
+    using Releaser = std::function<void()>;
+
+    // Register (or replace) the resource id; nothing is loaded yet
+    void add(const std::string& id, Loader load, Releaser release = {});
+
+    // Load id on first use; returns true if it is available
+    bool require(const std::string& id);
+    bool isLoaded(const std::string& id) const;
+
+    void release(const std::string& id);
+    void releaseAll();
+
+private:
+    enum class State { Unloaded, Loaded, Failed };
+    struct Entry {
+        Loader load;
+        Releaser release;
+        State state = State::Unloaded;
+    };
+    std::unordered_map<std::string, Entry> m_entries;
+};
+
+} // namespace Watercan
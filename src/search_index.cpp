@@ -0,0 +1,262 @@
+#include "search_index.h"
+#include "spirit_tree.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <string_view>
+
+namespace Watercan {
+
+namespace {
+
+constexpr char FIELD_SEPARATOR = '\x1f';
+
+void appendLower(std::string& out, const std::string& s) {
+    for (char c : s) out.push_back((char)std::tolower((unsigned char)c));
+}
+
+} // namespace
+
+void SearchIndex::clear() {
+    m_entries.clear();
+    m_deadCount = 0;
+    m_postings.clear();
+    m_spirits.clear();
+    m_prefixPostings.clear();
+    m_syncedGeneration = 0;
+    m_pass = 0;
+    ++m_version;
+}
+
+bool SearchIndex::sync(const SpiritTreeManager& manager) {
+    const uint64_t generation = manager.getEditGeneration();
+    if (m_pass != 0 && generation == m_syncedGeneration) return false;
+    ++m_pass;
+
+    bool changed = false;
+    for (const std::string& spiritName : manager.getAllSpiritNames()) {
+        auto ins = m_spirits.try_emplace(spiritName);
+        SpiritSlot& slot = ins.first->second;
+        const uint64_t spiritGeneration = manager.getSpiritEditGeneration(spiritName);
+        if (ins.second || slot.generation != spiritGeneration) {
+            // nm, typ and id are all the index needs, so unbuilt spirits are read straight from
+            // the load snapshot; building every tree here would undo lazy loading
+            indexSpirit(spiritName, manager.getSpiritNodes(spiritName), slot);
+            slot.generation = spiritGeneration;
+            changed = true;
+        }
+        slot.pass = m_pass;
+    }
+    // Spirits deleted since the last sync
+    for (auto it = m_spirits.begin(); it != m_spirits.end();) {
+        if (it->second.pass == m_pass) {
+            ++it;
+            continue;
+        }
+        for (uint32_t e : it->second.entries) killEntry(e);
+        it = m_spirits.erase(it);
+        changed = true;
+    }
+
+    m_syncedGeneration = generation;
+    if (changed) {
+        compactIfNeeded();
+        ++m_version;
+    }
+    return changed;
+}
+
+void SearchIndex::indexSpirit(const std::string& spiritName, const std::vector<SpiritNode>& nodes, SpiritSlot& slot) {
+    // Entries whose node kept its id, nm and typ are kept; the rest are replaced
+    m_scratchById.clear();
+    for (uint32_t e : slot.entries) {
+        auto ins = m_scratchById.emplace(m_entries[e].id, e);
+        if (!ins.second) killEntry(e); // duplicate id: only one entry can be matched up
+    }
+    const Symbol spirit(spiritName);
+    std::vector<uint32_t> entries;
+    entries.reserve(nodes.size());
+    for (const SpiritNode& node : nodes) {
+        auto it = m_scratchById.find(node.id);
+        if (it != m_scratchById.end()) {
+            const Entry& e = m_entries[it->second];
+            if (e.name == node.name && e.type == node.type) {
+                entries.push_back(it->second);
+                m_scratchById.erase(it);
+                continue;
+            }
+        }
+        entries.push_back(addEntry(spirit, node));
+    }
+    for (const auto& stale : m_scratchById) killEntry(stale.second);
+    slot.entries = std::move(entries);
+}
+
+uint32_t SearchIndex::addEntry(Symbol spirit, const SpiritNode& node) {
+    const uint32_t index = (uint32_t)m_entries.size();
+    m_entries.emplace_back();
+    Entry& e = m_entries.back();
+    e.spirit = spirit;
+    e.id = node.id;
+    e.name = node.name;
+    e.type = node.type;
+
+    char buf[32];
+    appendLower(e.text, node.name);
+    e.fieldEnd[0] = (uint32_t)e.text.size();
+    e.text.push_back(FIELD_SEPARATOR);
+    appendLower(e.text, node.type);
+    e.fieldEnd[1] = (uint32_t)e.text.size();
+    e.text.push_back(FIELD_SEPARATOR);
+    std::snprintf(buf, sizeof(buf), "%llx", (unsigned long long)node.id);
+    e.text += buf;
+    e.fieldEnd[2] = (uint32_t)e.text.size();
+    e.text.push_back(FIELD_SEPARATOR);
+    std::snprintf(buf, sizeof(buf), "%llu", (unsigned long long)node.id);
+    e.text += buf;
+    e.fieldEnd[3] = (uint32_t)e.text.size();
+
+    addTrigrams(index);
+    return index;
+}
+
+void SearchIndex::addTrigrams(uint32_t index) {
+    const std::string& text = m_entries[index].text;
+    m_scratchTrigrams.clear();
+    for (size_t i = 0; i + 3 <= text.size(); ++i) {
+        if (text[i] == FIELD_SEPARATOR || text[i + 1] == FIELD_SEPARATOR || text[i + 2] == FIELD_SEPARATOR) continue;
+        m_scratchTrigrams.push_back(packTrigram(text.data() + i));
+    }
+    std::sort(m_scratchTrigrams.begin(), m_scratchTrigrams.end());
+    m_scratchTrigrams.erase(std::unique(m_scratchTrigrams.begin(), m_scratchTrigrams.end()), m_scratchTrigrams.end());
+    // Entries are only ever appended, so every posting list stays sorted
+    for (uint32_t t : m_scratchTrigrams) m_postings[t].push_back(index);
+
+    const Entry& e = m_entries[index];
+    m_scratchTrigrams.clear();
+    for (size_t f = 0; f < FIELD_COUNT; ++f) {
+        const uint32_t start = e.fieldStart(f);
+        const uint32_t len = e.fieldEnd[f] - start;
+        if (len >= 1) m_scratchTrigrams.push_back(packPrefix(text.data() + start, 1));
+        if (len >= 2) m_scratchTrigrams.push_back(packPrefix(text.data() + start, 2));
+    }
+    std::sort(m_scratchTrigrams.begin(), m_scratchTrigrams.end());
+    m_scratchTrigrams.erase(std::unique(m_scratchTrigrams.begin(), m_scratchTrigrams.end()), m_scratchTrigrams.end());
+    for (uint32_t key : m_scratchTrigrams) m_prefixPostings[key].push_back(index);
+}
+
+void SearchIndex::killEntry(uint32_t index) {
+    Entry& e = m_entries[index];
+    if (!e.alive) return;
+    e.alive = false;
+    ++m_deadCount;
+}
+
+void SearchIndex::compactIfNeeded() {
+    if (m_deadCount < 1024 || m_deadCount * 2 < m_entries.size()) return;
+    std::vector<uint32_t> remap(m_entries.size(), UINT32_MAX);
+    std::vector<Entry> live;
+    live.reserve(m_entries.size() - m_deadCount);
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        if (!m_entries[i].alive) continue;
+        remap[i] = (uint32_t)live.size();
+        live.push_back(std::move(m_entries[i]));
+    }
+    m_entries = std::move(live);
+    m_deadCount = 0;
+    for (auto& kv : m_spirits) {
+        for (uint32_t& e : kv.second.entries) e = remap[e];
+    }
+    m_postings.clear();
+    m_prefixPostings.clear();
+    for (uint32_t i = 0; i < (uint32_t)m_entries.size(); ++i) addTrigrams(i);
+}
+
+size_t SearchIndex::query(const std::string& text, size_t maxHits, std::vector<Hit>& out) {
+    out.clear();
+    std::string q;
+    appendLower(q, text);
+    while (!q.empty() && q.back() == ' ') q.pop_back();
+    size_t lead = 0;
+    while (lead < q.size() && q[lead] == ' ') ++lead;
+    q.erase(0, lead);
+    bool hexOnly = false;
+    if (q.size() > 2 && q[0] == '0' && q[1] == 'x') {
+        q.erase(0, 2);
+        hexOnly = true;
+    }
+    if (q.empty() || q.find(FIELD_SEPARATOR) != std::string::npos) return 0;
+
+    // Rank of the best field match of an entry (field * 2, +1 when not at the field start),
+    // or UINT32_MAX when the query does not occur in any field searched. Short queries only
+    // match at the start of a field.
+    const bool prefixOnly = q.size() < 3;
+    auto rankOf = [&](const Entry& e) {
+        uint32_t best = UINT32_MAX;
+        const std::string_view all(e.text);
+        for (uint32_t f = 0; f < FIELD_COUNT; ++f) {
+            if (hexOnly && f != (uint32_t)Field::HexId) continue;
+            const uint32_t start = e.fieldStart(f);
+            size_t pos = all.substr(start, e.fieldEnd[f] - start).find(q);
+            if (pos == std::string_view::npos || (prefixOnly && pos != 0)) continue;
+            best = std::min(best, f * 2 + (pos == 0 ? 0u : 1u));
+            if (pos == 0) break;
+        }
+        return best;
+    };
+
+    m_scratchRanked.clear();
+    if (q.size() >= 3) {
+        // Candidates come from the rarest trigram; the others are checked by binary search
+        // and everything left is confirmed against the text
+        std::vector<const std::vector<uint32_t>*> lists;
+        for (size_t i = 0; i + 3 <= q.size(); ++i) {
+            auto it = m_postings.find(packTrigram(q.data() + i));
+            if (it == m_postings.end()) return 0;
+            lists.push_back(&it->second);
+        }
+        std::sort(lists.begin(), lists.end(), [](const std::vector<uint32_t>* a, const std::vector<uint32_t>* b) {
+            return a->size() < b->size();
+        });
+        lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+        for (uint32_t idx : *lists[0]) {
+            const Entry& e = m_entries[idx];
+            if (!e.alive) continue;
+            bool inAll = true;
+            for (size_t l = 1; l < lists.size() && inAll; ++l) {
+                inAll = std::binary_search(lists[l]->begin(), lists[l]->end(), idx);
+            }
+            if (!inAll) continue;
+            uint32_t rank = rankOf(e);
+            if (rank != UINT32_MAX) m_scratchRanked.emplace_back(rank, idx);
+        }
+    } else {
+        auto it = m_prefixPostings.find(packPrefix(q.data(), q.size()));
+        if (it == m_prefixPostings.end()) return 0;
+        for (uint32_t idx : it->second) {
+            const Entry& e = m_entries[idx];
+            if (!e.alive) continue;
+            uint32_t rank = rankOf(e);
+            if (rank != UINT32_MAX) m_scratchRanked.emplace_back(rank, idx);
+        }
+    }
+
+    const size_t total = m_scratchRanked.size();
+    const size_t shown = std::min(total, maxHits);
+    std::partial_sort(m_scratchRanked.begin(), m_scratchRanked.begin() + (ptrdiff_t)shown, m_scratchRanked.end());
+    out.reserve(shown);
+    for (size_t i = 0; i < shown; ++i) {
+        const Entry& e = m_entries[m_scratchRanked[i].second];
+        Hit hit;
+        hit.spirit = e.spirit;
+        hit.nodeId = e.id;
+        hit.name = e.name;
+        hit.type = e.type;
+        hit.field = (Field)(m_scratchRanked[i].first / 2);
+        hit.prefix = (m_scratchRanked[i].first % 2) == 0;
+        out.push_back(hit);
+    }
+    return total;
+}
+
+} // namespace Watercan
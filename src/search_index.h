@@ -0,0 +1,101 @@
+#pragma once
+
+#include "string_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Watercan {
+
+class SpiritTreeManager;
+struct SpiritNode;
+
+// Search over the nodes of every spirit of a loaded file by nm, typ and id (hex or decimal),
+// case-insensitive. Queries of three or more characters match anywhere in a field through a
+// trigram index; shorter ones match field prefixes through postings keyed by the first one or
+// two characters of each field. sync() brings
+// the index up to date with a manager by re-checking only the spirits edited since the last
+// call, and within those only the nodes whose id, nm or typ changed.
+class SearchIndex {
+public:
+    enum class Field : uint8_t { Name = 0, Type, HexId, DecimalId };
+    static constexpr size_t FIELD_COUNT = 4;
+
+    struct Hit {
+        Symbol spirit;
+        uint64_t nodeId = 0;
+        Symbol name;
+        Symbol type;
+        Field field = Field::Name;  // best field the query matched
+        bool prefix = false;        // the match starts that field
+    };
+
+    // Index every spirit of manager not yet seen and re-check the ones edited since the last
+    // sync (per-spirit edit generations); spirits no longer in the file are dropped. Never
+    // builds a tree: spirits not built yet are read from the load snapshot. Returns true if
+    // anything changed. A different manager should be preceded by clear().
+    bool sync(const SpiritTreeManager& manager);
+    void clear();
+
+    // Up to maxHits best matches (name before type before id, prefix before substring, then
+    // file order) into out; returns the number of matching nodes, which may exceed maxHits.
+    // A leading "0x" restricts the query to hex ids.
+    size_t query(const std::string& text, size_t maxHits, std::vector<Hit>& out);
+
+    // Bumped whenever the indexed content changes, so cached results can be re-queried
+    uint64_t version() const { return m_version; }
+    size_t nodeCount() const { return m_entries.size() - m_deadCount; }
+
+private:
+    struct Entry {
+        Symbol spirit;
+        uint64_t id = 0;
+        Symbol name;
+        Symbol type;
+        // Lower-cased fields separated by '\x1f' (name, type, hex id, decimal id)
+        std::string text;
+        uint32_t fieldEnd[FIELD_COUNT] = {};
+        bool alive = true;
+
+        uint32_t fieldStart(size_t f) const { return f == 0 ? 0 : fieldEnd[f - 1] + 1; }
+    };
+    struct SpiritSlot {
+        uint64_t generation = 0;
+        uint64_t pass = 0;
+        std::vector<uint32_t> entries;   // live entries of this spirit, in node order
+    };
+    void indexSpirit(const std::string& spiritName, const std::vector<SpiritNode>& nodes, SpiritSlot& slot);
+    uint32_t addEntry(Symbol spirit, const SpiritNode& node);
+    void addTrigrams(uint32_t index);
+    void killEntry(uint32_t index);
+    // Drop dead entries and rebuild the postings once they outnumber the live ones
+    void compactIfNeeded();
+    static uint32_t packTrigram(const char* p) {
+        return ((uint32_t)(uint8_t)p[0] << 16) | ((uint32_t)(uint8_t)p[1] << 8) | (uint32_t)(uint8_t)p[2];
+    }
+    // Key of a one- or two-character field prefix, with the length in the top byte
+    static uint32_t packPrefix(const char* p, size_t len) {
+        return ((uint32_t)len << 24) | ((uint32_t)(uint8_t)p[0] << 16) | (len > 1 ? (uint32_t)(uint8_t)p[1] << 8 : 0u);
+    }
+
+    std::vector<Entry> m_entries;
+    size_t m_deadCount = 0;
+    // Trigram -> ascending entry indices (dead entries are skipped at query time)
+    std::unordered_map<uint32_t, std::vector<uint32_t>> m_postings;
+    // Field prefix -> ascending entry indices, for queries shorter than a trigram
+    std::unordered_map<uint32_t, std::vector<uint32_t>> m_prefixPostings;
+    std::unordered_map<std::string, SpiritSlot> m_spirits;
+
+    uint64_t m_syncedGeneration = 0;
+    uint64_t m_pass = 0;
+    uint64_t m_version = 0;
+
+    // Scratch reused between calls
+    std::unordered_map<uint64_t, uint32_t> m_scratchById;
+    std::vector<uint32_t> m_scratchTrigrams;
+    std::vector<std::pair<uint32_t, uint32_t>> m_scratchRanked; // (rank, entry)
+};
+
+} // namespace Watercan
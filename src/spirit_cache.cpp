@@ -0,0 +1,321 @@
+#include "spirit_cache.h"
+#include "mapped_file.h"
+#include "spirit_tree.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <unordered_map>
+
+namespace Watercan {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr char CACHE_MAGIC[8] = {'W', 'C', 'S', 'P', 'I', 'R', 'I', 'T'};
+// Bump whenever the record layout or the tree build/layout rules change
+constexpr uint32_t CACHE_VERSION = 2;
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304u;
+constexpr uint32_t FLAG_LAID_OUT = 1u << 0;
+constexpr uint32_t FLAG_RANGES = 1u << 1;
+constexpr uint32_t NODE_AP = 1u << 0;
+
+inline uint64_t mix(uint64_t h, uint64_t w) {
+    h = (h ^ w) * 0xFF51AFD7ED558CCDull;
+    return h ^ (h >> 32);
+}
+
+class Writer {
+public:
+    explicit Writer(std::string& out) : m_out(out) {}
+    template <typename T> void put(T v) {
+        char buf[sizeof(T)];
+        std::memcpy(buf, &v, sizeof(T));
+        m_out.append(buf, sizeof(T));
+    }
+    void bytes(const void* p, size_t n) { m_out.append(static_cast<const char*>(p), n); }
+private:
+    std::string& m_out;
+};
+
+// Bounds-checked cursor over the mapped cache; any overrun latches ok() to false
+class Reader {
+public:
+    Reader(const unsigned char* p, size_t n) : m_p(p), m_end(p + n) {}
+    template <typename T> T get() {
+        T v{};
+        if ((size_t)(m_end - m_p) < sizeof(T)) { m_ok = false; return v; }
+        std::memcpy(&v, m_p, sizeof(T));
+        m_p += sizeof(T);
+        return v;
+    }
+    const unsigned char* take(size_t n) {
+        if ((size_t)(m_end - m_p) < n) { m_ok = false; return nullptr; }
+        const unsigned char* p = m_p;
+        m_p += n;
+        return p;
+    }
+    // Enough bytes left for count records of recordSize (guards allocations)
+    bool fits(uint64_t count, size_t recordSize) {
+        if (count > (uint64_t)(m_end - m_p) / recordSize) m_ok = false;
+        return m_ok;
+    }
+    bool ok() const { return m_ok; }
+private:
+    const unsigned char* m_p;
+    const unsigned char* m_end;
+    bool m_ok = true;
+};
+
+// Per-node record size: id, dep, 4 string indices, cost, flags, x, y, child count
+constexpr size_t NODE_RECORD_BYTES = 8 + 8 + 4 * 4 + 4 + 4 + 4 + 4 + 4;
+// Per-node source range: offset, length
+constexpr size_t RANGE_RECORD_BYTES = 8 + 4;
+
+void writeKey(Writer& w, const SourceKey& key) {
+    w.put<uint64_t>(key.size);
+    w.put<int64_t>(key.mtime);
+    w.put<uint64_t>(key.hash);
+    w.put<uint32_t>((uint32_t)key.path.size());
+    w.bytes(key.path.data(), key.path.size());
+}
+
+} // namespace
+
+uint64_t hashBytes(const unsigned char* data, size_t size) {
+    // Four independent lanes over 32-byte blocks keep the multiplies pipelined
+    uint64_t h[4] = {0x9E3779B97F4A7C15ull ^ size, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull, 0x27D4EB2F165667C5ull};
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (int lane = 0; lane < 4; ++lane) {
+            uint64_t w;
+            std::memcpy(&w, data + i + lane * 8, 8);
+            h[lane] = mix(h[lane], w);
+        }
+    }
+    uint64_t r = mix(mix(h[0], h[1]), mix(h[2], h[3]));
+    for (; i + 8 <= size; i += 8) {
+        uint64_t w;
+        std::memcpy(&w, data + i, 8);
+        r = mix(r, w);
+    }
+    uint64_t tail = 0;
+    if (i < size) std::memcpy(&tail, data + i, size - i);
+    return mix(mix(r, tail), size);
+}
+
+bool makeSourceKey(const std::string& path, const unsigned char* data, size_t size, SourceKey& key) {
+    try {
+        std::error_code ec;
+        fs::path abs = fs::weakly_canonical(fs::absolute(fs::u8path(path)), ec);
+        key.path = ec ? path : abs.u8string();
+        auto mtime = fs::last_write_time(fs::u8path(path), ec);
+        if (ec) return false;
+        key.mtime = (int64_t)mtime.time_since_epoch().count();
+    } catch (...) {
+        return false;
+    }
+    key.size = size;
+    key.hash = hashBytes(data, size);
+    return true;
+}
+
+std::string spiritCachePath(const std::string& cacheDir, const SourceKey& key) {
+    uint64_t h = hashBytes(reinterpret_cast<const unsigned char*>(key.path.data()), key.path.size());
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.wcache", (unsigned long long)h);
+    return (fs::u8path(cacheDir) / name).u8string();
+}
+
+void serializeSpiritCache(const SourceKey& key, const std::vector<SpiritCacheEntry>& spirits, std::string& buffer) {
+    // String table: every distinct Symbol (and spirit name) once, index 0 = ""
+    std::vector<const std::string*> strings{nullptr};
+    std::unordered_map<std::string, uint32_t> stringIndex{{std::string(), 0u}};
+    auto intern = [&](const std::string& s) -> uint32_t {
+        auto it = stringIndex.find(s);
+        if (it != stringIndex.end()) return it->second;
+        uint32_t idx = (uint32_t)strings.size();
+        auto placed = stringIndex.emplace(s, idx).first;
+        strings.push_back(&placed->first);
+        return idx;
+    };
+    size_t nodeTotal = 0;
+    for (const auto& e : spirits) {
+        intern(e.tree->spiritName);
+        for (const auto& n : e.tree->nodes) {
+            intern(n.name);
+            intern(n.spirit);
+            intern(n.type);
+            intern(n.costType);
+        }
+        nodeTotal += e.tree->nodes.size();
+    }
+
+    buffer.clear();
+    buffer.reserve(256 + key.path.size() + nodeTotal * (NODE_RECORD_BYTES + RANGE_RECORD_BYTES + 16));
+    Writer w(buffer);
+    w.bytes(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    w.put<uint32_t>(CACHE_VERSION);
+    w.put<uint32_t>(BYTE_ORDER_MARK);
+    writeKey(w, key);
+    w.put<uint32_t>((uint32_t)strings.size());
+    for (size_t i = 1; i < strings.size(); ++i) {
+        w.put<uint32_t>((uint32_t)strings[i]->size());
+        w.bytes(strings[i]->data(), strings[i]->size());
+    }
+
+    w.put<uint32_t>((uint32_t)spirits.size());
+    for (const auto& e : spirits) {
+        const SpiritTree& tree = *e.tree;
+        size_t childTotal = 0;
+        if (e.laidOut) {
+            for (const auto& n : tree.nodes) childTotal += n.children.size();
+        }
+        w.put<uint32_t>(stringIndex[tree.spiritName]);
+        w.put<uint32_t>((uint32_t)tree.nodes.size());
+        w.put<uint32_t>((uint32_t)childTotal);
+        const bool hasRanges = e.ranges && e.ranges->size() == tree.nodes.size();
+        w.put<uint32_t>((e.laidOut ? FLAG_LAID_OUT : 0u) | (hasRanges ? FLAG_RANGES : 0u));
+        w.put<uint64_t>(e.laidOut ? tree.rootNodeId : 0);
+        const float bounds[6] = {tree.minX, tree.maxX, tree.minY, tree.maxY, tree.width, tree.height};
+        for (float b : bounds) w.put<float>(e.laidOut ? b : 0.0f);
+        for (const auto& n : tree.nodes) {
+            w.put<uint64_t>(n.id);
+            w.put<uint64_t>(n.dep);
+            w.put<uint32_t>(stringIndex[n.name]);
+            w.put<uint32_t>(stringIndex[n.spirit]);
+            w.put<uint32_t>(stringIndex[n.type]);
+            w.put<uint32_t>(stringIndex[n.costType]);
+            w.put<int32_t>((int32_t)n.cost);
+            w.put<uint32_t>(n.isAdventurePass ? NODE_AP : 0u);
+            w.put<float>(e.laidOut ? n.x : 0.0f);
+            w.put<float>(e.laidOut ? n.y : 0.0f);
+            w.put<uint32_t>(e.laidOut ? (uint32_t)n.children.size() : 0u);
+        }
+        if (e.laidOut) {
+            for (const auto& n : tree.nodes) {
+                for (uint64_t c : n.children) w.put<uint64_t>(c);
+            }
+        }
+        if (hasRanges) {
+            for (const SourceRange& range : *e.ranges) {
+                w.put<uint64_t>(range.offset);
+                w.put<uint32_t>(range.length);
+            }
+        }
+    }
+    w.put<uint64_t>(hashBytes(reinterpret_cast<const unsigned char*>(buffer.data()), buffer.size()));
+}
+
+bool readSpiritCache(const std::string& cachePath, const SourceKey& key, std::vector<SpiritTree>& trees,
+                     std::vector<uint8_t>& laidOut, std::vector<std::vector<SourceRange>>& ranges) {
+    MappedFile file;
+    if (!file.open(cachePath) || file.size() < sizeof(CACHE_MAGIC) + 8 + sizeof(uint64_t)) return false;
+
+    // Whole-file check first: a damaged cache is rejected before anything is allocated
+    const size_t bodySize = file.size() - sizeof(uint64_t);
+    uint64_t storedHash = 0;
+    std::memcpy(&storedHash, file.data() + bodySize, sizeof(storedHash));
+
+    Reader r(file.data(), bodySize);
+    const unsigned char* magic = r.take(sizeof(CACHE_MAGIC));
+    if (!magic || std::memcmp(magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) return false;
+    if (r.get<uint32_t>() != CACHE_VERSION || r.get<uint32_t>() != BYTE_ORDER_MARK) return false;
+
+    SourceKey stored;
+    stored.size = r.get<uint64_t>();
+    stored.mtime = r.get<int64_t>();
+    stored.hash = r.get<uint64_t>();
+    uint32_t pathLen = r.get<uint32_t>();
+    const unsigned char* pathBytes = r.take(pathLen);
+    if (!r.ok()) return false;
+    stored.path.assign(reinterpret_cast<const char*>(pathBytes), pathLen);
+    if (stored != key) return false;
+    if (hashBytes(file.data(), bodySize) != storedHash) return false;
+
+    uint32_t stringCount = r.get<uint32_t>();
+    if (stringCount == 0 || !r.fits(stringCount - 1, sizeof(uint32_t))) return false;
+    std::vector<Symbol> symbols;
+    symbols.reserve(stringCount);
+    symbols.emplace_back();
+    for (uint32_t i = 1; i < stringCount; ++i) {
+        uint32_t len = r.get<uint32_t>();
+        const unsigned char* s = r.take(len);
+        if (!r.ok()) return false;
+        symbols.emplace_back(std::string_view(reinterpret_cast<const char*>(s), len));
+    }
+    auto symbol = [&](uint32_t idx, bool& ok) -> Symbol {
+        if (idx >= symbols.size()) { ok = false; return Symbol(); }
+        return symbols[idx];
+    };
+
+    uint32_t spiritCount = r.get<uint32_t>();
+    if (!r.fits(spiritCount, 48)) return false;
+    std::vector<SpiritTree> outTrees(spiritCount);
+    std::vector<uint8_t> outLaidOut(spiritCount, 0);
+    std::vector<std::vector<SourceRange>> outRanges(spiritCount);
+    bool ok = true;
+    for (uint32_t s = 0; s < spiritCount && ok; ++s) {
+        SpiritTree& tree = outTrees[s];
+        tree.spiritName = symbol(r.get<uint32_t>(), ok).str();
+        uint32_t nodeCount = r.get<uint32_t>();
+        uint32_t childTotal = r.get<uint32_t>();
+        uint32_t flags = r.get<uint32_t>();
+        const bool hasLayout = (flags & FLAG_LAID_OUT) != 0;
+        tree.rootNodeId = r.get<uint64_t>();
+        tree.minX = r.get<float>();
+        tree.maxX = r.get<float>();
+        tree.minY = r.get<float>();
+        tree.maxY = r.get<float>();
+        tree.width = r.get<float>();
+        tree.height = r.get<float>();
+        if (tree.spiritName.empty() || !r.fits(nodeCount, NODE_RECORD_BYTES)) return false;
+
+        tree.nodes.resize(nodeCount);
+        std::vector<uint32_t> childCounts(nodeCount);
+        uint64_t childSum = 0;
+        for (uint32_t i = 0; i < nodeCount; ++i) {
+            SpiritNode& n = tree.nodes[i];
+            n.id = r.get<uint64_t>();
+            n.dep = r.get<uint64_t>();
+            n.name = symbol(r.get<uint32_t>(), ok);
+            n.originalName = n.name;
+            n.spirit = symbol(r.get<uint32_t>(), ok);
+            n.type = symbol(r.get<uint32_t>(), ok);
+            n.costType = symbol(r.get<uint32_t>(), ok);
+            n.cost = (int)r.get<int32_t>();
+            n.isAdventurePass = (r.get<uint32_t>() & NODE_AP) != 0;
+            n.x = r.get<float>();
+            n.y = r.get<float>();
+            childCounts[i] = r.get<uint32_t>();
+            childSum += childCounts[i];
+        }
+        if (!r.ok() || childSum != childTotal || (!hasLayout && childTotal != 0) ||
+            !r.fits(childTotal, sizeof(uint64_t))) {
+            return false;
+        }
+        for (uint32_t i = 0; i < nodeCount; ++i) {
+            auto& children = tree.nodes[i].children;
+            children.resize(childCounts[i]);
+            for (uint64_t& c : children) c = r.get<uint64_t>();
+        }
+        if (flags & FLAG_RANGES) {
+            if (!r.fits(nodeCount, RANGE_RECORD_BYTES)) return false;
+            std::vector<SourceRange>& nodeRanges = outRanges[s];
+            nodeRanges.resize(nodeCount);
+            for (SourceRange& range : nodeRanges) {
+                range.offset = r.get<uint64_t>();
+                range.length = r.get<uint32_t>();
+            }
+        }
+        outLaidOut[s] = hasLayout ? 1 : 0;
+    }
+    if (!ok || !r.ok()) return false;
+
+    trees = std::move(outTrees);
+    laidOut = std::move(outLaidOut);
+    ranges = std::move(outRanges);
+    return true;
+}
+
+} // namespace Watercan
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Watercan {
+
+struct SpiritTree;
+struct SourceRange;
+
+// Identity of a spirits file as it was parsed. A binary cache built from it is only used
+// while every field still matches the file on disk.
+struct SourceKey {
+    std::string path;   // absolute, normalized
+    uint64_t size = 0;
+    int64_t mtime = 0;  // std::filesystem::file_time_type ticks
+    uint64_t hash = 0;  // hashBytes of the contents
+
+    bool operator==(const SourceKey& o) const {
+        return size == o.size && mtime == o.mtime && hash == o.hash && path == o.path;
+    }
+    bool operator!=(const SourceKey& o) const { return !(*this == o); }
+};
+
+// Fast 64-bit content hash (not cryptographic; detects edits, not tampering)
+uint64_t hashBytes(const unsigned char* data, size_t size);
+// Fill key for the file at path whose contents are data/size; false if it cannot be stat'ed
+bool makeSourceKey(const std::string& path, const unsigned char* data, size_t size, SourceKey& key);
+// Cache location for a spirits file: "<cacheDir>/<hash of its SourceKey path>.wcache", so
+// nothing is ever written next to the user's files
+std::string spiritCachePath(const std::string& cacheDir, const SourceKey& key);
+
+// A spirit to store: its nodes and, when laidOut, their child lists, positions, root and
+// bounds exactly as a fresh build of the load snapshot produces them. ranges, when set, holds
+// the source range of every node (parallel to tree->nodes).
+struct SpiritCacheEntry {
+    const SpiritTree* tree = nullptr;
+    bool laidOut = false;
+    const std::vector<SourceRange>* ranges = nullptr;
+};
+
+// Binary cache format (native byte order, rejected on any other):
+//   header   magic, version, SourceKey, string table (every distinct text field once)
+//   spirits  per spirit: name, counts, root id, bounds, node records (ids, string indices,
+//            cost, ap, position, child count), the concatenated child id lists and the
+//            node source ranges
+//   trailer  hashBytes of everything above, so torn or corrupted files are ignored
+// Serializes into out; the caller writes it (to a temporary file renamed over the old cache).
+void serializeSpiritCache(const SourceKey& key, const std::vector<SpiritCacheEntry>& spirits, std::string& out);
+
+// Read a cache written for key (memory-mapped). trees receives every spirit in file order
+// with spiritName, nodes (originalName = name) and, where laidOut[i] is set, children,
+// positions, rootNodeId and bounds; ranges[i] is empty for spirits stored without source
+// ranges. False, with the outputs untouched, when the cache is missing, stale, from another
+// build or damaged.
+bool readSpiritCache(const std::string& cachePath, const SourceKey& key, std::vector<SpiritTree>& trees,
+                     std::vector<uint8_t>& laidOut, std::vector<std::vector<SourceRange>>& ranges);
+
+} // namespace Watercan
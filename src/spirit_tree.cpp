@@ -1,8 +1,14 @@
 #include "spirit_tree.h"
+#include "name_index.h"
+#include "mapped_file.h"
 #include <nlohmann/json.hpp>
 #include <fstream>
 #include <algorithm>
+#include <cctype>
+#include <charconv>
 #include <cmath>
+#include <filesystem>
+#include <iterator>
 #include <unordered_set>
 #include <queue>
 
@@ -10,104 +16,655 @@ namespace Watercan {
 
 using json = nlohmann::json;
 
-bool SpiritTreeManager::loadFromFile(const std::string& filepath) {
-    std::ifstream file(filepath);
-    if (!file.is_open()) {
+SpiritNode* SpiritTree::findNode(uint64_t id) {
+    return const_cast<SpiritNode*>(static_cast<const SpiritTree*>(this)->findNode(id));
+}
+
+const SpiritNode* SpiritTree::findNode(uint64_t id) const {
+    auto it = indexById.find(id);
+    if (it == indexById.end() || it->second >= nodes.size()) return nullptr;
+    return &nodes[it->second];
+}
+
+void SpiritTree::reindex() {
+    indexById.clear();
+    indexById.reserve(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) indexById[nodes[i].id] = i;
+}
+
+void SpiritTree::appendNode(const SpiritNode& node) {
+    nodes.push_back(node);
+    indexById[node.id] = nodes.size() - 1;
+}
+
+void SpiritTree::insertNodeAt(size_t pos, const SpiritNode& node) {
+    pos = std::min(pos, nodes.size());
+    nodes.insert(nodes.begin() + pos, node);
+    for (auto& kv : indexById) {
+        if (kv.second >= pos) ++kv.second;
+    }
+    // The last node in file order keeps the entry for a repeated id
+    auto it = indexById.find(node.id);
+    if (it == indexById.end() || it->second < pos) indexById[node.id] = pos;
+}
+
+void SpiritTree::eraseNodeAt(size_t pos) {
+    if (pos >= nodes.size()) return;
+    uint64_t id = nodes[pos].id;
+    nodes.erase(nodes.begin() + pos);
+    auto it = indexById.find(id);
+    if (it != indexById.end() && it->second == pos) indexById.erase(it);
+    for (auto& kv : indexById) {
+        if (kv.second > pos) --kv.second;
+    }
+    // A node sharing the erased id (duplicate name) takes over the entry; the erased one was
+    // the last, so any other comes before it
+    if (indexById.find(id) == indexById.end()) {
+        for (size_t i = pos; i-- > 0; ) {
+            if (nodes[i].id == id) { indexById.emplace(id, i); break; }
+        }
+    }
+}
+
+void SpiritTree::reindexId(uint64_t id) {
+    for (size_t i = nodes.size(); i-- > 0; ) {
+        if (nodes[i].id == id) { indexById[id] = i; return; }
+    }
+    indexById.erase(id);
+}
+
+namespace {
+
+// Point rootNodeId at the last root in file order, as buildTree leaves it
+void resetRootId(SpiritTree& tree) {
+    for (size_t i = tree.nodes.size(); i-- > 0; ) {
+        if (tree.nodes[i].dep == 0) { tree.rootNodeId = tree.nodes[i].id; return; }
+    }
+}
+
+// Accumulate an (oldBase - newBase) shift for id
+void addShift(std::unordered_map<uint64_t, std::pair<float,float>>* shifts, uint64_t id, float dx, float dy) {
+    if (!shifts) return;
+    auto& s = (*shifts)[id];
+    s.first += dx;
+    s.second += dy;
+}
+
+// Byte iterator that publishes how far the parser has read, so the SAX reader can record
+// item ranges during the one parse. The lexer reads a character at a time and reports '{'
+// and '}' right after reading them, so at those events the position is just past the brace.
+class TrackedInput {
+public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = char;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const char*;
+    using reference = const char&;
+
+    TrackedInput(const char* p, const char** pos) : m_p(p), m_pos(pos) {}
+    reference operator*() const { return *m_p; }
+    TrackedInput& operator++() { *m_pos = ++m_p; return *this; }
+    TrackedInput operator++(int) { TrackedInput old = *this; ++*this; return old; }
+    bool operator==(const TrackedInput& o) const { return m_p == o.m_p; }
+    bool operator!=(const TrackedInput& o) const { return m_p != o.m_p; }
+
+private:
+    const char* m_p;
+    const char** m_pos;
+};
+
+// SAX reader for the spirits array: fills SpiritNodes straight from the token stream so no
+// DOM is ever built. Follows json::value() semantics per item: unknown keys are skipped,
+// a repeated key keeps its last value, and a known key whose (last) value has the wrong
+// JSON type fails the whole load. Given the text start and a TrackedInput position it also
+// records each item's byte range.
+class SpiritNodeSaxReader : public nlohmann::json_sax<json> {
+public:
+    explicit SpiritNodeSaxReader(LoadedSpirits& out, const char* base = nullptr, const char* const* pos = nullptr)
+        : m_out(out), m_base(base), m_pos(pos) {}
+
+    bool null() override { return scalar(Value::Null); }
+    bool boolean(bool val) override { m_bool = val; return scalar(Value::Bool); }
+    bool number_integer(number_integer_t val) override {
+        m_unsigned = (uint64_t)val; m_int = (int)val; return scalar(Value::Number);
+    }
+    bool number_unsigned(number_unsigned_t val) override {
+        m_unsigned = val; m_int = (int)val; return scalar(Value::Number);
+    }
+    bool number_float(number_float_t val, const string_t&) override {
+        m_unsigned = (uint64_t)val; m_int = (int)val; return scalar(Value::Number);
+    }
+    bool string(string_t& val) override { m_string = &val; return scalar(Value::String); }
+    bool binary(binary_t&) override { return scalar(Value::Other); }
+
+    bool start_object(std::size_t) override {
+        if (m_depth == 2) containerValue();
+        if (m_depth == 1 && m_pos) m_itemStart = *m_pos - 1;
+        ++m_depth;
+        if (m_depth == 2) { m_node = SpiritNode(); m_field = Field::None; m_badFields = 0; }
+        return true;
+    }
+    bool end_object() override {
+        if (m_depth == 2) {
+            if (m_badFields != 0) return false;
+            m_node.originalName = m_node.name;
+            if (m_pos) {
+                SourceRange range{(uint64_t)(m_itemStart - m_base), (uint32_t)(*m_pos - m_itemStart)};
+                m_out.add(std::move(m_node), &range);
+            } else {
+                m_out.add(std::move(m_node), nullptr);
+            }
+        }
+        --m_depth;
+        m_field = Field::None;
+        return true;
+    }
+    bool start_array(std::size_t) override {
+        if (m_depth == 1) return false; // array items must be objects
+        if (m_depth == 2) containerValue();
+        ++m_depth;
+        return true;
+    }
+    bool end_array() override {
+        --m_depth;
+        m_field = Field::None;
+        return true;
+    }
+    bool key(string_t& val) override {
+        if (m_depth != 2) return true;
+        if (val == "id") m_field = Field::Id;
+        else if (val == "dep") m_field = Field::Dep;
+        else if (val == "nm") m_field = Field::Name;
+        else if (val == "spirit") m_field = Field::Spirit;
+        else if (val == "typ") m_field = Field::Type;
+        else if (val == "ctyp") m_field = Field::CostType;
+        else if (val == "cst") m_field = Field::Cost;
+        else if (val == "ap") m_field = Field::AdventurePass;
+        else m_field = Field::None;
+        return true;
+    }
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override {
         return false;
     }
 
+private:
+    enum class Field { None, Id, Dep, Name, Spirit, Type, CostType, Cost, AdventurePass };
+    enum class Value { Null, Bool, Number, String, Other };
+
+    bool scalar(Value kind) {
+        // A bare top-level null iterates as empty; any other non-object item is an error
+        if (m_depth == 0) return kind == Value::Null;
+        if (m_depth == 1) return false;
+        if (m_depth > 2) return true;
+        Field field = m_field;
+        m_field = Field::None;
+        bool ok = true;
+        switch (field) {
+            case Field::None: return true;
+            case Field::Id:
+                if ((ok = kind == Value::Number)) m_node.id = m_unsigned;
+                break;
+            case Field::Dep:
+                if ((ok = kind == Value::Number)) m_node.dep = m_unsigned;
+                break;
+            case Field::Cost:
+                if ((ok = kind == Value::Number)) m_node.cost = m_int;
+                break;
+            case Field::AdventurePass:
+                if ((ok = kind == Value::Bool)) m_node.isAdventurePass = m_bool;
+                break;
+            case Field::Name:
+            case Field::Spirit:
+            case Field::Type:
+            case Field::CostType:
+                if ((ok = kind == Value::String)) {
+                    Symbol& dst = field == Field::Name ? m_node.name
+                                : field == Field::Spirit ? m_node.spirit
+                                : field == Field::Type ? m_node.type
+                                : m_node.costType;
+                    dst = Symbol(*m_string);
+                }
+                break;
+        }
+        setFieldBad(field, !ok);
+        return true;
+    }
+
+    // An object/array value inside an item: fine for unknown keys, a type error for known ones
+    void containerValue() {
+        setFieldBad(m_field, m_field != Field::None);
+        m_field = Field::None;
+    }
+
+    void setFieldBad(Field field, bool bad) {
+        uint32_t bit = 1u << (uint32_t)field;
+        if (bad) m_badFields |= bit; else m_badFields &= ~bit;
+    }
+
+    LoadedSpirits& m_out;
+    const char* m_base;
+    const char* const* m_pos;         // parser position, when tracked
+    const char* m_itemStart = nullptr;
+    SpiritNode m_node;
+    int m_depth = 0;
+    Field m_field = Field::None;
+    uint32_t m_badFields = 0; // known keys whose current value has the wrong type
+    bool m_bool = false;
+    uint64_t m_unsigned = 0;
+    int m_int = 0;
+    std::string* m_string = nullptr;
+};
+
+} // namespace
+
+void LoadedSpirits::add(SpiritNode&& node, const SourceRange* range) {
+    if (node.spirit.empty()) return;
+    auto it = nodes.find(node.spirit);
+    if (it == nodes.end()) {
+        order.push_back(node.spirit);
+        it = nodes.emplace(node.spirit, std::vector<SpiritNode>()).first;
+    }
+    it->second.push_back(std::move(node));
+    if (range) ranges[it->first].push_back(*range);
+}
+
+namespace {
+
+bool fileModifiedTime(const std::string& path, int64_t& out) {
+    std::error_code ec;
+    auto mtime = std::filesystem::last_write_time(std::filesystem::u8path(path), ec);
+    if (ec) return false;
+    out = (int64_t)mtime.time_since_epoch().count();
+    return true;
+}
+
+} // namespace
+
+bool SpiritTreeManager::loadFromFile(const std::string& filepath) {
+    if (!m_binaryCacheDir.empty()) return loadWithBinaryCache(filepath);
+
+    MappedFile source;
+    if (!source.open(filepath)) return false;
+    return loadFromMappedJson(filepath, source.data(), source.size());
+}
+
+bool SpiritTreeManager::loadFromMappedJson(const std::string& filepath, const unsigned char* data, size_t size) {
     try {
-        json data = json::parse(file);
-        if (!loadFromJson(data)) return false;
+        LoadedSpirits loaded;
+        const char* begin = reinterpret_cast<const char*>(data);
+        const char* pos = begin;
+        SpiritNodeSaxReader reader(loaded, begin, &pos);
+        if (!json::sax_parse(TrackedInput(begin, &pos), TrackedInput(begin + size, &pos), &reader)) return false;
+        if (!loadFromSpirits(loaded)) return false;
         m_loadedFile = filepath;
+
+        // Item ranges are only worth keeping while the file can still be checked for changes
+        int64_t mtime = 0;
+        if (fileModifiedTime(filepath, mtime)) adoptSourceRanges(std::move(loaded.ranges), size, mtime);
         return true;
     } catch (const std::exception& e) {
         return false;
     }
 }
 
-bool SpiritTreeManager::getNameFromLoadedFile(const std::string& spiritName, uint64_t nodeId, std::string* outName) const {
-    if (m_loadedFile.empty()) return false;
+void SpiritTreeManager::adoptSourceRanges(std::unordered_map<std::string, std::vector<SourceRange>>&& ranges,
+                                          uint64_t fileSize, int64_t fileTime) {
+    for (auto& kv : ranges) {
+        auto oit = m_originalTrees.find(kv.first);
+        if (oit == m_originalTrees.end() || oit->second.nodes.size() != kv.second.size()) continue;
+        m_originalRanges[kv.first] = std::move(kv.second);
+    }
+    m_rangesFileSize = fileSize;
+    m_rangesFileTime = fileTime;
+}
+
+bool SpiritTreeManager::loadWithBinaryCache(const std::string& filepath) {
+    // The key needs the whole file anyway, so the JSON fallback parses the same mapping
+    MappedFile source;
+    if (!source.open(filepath)) return false;
+    SourceKey key;
+    const bool keyed = makeSourceKey(filepath, source.data(), source.size(), key);
+
     try {
-        std::ifstream f(m_loadedFile);
-        if (!f.is_open()) return false;
-        json data = json::parse(f);
-        for (const auto &item : data) {
-            uint64_t id = item.value("id", 0ULL);
-            std::string spirit = item.value("spirit", std::string());
-            if (id == nodeId && spirit == spiritName) {
-                if (outName) *outName = item.value("nm", std::string());
+        std::vector<SpiritTree> cached;
+        std::vector<uint8_t> laidOut;
+        std::vector<std::vector<SourceRange>> ranges;
+        if (keyed && readSpiritCache(spiritCachePath(m_binaryCacheDir, key), key, cached, laidOut, ranges)) {
+            LoadedSpirits loaded;
+            for (size_t i = 0; i < cached.size(); ++i) {
+                const SpiritTree& tree = cached[i];
+                // The snapshot is what the parser would have produced: no layout or children
+                std::vector<SpiritNode>& nodes = loaded.nodes[tree.spiritName];
+                nodes = tree.nodes;
+                for (SpiritNode& n : nodes) {
+                    n.x = n.y = 0.0f;
+                    std::vector<uint64_t>().swap(n.children);
+                }
+                if (!ranges[i].empty()) loaded.ranges[tree.spiritName] = std::move(ranges[i]);
+                loaded.order.push_back(tree.spiritName);
+            }
+            if (loaded.nodes.size() == cached.size() && loadFromSpirits(loaded)) {
+                // The key matched, so the ranges still describe the file on disk
+                adoptSourceRanges(std::move(loaded.ranges), key.size, key.mtime);
+                bool complete = true;
+                for (size_t i = 0; i < cached.size(); ++i) {
+                    if (!laidOut[i]) {
+                        complete = false;
+                        continue;
+                    }
+                    cached[i].reindex();
+                    adoptTree(std::move(cached[i]));
+                }
+                m_loadedFile = filepath;
+                m_sourceKey = key;
+                m_loadedFromCache = true;
+                m_cacheStale = !complete;
                 return true;
             }
         }
-    } catch (...) {}
-    return false;
+
+        if (!loadFromMappedJson(filepath, source.data(), source.size())) return false;
+        if (keyed) {
+            m_sourceKey = key;
+            m_cacheStale = true;
+        }
+        return true;
+    } catch (const std::exception& e) {
+        return false;
+    }
 }
 
-bool SpiritTreeManager::loadFromJson(const nlohmann::json& data) {
-    m_trees.clear();
-    m_spiritNames.clear();
-    m_guideNames.clear();
-    m_allSpiritNamesOrdered.clear();
+bool SpiritTreeManager::takeBinaryCache(BinaryCacheSnapshot& out) {
+    if (m_sourceKey.path.empty() || m_loadedFile.empty() || m_binaryCacheDir.empty()) return false;
+    // One attempt per load; an unwritable directory must not be retried every frame
+    m_cacheStale = false;
+    out.path = spiritCachePath(m_binaryCacheDir, m_sourceKey);
+    out.key = m_sourceKey;
+    out.trees.clear();
+    out.laidOut.clear();
+    out.ranges.clear();
+    out.trees.reserve(m_loadOrder.size());
+    out.laidOut.reserve(m_loadOrder.size());
+    for (const auto& spiritName : m_loadOrder) {
+        auto oit = m_originalTrees.find(spiritName);
+        if (oit == m_originalTrees.end()) return false; // deleted since the load
+        // A built tree that was never edited is exactly what a fresh build would produce
+        auto it = m_trees.find(spiritName);
+        auto use = m_treeUse.find(spiritName);
+        const bool laidOut = it != m_trees.end() && use != m_treeUse.end() && !use->second.touched &&
+                             it->second.nodes.size() == oit->second.nodes.size();
+        out.trees.push_back(laidOut ? it->second : oit->second);
+        out.laidOut.push_back(laidOut ? 1 : 0);
+        auto rit = m_originalRanges.find(spiritName);
+        out.ranges.push_back(rit != m_originalRanges.end() ? rit->second : std::vector<SourceRange>());
+    }
+    // Trees stored without a layout are laid out on their next load and written again then
+    return true;
+}
 
-    std::unordered_map<std::string, std::vector<SpiritNode>> spiritNodes;
-    std::vector<std::string> spiritOrder;
-
-    for (const auto& item : data) {
-        SpiritNode node;
-        node.id = item.value("id", 0ULL);
-        node.dep = item.value("dep", 0ULL);
-        node.name = item.value("nm", "");
-        node.originalName = node.name;
-        node.spirit = item.value("spirit", "");
-        node.type = item.value("typ", "");
-        node.costType = item.value("ctyp", "");
-        node.cost = item.value("cst", 0);
-        node.isAdventurePass = item.value("ap", false);
-
-        if (!node.spirit.empty()) {
-            if (spiritNodes.find(node.spirit) == spiritNodes.end()) {
-                spiritOrder.push_back(node.spirit);
-            }
-            spiritNodes[node.spirit].push_back(node);
-        }
+void SpiritTreeManager::BinaryCacheSnapshot::serialize(std::string& out) const {
+    std::vector<SpiritCacheEntry> entries;
+    entries.reserve(trees.size());
+    for (size_t i = 0; i < trees.size(); ++i) {
+        entries.push_back({&trees[i], laidOut[i] != 0, i < ranges.size() ? &ranges[i] : nullptr});
     }
+    serializeSpiritCache(key, entries, out);
+}
 
-    for (const auto& spiritName : spiritOrder) {
-        auto& nodes = spiritNodes[spiritName];
-        SpiritTree tree;
-        tree.spiritName = spiritName;
-        tree.nodes = std::move(nodes);
+const SpiritNode* SpiritTreeManager::getOriginalNode(const std::string& spiritName, uint64_t nodeId) const {
+    const SpiritTree* original = originalTree(spiritName);
+    return original ? original->findNode(nodeId) : nullptr;
+}
 
-        buildTree(tree);
-        computeLayout(tree);
+bool SpiritTreeManager::getNameFromLoadedFile(const std::string& spiritName, uint64_t nodeId, std::string* outName) const {
+    const SpiritNode* original = getOriginalNode(spiritName, nodeId);
+    if (!original) return false;
+    if (outName) *outName = original->name;
+    return true;
+}
 
-        m_allSpiritNamesOrdered.push_back(spiritName);
-        m_trees[spiritName] = std::move(tree);
+bool SpiritTreeManager::originalIndex(const std::string& spiritName, uint64_t nodeId, size_t* outIndex) const {
+    const SpiritTree* original = originalTree(spiritName);
+    if (!original) return false;
+    auto it = original->indexById.find(nodeId);
+    if (it == original->indexById.end() || it->second >= original->nodes.size()) return false;
+    *outIndex = it->second;
+    return true;
+}
+
+bool SpiritTreeManager::hasOriginalNodeSource(const std::string& spiritName, uint64_t nodeId) const {
+    auto rit = m_originalRanges.find(spiritName);
+    size_t index = 0;
+    return rit != m_originalRanges.end() && originalIndex(spiritName, nodeId, &index) &&
+           index < rit->second.size() && rit->second[index].length > 0;
+}
+
+bool SpiritTreeManager::getOriginalNodeSource(const std::string& spiritName, uint64_t nodeId, std::string* outJson) const {
+    if (!hasOriginalNodeSource(spiritName, nodeId)) return false;
+    size_t index = 0;
+    originalIndex(spiritName, nodeId, &index);
+    const SourceRange& range = m_originalRanges.find(spiritName)->second[index];
+
+    int64_t mtime = 0;
+    if (!fileModifiedTime(m_loadedFile, mtime) || mtime != m_rangesFileTime) return false;
+    MappedFile source;
+    if (!source.open(m_loadedFile) || source.size() != m_rangesFileSize) return false;
+    if (range.offset + range.length > source.size()) return false;
+    if (outJson) outJson->assign(reinterpret_cast<const char*>(source.data()) + range.offset, range.length);
+    return true;
+}
+
+bool SpiritTreeManager::findNameForId(const std::string& spiritName, uint64_t nodeId, const NameIndex* names,
+                                      std::string* outName) const {
+    if (names && names->lookup(nodeId, outName)) return true;
+    return getNameFromLoadedFile(spiritName, nodeId, outName);
+}
+
+size_t SpiritTreeManager::fixMismatchedNames(const std::string& spiritName, const NameIndex& names,
+                                             std::vector<uint64_t>* outUnresolved) {
+    SpiritTree* tree = materialize(spiritName);
+    if (!tree) return 0;
+    size_t fixed = 0;
+    std::string restored;
+    for (SpiritNode& node : tree->nodes) {
+        if (node.id == fnv1a32(node.name)) continue;
+        if (!names.lookup(node.id, &restored)) {
+            if (outUnresolved) outUnresolved->push_back(node.id);
+            continue;
+        }
+        NodeFields before = fieldsOf(node);
+        node.name = restored;
+        recordNodeFields(spiritName, node.id, before);
+        ++fixed;
     }
+    // Names feed the duplicate/mismatch analysis and the restore state of the whole spirit
+    if (fixed > 0) markDirty(spiritName);
+    return fixed;
+}
 
-    for (const auto& name : m_allSpiritNamesOrdered) {
-        if (checkIfGuide(m_trees[name])) {
-            m_guideNames.push_back(name);
-        } else {
-            m_spiritNames.push_back(name);
+void SpiritTreeManager::collectLoadedNames(std::vector<Symbol>& out) const {
+    for (const auto& spiritName : m_loadOrder) {
+        auto it = m_originalTrees.find(spiritName);
+        if (it == m_originalTrees.end()) continue;
+        for (const SpiritNode& node : it->second.nodes) {
+            if (!node.name.empty()) out.push_back(node.name);
         }
     }
+}
 
-    m_originalNodeIds.clear();
+bool SpiritTreeManager::loadFromSpirits(LoadedSpirits& loaded) {
+    m_trees.clear();
+    m_treeUse.clear();
+    m_loadedFromCache = false;
+    m_cacheStale = false;
+    m_sourceKey = SourceKey();
+    m_spiritNames.clear();
+    m_guideNames.clear();
+    m_allSpiritNamesOrdered.clear();
     m_cachedState.clear();
-    for (const auto& kv : m_trees) {
-        auto& ids = m_originalNodeIds[kv.first];
-        for (const auto& n : kv.second.nodes) ids.insert(n.id);
+    m_analysis.clear();
+    m_spiritEditGeneration.clear();
+    m_history.clear();
+
+    // Each spirit's parsed nodes become its immutable load snapshot (file order, no layout
+    // or children). Working trees are built from it on first use (materialize), so a load
+    // costs one parse no matter how many spirits the file holds.
+    m_originalTrees.clear();
+    m_originalRanges.clear();
+    m_rangesFileSize = 0;
+    m_rangesFileTime = 0;
+    m_loadOrder = loaded.order;
+    for (const auto& spiritName : loaded.order) {
+        SpiritTree& original = m_originalTrees[spiritName];
+        original.spiritName = spiritName;
+        original.nodes = std::move(loaded.nodes[spiritName]);
+        original.reindex();
+        m_allSpiritNamesOrdered.push_back(spiritName);
+        if (checkIfGuide(spiritName)) {
+            m_guideNames.push_back(spiritName);
+        } else {
+            m_spiritNames.push_back(spiritName);
+        }
+    }
+
+    return true;
+}
+
+const SpiritTree* SpiritTreeManager::originalTree(const std::string& spiritName) const {
+    auto it = m_originalTrees.find(spiritName);
+    return it != m_originalTrees.end() ? &it->second : nullptr;
+}
+
+const SpiritTree* SpiritTreeManager::viewTree(const std::string& spiritName) const {
+    auto it = m_trees.find(spiritName);
+    if (it != m_trees.end()) return &it->second;
+    auto oit = m_originalTrees.find(spiritName);
+    return oit != m_originalTrees.end() ? &oit->second : nullptr;
+}
+
+SpiritTree* SpiritTreeManager::materialize(const std::string& spiritName) {
+    auto it = m_trees.find(spiritName);
+    if (it != m_trees.end()) {
+        m_treeUse[spiritName].lastUse = ++m_useTick;
+        return &it->second;
     }
+    const SpiritTree* original = originalTree(spiritName);
+    if (!original) return nullptr;
+
+    SpiritTree tree;
+    tree.spiritName = spiritName;
+    tree.nodes = original->nodes;
+    tree.indexById = original->indexById;
+    buildTree(tree);
+    computeLayout(tree);
+
+    SpiritTree& placed = m_trees[spiritName];
+    placed = std::move(tree);
+    ++m_layoutGeneration;
+    TreeUse& use = m_treeUse[spiritName];
+    use.lastUse = ++m_useTick;
+    use.touched = false;
+    return &placed;
+}
+
+std::unordered_map<std::string, SpiritTree>::iterator SpiritTreeManager::findTree(const std::string& spiritName) {
+    return materialize(spiritName) ? m_trees.find(spiritName) : m_trees.end();
+}
+
+std::unordered_map<std::string, SpiritTree>::const_iterator SpiritTreeManager::findTree(const std::string& spiritName) const {
+    // Never builds: const access stays read-only, so it is safe next to workers reading
+    // the load snapshot
+    return m_trees.find(spiritName);
+}
+
+bool SpiritTreeManager::isMaterialized(const std::string& spiritName) const {
+    return m_trees.find(spiritName) != m_trees.end();
+}
+
+const std::vector<SpiritNode>& SpiritTreeManager::getSpiritNodes(const std::string& spiritName) const {
+    static const std::vector<SpiritNode> empty;
+    const SpiritTree* tree = viewTree(spiritName);
+    return tree ? tree->nodes : empty;
+}
+
+namespace {
+// Hash map entries cost roughly a node allocation plus the bucket pointer
+constexpr size_t INDEX_ENTRY_BYTES = sizeof(std::pair<const uint64_t, size_t>) + 2 * sizeof(void*);
+}
+
+size_t SpiritTreeManager::estimateTreeBytes(const SpiritTree& tree) {
+    size_t bytes = sizeof(SpiritTree) + tree.nodes.capacity() * sizeof(SpiritNode);
+    for (const auto& n : tree.nodes) bytes += n.children.capacity() * sizeof(uint64_t);
+    return bytes + tree.indexById.size() * INDEX_ENTRY_BYTES;
+}
+
+void SpiritTreeManager::prepareTree(SpiritTree& tree) {
+    tree.reindex();
+    buildTree(tree);
+    computeLayout(tree);
+}
 
+bool SpiritTreeManager::adoptTree(SpiritTree&& tree) {
+    const std::string spiritName = tree.spiritName;
+    if (m_trees.find(spiritName) != m_trees.end()) return false;
+    auto oit = m_originalTrees.find(spiritName);
+    if (oit == m_originalTrees.end() || oit->second.nodes.size() != tree.nodes.size()) return false;
+    m_trees[spiritName] = std::move(tree);
+    ++m_layoutGeneration;
+    // Never looked at yet: first in line for eviction
+    TreeUse& use = m_treeUse[spiritName];
+    use.lastUse = 0;
+    use.touched = false;
     return true;
 }
 
+size_t SpiritTreeManager::getMaterializedBytes() const {
+    size_t total = 0;
+    for (const auto& kv : m_trees) total += estimateTreeBytes(kv.second);
+    return total;
+}
+
+void SpiritTreeManager::pinTree(const std::string& spiritName, bool pinned) {
+    if (spiritName.empty() || !viewTree(spiritName)) return;
+    m_treeUse[spiritName].pinned = pinned;
+}
+
+size_t SpiritTreeManager::evictIdleTrees(const std::string& keepSpirit, size_t capBytes) {
+    size_t total = 0;
+    std::vector<std::pair<uint64_t, std::string>> idle;
+    for (const auto& kv : m_trees) {
+        total += estimateTreeBytes(kv.second);
+        if (kv.first == keepSpirit) continue;
+        // Only trees identical to their load snapshot can be rebuilt from it, and only
+        // when nobody holds pointers into them
+        auto use = m_treeUse.find(kv.first);
+        if (use == m_treeUse.end() || use->second.touched || use->second.pinned) continue;
+        if (m_originalTrees.find(kv.first) == m_originalTrees.end()) continue;
+        idle.emplace_back(use->second.lastUse, kv.first);
+    }
+    if (total <= capBytes) return 0;
+
+    std::sort(idle.begin(), idle.end());
+    size_t evicted = 0;
+    for (const auto& entry : idle) {
+        if (total <= capBytes) break;
+        const std::string& name = entry.second;
+        auto it = m_trees.find(name);
+        total -= std::min(total, estimateTreeBytes(it->second));
+        m_trees.erase(it);
+        m_treeUse.erase(name);
+        m_cachedState.erase(name);
+        ++evicted;
+    }
+    return evicted;
+}
+
 bool SpiritTreeManager::loadFromString(const std::string& jsonContents) {
     try {
-        json data = json::parse(jsonContents);
-        if (!loadFromJson(data)) return false;
+        LoadedSpirits loaded;
+        SpiritNodeSaxReader reader(loaded);
+        if (!json::sax_parse(jsonContents, &reader)) return false;
+        if (!loadFromSpirits(loaded)) return false;
         // When loading from string this is not a file on disk
         m_loadedFile.clear();
         return true;
@@ -118,7 +675,7 @@ bool SpiritTreeManager::loadFromString(const std::string& jsonContents) {
 
 bool SpiritTreeManager::addSpirit(const std::string& spiritName, const std::string& beforeSpirit) {
     if (spiritName.empty()) return false;
-    if (m_trees.find(spiritName) != m_trees.end()) return false; // already exists
+    if (viewTree(spiritName)) return false; // already exists
 
     SpiritTree tree;
     tree.spiritName = spiritName;
@@ -139,18 +696,24 @@ bool SpiritTreeManager::addSpirit(const std::string& spiritName, const std::stri
     }
 
     // Categorize into spirit or guide lists; insert at front so new spirits appear at top
-    if (checkIfGuide(m_trees[spiritName])) {
+    if (checkIfGuide(spiritName)) {
         m_guideNames.insert(m_guideNames.begin(), spiritName);
     } else {
         m_spiritNames.insert(m_spiritNames.begin(), spiritName);
     }
+    markDirty(spiritName);
     return true;
 }
 
 bool SpiritTreeManager::deleteSpirit(const std::string& spiritName) {
-    auto it = m_trees.find(spiritName);
-    if (it == m_trees.end()) return false;
-    m_trees.erase(it);
+    if (!viewTree(spiritName)) return false;
+    m_trees.erase(spiritName);
+    m_originalTrees.erase(spiritName);
+    m_originalRanges.erase(spiritName);
+    m_treeUse.erase(spiritName);
+    m_analysis.erase(spiritName);
+    m_spiritEditGeneration.erase(spiritName);
+    m_history.dropSpirit(spiritName);
 
     // Remove from lists
     auto itAll = std::find(m_allSpiritNamesOrdered.begin(), m_allSpiritNamesOrdered.end(), spiritName);
@@ -159,59 +722,191 @@ bool SpiritTreeManager::deleteSpirit(const std::string& spiritName) {
     if (itSp != m_spiritNames.end()) m_spiritNames.erase(itSp);
     auto itGu = std::find(m_guideNames.begin(), m_guideNames.end(), spiritName);
     if (itGu != m_guideNames.end()) m_guideNames.erase(itGu);
+    ++m_editGeneration;
+    ++m_layoutGeneration;
     return true;
 }
 
-bool SpiritTreeManager::saveToFile(const std::string& filepath) const {
-    try {
-        // Build a JSON array of all nodes from all trees
-        // Maintaining the same structure and order as the original file
-        json output = json::array();
-        
-        // Collect all nodes from all trees in original file order
-        for (const auto& spiritName : m_allSpiritNamesOrdered) {
-            auto it = m_trees.find(spiritName);
-            if (it == m_trees.end()) continue;
-            const auto& tree = it->second;
-            
-            for (const auto& node : tree.nodes) {
-                json nodeJson;
-                // Keys in alphabetical order to match original file format
-                nodeJson["ap"] = node.isAdventurePass;
-                nodeJson["cst"] = node.cost;
-                nodeJson["ctyp"] = node.costType;
-                nodeJson["dep"] = node.dep;
-                nodeJson["id"] = node.id;
-                nodeJson["nm"] = node.name;
-                nodeJson["spirit"] = node.spirit;
-                nodeJson["typ"] = node.type;
-                output.push_back(nodeJson);
+namespace {
+
+// Append a JSON string literal exactly as nlohmann's dump() writes it (UTF-8 kept as-is,
+// quote/backslash/control characters escaped). Returns false on invalid UTF-8, which
+// dump() rejects as well.
+bool appendJsonString(std::string& out, const std::string& str) {
+    static const char* HEX = "0123456789abcdef";
+    out.push_back('"');
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(str.data());
+    const unsigned char* end = p + str.size();
+    while (p < end) {
+        unsigned char c = *p;
+        if (c < 0x80) {
+            switch (c) {
+                case '"':  out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\b': out += "\\b"; break;
+                case '\t': out += "\\t"; break;
+                case '\n': out += "\\n"; break;
+                case '\f': out += "\\f"; break;
+                case '\r': out += "\\r"; break;
+                default:
+                    if (c < 0x20) {
+                        out += "\\u00";
+                        out.push_back(HEX[c >> 4]);
+                        out.push_back(HEX[c & 0xF]);
+                    } else {
+                        out.push_back((char)c);
+                    }
             }
+            ++p;
+            continue;
         }
-        
-        // Write to file with pretty formatting (3-space indent like original)
-        std::ofstream file(filepath);
-        if (!file.is_open()) {
-            return false;
+
+        // Multi-byte sequence: validate lead byte, continuation count and the ranges that
+        // exclude overlong forms, surrogates and code points above U+10FFFF
+        size_t len = 0;
+        unsigned char lo = 0x80, hi = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF) len = 2;
+        else if (c >= 0xE0 && c <= 0xEF) { len = 3; if (c == 0xE0) lo = 0xA0; if (c == 0xED) hi = 0x9F; }
+        else if (c >= 0xF0 && c <= 0xF4) { len = 4; if (c == 0xF0) lo = 0x90; if (c == 0xF4) hi = 0x8F; }
+        else return false;
+        if ((size_t)(end - p) < len) return false;
+        if (p[1] < lo || p[1] > hi) return false;
+        for (size_t i = 2; i < len; ++i) {
+            if (p[i] < 0x80 || p[i] > 0xBF) return false;
         }
-        
-        file << output.dump(3);
-        file.close();
-        
-        return true;
-        
-    } catch (const std::exception& e) {
+        out.append(reinterpret_cast<const char*>(p), len);
+        p += len;
+    }
+    out.push_back('"');
+    return true;
+}
+
+template <typename T>
+void appendJsonInteger(std::string& out, T value) {
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, res.ptr);
+}
+
+// One array element in the file format: 3-space indent, keys in alphabetical order (Node is
+// a SpiritNode or a JsonSnapshot::Node)
+template <typename Node>
+bool appendNodeJson(std::string& out, const Node& node) {
+    out += "   {\n      \"ap\": ";
+    out += node.isAdventurePass ? "true" : "false";
+    out += ",\n      \"cst\": ";
+    appendJsonInteger(out, node.cost);
+    out += ",\n      \"ctyp\": ";
+    if (!appendJsonString(out, node.costType)) return false;
+    out += ",\n      \"dep\": ";
+    appendJsonInteger(out, node.dep);
+    out += ",\n      \"id\": ";
+    appendJsonInteger(out, node.id);
+    out += ",\n      \"nm\": ";
+    if (!appendJsonString(out, node.name)) return false;
+    out += ",\n      \"spirit\": ";
+    if (!appendJsonString(out, node.spirit)) return false;
+    out += ",\n      \"typ\": ";
+    if (!appendJsonString(out, node.type)) return false;
+    out += "\n   }";
+    return true;
+}
+
+template <typename Node>
+size_t estimateNodeJsonSize(const Node& node) {
+    // Fixed keys/indentation (~120 bytes) plus the variable-length fields
+    return 128 + node.costType.size() + node.name.size() + node.spirit.size() + node.type.size();
+}
+
+bool writeBufferToFile(const std::string& filepath, const std::string& buffer) {
+    std::ofstream file(filepath);
+    if (!file.is_open()) {
         return false;
     }
+    file.write(buffer.data(), (std::streamsize)buffer.size());
+    file.close();
+    return !file.fail();
 }
 
-void SpiritTreeManager::buildTree(SpiritTree& tree) {
-    // Create lookup map
-    std::unordered_map<uint64_t, size_t> idToIndex;
-    for (size_t i = 0; i < tree.nodes.size(); ++i) {
-        idToIndex[tree.nodes[i].id] = i;
+} // namespace
+
+bool SpiritTreeManager::writeNodesJson(const std::vector<const SpiritTree*>& trees, std::string& out) {
+    size_t estimate = 4;
+    for (const SpiritTree* tree : trees) {
+        for (const auto& node : tree->nodes) estimate += estimateNodeJsonSize(node);
     }
-    
+    out.clear();
+    out.reserve(estimate);
+
+    // Same layout as nlohmann dump(3) of an array of objects ("[]" when empty)
+    bool first = true;
+    out.push_back('[');
+    for (const SpiritTree* tree : trees) {
+        for (const auto& node : tree->nodes) {
+            out += first ? "\n" : ",\n";
+            first = false;
+            if (!appendNodeJson(out, node)) return false;
+        }
+    }
+    out += first ? "]" : "\n]";
+    return true;
+}
+
+bool SpiritTreeManager::writeJson(std::string& out) const {
+    // Collect all trees in original file order
+    std::vector<const SpiritTree*> trees;
+    trees.reserve(m_allSpiritNamesOrdered.size());
+    for (const auto& spiritName : m_allSpiritNamesOrdered) {
+        // Trees never opened are written straight from their load snapshot
+        if (const SpiritTree* tree = viewTree(spiritName)) trees.push_back(tree);
+    }
+    return writeNodesJson(trees, out);
+}
+
+void SpiritTreeManager::takeNodesSnapshot(const std::vector<const SpiritTree*>& trees, JsonSnapshot& out) {
+    size_t count = 0;
+    for (const SpiritTree* tree : trees) count += tree->nodes.size();
+    out.nodes.clear();
+    out.nodes.reserve(count);
+    for (const SpiritTree* tree : trees) {
+        for (const auto& node : tree->nodes) {
+            out.nodes.push_back({node.id, node.dep, node.name, node.spirit, node.type, node.costType, node.cost,
+                                 node.isAdventurePass});
+        }
+    }
+}
+
+void SpiritTreeManager::takeJsonSnapshot(JsonSnapshot& out) const {
+    std::vector<const SpiritTree*> trees;
+    trees.reserve(m_allSpiritNamesOrdered.size());
+    for (const auto& spiritName : m_allSpiritNamesOrdered) {
+        if (const SpiritTree* tree = viewTree(spiritName)) trees.push_back(tree);
+    }
+    takeNodesSnapshot(trees, out);
+}
+
+bool SpiritTreeManager::JsonSnapshot::serialize(std::string& out) const {
+    size_t estimate = 4;
+    for (const auto& node : nodes) estimate += estimateNodeJsonSize(node);
+    out.clear();
+    out.reserve(estimate);
+
+    out.push_back('[');
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        out += i == 0 ? "\n" : ",\n";
+        if (!appendNodeJson(out, nodes[i])) return false;
+    }
+    out += nodes.empty() ? "]" : "\n]";
+    return true;
+}
+
+bool SpiritTreeManager::saveToFile(const std::string& filepath) const {
+    std::string buffer;
+    if (!writeJson(buffer)) return false;
+    return writeBufferToFile(filepath, buffer);
+}
+
+void SpiritTreeManager::buildTree(SpiritTree& tree) {
     // Build parent-child relationships
     for (auto& node : tree.nodes) {
         node.children.clear();
@@ -221,9 +916,9 @@ void SpiritTreeManager::buildTree(SpiritTree& tree) {
         if (node.dep == 0) {
             tree.rootNodeId = node.id;
         } else {
-            auto it = idToIndex.find(node.dep);
-            if (it != idToIndex.end()) {
-                tree.nodes[it->second].children.push_back(node.id);
+            SpiritNode* parent = tree.findNode(node.dep);
+            if (parent) {
+                parent->children.push_back(node.id);
             }
         }
     }
@@ -244,10 +939,39 @@ void SpiritTreeManager::computeLayout(SpiritTree& tree) {
     if (!root) return;
     
     // Layout from root going upward
-    // Root is at bottom (y=0), children go up (negative y for "north")
-    layoutSubtree(tree, *root, 0.0f, 0.0f, 0);
-    
-    // Calculate bounds
+    // Root is at bottom (y=0), children go up (negative y for "north").
+    // Only loads lay out from scratch, and they start a fresh history anyway.
+    const bool wasRecording = m_recordUndo;
+    m_recordUndo = false;
+    m_layout.build(tree);
+    applyLayout(tree, (uint32_t)(root - tree.nodes.data()), 0.0f, 0.0f, nullptr);
+    computeBounds(tree);
+    m_recordUndo = wasRecording;
+}
+
+void SpiritTreeManager::applyLayout(SpiritTree& tree, uint32_t root, float x, float y,
+                                    std::unordered_map<uint64_t, std::pair<float,float>>* outShifts) {
+    m_layoutPositions.resize(tree.nodes.size());
+    m_layoutVisited.clear();
+    m_layout.layoutFrom(root, x, y, m_layoutPositions, &m_layoutVisited);
+
+    UndoOp op;
+    op.kind = UndoOp::Kind::Layout;
+    for (uint32_t i : m_layoutVisited) {
+        SpiritNode& n = tree.nodes[i];
+        const TreeLayout::Point& p = m_layoutPositions[i];
+        // Skip the root (a dragged node is kept directly under the cursor)
+        if (outShifts && i != root) (*outShifts)[n.id] = std::make_pair(n.x - p.x, n.y - p.y);
+        if (m_recordUndo && (n.x != p.x || n.y != p.y)) {
+            op.placements.push_back(UndoOp::Placement{n.id, n.x, n.y, p.x, p.y});
+        }
+        n.x = p.x;
+        n.y = p.y;
+    }
+    if (!op.placements.empty()) recordOp(tree.spiritName, std::move(op));
+}
+
+void SpiritTreeManager::computeBounds(SpiritTree& tree) {
     tree.minX = tree.maxX = 0.0f;
     tree.minY = tree.maxY = 0.0f;
     
@@ -262,166 +986,55 @@ void SpiritTreeManager::computeLayout(SpiritTree& tree) {
     tree.height = tree.maxY - tree.minY;
 }
 
-void SpiritTreeManager::layoutSubtree(SpiritTree& tree, SpiritNode& node, float x, float y, int depth) {
-    node.x = x;
-    node.y = y;
-    
-    // Create lookup map
-    std::unordered_map<uint64_t, SpiritNode*> idToNode;
-    for (auto& n : tree.nodes) {
-        idToNode[n.id] = &n;
-    }
-    
-    // Layout children
-    // Parent is at south (bottom), children go north (up, so negative y in screen coords)
-    // But we'll use positive y going up for logical coords
-    const float nodeSpacingY = 100.0f;  // Vertical spacing
-    const float nodeSpacingX = 120.0f;  // Horizontal spacing for branches
-    
-    size_t childCount = node.children.size();
-
-    // Compute positions for any number of children. For 1-3 children preserve the
-    // original aesthetic (NW,N,NE). For >3 distribute evenly centered over parent.
-    const float diagonalYOffset = -25.0f;  // NW/NE nodes are slightly lower
-
-    for (size_t i = 0; i < childCount; ++i) {
-        auto it = idToNode.find(node.children[i]);
-        if (it == idToNode.end()) continue;
-
-        SpiritNode* child = it->second;
-        float childX = x;
-        float childY = y + nodeSpacingY;  // Move up (north)
-
-        if (childCount == 1) {
-            childX = x;
-        } else if (childCount == 2) {
-            // Keep original two-child look: left + center
-            if (i == 0) {
-                childX = x - nodeSpacingX;  // North-West
-                childY += diagonalYOffset;  // Slightly lower
-            } else {
-                childX = x;  // North (directly above)
-            }
-        } else if (childCount == 3) {
-            // Original three-child layout
-            if (i == 0) {
-                childX = x - nodeSpacingX;  // North-West
-                childY += diagonalYOffset;  // Slightly lower
-            } else if (i == 1) {
-                childX = x;  // North (center)
-            } else {
-                childX = x + nodeSpacingX;  // North-East
-                childY += diagonalYOffset;  // Slightly lower
-            }
-        } else {
-            // Distribute children evenly centered above the parent for >3 children
-            float startX = x - nodeSpacingX * (float(childCount - 1) * 0.5f);
-            childX = startX + (float)i * nodeSpacingX;
-            // Slightly lower for non-center children to preserve visual grouping
-            float centerIndex = (childCount - 1) * 0.5f;
-            if (std::fabs((float)i - centerIndex) > 0.01f) childY += diagonalYOffset;
-        }
-
-        layoutSubtree(tree, *child, childX, childY, depth + 1);
-    }
-}
-
 SpiritTree* SpiritTreeManager::getTree(const std::string& spiritName) {
-    auto it = m_trees.find(spiritName);
+    auto it = findTree(spiritName);
     return (it != m_trees.end()) ? &it->second : nullptr;
 }
 
 const SpiritTree* SpiritTreeManager::getTree(const std::string& spiritName) const {
-    auto it = m_trees.find(spiritName);
+    auto it = findTree(spiritName);
     return (it != m_trees.end()) ? &it->second : nullptr;
 }
 
 size_t SpiritTreeManager::getNodeCount(const std::string& spiritName) const {
-    auto it = m_trees.find(spiritName);
-    return (it != m_trees.end()) ? it->second.nodes.size() : 0;
+    return getSpiritNodes(spiritName).size();
 }
 
 bool SpiritTreeManager::isGuide(const std::string& spiritName) const {
-    auto it = m_trees.find(spiritName);
-    if (it == m_trees.end()) return false;
-    return checkIfGuide(it->second);
+    return getAnalysis(spiritName).isGuide;
 }
 
 bool SpiritTreeManager::isTravellingSpirit(const std::string& spiritName) const {
-    auto it = m_trees.find(spiritName);
-    if (it == m_trees.end()) return false;
-    const SpiritTree& tree = it->second;
-
-    // Do not apply identification rules to guides
-    if (checkIfGuide(tree)) return false;
-
-    // Rule 1: If any node has Adventure Pass flag, it's NOT travelling
-    for (const auto& node : tree.nodes) {
-        if (node.isAdventurePass) return false;
-    }
-
-    // Rule X: MUST contain an emote_upgrade node somewhere (check name contains "emote_upgrade", case-insensitive)
-    bool hasEmoteUpgrade = false;
-    for (const auto& node : tree.nodes) {
-        std::string nm = node.name;
-        std::transform(nm.begin(), nm.end(), nm.begin(), [](unsigned char c){ return std::tolower(c); });
-        if (nm.find("emote_upgrade") != std::string::npos) {
-            hasEmoteUpgrade = true;
-            break;
-        }
-    }
-    if (!hasEmoteUpgrade) return false;
-
-    // Rule 2: If there exists a non-root node with typ != "seasonal heart", it's a travelling spirit
-    for (const auto& node : tree.nodes) {
-        if (node.dep == 0) continue; // skip root/top nodes
-        std::string typ = node.type;
-        std::transform(typ.begin(), typ.end(), typ.begin(), [](unsigned char c){ return std::tolower(c); });
-        if (typ != "seasonal heart") {
-            return true;
-        }
-    }
-
-    return false;
+    return getAnalysis(spiritName).isTravelling;
 }
 
-bool SpiritTreeManager::checkIfGuide(const SpiritTree& tree) const {
+bool SpiritTreeManager::checkIfGuide(const std::string& spiritName) {
     // Check if spirit name starts with "quest" or "tgc_"
-    if (tree.spiritName.size() >= 5 && tree.spiritName.substr(0, 5) == "quest") {
+    if (spiritName.size() >= 5 && spiritName.substr(0, 5) == "quest") {
         return true;
     }
-    if (tree.spiritName.size() >= 4 && tree.spiritName.substr(0, 4) == "tgc_") {
+    if (spiritName.size() >= 4 && spiritName.substr(0, 4) == "tgc_") {
         return true;
     }
     return false;
 }
 
 bool SpiritTreeManager::updateNodeId(const std::string& spiritName, uint64_t oldId) {
-    auto it = m_trees.find(spiritName);
+    auto it = findTree(spiritName);
     if (it == m_trees.end()) return false;
     
-    SpiritTree& tree = it->second;
-    for (auto& node : tree.nodes) {
-        if (node.id == oldId) {
-            uint32_t newId = fnv1a32(node.name);
-            return changeNodeId(spiritName, oldId, newId);
-        }
-    }
-    return false;
+    const SpiritNode* node = it->second.findNode(oldId);
+    if (!node) return false;
+    uint32_t newId = fnv1a32(node->name);
+    return changeNodeId(spiritName, oldId, newId);
 }
 
 bool SpiritTreeManager::changeNodeId(const std::string& spiritName, uint64_t oldId, uint64_t newId) {
-    auto it = m_trees.find(spiritName);
+    auto it = findTree(spiritName);
     if (it == m_trees.end()) return false;
 
     SpiritTree& tree = it->second;
-    SpiritNode* target = nullptr;
-    for (auto& node : tree.nodes) {
-        if (node.id == oldId) {
-            target = &node;
-            break;
-        }
-    }
+    SpiritNode* target = tree.findNode(oldId);
     if (!target) return false;
 
     // Update parent references and children references across the tree
@@ -439,21 +1052,29 @@ bool SpiritTreeManager::changeNodeId(const std::string& spiritName, uint64_t old
     // Update root if needed
     if (tree.rootNodeId == oldId) tree.rootNodeId = newId;
 
-    // Finally set the node's id
+    // Finally set the node's id and move its index entry
     target->id = newId;
+    tree.reindexId(oldId);
+    tree.reindexId(newId);
+    markDirty(spiritName);
+
+    UndoOp op;
+    op.kind = UndoOp::Kind::IdChange;
+    op.from = oldId;
+    op.to = newId;
+    recordOp(spiritName, std::move(op));
     return true;
 }
 
 SpiritNode* SpiritTreeManager::getNode(const std::string& spiritName, uint64_t nodeId) {
-    auto it = m_trees.find(spiritName);
+    auto it = findTree(spiritName);
     if (it == m_trees.end()) return nullptr;
-    
-    for (auto& node : it->second.nodes) {
-        if (node.id == nodeId) {
-            return &node;
-        }
-    }
-    return nullptr;
+    return it->second.findNode(nodeId);
+}
+
+const SpiritNode* SpiritTreeManager::getNode(const std::string& spiritName, uint64_t nodeId) const {
+    const SpiritTree* tree = viewTree(spiritName);
+    return tree ? tree->findNode(nodeId) : nullptr;
 }
 
 std::string SpiritTreeManager::nodeToJson(const SpiritNode& node) {
@@ -474,6 +1095,7 @@ std::string SpiritTreeManager::nodeToJson(const SpiritNode& node) {
 bool SpiritTreeManager::updateNodeFromJson(const std::string& spiritName, uint64_t nodeId, const std::string& jsonStr, uint64_t* newNodeId) {
     SpiritNode* node = getNode(spiritName, nodeId);
     if (!node) return false;
+    const NodeFields before = fieldsOf(*node);
     
     try {
         json data = json::parse(jsonStr);
@@ -482,7 +1104,7 @@ bool SpiritTreeManager::updateNodeFromJson(const std::string& spiritName, uint64
         if (data.contains("ap")) node->isAdventurePass = data["ap"].get<bool>();
         if (data.contains("cst")) node->cost = data["cst"].get<int>();
         if (data.contains("ctyp")) node->costType = data["ctyp"].get<std::string>();
-        if (data.contains("dep")) node->dep = data["dep"].get<uint64_t>();
+        uint64_t newDep = data.contains("dep") ? data["dep"].get<uint64_t>() : node->dep;
         if (data.contains("id")) {
             uint64_t newId = data["id"].get<uint64_t>();
             if (newId != node->id) {
@@ -496,6 +1118,8 @@ bool SpiritTreeManager::updateNodeFromJson(const std::string& spiritName, uint64
             if (isNameDuplicate(spiritName, newName, node->id)) {
                 // Revert to original name
                 node->name = node->originalName;
+                markSubtreeDirty(spiritName, node->id);
+                recordNodeFields(spiritName, node->id, before);
                 return false;
             }
             node->name = newName;
@@ -508,52 +1132,147 @@ bool SpiritTreeManager::updateNodeFromJson(const std::string& spiritName, uint64
             *newNodeId = node->id;
         }
         
-        // Rebuild tree relationships after editing
-        rebuildTree(spiritName);
+        recordNodeFields(spiritName, node->id, before);
+        // Patch relationships for a parent change; other fields only touch this node
+        if (newDep != node->dep) relinkNode(spiritName, node->id, newDep);
+        else markSubtreeDirty(spiritName, node->id);
         
         return true;
     } catch (const std::exception& e) {
+        recordNodeFields(spiritName, node->id, before);
         return false;
     }
 }
 
 void SpiritTreeManager::rebuildTree(const std::string& spiritName) {
-    auto it = m_trees.find(spiritName);
+    auto it = findTree(spiritName);
     if (it == m_trees.end()) return;
     
     SpiritTree& tree = it->second;
+    // Callers may have assigned ids directly before asking for a rebuild
+    tree.reindex();
+    std::vector<std::vector<uint64_t>> oldChildren;
+    if (m_recordUndo) {
+        oldChildren.reserve(tree.nodes.size());
+        for (const auto& n : tree.nodes) oldChildren.push_back(n.children);
+    }
     buildTree(tree);
     markDirty(spiritName);
+    // The rebuild puts every child list back in file order; record the lists it changed
+    for (size_t i = 0; i < oldChildren.size(); ++i) {
+        if (oldChildren[i] == tree.nodes[i].children) continue;
+        UndoOp op;
+        op.kind = UndoOp::Kind::ChildOrder;
+        op.nodeId = tree.nodes[i].id;
+        op.ids = std::move(oldChildren[i]);
+        op.idsAfter = tree.nodes[i].children;
+        recordOp(spiritName, std::move(op));
+    }
     // Note: We don't recompute layout here to preserve node positions
 }
 
+bool SpiritTreeManager::relinkNode(const std::string& spiritName, uint64_t nodeId, uint64_t newParentId) {
+    auto it = findTree(spiritName);
+    if (it == m_trees.end()) return false;
+    SpiritTree& tree = it->second;
+    SpiritNode* node = tree.findNode(nodeId);
+    if (!node) return false;
+
+    const SpiritNode* base = tree.nodes.data();
+    const size_t nodeIndex = (size_t)(node - base);
+    const uint64_t oldParentId = node->dep;
+    UndoOp op;
+    op.kind = UndoOp::Kind::Link;
+    op.nodeId = nodeId;
+    op.from = oldParentId;
+    op.to = newParentId;
+    if (SpiritNode* oldParent = oldParentId != 0 ? tree.findNode(oldParentId) : nullptr) {
+        auto& siblings = oldParent->children;
+        auto pos = std::find(siblings.begin(), siblings.end(), nodeId);
+        if (pos != siblings.end()) op.fromIndex = (uint32_t)(pos - siblings.begin());
+        siblings.erase(std::remove(siblings.begin(), siblings.end(), nodeId), siblings.end());
+    }
+    node->dep = newParentId;
+
+    if (newParentId != 0) {
+        if (SpiritNode* newParent = tree.findNode(newParentId)) {
+            // Join the new parent's children in file order, where buildTree would put it
+            auto& siblings = newParent->children;
+            auto pos = std::find_if(siblings.begin(), siblings.end(), [&](uint64_t c) {
+                const SpiritNode* cn = tree.findNode(c);
+                return cn && (size_t)(cn - base) > nodeIndex;
+            });
+            op.toIndex = (uint32_t)(pos - siblings.begin());
+            siblings.insert(pos, nodeId);
+        }
+    }
+
+    // Keep rootNodeId as buildTree leaves it: the last root in file order
+    const SpiritNode* root = tree.findNode(tree.rootNodeId);
+    if (newParentId == 0) {
+        if (!root || root->dep != 0 || root < node) tree.rootNodeId = nodeId;
+    } else if (tree.rootNodeId == nodeId) {
+        for (size_t i = tree.nodes.size(); i-- > 0; ) {
+            if (tree.nodes[i].dep == 0) { tree.rootNodeId = tree.nodes[i].id; break; }
+        }
+    }
+
+    if (oldParentId != 0) queueDirtySubtree(spiritName, oldParentId);
+    if (newParentId != 0) queueDirtySubtree(spiritName, newParentId);
+    queueDirtySubtree(spiritName, nodeId);
+    queueAnalysisNode(spiritName, nodeId);
+    ++m_editGeneration;
+    recordOp(spiritName, std::move(op));
+    return true;
+}
+
+bool SpiritTreeManager::setChildOrder(const std::string& spiritName, uint64_t parentId,
+                                      const std::vector<uint64_t>& order) {
+    SpiritNode* parent = getNode(spiritName, parentId);
+    if (!parent) return false;
+    if (parent->children == order) return true;
+    UndoOp op;
+    op.kind = UndoOp::Kind::ChildOrder;
+    op.nodeId = parentId;
+    op.ids = parent->children;
+    op.idsAfter = order;
+    parent->children = order;
+    markSubtreeDirty(spiritName, parentId);
+    recordOp(spiritName, std::move(op));
+    return true;
+}
+
 bool SpiritTreeManager::moveNodeBase(const std::string& spiritName, uint64_t nodeId, float dx, float dy) {
-    auto it = m_trees.find(spiritName);
+    auto it = findTree(spiritName);
     if (it == m_trees.end()) return false;
     SpiritTree& tree = it->second;
-    for (auto& node : tree.nodes) {
-        if (node.id == nodeId) {
-            node.x += dx;
-            node.y += dy;
-            // Update bounds to include the new position
-            tree.minX = std::min(tree.minX, node.x);
-            tree.maxX = std::max(tree.maxX, node.x);
-            tree.minY = std::min(tree.minY, node.y);
-            tree.maxY = std::max(tree.maxY, node.y);
-            tree.width = tree.maxX - tree.minX;
-            tree.height = tree.maxY - tree.minY;
-            // Mark that a manual move occurred: a reshape is now desirable
-            auto &cs = m_cachedState[spiritName];
-            cs.reshapeDirty = false;
-            cs.reshapeResult = true;
-            return true;
-        }
+    SpiritNode* node = tree.findNode(nodeId);
+    if (!node) return false;
+    node->x += dx;
+    node->y += dy;
+    // Update bounds to include the new position
+    tree.minX = std::min(tree.minX, node->x);
+    tree.maxX = std::max(tree.maxX, node->x);
+    tree.minY = std::min(tree.minY, node->y);
+    tree.maxY = std::max(tree.maxY, node->y);
+    tree.width = tree.maxX - tree.minX;
+    tree.height = tree.maxY - tree.minY;
+    // The node left its layout slot and its children left theirs
+    queueDirtySubtree(spiritName, nodeId);
+
+    if (dx != 0.0f || dy != 0.0f) {
+        UndoOp op;
+        op.kind = UndoOp::Kind::MoveNode;
+        op.nodeId = nodeId;
+        op.dx = dx;
+        op.dy = dy;
+        recordOp(spiritName, std::move(op));
     }
-    return false;
+    return true;
 }
 
 bool SpiritTreeManager::moveTreeBase(const std::string& spiritName, float dx, float dy) {
-    auto it = m_trees.find(spiritName);
+    auto it = findTree(spiritName);
     if (it == m_trees.end()) return false;
     SpiritTree& tree = it->second;
     if (dx == 0.0f && dy == 0.0f) return true;
@@ -573,25 +1292,23 @@ bool SpiritTreeManager::moveTreeBase(const std::string& spiritName, float dx, fl
     }
     tree.width = tree.maxX - tree.minX;
     tree.height = tree.maxY - tree.minY;
-    // Mark that a manual tree move occurred: reshape is desirable
-    auto &cs = m_cachedState[spiritName];
-    cs.reshapeDirty = false;
-    cs.reshapeResult = true;
+    // Every node moved by the same delta, so no node changed relative to its parent
+    UndoOp op;
+    op.kind = UndoOp::Kind::MoveTree;
+    op.dx = dx;
+    op.dy = dy;
+    recordOp(spiritName, std::move(op));
     return true;
 }
 
 
 bool SpiritTreeManager::moveSubtreeBase(const std::string& spiritName, uint64_t subtreeRootId, float dx, float dy,
                                          std::unordered_set<uint64_t>* outMovedIds) {
-    auto it = m_trees.find(spiritName);
+    auto it = findTree(spiritName);
     if (it == m_trees.end()) return false;
     SpiritTree& tree = it->second;
     if (dx == 0.0f && dy == 0.0f) return true;
 
-    // Build id->node map
-    std::unordered_map<uint64_t, SpiritNode*> idToNode;
-    for (auto& n : tree.nodes) idToNode[n.id] = &n;
-
     // Collect subtree via DFS
     std::unordered_set<uint64_t> subtree;
     std::vector<uint64_t> stack;
@@ -600,17 +1317,17 @@ bool SpiritTreeManager::moveSubtreeBase(const std::string& spiritName, uint64_t
         uint64_t cur = stack.back(); stack.pop_back();
         if (subtree.count(cur)) continue;
         subtree.insert(cur);
-        auto itn = idToNode.find(cur);
-        if (itn == idToNode.end()) continue;
-        for (uint64_t c : itn->second->children) stack.push_back(c);
+        const SpiritNode* n = tree.findNode(cur);
+        if (!n) continue;
+        for (uint64_t c : n->children) stack.push_back(c);
     }
 
     // Move only subtree nodes
     for (uint64_t id : subtree) {
-        auto itn = idToNode.find(id);
-        if (itn == idToNode.end()) continue;
-        itn->second->x += dx;
-        itn->second->y += dy;
+        SpiritNode* n = tree.findNode(id);
+        if (!n) continue;
+        n->x += dx;
+        n->y += dy;
     }
 
     // Recompute bounds for the whole tree
@@ -627,10 +1344,15 @@ bool SpiritTreeManager::moveSubtreeBase(const std::string& spiritName, uint64_t
     tree.width = tree.maxX - tree.minX;
     tree.height = tree.maxY - tree.minY;
 
-    // Mark that a manual subtree move occurred: reshape is desirable
-    auto &cs = m_cachedState[spiritName];
-    cs.reshapeDirty = false;
-    cs.reshapeResult = true;
+    // Only the subtree root changed relative to its parent
+    queueDirtySubtree(spiritName, subtreeRootId);
+
+    UndoOp op;
+    op.kind = UndoOp::Kind::MoveSubtree;
+    op.nodeId = subtreeRootId;
+    op.dx = dx;
+    op.dy = dy;
+    recordOp(spiritName, std::move(op));
 
     if (outMovedIds) *outMovedIds = std::move(subtree);
     return true;
@@ -638,185 +1360,376 @@ bool SpiritTreeManager::moveSubtreeBase(const std::string& spiritName, uint64_t
 
 bool SpiritTreeManager::reshapeTreeAndCollectShifts(const std::string& spiritName,
                                                      std::unordered_map<uint64_t, std::pair<float,float>>* outShifts) {
-    auto it = m_trees.find(spiritName);
+    auto it = findTree(spiritName);
     if (it == m_trees.end()) return false;
     SpiritTree& tree = it->second;
 
     std::unordered_map<uint64_t, std::pair<float,float>> mergedShifts;
-    // Find root nodes (dep == 0)
-    for (const auto& n : tree.nodes) {
-        if (n.dep == 0) {
-            std::unordered_map<uint64_t, std::pair<float,float>> shifts;
-            if (layoutSubtreeAndCollectShifts(spiritName, n.id, &shifts)) {
-                for (const auto& kv : shifts) mergedShifts[kv.first] = kv.second;
-            }
-        }
+    // Re-layout every root (dep == 0) over one adjacency build
+    m_layout.build(tree);
+    for (size_t i = 0; i < tree.nodes.size(); ++i) {
+        if (tree.nodes[i].dep != 0) continue;
+        const SpiritNode* root = tree.findNode(tree.nodes[i].id);
+        if (!root) continue;
+        applyLayout(tree, (uint32_t)(root - tree.nodes.data()), root->x, root->y, &mergedShifts);
     }
+    computeBounds(tree);
 
     if (outShifts) *outShifts = std::move(mergedShifts);
-    // After computing and applying a reshape, the tree now matches layout; clear cached reshape flag.
-    auto &cs = m_cachedState[spiritName];
-    cs.reshapeDirty = false;
-    cs.reshapeResult = false;
+    // Every reachable node moved; recheck all layout flags on the next query
+    m_cachedState[spiritName].reshapeDirty = true;
     return true;
 }
 
-bool SpiritTreeManager::needsReshape(const std::string& spiritName, float epsilon) {
-    // Check cache first
-    auto& cs = m_cachedState[spiritName];
-    if (!cs.reshapeDirty) return cs.reshapeResult;
-    cs.reshapeDirty = false;
+namespace {
+
+// True when node i sits off the slot the layout would give it under its parent. Roots,
+// nodes whose parent is missing and repeated ids (never laid out) are never misplaced.
+bool isNodeMisplaced(const SpiritTree& tree, size_t i, float epsilon) {
+    const SpiritNode& n = tree.nodes[i];
+    if (n.dep == 0) return false;
+    const SpiritNode* parent = tree.findNode(n.dep);
+    if (!parent || tree.findNode(n.id) != &n) return false;
+    const auto& siblings = parent->children;
+    auto pos = std::find(siblings.begin(), siblings.end(), n.id);
+    if (pos == siblings.end()) return false;
+    TreeLayout::Point p = TreeLayout::childPosition(parent->x, parent->y, (size_t)(pos - siblings.begin()), siblings.size());
+    return fabsf(n.x - p.x) > epsilon || fabsf(n.y - p.y) > epsilon;
+}
 
-    // If the spirit name is empty, nothing to do
-    auto it = m_trees.find(spiritName);
-    if (it == m_trees.end()) { cs.reshapeResult = false; return false; }
-    const SpiritTree& tree = it->second;
+// True when node i was created at runtime or its id is not part of the load snapshot
+bool isNodeUnrestored(const SpiritNode& n, const SpiritTree* original) {
+    if (n.isNew) return true;
+    return original && original->indexById.find(n.id) == original->indexById.end();
+}
 
-    // If there are snapped nodes recorded for this spirit, we consider reshape necessary
-    auto pit = m_perTreeSnaps.find(spiritName);
-    if (pit != m_perTreeSnaps.end() && !pit->second.empty()) { cs.reshapeResult = true; return true; }
-
-    // Make a copy and recompute positions using layoutSubtree on each root without mutating the real tree
-    SpiritTree tmp = tree;
-    // Build id map for tmp and find roots
-    std::unordered_map<uint64_t, SpiritNode*> idToNode;
-    for (auto& n : tmp.nodes) idToNode[n.id] = &n;
-    for (auto& n : tmp.nodes) {
-        if (n.dep == 0) {
-            SpiritNode* root = idToNode[n.id];
-            if (root) layoutSubtree(tmp, *root, root->x, root->y, 0);
-        }
+// Past this many queued subtrees a full recheck is cheaper than walking each of them
+constexpr size_t MAX_DIRTY_SUBTREES = 64;
+
+// Per-node facts counted by the spirit analysis
+enum : uint8_t {
+    FACT_AP       = 1u << 0, // ap set (rules the spirit out as travelling)
+    FACT_EMOTE    = 1u << 1, // nm contains "emote_upgrade" (case-insensitive)
+    FACT_TRAVEL   = 1u << 2, // non-root node whose typ is not "seasonal heart"
+    FACT_MISMATCH = 1u << 3, // id != fnv1a32(nm)
+    FACT_COUNTED  = 1u << 7, // slot has been counted
+};
+
+bool containsIgnoreCase(const std::string& haystack, const char* needle, size_t needleLen) {
+    if (haystack.size() < needleLen) return false;
+    for (size_t i = 0; i + needleLen <= haystack.size(); ++i) {
+        size_t k = 0;
+        while (k < needleLen && std::tolower((unsigned char)haystack[i + k]) == needle[k]) ++k;
+        if (k == needleLen) return true;
     }
+    return false;
+}
 
-    // Compare positions
-    std::unordered_map<uint64_t, const SpiritNode*> origMap;
-    for (const auto& n : tree.nodes) origMap[n.id] = &n;
-    for (const auto& n : tmp.nodes) {
-        auto itn = origMap.find(n.id);
-        if (itn == origMap.end()) continue;
-        const SpiritNode* orig = itn->second;
-        float dx = fabsf(orig->x - n.x);
-        float dy = fabsf(orig->y - n.y);
-        if (dx > epsilon || dy > epsilon) { cs.reshapeResult = true; return true; }
+uint8_t nodeFacts(const SpiritNode& node) {
+    static const char EMOTE[] = "emote_upgrade";
+    static const char SEASONAL_HEART[] = "seasonal heart";
+    uint8_t bits = FACT_COUNTED;
+    if (node.isAdventurePass) bits |= FACT_AP;
+    if (containsIgnoreCase(node.name, EMOTE, sizeof(EMOTE) - 1)) bits |= FACT_EMOTE;
+    if (node.dep != 0 && !(node.type.size() == sizeof(SEASONAL_HEART) - 1 &&
+                           containsIgnoreCase(node.type, SEASONAL_HEART, sizeof(SEASONAL_HEART) - 1))) {
+        bits |= FACT_TRAVEL;
     }
-    cs.reshapeResult = false;
-    return false;
+    if (node.id != fnv1a32(node.name)) bits |= FACT_MISMATCH;
+    return bits;
+}
+
+// Add delta to refs[id] and keep ids holding exactly the ids with a non-zero count.
+// Returns true when the membership of id in ids changed.
+bool adjustRef(std::unordered_map<uint64_t, uint32_t>& refs, std::unordered_set<uint64_t>& ids,
+               uint64_t id, int delta) {
+    uint32_t& count = refs[id];
+    count = (uint32_t)((int)count + delta);
+    if (count == 0) {
+        refs.erase(id);
+        ids.erase(id);
+        return true;
+    }
+    return ids.insert(id).second;
+}
+
+} // namespace
+
+bool SpiritTreeManager::needsReshape(const std::string& spiritName, float epsilon) {
+    auto it = findTree(spiritName);
+    if (it == m_trees.end()) return false;
+
+    // If there are snapped nodes recorded for this spirit, we consider reshape necessary
+    if (hasSnapsInternal(spiritName)) return true;
+
+    refreshCachedState(spiritName, epsilon);
+    return m_cachedState[spiritName].misplacedCount > 0;
 }
 
 bool SpiritTreeManager::needsRestore(const std::string& spiritName) const {
-    // Check cache first
+    auto it = findTree(spiritName);
+    if (it == m_trees.end()) return false;
+    const SpiritTree& tree = it->second;
+
     auto& cs = m_cachedState[spiritName];
-    if (!cs.restoreDirty) return cs.restoreResult;
-    cs.restoreDirty = false;
+    refreshCachedState(spiritName, cs.epsilon);
+    // Any new/custom node or any id the loaded file did not have
+    if (cs.unrestoredCount > 0) return true;
+
+    // Otherwise only a changed node count differs from the original load snapshot
+    auto oit = m_originalTrees.find(spiritName);
+    if (oit == m_originalTrees.end()) return false;
+    return tree.nodes.size() != oit->second.nodes.size();
+}
 
-    auto it = m_trees.find(spiritName);
-    if (it == m_trees.end()) { cs.restoreResult = false; return false; }
+void SpiritTreeManager::markDirty(const std::string& spiritName) {
+    m_treeUse[spiritName].touched = true;
+    auto& cs = m_cachedState[spiritName];
+    cs.reshapeDirty = true;
+    cs.restoreDirty = true;
+    cs.dirtySubtrees.clear();
+    m_analysis[spiritName].fullDirty = true;
+    m_spiritEditGeneration[spiritName] = ++m_editGeneration;
+    ++m_layoutGeneration;
+}
+
+void SpiritTreeManager::markSubtreeDirty(const std::string& spiritName, uint64_t nodeId) {
+    queueDirtySubtree(spiritName, nodeId);
+    queueAnalysisNode(spiritName, nodeId);
+    m_spiritEditGeneration[spiritName] = ++m_editGeneration;
+}
+
+uint64_t SpiritTreeManager::getSpiritEditGeneration(const std::string& spiritName) const {
+    auto it = m_spiritEditGeneration.find(spiritName);
+    return it != m_spiritEditGeneration.end() ? it->second : 0;
+}
+
+void SpiritTreeManager::queueDirtySubtree(const std::string& spiritName, uint64_t nodeId) {
+    m_treeUse[spiritName].touched = true;
+    ++m_layoutGeneration;
+    auto& cs = m_cachedState[spiritName];
+    if (cs.reshapeDirty && cs.restoreDirty) return; // a full recheck is already pending
+    if (cs.dirtySubtrees.size() >= MAX_DIRTY_SUBTREES) {
+        cs.reshapeDirty = true;
+        cs.restoreDirty = true;
+        cs.dirtySubtrees.clear();
+        return;
+    }
+    cs.dirtySubtrees.push_back(nodeId);
+}
+
+void SpiritTreeManager::refreshCachedState(const std::string& spiritName, float epsilon) const {
+    auto& cs = m_cachedState[spiritName];
+    auto it = findTree(spiritName);
+    if (it == m_trees.end()) return;
     const SpiritTree& tree = it->second;
+    const SpiritTree* original = originalTree(spiritName);
+
+    const size_t count = tree.nodes.size();
+    if (cs.nodeFlags.size() != count) {
+        // Nodes were added or removed: slot flags no longer line up
+        cs.nodeFlags.assign(count, 0);
+        cs.misplacedCount = cs.unrestoredCount = 0;
+        cs.reshapeDirty = cs.restoreDirty = true;
+    }
+    if (epsilon != cs.epsilon) {
+        cs.epsilon = epsilon;
+        cs.reshapeDirty = true;
+    }
 
-    // Check for any new/custom nodes (added at runtime)
-    for (const auto& n : tree.nodes) {
-        if (n.isNew) { cs.restoreResult = true; return true; }
+    auto update = [&](size_t i, bool reshape, bool restore) {
+        uint8_t& f = cs.nodeFlags[i];
+        if (reshape) {
+            bool on = isNodeMisplaced(tree, i, epsilon);
+            if (on != ((f & NODE_MISPLACED) != 0)) {
+                f ^= NODE_MISPLACED;
+                if (on) ++cs.misplacedCount; else --cs.misplacedCount;
+            }
+        }
+        if (restore) {
+            bool on = isNodeUnrestored(tree.nodes[i], original);
+            if (on != ((f & NODE_UNRESTORED) != 0)) {
+                f ^= NODE_UNRESTORED;
+                if (on) ++cs.unrestoredCount; else --cs.unrestoredCount;
+            }
+        }
+    };
+
+    if (cs.reshapeDirty || cs.restoreDirty) {
+        const bool reshape = cs.reshapeDirty, restore = cs.restoreDirty;
+        for (size_t i = 0; i < count; ++i) update(i, reshape, restore);
+        cs.reshapeDirty = cs.restoreDirty = false;
+    }
+    if (cs.dirtySubtrees.empty()) return;
+
+    // Re-check each dirty subtree plus its siblings (a changed child count moves all of them)
+    std::unordered_set<size_t> region, walked;
+    std::vector<size_t> stack;
+    const SpiritNode* base = tree.nodes.data();
+    for (uint64_t rootId : cs.dirtySubtrees) {
+        const SpiritNode* root = tree.findNode(rootId);
+        if (!root) continue;
+        if (root->dep != 0) {
+            if (const SpiritNode* parent = tree.findNode(root->dep)) {
+                for (uint64_t sib : parent->children) {
+                    if (const SpiritNode* s = tree.findNode(sib)) region.insert((size_t)(s - base));
+                }
+            }
+        }
+        stack.push_back((size_t)(root - base));
+        while (!stack.empty()) {
+            size_t cur = stack.back(); stack.pop_back();
+            if (!walked.insert(cur).second) continue;
+            region.insert(cur);
+            for (uint64_t c : tree.nodes[cur].children) {
+                if (const SpiritNode* child = tree.findNode(c)) stack.push_back((size_t)(child - base));
+            }
+        }
+    }
+    cs.dirtySubtrees.clear();
+    for (size_t i : region) update(i, true, true);
+}
+
+void SpiritTreeManager::queueAnalysisNode(const std::string& spiritName, uint64_t nodeId) {
+    auto& st = m_analysis[spiritName];
+    if (st.fullDirty) return;
+    if (st.dirtyNodes.size() >= MAX_DIRTY_SUBTREES) {
+        st.fullDirty = true;
+        st.dirtyNodes.clear();
+        return;
+    }
+    st.dirtyNodes.push_back(nodeId);
+}
+
+void SpiritTreeManager::recountNode(AnalysisState& st, const SpiritNode& node, size_t index, uint64_t& version) {
+    auto& f = st.facts[index];
+    const uint8_t bits = nodeFacts(node);
+    if (f.bits == bits && f.id == node.id && f.name == node.name) return;
+    bool duplicatesChanged = false;
+
+    if (f.bits & FACT_COUNTED) {
+        if (f.bits & FACT_AP) --st.apCount;
+        if (f.bits & FACT_EMOTE) --st.emoteCount;
+        if (f.bits & FACT_TRAVEL) --st.travelCount;
+        if (f.bits & FACT_MISMATCH) adjustRef(st.mismatchRefs, st.result.mismatchedIds, f.id, -1);
+        if (--st.idCounts[f.id] == 0) st.idCounts.erase(f.id);
+        auto git = st.idsByName.find(f.name);
+        if (git != st.idsByName.end()) {
+            auto& group = git->second;
+            const size_t before = group.size();
+            auto pos = std::find(group.begin(), group.end(), f.id);
+            if (pos != group.end()) group.erase(pos);
+            if (before > 1) duplicatesChanged |= adjustRef(st.duplicateRefs, st.result.duplicateIds, f.id, -1);
+            if (before == 2) duplicatesChanged |= adjustRef(st.duplicateRefs, st.result.duplicateIds, group[0], -1);
+            if (group.empty()) st.idsByName.erase(git);
+        }
     }
 
-    // Compare current node IDs against cached original IDs
-    auto oit = m_originalNodeIds.find(spiritName);
-    if (oit == m_originalNodeIds.end()) { cs.restoreResult = false; return false; }
-    const auto& origIds = oit->second;
+    f.name = node.name;
+    f.id = node.id;
+    f.bits = bits;
+    if (bits & FACT_AP) ++st.apCount;
+    if (bits & FACT_EMOTE) ++st.emoteCount;
+    if (bits & FACT_TRAVEL) ++st.travelCount;
+    if (bits & FACT_MISMATCH) adjustRef(st.mismatchRefs, st.result.mismatchedIds, f.id, +1);
+    ++st.idCounts[f.id];
+    auto& group = st.idsByName[f.name];
+    group.push_back(f.id);
+    if (group.size() > 1) duplicatesChanged |= adjustRef(st.duplicateRefs, st.result.duplicateIds, f.id, +1);
+    if (group.size() == 2) duplicatesChanged |= adjustRef(st.duplicateRefs, st.result.duplicateIds, group[0], +1);
+
+    if (duplicatesChanged) st.result.version = ++version;
+}
 
-    // Quick size check
-    if (tree.nodes.size() != origIds.size()) { cs.restoreResult = true; return true; }
+void SpiritTreeManager::classify(AnalysisState& st) {
+    // Guides are never travelling; ap anywhere rules it out; an emote upgrade is required
+    st.result.isTravelling = !st.result.isGuide && st.apCount == 0 && st.emoteCount > 0 && st.travelCount > 0;
+}
 
-    // Check all current nodes exist in originals
-    for (const auto& n : tree.nodes) {
-        if (origIds.find(n.id) == origIds.end()) { cs.restoreResult = true; return true; }
+SpiritTreeManager::SpiritAnalysis SpiritTreeManager::analyzeNodes(const std::string& spiritName,
+                                                                  const std::vector<SpiritNode>& nodes) {
+    AnalysisState st;
+    uint64_t version = 0;
+    st.facts.resize(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) recountNode(st, nodes[i], i, version);
+    st.result.isGuide = checkIfGuide(spiritName);
+    classify(st);
+    return std::move(st.result);
+}
+
+SpiritTreeManager::AnalysisState* SpiritTreeManager::refreshAnalysis(const std::string& spiritName) const {
+    // Trees not built yet are analysed from their snapshot; only built trees get edited,
+    // so the per-node path below never runs on a snapshot
+    const SpiritTree* view = viewTree(spiritName);
+    if (!view) return nullptr;
+    const SpiritTree& tree = *view;
+    auto& st = m_analysis[spiritName];
+
+    if (st.fullDirty || st.facts.size() != tree.nodes.size()) {
+        st = AnalysisState();
+        st.facts.resize(tree.nodes.size());
+        for (size_t i = 0; i < tree.nodes.size(); ++i) recountNode(st, tree.nodes[i], i, m_analysisVersion);
+        st.result.isGuide = checkIfGuide(spiritName);
+        st.result.version = ++m_analysisVersion;
+    } else {
+        for (uint64_t id : st.dirtyNodes) {
+            auto idx = tree.indexById.find(id);
+            if (idx == tree.indexById.end()) continue;
+            auto cnt = st.idCounts.find(id);
+            if (cnt != st.idCounts.end() && cnt->second > 1) {
+                // The edited node may be any of the nodes sharing this id
+                for (size_t i = 0; i < tree.nodes.size(); ++i) {
+                    if (tree.nodes[i].id == id) recountNode(st, tree.nodes[i], i, m_analysisVersion);
+                }
+            } else {
+                recountNode(st, tree.nodes[idx->second], idx->second, m_analysisVersion);
+            }
+        }
     }
+    st.fullDirty = false;
+    st.dirtyNodes.clear();
+    classify(st);
+    return &st;
+}
 
-    cs.restoreResult = false;
-    return false;
+const SpiritTreeManager::SpiritAnalysis& SpiritTreeManager::getAnalysis(const std::string& spiritName) const {
+    static const SpiritAnalysis empty;
+    const AnalysisState* st = refreshAnalysis(spiritName);
+    return st ? st->result : empty;
 }
 
-void SpiritTreeManager::markDirty(const std::string& spiritName) {
-    auto& cs = m_cachedState[spiritName];
-    cs.reshapeDirty = true;
-    cs.restoreDirty = true;
+bool SpiritTreeManager::hasIdMismatch(const std::string& spiritName, uint64_t nodeId) const {
+    return getAnalysis(spiritName).mismatchedIds.count(nodeId) > 0;
 }
 
 void SpiritTreeManager::positionLinkedNode(const std::string& spiritName, uint64_t nodeId,
                                              std::unordered_map<uint64_t, std::pair<float,float>>* outShifts) {
-    auto it = m_trees.find(spiritName);
+    auto it = findTree(spiritName);
     if (it == m_trees.end()) return;
     
     SpiritTree& tree = it->second;
     
     // Find the node
-    SpiritNode* node = nullptr;
-    for (auto& n : tree.nodes) {
-        if (n.id == nodeId) {
-            node = &n;
-            break;
-        }
-    }
+    SpiritNode* node = tree.findNode(nodeId);
     if (!node || node->dep == 0) return;  // No node or no parent
     
     // Find the parent
-    SpiritNode* parent = nullptr;
-    for (auto& n : tree.nodes) {
-        if (n.id == node->dep) {
-            parent = &n;
-            break;
-        }
-    }
+    SpiritNode* parent = tree.findNode(node->dep);
     if (!parent) return;
     
-    // Create lookup map for all nodes
-    std::unordered_map<uint64_t, SpiritNode*> idToNode;
-    for (auto& n : tree.nodes) {
-        idToNode[n.id] = &n;
-    }
-    
-    // Layout constants (same as in layoutSubtree)
-    const float nodeSpacingY = 100.0f;
-    const float nodeSpacingX = 120.0f;
-    const float diagonalYOffset = -25.0f;
-    
     size_t childCount = parent->children.size();
+    UndoOp op;
+    op.kind = UndoOp::Kind::Layout;
 
     // Reposition ALL children of this parent according to the layout rules
     for (size_t i = 0; i < childCount; ++i) {
-        auto childIt = idToNode.find(parent->children[i]);
-        if (childIt == idToNode.end()) continue;
-
-        SpiritNode* child = childIt->second;
-        float x = parent->x;
-        float y = parent->y + nodeSpacingY;
-
-        // Position based on child index (same logic as layoutSubtree)
-        if (childCount == 1) {
-            x = parent->x;  // Directly above (N)
-        } else if (childCount == 2) {
-            if (i == 0) {
-                x = parent->x - nodeSpacingX;  // NW
-                y += diagonalYOffset;
-            } else {
-                x = parent->x;  // N
-            }
-        } else if (childCount == 3) {
-            if (i == 0) {
-                x = parent->x - nodeSpacingX;  // NW
-                y += diagonalYOffset;
-            } else if (i == 1) {
-                x = parent->x;  // N
-            } else {
-                x = parent->x + nodeSpacingX;  // NE
-                y += diagonalYOffset;
-            }
-        } else {
-            // Distribute children evenly centered above the parent for >3 children
-            float startX = parent->x - nodeSpacingX * (float(childCount - 1) * 0.5f);
-            x = startX + (float)i * nodeSpacingX;
-            float centerIndex = (childCount - 1) * 0.5f;
-            if (std::fabs((float)i - centerIndex) > 0.01f) y += diagonalYOffset;
-        }
+        SpiritNode* child = tree.findNode(parent->children[i]);
+        if (!child) continue;
+
+        // Position based on child index (same rule as the full layout)
+        TreeLayout::Point p = TreeLayout::childPosition(parent->x, parent->y, i, childCount);
+        float x = p.x;
+        float y = p.y;
 
         // If caller requested, record the visual shift (oldBase - newBase) so the renderer can
         // apply an immediate offset that will be springed back to zero (producing a smooth motion)
@@ -826,85 +1739,39 @@ void SpiritTreeManager::positionLinkedNode(const std::string& spiritName, uint64
             (*outShifts)[child->id] = std::make_pair(dx, dy);
         }
 
+        if (m_recordUndo && (child->x != x || child->y != y)) {
+            op.placements.push_back(UndoOp::Placement{child->id, child->x, child->y, x, y});
+        }
         child->x = x;
         child->y = y;
     }
+    queueDirtySubtree(spiritName, parent->id);
+    if (!op.placements.empty()) recordOp(spiritName, std::move(op));
 }
 
 bool SpiritTreeManager::layoutSubtreeAndCollectShifts(const std::string& spiritName, uint64_t rootNodeId,
                                        std::unordered_map<uint64_t, std::pair<float,float>>* outShifts) {
-    auto it = m_trees.find(spiritName);
+    auto it = findTree(spiritName);
     if (it == m_trees.end()) return false;
     SpiritTree& tree = it->second;
 
-    // Build id lookup and find root
-    std::unordered_map<uint64_t, SpiritNode*> idToNode;
-    SpiritNode* root = nullptr;
-    for (auto& n : tree.nodes) {
-        idToNode[n.id] = &n;
-        if (n.id == rootNodeId) root = &n;
-    }
+    SpiritNode* root = tree.findNode(rootNodeId);
     if (!root) return false;
 
-    // Collect subtree nodes
-    std::vector<uint64_t> stack;
-    std::unordered_set<uint64_t> subtreeSet;
-    stack.push_back(root->id);
-    while (!stack.empty()) {
-        uint64_t cur = stack.back(); stack.pop_back();
-        if (subtreeSet.count(cur)) continue;
-        subtreeSet.insert(cur);
-        auto itn = idToNode.find(cur);
-        if (itn == idToNode.end()) continue;
-        for (uint64_t c : itn->second->children) stack.push_back(c);
-    }
-
-    // Save old positions for subtree nodes
-    std::unordered_map<uint64_t, std::pair<float,float>> oldPos;
-    for (uint64_t id : subtreeSet) {
-        auto itn = idToNode.find(id);
-        if (itn != idToNode.end()) oldPos[id] = std::make_pair(itn->second->x, itn->second->y);
-    }
-
     // Re-layout the subtree rooted at 'root' using current root->x, root->y
-    layoutSubtree(tree, *root, root->x, root->y, 0);
+    m_layout.build(tree);
+    applyLayout(tree, (uint32_t)(root - tree.nodes.data()), root->x, root->y, outShifts);
 
     // Recompute bounds for the whole tree
-    tree.minX = tree.maxX = 0.0f;
-    tree.minY = tree.maxY = 0.0f;
-    for (const auto& n : tree.nodes) {
-        tree.minX = std::min(tree.minX, n.x);
-        tree.maxX = std::max(tree.maxX, n.x);
-        tree.minY = std::min(tree.minY, n.y);
-        tree.maxY = std::max(tree.maxY, n.y);
-    }
-    tree.width = tree.maxX - tree.minX;
-    tree.height = tree.maxY - tree.minY;
-
-    // Compute shifts for subtree nodes (oldBase - newBase) excluding the root node
-    if (outShifts) {
-        for (auto &kv : oldPos) {
-            uint64_t id = kv.first;
-            if (id == rootNodeId) continue; // skip root (dragged node kept directly under cursor)
-            auto itn = idToNode.find(id);
-            if (itn == idToNode.end()) continue;
-            float oldX = kv.second.first;
-            float oldY = kv.second.second;
-            float newX = itn->second->x;
-            float newY = itn->second->y;
-            (*outShifts)[id] = std::make_pair(oldX - newX, oldY - newY);
-        }
-    }
+    computeBounds(tree);
 
-    // After re-layout of a subtree, it's consistent with layout; clear reshape-needed flag.
-    auto &cs = m_cachedState[spiritName];
-    cs.reshapeDirty = false;
-    cs.reshapeResult = false;
+    // The re-laid-out subtree is consistent with layout again; recheck just that region
+    queueDirtySubtree(spiritName, rootNodeId);
     return true;
 }
 
 uint64_t SpiritTreeManager::createNode(const std::string& spiritName, float x, float y) {
-    auto it = m_trees.find(spiritName);
+    auto it = findTree(spiritName);
     if (it == m_trees.end()) return 0;
     
     SpiritTree& tree = it->second;
@@ -942,64 +1809,135 @@ uint64_t SpiritTreeManager::createNode(const std::string& spiritName, float x, f
     newNode.y = y;
     newNode.isNew = true;
 
-    // Add to tree
-    tree.nodes.push_back(newNode);
-    
-    // Rebuild tree relationships
-    buildTree(tree);
+    // Add to tree. The node is a root without a parent, so only its own children (nodes
+    // already depending on its id) and the root id need patching; other child lists keep
+    // their order.
+    const size_t slot = tree.nodes.size();
+    tree.appendNode(newNode);
+    SpiritNode& added = tree.nodes[slot];
+    if (tree.findNode(added.id) == &added) {
+        for (size_t i = 0; i < slot; ++i) {
+            if (tree.nodes[i].dep == added.id) added.children.push_back(tree.nodes[i].id);
+        }
+    }
+    tree.rootNodeId = added.id;
     markDirty(spiritName);
+
+    UndoOp op;
+    op.kind = UndoOp::Kind::Create;
+    op.nodeId = newNode.id;
+    op.slot = (uint32_t)slot;
+    op.x = x;
+    op.y = y;
+    op.before = fieldsOf(newNode);
+    op.ids = added.children;
+    op.idsAfter = added.children;
+    recordOp(spiritName, std::move(op));
     
     return newNode.id;
 }
 
 bool SpiritTreeManager::deleteNode(const std::string& spiritName, uint64_t nodeId) {
-    auto it = m_trees.find(spiritName);
+    auto it = findTree(spiritName);
     if (it == m_trees.end()) return false;
     
     SpiritTree& tree = it->second;
     
     // Find and remove the node
-    auto nodeIt = std::find_if(tree.nodes.begin(), tree.nodes.end(),
-        [nodeId](const SpiritNode& n) { return n.id == nodeId; });
-    
-    if (nodeIt == tree.nodes.end()) return false;
-    
-    // Remove the node
-    tree.nodes.erase(nodeIt);
-    
-    // Update any nodes that had this as their parent (orphan them)
-    for (auto& node : tree.nodes) {
-        if (node.dep == nodeId) {
-            node.dep = 0;  // Make them free-floating
-        }
+    const SpiritNode* target = tree.findNode(nodeId);
+    if (!target) return false;
+    const size_t pos = (size_t)(target - tree.nodes.data());
+
+    UndoOp op;
+    op.kind = UndoOp::Kind::Delete;
+    op.nodeId = nodeId;
+    op.from = target->dep;
+    op.slot = (uint32_t)pos;
+    op.x = target->x;
+    op.y = target->y;
+    op.before = fieldsOf(*target);
+    op.idsAfter = target->children;
+    if (const SpiritNode* parent = target->dep != 0 ? tree.findNode(target->dep) : nullptr) {
+        auto it = std::find(parent->children.begin(), parent->children.end(), nodeId);
+        if (it != parent->children.end()) op.fromIndex = (uint32_t)(it - parent->children.begin());
     }
-    
-    // Rebuild tree relationships
-    buildTree(tree);
+
+    // Remove the node; nodes that had it as their parent become free-floating roots
+    op.ids = removeNodeAt(tree, pos);
     markDirty(spiritName);
+    recordOp(spiritName, std::move(op));
     
     return true;
 }
 
+std::vector<uint64_t> SpiritTreeManager::removeNodeAt(SpiritTree& tree, size_t pos) {
+    std::vector<uint64_t> orphans;
+    const uint64_t nodeId = tree.nodes[pos].id;
+    const uint64_t parentId = tree.nodes[pos].dep;
+    tree.eraseNodeAt(pos);
+
+    // A repeated id is still in use by another node; fall back to a full relink
+    if (tree.findNode(nodeId)) {
+        for (auto& node : tree.nodes) {
+            if (node.dep == nodeId) { node.dep = 0; orphans.push_back(node.id); }
+        }
+        buildTree(tree);
+        return orphans;
+    }
+
+    if (SpiritNode* parent = parentId != 0 ? tree.findNode(parentId) : nullptr) {
+        auto& siblings = parent->children;
+        auto it = std::find(siblings.begin(), siblings.end(), nodeId);
+        if (it != siblings.end()) siblings.erase(it);
+    }
+    for (auto& node : tree.nodes) {
+        if (node.dep == nodeId) { node.dep = 0; orphans.push_back(node.id); }
+    }
+    resetRootId(tree);
+    return orphans;
+}
+
+void SpiritTreeManager::restoreNode(SpiritTree& tree, const UndoOp& op) {
+    SpiritNode node;
+    node.id = op.nodeId;
+    node.dep = op.from;
+    node.name = op.before.name;
+    node.originalName = op.before.originalName;
+    node.spirit = op.before.spirit;
+    node.type = op.before.type;
+    node.costType = op.before.costType;
+    node.cost = op.before.cost;
+    node.isAdventurePass = op.before.isAdventurePass;
+    node.isNew = op.before.isNew;
+    node.x = op.x;
+    node.y = op.y;
+    node.children = op.idsAfter;
+    tree.insertNodeAt(op.slot, node);
+
+    for (uint64_t cid : op.ids) {
+        if (SpiritNode* child = tree.findNode(cid)) child->dep = op.nodeId;
+    }
+    if (SpiritNode* parent = op.from != 0 ? tree.findNode(op.from) : nullptr) {
+        auto& siblings = parent->children;
+        size_t at = op.fromIndex == UndoOp::NO_INDEX ? siblings.size() : std::min<size_t>(op.fromIndex, siblings.size());
+        siblings.insert(siblings.begin() + at, op.nodeId);
+    }
+    resetRootId(tree);
+}
+
 void SpiritTreeManager::recordSnap(const std::string& spiritName, uint64_t childId, uint64_t oldParentId) {
-    auto it = m_trees.find(spiritName);
+    auto it = findTree(spiritName);
     if (it == m_trees.end()) return;
     // Keep map per-manager; record mapping child -> {oldParent, oldIndex} (only if child exists in this spirit)
     SpiritTree& tree = it->second;
-    bool childExists = false;
-    for (const auto& n : tree.nodes) if (n.id == childId) { childExists = true; break; }
-    if (!childExists) return;
+    if (!tree.findNode(childId)) return;
 
     // Find the old parent's child index if possible
     size_t oldIndex = 0;
     bool foundIndex = false;
-    for (const auto& n : tree.nodes) {
-        if (n.id == oldParentId) {
-            const SpiritNode* parent = &n;
-            for (size_t i = 0; i < parent->children.size(); ++i) {
-                if (parent->children[i] == childId) { oldIndex = i; foundIndex = true; break; }
-            }
-            break;
+    if (const SpiritNode* parent = tree.findNode(oldParentId)) {
+        for (size_t i = 0; i < parent->children.size(); ++i) {
+            if (parent->children[i] == childId) { oldIndex = i; foundIndex = true; break; }
         }
     }
 
@@ -1013,7 +1951,6 @@ void SpiritTreeManager::recordSnap(const std::string& spiritName, uint64_t child
     // Also persist the mapping inside the per-tree structure in case the app needs to query it
     auto &vec = m_perTreeSnaps[spiritName];
     if (std::find(vec.begin(), vec.end(), childId) == vec.end()) vec.push_back(childId);
-    markDirty(spiritName);
 }
 
 void SpiritTreeManager::clearSnap(const std::string& spiritName, uint64_t childId) {
@@ -1028,7 +1965,6 @@ void SpiritTreeManager::clearSnap(const std::string& spiritName, uint64_t childI
         vec.erase(std::remove(vec.begin(), vec.end(), childId), vec.end());
         if (vec.empty()) m_perTreeSnaps.erase(pit);
     }
-    markDirty(spiritName);
 }
 
 void SpiritTreeManager::clearAllSnaps(const std::string& spiritName) {
@@ -1041,74 +1977,41 @@ void SpiritTreeManager::clearAllSnaps(const std::string& spiritName) {
         }
         m_perTreeSnaps.erase(pit);
     }
-    markDirty(spiritName);
 }
 
 bool SpiritTreeManager::reloadSpirit(const std::string& spiritName) {
-    if (m_loadedFile.empty()) return false;
-    auto treeIt = m_trees.find(spiritName);
+    auto treeIt = findTree(spiritName);
     if (treeIt == m_trees.end()) return false;
 
-    try {
-        std::ifstream f(m_loadedFile);
-        if (!f.is_open()) return false;
-        json data = json::parse(f);
-
-        // Collect original nodes for this spirit from the file
-        std::vector<SpiritNode> originalNodes;
-        for (const auto& item : data) {
-            std::string spirit = item.value("spirit", std::string());
-            if (spirit != spiritName) continue;
-            SpiritNode node;
-            node.id = item.value("id", 0ULL);
-            node.dep = item.value("dep", 0ULL);
-            node.name = item.value("nm", std::string());
-            node.originalName = node.name;
-            node.spirit = spirit;
-            node.type = item.value("typ", std::string());
-            node.costType = item.value("ctyp", std::string());
-            node.cost = item.value("cst", 0);
-            node.isAdventurePass = item.value("ap", false);
-            node.isNew = false;
-            originalNodes.push_back(node);
-        }
-
-        // Replace the tree's nodes entirely and rebuild
-        SpiritTree& tree = treeIt->second;
-        tree.nodes = std::move(originalNodes);
-        buildTree(tree);
-        computeLayout(tree);
-
-        // Update cached original IDs for this spirit
-        auto &ids = m_originalNodeIds[spiritName];
-        ids.clear();
-        for (const auto& n : tree.nodes) ids.insert(n.id);
-
-        // After reload, the tree matches the loaded file; clear cached flags
-        auto &cs = m_cachedState[spiritName];
-        cs.reshapeDirty = false; cs.reshapeResult = false;
-        cs.restoreDirty = false; cs.restoreResult = false;
+    // Replace the tree's nodes with the original load snapshot (empty for spirits added at runtime)
+    SpiritTree& tree = treeIt->second;
+    if (const SpiritTree* original = originalTree(spiritName)) {
+        tree.nodes = original->nodes;
+        tree.indexById = original->indexById;
+    } else {
+        tree.nodes.clear();
+        tree.indexById.clear();
+    }
+    buildTree(tree);
+    computeLayout(tree);
 
-        // Clear all snap records for this spirit
-        clearAllSnaps(spiritName);
-        markDirty(spiritName);
+    // Clear all snap records for this spirit
+    clearAllSnaps(spiritName);
+    markDirty(spiritName);
+    m_history.dropSpirit(spiritName);
+    // Back to the load snapshot: evictable again unless it is edited
+    if (m_originalTrees.count(spiritName)) m_treeUse[spiritName].touched = false;
 
-        return true;
-    } catch (...) {
-        return false;
-    }
+    return true;
 }
+
 std::vector<uint64_t> SpiritTreeManager::restoreSnaps(const std::string& spiritName) {
     std::vector<uint64_t> restored;
     if (spiritName.empty()) return restored;
-    auto it = m_trees.find(spiritName);
+    auto it = findTree(spiritName);
     if (it == m_trees.end()) return restored;
     SpiritTree& tree = it->second;
 
-    // Build id->node map
-    std::unordered_map<uint64_t, SpiritNode*> idToNode;
-    for (auto& n : tree.nodes) idToNode[n.id] = &n;
-
     // Reattach any snapped nodes if their original parent still exists
     std::vector<uint64_t> toErase;
     std::vector<std::pair<uint64_t,size_t>> restoredWithIndex; // (childId, originalIndex)
@@ -1116,15 +2019,14 @@ std::vector<uint64_t> SpiritTreeManager::restoreSnaps(const std::string& spiritN
         uint64_t childId = itKv->first;
         SnapInfo info = itKv->second;
         uint64_t oldParent = info.parentId;
-        auto itChild = idToNode.find(childId);
-        auto itParent = idToNode.find(oldParent);
-        if (itChild != idToNode.end() && itParent != idToNode.end()) {
-            // Reattach to old parent
-            itChild->second->dep = oldParent;
+        SpiritNode* child = tree.findNode(childId);
+        if (child && tree.findNode(oldParent)) {
+            // Reattach to old parent (patches both child lists, no rebuild)
+            relinkNode(spiritName, childId, oldParent);
             toErase.push_back(childId);
             restored.push_back(childId);
             restoredWithIndex.push_back(std::make_pair(childId, info.index));
-            // Remove from map and per-tree lists now, we'll apply original indices after rebuild
+            // Remove from map and per-tree lists now, we'll apply original indices below
             itKv = m_snappedParents.erase(itKv);
             auto &vec = m_perTreeSnaps[spiritName];
             vec.erase(std::remove(vec.begin(), vec.end(), childId), vec.end());
@@ -1133,11 +2035,8 @@ std::vector<uint64_t> SpiritTreeManager::restoreSnaps(const std::string& spiritN
         }
     }
 
-    // Rebuild tree relationships if we restored any nodes so subsequent layout calls
-    // operate on the full tree structure
+    // Move each restored node back to its original index among its siblings
     if (!toErase.empty()) {
-        rebuildTree(spiritName);
-        // After rebuild we should ensure each restored node occupies its original index
         const SpiritTree* tptr = getTree(spiritName);
         if (tptr) {
             // Convert tree to mutable reference to adjust parent->children ordering
@@ -1146,22 +2045,18 @@ std::vector<uint64_t> SpiritTreeManager::restoreSnaps(const std::string& spiritN
                 uint64_t rid = pr.first;
                 size_t idx = pr.second;
                 // Find child
-                SpiritNode* child = nullptr;
-                for (auto &n : treeRef.nodes) {
-                    if (n.id == rid) { child = &n; break; }
-                }
+                SpiritNode* child = treeRef.findNode(rid);
                 if (!child) continue;
                 // Find parent by id recorded in child->dep
-                SpiritNode* parent = nullptr;
-                for (auto &n : treeRef.nodes) {
-                    if (n.id == child->dep) { parent = &n; break; }
-                }
+                SpiritNode* parent = treeRef.findNode(child->dep);
                 if (!parent) continue;
                 // Remove any existing entries of child from parent's list
-                parent->children.erase(std::remove(parent->children.begin(), parent->children.end(), rid), parent->children.end());
+                std::vector<uint64_t> order = parent->children;
+                order.erase(std::remove(order.begin(), order.end(), rid), order.end());
                 // Clamp index and insert
-                size_t insertIdx = std::min(idx, parent->children.size());
-                parent->children.insert(parent->children.begin() + insertIdx, rid);
+                size_t insertIdx = std::min(idx, order.size());
+                order.insert(order.begin() + insertIdx, rid);
+                setChildOrder(spiritName, parent->id, order);
             }
         }
     }
@@ -1182,9 +2077,9 @@ bool SpiritTreeManager::hasSnapsInternal(const std::string& spiritName) const {
 }
 
 bool SpiritTreeManager::isNameDuplicate(const std::string& spiritName, const std::string& name, uint64_t excludeId) const {
-    auto it = m_trees.find(spiritName);
-    if (it == m_trees.end()) return false;
-    const SpiritTree& tree = it->second;
+    const SpiritTree* view = viewTree(spiritName);
+    if (!view) return false;
+    const SpiritTree& tree = *view;
     for (const auto& n : tree.nodes) {
         if (n.id == excludeId) continue;
         if (n.name == name) return true;
@@ -1192,35 +2087,19 @@ bool SpiritTreeManager::isNameDuplicate(const std::string& spiritName, const std
     return false;
 }
 
-std::unordered_set<uint64_t> SpiritTreeManager::getDuplicateNodeIds(const std::string& spiritName) const {
-    std::unordered_set<uint64_t> out;
-    auto it = m_trees.find(spiritName);
-    if (it == m_trees.end()) return out;
-    const SpiritTree& tree = it->second;
-    // map name -> vector of ids
-    std::unordered_map<std::string, std::vector<uint64_t>> nameMap;
-    for (const auto& n : tree.nodes) {
-        nameMap[n.name].push_back(n.id);
-    }
-    for (const auto& kv : nameMap) {
-        if (kv.second.size() > 1) {
-            for (uint64_t id : kv.second) out.insert(id);
-        }
-    }
-    return out;
+const std::unordered_set<uint64_t>& SpiritTreeManager::getDuplicateNodeIds(const std::string& spiritName) const {
+    return getAnalysis(spiritName).duplicateIds;
 }
 
 bool SpiritTreeManager::hasSnaps(const std::string& spiritName) const {
     // Check per-tree list for snaps first
     if (hasSnapsInternal(spiritName)) return true;
     // Fallback: check global map for any child ids that belong to this spirit
-    auto it = m_trees.find(spiritName);
-    if (it == m_trees.end()) return false;
-    const SpiritTree& tree = it->second;
-    std::unordered_set<uint64_t> ids;
-    for (const auto& n : tree.nodes) ids.insert(n.id);
+    const SpiritTree* view = viewTree(spiritName);
+    if (!view) return false;
+    const SpiritTree& tree = *view;
     for (const auto &kv : m_snappedParents) {
-        if (ids.count(kv.first)) return true;
+        if (tree.indexById.count(kv.first)) return true;
     }
     return false;
 }
@@ -1228,23 +2107,22 @@ bool SpiritTreeManager::hasSnaps(const std::string& spiritName) const {
 
 bool SpiritTreeManager::moveNode(const std::string& fromSpirit, const std::string& toSpirit, uint64_t nodeId) {
     if (fromSpirit == toSpirit) return true; // nothing to do
-    auto itFrom = m_trees.find(fromSpirit);
-    auto itTo = m_trees.find(toSpirit);
+    auto itFrom = findTree(fromSpirit);
+    auto itTo = findTree(toSpirit);
     if (itFrom == m_trees.end() || itTo == m_trees.end()) return false;
 
     SpiritTree& fromTree = itFrom->second;
     SpiritTree& toTree = itTo->second;
 
-    auto nodeIt = std::find_if(fromTree.nodes.begin(), fromTree.nodes.end(),
-        [nodeId](const SpiritNode& n) { return n.id == nodeId; });
-    if (nodeIt == fromTree.nodes.end()) return false;
+    const SpiritNode* source = fromTree.findNode(nodeId);
+    if (!source) return false;
 
     // Move node by copying and erasing
-    SpiritNode nodeCopy = *nodeIt;
+    SpiritNode nodeCopy = *source;
     nodeCopy.spirit = toSpirit;
 
     // Erase from source
-    fromTree.nodes.erase(nodeIt);
+    fromTree.eraseNodeAt((size_t)(source - fromTree.nodes.data()));
 
     // Remove parent references in source that pointed to this node
     for (auto& n : fromTree.nodes) {
@@ -1252,15 +2130,200 @@ bool SpiritTreeManager::moveNode(const std::string& fromSpirit, const std::strin
     }
 
     // Add to destination
-    toTree.nodes.push_back(nodeCopy);
+    toTree.appendNode(nodeCopy);
 
     // Rebuild both trees
     buildTree(fromTree);
     buildTree(toTree);
+    markDirty(fromSpirit);
+    markDirty(toSpirit);
+    // Steps of either spirit may refer to the node in its old place
+    m_history.dropSpirit(fromSpirit);
+    m_history.dropSpirit(toSpirit);
+
+    return true;
+}
+
+NodeFields SpiritTreeManager::fieldsOf(const SpiritNode& node) {
+    NodeFields f;
+    f.name = node.name;
+    f.originalName = node.originalName;
+    f.spirit = node.spirit;
+    f.type = node.type;
+    f.costType = node.costType;
+    f.cost = node.cost;
+    f.isAdventurePass = node.isAdventurePass;
+    f.isNew = node.isNew;
+    return f;
+}
+
+void SpiritTreeManager::recordOp(const std::string& spiritName, UndoOp&& op) {
+    m_treeUse[spiritName].touched = true;
+    if (m_recordUndo) m_history.record(spiritName, std::move(op));
+}
+
+void SpiritTreeManager::recordNodeFields(const std::string& spiritName, uint64_t nodeId, const NodeFields& before) {
+    if (!m_recordUndo) return;
+    const SpiritNode* node = getNode(spiritName, nodeId);
+    if (!node) return;
+    NodeFields after = fieldsOf(*node);
+    if (after == before) return;
+    UndoOp op;
+    op.kind = UndoOp::Kind::Fields;
+    op.nodeId = nodeId;
+    op.before = before;
+    op.after = std::move(after);
+    recordOp(spiritName, std::move(op));
+}
+
+bool SpiritTreeManager::undo(std::string* outSpirit, std::unordered_map<uint64_t, std::pair<float,float>>* outShifts) {
+    UndoStep step;
+    while (m_history.takeUndo(step)) {
+        if (!applyStep(step, false, outShifts)) continue;
+        if (outSpirit) *outSpirit = step.spirit;
+        m_history.pushRedo(std::move(step));
+        return true;
+    }
+    return false;
+}
+
+bool SpiritTreeManager::redo(std::string* outSpirit, std::unordered_map<uint64_t, std::pair<float,float>>* outShifts) {
+    UndoStep step;
+    while (m_history.takeRedo(step)) {
+        if (!applyStep(step, true, outShifts)) continue;
+        if (outSpirit) *outSpirit = step.spirit;
+        m_history.pushUndo(std::move(step));
+        return true;
+    }
+    return false;
+}
+
+bool SpiritTreeManager::applyStep(const UndoStep& step, bool forward,
+                                  std::unordered_map<uint64_t, std::pair<float,float>>* outShifts) {
+    auto it = findTree(step.spirit);
+    if (it == m_trees.end()) return false;
+    SpiritTree& tree = it->second;
+
+    const bool wasRecording = m_recordUndo;
+    m_recordUndo = false;
+    if (forward) {
+        for (const auto& op : step.ops) applyOp(tree, op, true, outShifts);
+    } else {
+        for (auto op = step.ops.rbegin(); op != step.ops.rend(); ++op) applyOp(tree, *op, false, outShifts);
+    }
+    m_recordUndo = wasRecording;
 
+    // Only nodes that still exist and ended up somewhere else need animating
+    if (outShifts) {
+        for (auto s = outShifts->begin(); s != outShifts->end(); ) {
+            bool still = std::fabs(s->second.first) < 1e-4f && std::fabs(s->second.second) < 1e-4f;
+            if (still || !tree.findNode(s->first)) s = outShifts->erase(s);
+            else ++s;
+        }
+    }
     return true;
 }
 
+void SpiritTreeManager::applyOp(SpiritTree& tree, const UndoOp& op, bool forward,
+                                std::unordered_map<uint64_t, std::pair<float,float>>* outShifts) {
+    const std::string& spiritName = tree.spiritName;
+    const float sign = forward ? 1.0f : -1.0f;
+    switch (op.kind) {
+    case UndoOp::Kind::Fields: {
+        SpiritNode* node = tree.findNode(op.nodeId);
+        if (!node) return;
+        const NodeFields& f = forward ? op.after : op.before;
+        node->name = f.name;
+        node->originalName = f.originalName;
+        node->spirit = f.spirit;
+        node->type = f.type;
+        node->costType = f.costType;
+        node->cost = f.cost;
+        node->isAdventurePass = f.isAdventurePass;
+        node->isNew = f.isNew;
+        markSubtreeDirty(spiritName, op.nodeId);
+        return;
+    }
+    case UndoOp::Kind::MoveNode:
+        if (moveNodeBase(spiritName, op.nodeId, sign * op.dx, sign * op.dy)) {
+            addShift(outShifts, op.nodeId, -sign * op.dx, -sign * op.dy);
+        }
+        return;
+    case UndoOp::Kind::MoveSubtree: {
+        std::unordered_set<uint64_t> moved;
+        if (moveSubtreeBase(spiritName, op.nodeId, sign * op.dx, sign * op.dy, &moved)) {
+            for (uint64_t id : moved) addShift(outShifts, id, -sign * op.dx, -sign * op.dy);
+        }
+        return;
+    }
+    case UndoOp::Kind::MoveTree:
+        moveTreeBase(spiritName, sign * op.dx, sign * op.dy);
+        for (const auto& n : tree.nodes) addShift(outShifts, n.id, -sign * op.dx, -sign * op.dy);
+        return;
+    case UndoOp::Kind::Layout:
+        for (const auto& p : op.placements) {
+            SpiritNode* node = tree.findNode(p.id);
+            if (!node) continue;
+            float x = forward ? p.toX : p.fromX;
+            float y = forward ? p.toY : p.fromY;
+            addShift(outShifts, p.id, node->x - x, node->y - y);
+            node->x = x;
+            node->y = y;
+        }
+        computeBounds(tree);
+        m_cachedState[spiritName].reshapeDirty = true;
+        return;
+    case UndoOp::Kind::Link: {
+        const uint64_t parentId = forward ? op.to : op.from;
+        const uint32_t index = forward ? op.toIndex : op.fromIndex;
+        if (!relinkNode(spiritName, op.nodeId, parentId)) return;
+        // relinkNode files the node in file order; put it back where it was recorded
+        SpiritNode* parent = parentId != 0 ? tree.findNode(parentId) : nullptr;
+        if (!parent || index == UndoOp::NO_INDEX) return;
+        auto& siblings = parent->children;
+        siblings.erase(std::remove(siblings.begin(), siblings.end(), op.nodeId), siblings.end());
+        siblings.insert(siblings.begin() + std::min<size_t>(index, siblings.size()), op.nodeId);
+        return;
+    }
+    case UndoOp::Kind::ChildOrder:
+        if (SpiritNode* parent = tree.findNode(op.nodeId)) {
+            parent->children = forward ? op.idsAfter : op.ids;
+            markSubtreeDirty(spiritName, op.nodeId);
+        }
+        return;
+    case UndoOp::Kind::IdChange:
+        if (forward) changeNodeId(spiritName, op.from, op.to);
+        else changeNodeId(spiritName, op.to, op.from);
+        return;
+    case UndoOp::Kind::Create:
+    case UndoOp::Kind::Delete: {
+        // Undoing a create and redoing a delete both take the node out again
+        const bool remove = (op.kind == UndoOp::Kind::Create) != forward;
+        if (remove) {
+            size_t pos = op.slot;
+            if (pos >= tree.nodes.size() || tree.nodes[pos].id != op.nodeId) {
+                const SpiritNode* node = tree.findNode(op.nodeId);
+                if (!node) return;
+                pos = (size_t)(node - tree.nodes.data());
+            }
+            removeNodeAt(tree, pos);
+            if (op.kind == UndoOp::Kind::Create) {
+                // Nodes that pointed at the id before it existed keep pointing at it
+                for (uint64_t cid : op.ids) {
+                    if (SpiritNode* n = tree.findNode(cid)) n->dep = op.nodeId;
+                }
+                resetRootId(tree);
+            }
+        } else {
+            restoreNode(tree, op);
+        }
+        computeBounds(tree);
+        markDirty(spiritName);
+        return;
+    }
+    }
+}
+
 
 
 } // namespace Watercan
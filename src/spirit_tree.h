@@ -5,19 +5,23 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <cstdint>
-#include <nlohmann/json_fwd.hpp>
+#include "spirit_cache.h"
+#include "string_pool.h"
+#include "tree_layout.h"
+#include "undo_history.h"
 
 namespace Watercan {
 
-// Represents a single node in a spirit tree
+// Represents a single node in a spirit tree. Text fields are interned Symbols (one pointer
+// each), so copying a node only copies its children list and field compares are cheap.
 struct SpiritNode {
     uint64_t id = 0;
     uint64_t dep = 0;  // Parent dependency (0 = root node)
-    std::string name;
-    std::string originalName; // preserved initial name loaded from file (for reversion on duplicates)
-    std::string spirit;
-    std::string type;
-    std::string costType;
+    Symbol name;
+    Symbol originalName; // preserved initial name loaded from file (for reversion on duplicates)
+    Symbol spirit;
+    Symbol type;
+    Symbol costType;
     int cost = 0;
     bool isAdventurePass = false;
     bool isNew = false; // true for nodes created at runtime (not originally in loaded file)
@@ -39,8 +43,46 @@ struct SpiritTree {
     float minY = 0.0f, maxY = 0.0f;
     float width = 0.0f;
     float height = 0.0f;
+
+    // Persistent id -> position in `nodes`. Kept current by SpiritTreeManager on every
+    // structural edit so lookups never need a scan or a throwaway map. When ids repeat
+    // (duplicate names hash to the same id) the last node in file order wins, as the
+    // id -> node maps built before it did.
+    std::unordered_map<uint64_t, size_t> indexById;
+
+    // O(1) lookup through indexById (trees assembled by hand must call reindex() first)
+    SpiritNode* findNode(uint64_t id);
+    const SpiritNode* findNode(uint64_t id) const;
+    // Rebuild indexById from scratch
+    void reindex();
+    // Append a node / erase the node at pos, keeping indexById in step
+    void appendNode(const SpiritNode& node);
+    void insertNodeAt(size_t pos, const SpiritNode& node);
+    void eraseNodeAt(size_t pos);
+    // Re-point the index entry for id at its last node (or drop it when no node has it)
+    void reindexId(uint64_t id);
 };
 
+// Byte range of one item of the spirits array within the loaded file
+struct SourceRange {
+    uint64_t offset = 0;
+    uint32_t length = 0;
+};
+
+// Nodes read from a spirits file, grouped by spirit in first-seen file order
+struct LoadedSpirits {
+    std::vector<std::string> order;
+    std::unordered_map<std::string, std::vector<SpiritNode>> nodes;
+    // Byte range of each node's item in the source text, parallel to nodes (JSON parses
+    // that track their position only)
+    std::unordered_map<std::string, std::vector<SourceRange>> ranges;
+
+    // Append a node to its spirit's group (nodes without a spirit are dropped)
+    void add(SpiritNode&& node, const SourceRange* range);
+};
+
+class NameIndex;
+
 // FNV-1a 32-bit hash function (matches Python fnv1a32)
 inline uint32_t fnv1a32(const std::string& data) {
     constexpr uint32_t FNV_OFFSET_BASIS = 0x811C9DC5;
@@ -57,14 +99,70 @@ class SpiritTreeManager {
 public:
     SpiritTreeManager() = default;
     
-    // Load spirits from a JSON file
+    // Load spirits from a JSON file (parsed straight from a read-only mapping of it)
     bool loadFromFile(const std::string& filepath);
 
     // Load spirits from an in-memory JSON string (useful for embedded assets)
     bool loadFromString(const std::string& jsonContents);
+
+    // Optional binary cache (spirit_cache.h) kept in cacheDir; an empty dir disables it. When
+    // enabled, loadFromFile takes the load snapshot, and every tree laid out in it, from a
+    // valid cache instead of parsing the JSON, and falls back to the JSON whenever the cache
+    // is missing or stale.
+    void setBinaryCacheDir(const std::string& cacheDir) { m_binaryCacheDir = cacheDir; }
+    bool loadedFromBinaryCache() const { return m_loadedFromCache; }
+    // True when the loaded file has no cache yet, or was loaded from one missing some tree
+    // layouts. Cleared by takeBinaryCache, so a load triggers at most one write.
+    bool binaryCacheStale() const { return m_cacheStale; }
+
+    // Everything needed to write the cache away from the manager: copies of the trees, so
+    // it can be serialized on another thread while editing goes on
+    struct BinaryCacheSnapshot {
+        std::string path;
+        SourceKey key;
+        std::vector<SpiritTree> trees;
+        std::vector<uint8_t> laidOut;
+        std::vector<std::vector<SourceRange>> ranges; // parallel to trees; empty when unknown
+
+        void serialize(std::string& out) const;
+    };
+    // Snapshot the cache for the loaded file: its load snapshot plus the layout of every tree
+    // that is built and unedited. Skipped (false) unless the file was loaded with the cache
+    // enabled and the snapshot still covers every spirit of the file.
+    bool takeBinaryCache(BinaryCacheSnapshot& out);
     
     // Save spirits to a JSON file (preserving original structure)
     bool saveToFile(const std::string& filepath) const;
+
+    // Serialize all spirits (file order) into out, byte-identical to the former dump(3)
+    // output: 3-space indent, keys ap/cst/ctyp/dep/id/nm/spirit/typ. False on invalid UTF-8.
+    bool writeJson(std::string& out) const;
+    // Serialize the nodes of the given trees, in order, as one JSON array into out
+    static bool writeNodesJson(const std::vector<const SpiritTree*>& trees, std::string& out);
+
+    // The fields a JSON save writes, copied per node. Text fields are Symbols (pooled strings
+    // that never change), so taking one is a flat copy and serialize() can run on another
+    // thread while the trees keep being edited.
+    struct JsonSnapshot {
+        struct Node {
+            uint64_t id = 0;
+            uint64_t dep = 0;
+            Symbol name;
+            Symbol spirit;
+            Symbol type;
+            Symbol costType;
+            int cost = 0;
+            bool isAdventurePass = false;
+        };
+        std::vector<Node> nodes;
+
+        // Same output as writeNodesJson over the snapshotted trees; false on invalid UTF-8
+        bool serialize(std::string& out) const;
+    };
+    // Snapshot every spirit in file order (what writeJson serializes)
+    void takeJsonSnapshot(JsonSnapshot& out) const;
+    // Snapshot the nodes of the given trees, in order (what writeNodesJson serializes)
+    static void takeNodesSnapshot(const std::vector<const SpiritTree*>& trees, JsonSnapshot& out);
     
     // Update a node's ID based on its name (FNV-1a hash)
     bool updateNodeId(const std::string& spiritName, uint64_t oldId);
@@ -76,16 +174,47 @@ public:
     
     // Get list of guide spirit names
     const std::vector<std::string>& getGuideNames() const { return m_guideNames; }
+
+    // Spirits and guides together, in file order
+    const std::vector<std::string>& getAllSpiritNames() const { return m_allSpiritNamesOrdered; }
     
-    // Get a specific spirit tree
+    // Get a specific spirit tree, building it from the load snapshot on first access. The
+    // const overload never builds anything and returns nullptr until the tree is built.
     SpiritTree* getTree(const std::string& spiritName);
     const SpiritTree* getTree(const std::string& spiritName) const;
     
     // Get node count for a spirit
     size_t getNodeCount(const std::string& spiritName) const;
+    // A spirit's nodes without building its tree: the working nodes once built, otherwise
+    // the load snapshot (file order, no layout or children). Empty for unknown spirits.
+    const std::vector<SpiritNode>& getSpiritNodes(const std::string& spiritName) const;
+
+    // Trees are built and laid out on first access (getTree, getNode, any edit) from the
+    // load snapshot. Trees identical to that snapshot can be dropped again to bound memory.
+    bool isMaterialized(const std::string& spiritName) const;
+    // Approximate bytes held by built trees (nodes, child lists, id indices)
+    size_t getMaterializedBytes() const;
+    // Drop least recently used unedited trees other than keepSpirit and pinned ones until the
+    // built trees fit in capBytes; returns how many were dropped. They are rebuilt on next
+    // access. Pointers into a dropped tree dangle, so pin every tree whose pointers are kept.
+    size_t evictIdleTrees(const std::string& keepSpirit, size_t capBytes);
+    // Keep (or stop keeping) a spirit's tree out of evictIdleTrees
+    void pinTree(const std::string& spiritName, bool pinned);
+
+    // Link and lay out a detached tree whose spiritName and nodes are set (as copied from
+    // getSpiritNodes). Uses only this manager's layout scratch, so separate managers can
+    // prepare trees on separate threads.
+    void prepareTree(SpiritTree& tree);
+    // Install a tree prepared from this manager's load snapshot as if it had been built on
+    // first access. Ignored (false) if the spirit is already built, gone, or changed size.
+    bool adoptTree(SpiritTree&& tree);
+    // Approximate bytes held by a built tree (nodes, child lists, id index)
+    static size_t estimateTreeBytes(const SpiritTree& tree);
     
-    // Get a mutable node by ID
+    // Get a node by ID (O(1) through the tree's id index). The const overload does not build
+    // the tree: until it is built it returns the load snapshot's node (no layout or children).
     SpiritNode* getNode(const std::string& spiritName, uint64_t nodeId);
+    const SpiritNode* getNode(const std::string& spiritName, uint64_t nodeId) const;
     
     // Update a node from JSON string, returns true if successful
     // If newNodeId is provided, it will be set to the new ID (in case ID was changed)
@@ -99,6 +228,12 @@ public:
     
     // Rebuild tree relationships (call after editing nodes)
     void rebuildTree(const std::string& spiritName);
+    // Re-parent a node (newParentId 0 detaches it) without a rebuild: only the old and new
+    // parent's child lists are patched (the node joins the new list in file order, as a
+    // rebuild would place it) and only those subtrees are marked dirty.
+    bool relinkNode(const std::string& spiritName, uint64_t nodeId, uint64_t newParentId);
+    // Replace a node's child list with order (same ids, new arrangement) and mark it dirty
+    bool setChildOrder(const std::string& spiritName, uint64_t parentId, const std::vector<uint64_t>& order);
     
     // Position a node as a child of its parent according to tree layout rules
     // Optionally, provide an output map of nodeId -> (dx, dy) shifts representing the
@@ -132,7 +267,24 @@ public:
     // Check whether a given name already exists in the spirit (excluding optional node id)
     bool isNameDuplicate(const std::string& spiritName, const std::string& name, uint64_t excludeId = 0) const;
     // Return set of node IDs that have duplicate names within the spirit (size>1 names)
-    std::unordered_set<uint64_t> getDuplicateNodeIds(const std::string& spiritName) const;
+    const std::unordered_set<uint64_t>& getDuplicateNodeIds(const std::string& spiritName) const;
+
+    // Facts about a spirit that the UI shows every frame. Kept current incrementally from
+    // markDirty / markSubtreeDirty / relinkNode: a query only re-checks the nodes edited
+    // since the last one (all of them after markDirty or a node count change).
+    struct SpiritAnalysis {
+        bool isGuide = false;
+        bool isTravelling = false;
+        std::unordered_set<uint64_t> duplicateIds;  // ids of nodes whose nm is used more than once
+        std::unordered_set<uint64_t> mismatchedIds; // ids of nodes where id != fnv1a32(nm)
+        uint64_t version = 0;                       // changes whenever duplicateIds changes
+    };
+    const SpiritAnalysis& getAnalysis(const std::string& spiritName) const;
+    // True if the node's id is not the FNV-1a hash of its name
+    bool hasIdMismatch(const std::string& spiritName, uint64_t nodeId) const;
+    // One-off analysis of a spirit's nodes with the same rules as getAnalysis. Touches no
+    // manager state, so it may run on several threads at once (batch validation).
+    static SpiritAnalysis analyzeNodes(const std::string& spiritName, const std::vector<SpiritNode>& nodes);
 
 public:
     // Map of snapped child -> original parent id and original index (persistent until restored)
@@ -145,17 +297,48 @@ public:
 
     // Mark a spirit's cached reshape/restore results as stale (call after any mutation)
     void markDirty(const std::string& spiritName);
+    // Cheaper markDirty for edits confined to the subtree rooted at nodeId (positions, child
+    // order, links or fields below it, plus its place among its siblings). Only that region
+    // is re-checked by the next needsReshape / needsRestore.
+    void markSubtreeDirty(const std::string& spiritName, uint64_t nodeId);
+    // Monotonic counter bumped by every markDirty; compare against a saved value to tell
+    // whether the data changed since (used by save/autosave bookkeeping)
+    uint64_t getEditGeneration() const { return m_editGeneration; }
+    // Bumped whenever node positions may have changed: every edit, layout-only moves (which
+    // leave the edit generation alone) and trees built or adopted
+    uint64_t getLayoutGeneration() const { return m_layoutGeneration; }
+    // Edit generation of the last change to one spirit's nodes (0 if unchanged since the load)
+    uint64_t getSpiritEditGeneration(const std::string& spiritName) const;
 
     
     // Convert a node to JSON string
     static std::string nodeToJson(const SpiritNode& node);
 
-    // Try to find a node name in the originally loaded file for the given spirit and id.
-    // If the app loaded from a file, this will scan that file and return the original
-    // "nm" value if present. Returns true on success.
+    // Look up a node as it was in the original load (before any edits). O(1), no disk access.
+    const SpiritNode* getOriginalNode(const std::string& spiritName, uint64_t nodeId) const;
+
+    // Try to find a node name in the originally loaded data for the given spirit and id.
+    // Returns the original "nm" value from the load snapshot. Returns true on success.
     bool getNameFromLoadedFile(const std::string& spiritName, uint64_t nodeId, std::string* outName) const;
+    // A node's item exactly as written in the loaded file (formatting and unknown keys
+    // included). The load snapshot only keeps the byte range of every item; the text is read
+    // through a short-lived mapping, so this fails once the file changed on disk, and for
+    // snapshots not taken from a file (string loads).
+    bool getOriginalNodeSource(const std::string& spiritName, uint64_t nodeId, std::string* outJson) const;
+    bool hasOriginalNodeSource(const std::string& spiritName, uint64_t nodeId) const;
+    // Name to restore for a node id: the name it was hashed from when names knows it (any
+    // file or name list seen so far), else the load snapshot's nm as above
+    bool findNameForId(const std::string& spiritName, uint64_t nodeId, const NameIndex* names,
+                       std::string* outName) const;
+    // Rename, in one pass and one undo step, every node of the spirit whose id is not the
+    // fnv1a32 of its nm but is known to names. Returns the number of nodes renamed; ids names
+    // does not know are appended to outUnresolved.
+    size_t fixMismatchedNames(const std::string& spiritName, const NameIndex& names,
+                              std::vector<uint64_t>* outUnresolved = nullptr);
+    // Every non-empty nm in the load snapshot, for seeding a NameIndex
+    void collectLoadedNames(std::vector<Symbol>& out) const;
 
-    // Reload a single spirit from the originally loaded file, discarding all changes.
+    // Reload a single spirit from the original load snapshot, discarding all changes.
     // Returns true if the spirit was successfully reloaded.
     bool reloadSpirit(const std::string& spiritName);
 
@@ -196,8 +379,28 @@ public:
     bool moveSubtreeBase(const std::string& spiritName, uint64_t subtreeRootId, float dx, float dy,
                          std::unordered_set<uint64_t>* outMovedIds = nullptr);
 
+    // Undo / redo. The mutators above record compact deltas (fields, links, child orders,
+    // base moves, layout positions, created/deleted nodes) rather than tree copies; all
+    // edits recorded between two commitUndoStep() calls (typically one frame) form one
+    // step. undo/redo apply the newest step through the same incremental dirty tracking,
+    // report the spirit it belongs to and add (oldBase - newBase) per moved node to
+    // outShifts so the renderer can animate the change.
+    bool undo(std::string* outSpirit, std::unordered_map<uint64_t, std::pair<float,float>>* outShifts);
+    bool redo(std::string* outSpirit, std::unordered_map<uint64_t, std::pair<float,float>>* outShifts);
+    bool canUndo() const { return m_history.canUndo(); }
+    bool canRedo() const { return m_history.canRedo(); }
+    void commitUndoStep() { m_history.commit(); }
+    // Memory allowed for undo + redo steps; the oldest steps are dropped beyond it
+    void setUndoBudget(size_t bytes) { m_history.setBudget(bytes); }
+    size_t getUndoBudget() const { return m_history.budget(); }
+    size_t getUndoBytes() const { return m_history.bytesUsed(); }
+    // Record an edit made directly on a node from getNode(); before holds its fields as
+    // they were ahead of the edit (nothing is recorded when they did not change)
+    void recordNodeFields(const std::string& spiritName, uint64_t nodeId, const NodeFields& before);
+    static NodeFields fieldsOf(const SpiritNode& node);
+
     // Check if data is loaded
-    bool isLoaded() const { return !m_trees.empty(); }
+    bool isLoaded() const { return !m_allSpiritNamesOrdered.empty(); }
     
     // Get loaded file path
     const std::string& getLoadedFile() const { return m_loadedFile; }
@@ -205,28 +408,145 @@ public:
 private:
     void buildTree(SpiritTree& tree);
     void computeLayout(SpiritTree& tree);
-    void layoutSubtree(SpiritTree& tree, SpiritNode& node, float x, float y, int depth);
-    bool checkIfGuide(const SpiritTree& tree) const;
-    // Common loader: parse a pre-parsed JSON array and populate trees
-    bool loadFromJson(const nlohmann::json& data);
-    
-    std::unordered_map<std::string, SpiritTree> m_trees;
+    // Lay out the subtree at node index root (m_layout must be built for tree) with the root
+    // at (x,y), store the positions and optionally record (oldBase - newBase) for every moved
+    // node except the root
+    void applyLayout(SpiritTree& tree, uint32_t root, float x, float y,
+                     std::unordered_map<uint64_t, std::pair<float,float>>* outShifts);
+    void computeBounds(SpiritTree& tree);
+    static bool checkIfGuide(const std::string& spiritName);
+    // Common loader: replace all trees with the given grouped nodes
+    bool loadFromSpirits(LoadedSpirits& loaded);
+    // loadFromFile with the binary cache enabled: cache hit, else JSON from the mapped file
+    bool loadWithBinaryCache(const std::string& filepath);
+    // Parse the mapped text of filepath into the load snapshot, with the source range of
+    // every snapshot node
+    bool loadFromMappedJson(const std::string& filepath, const unsigned char* data, size_t size);
+    // Keep the source ranges of the fresh load snapshot, taken from a file of the given
+    // size and modification time (spirits whose node count does not match are skipped)
+    void adoptSourceRanges(std::unordered_map<std::string, std::vector<SourceRange>>&& ranges,
+                           uint64_t fileSize, int64_t fileTime);
+    // Index of a node in the load snapshot (the last one for a repeated id)
+    bool originalIndex(const std::string& spiritName, uint64_t nodeId, size_t* outIndex) const;
+
+    // Build spiritName's tree from its load snapshot unless already built; nullptr when the
+    // spirit does not exist. Every mutable tree access goes through this (or findTree).
+    SpiritTree* materialize(const std::string& spiritName);
+    std::unordered_map<std::string, SpiritTree>::iterator findTree(const std::string& spiritName);
+    // Built trees only (never builds)
+    std::unordered_map<std::string, SpiritTree>::const_iterator findTree(const std::string& spiritName) const;
+    // The built tree if any, else the load snapshot, without building anything
+    const SpiritTree* viewTree(const std::string& spiritName) const;
+    // The load snapshot (with its id index)
+    const SpiritTree* originalTree(const std::string& spiritName) const;
+
+    std::unordered_map<std::string, SpiritTree> m_trees;   // built trees only
     std::vector<std::string> m_spiritNames;  // Regular spirits (in file order)
     std::vector<std::string> m_guideNames;   // Guide spirits (in file order)
     std::vector<std::string> m_allSpiritNamesOrdered;  // All spirits in original file order
     std::string m_loadedFile;
+    std::vector<std::string> m_loadOrder;  // spirits of the loaded file (snapshot order)
 
-    // Cached original node IDs per spirit (populated at load time)
-    std::unordered_map<std::string, std::unordered_set<uint64_t>> m_originalNodeIds;
+    // Binary cache state for the loaded file
+    std::string m_binaryCacheDir;           // empty: cache disabled
+    bool m_loadedFromCache = false;
+    bool m_cacheStale = false;
+    SourceKey m_sourceKey;                  // empty path: not loaded with the cache enabled
 
-    // Per-spirit dirty flags and cached results for needsReshape / needsRestore
+    // Immutable snapshot of every spirit as loaded (file order; no layout or children). Taken
+    // over from the parser in loadFromSpirits (which indexes it) and never touched by edits,
+    // so const readers and prefetch jobs copying from it never race with a lazy fill.
+    std::unordered_map<std::string, SpiritTree> m_originalTrees;
+    // Source range of every snapshot node, parallel to its m_originalTrees nodes, and the
+    // size / modification time m_loadedFile had when they were taken
+    std::unordered_map<std::string, std::vector<SourceRange>> m_originalRanges;
+    uint64_t m_rangesFileSize = 0;
+    int64_t m_rangesFileTime = 0;
+
+    // Recency and edit state of built trees, for evictIdleTrees
+    struct TreeUse {
+        uint64_t lastUse = 0;
+        bool touched = false;   // edited (or laid out again) since it was built or reloaded
+        bool pinned = false;    // pinTree: never evicted
+    };
+    std::unordered_map<std::string, TreeUse> m_treeUse;
+    uint64_t m_useTick = 0;
+
+    // Per-spirit state behind needsReshape / needsRestore. Every node slot carries two flags
+    // (off its layout slot / differs from the load snapshot) with running counts, so a query
+    // only re-checks the subtrees edited since the last one. A full recheck happens after
+    // markDirty or whenever the node count changed.
+    enum : uint8_t {
+        NODE_MISPLACED  = 1u << 0, // position differs from childPosition() under its parent
+        NODE_UNRESTORED = 1u << 1, // runtime-created, or id not present in the load snapshot
+    };
     struct CachedState {
         bool reshapeDirty = true;
         bool restoreDirty = true;
-        bool reshapeResult = false;
-        bool restoreResult = false;
+        float epsilon = 0.1f;
+        std::vector<uint64_t> dirtySubtrees;
+        std::vector<uint8_t> nodeFlags;     // parallel to SpiritTree::nodes
+        size_t misplacedCount = 0;
+        size_t unrestoredCount = 0;
     };
     mutable std::unordered_map<std::string, CachedState> m_cachedState;
+    // Queue a subtree for re-checking (no edit generation bump; used for layout-only moves)
+    void queueDirtySubtree(const std::string& spiritName, uint64_t nodeId);
+    // Bring the per-node flags of a spirit up to date (full or per dirty subtree)
+    void refreshCachedState(const std::string& spiritName, float epsilon) const;
+
+    // Incremental state behind getAnalysis. Each node slot remembers the name, id and fact
+    // bits it was last counted with; re-checking a node un-counts the old facts and counts
+    // the new ones, so duplicate groups and classification counters stay exact.
+    struct AnalysisState {
+        struct NodeFacts {
+            Symbol name;
+            uint64_t id = 0;
+            uint8_t bits = 0;
+        };
+        SpiritAnalysis result;
+        bool fullDirty = true;
+        std::vector<uint64_t> dirtyNodes;
+        std::vector<NodeFacts> facts;       // parallel to SpiritTree::nodes
+        std::unordered_map<Symbol, std::vector<uint64_t>> idsByName;
+        std::unordered_map<uint64_t, uint32_t> idCounts;      // nodes per id (duplicate ids)
+        std::unordered_map<uint64_t, uint32_t> duplicateRefs; // duplicate groups per id
+        std::unordered_map<uint64_t, uint32_t> mismatchRefs;  // mismatching nodes per id
+        size_t apCount = 0;         // nodes with ap set
+        size_t emoteCount = 0;      // nodes whose nm contains "emote_upgrade"
+        size_t travelCount = 0;     // non-root nodes whose typ is not "seasonal heart"
+    };
+    mutable std::unordered_map<std::string, AnalysisState> m_analysis;
+    mutable uint64_t m_analysisVersion = 0;
+    void queueAnalysisNode(const std::string& spiritName, uint64_t nodeId);
+    AnalysisState* refreshAnalysis(const std::string& spiritName) const;
+    // Re-count one node slot; version is bumped when the duplicate set changed
+    static void recountNode(AnalysisState& st, const SpiritNode& node, size_t index, uint64_t& version);
+    // Derive the travelling flag from the counters
+    static void classify(AnalysisState& st);
+    uint64_t m_editGeneration = 0;
+    uint64_t m_layoutGeneration = 0;
+    // Generation of the last markDirty / markSubtreeDirty per spirit (getSpiritEditGeneration)
+    std::unordered_map<std::string, uint64_t> m_spiritEditGeneration;
+
+    // Undo history; recording is switched off while a step is being applied and during loads
+    UndoHistory m_history;
+    bool m_recordUndo = true;
+    void recordOp(const std::string& spiritName, UndoOp&& op);
+    // Apply step backwards (undo) or forwards (redo); false if its spirit no longer exists
+    bool applyStep(const UndoStep& step, bool forward,
+                   std::unordered_map<uint64_t, std::pair<float,float>>* outShifts);
+    void applyOp(SpiritTree& tree, const UndoOp& op, bool forward,
+                 std::unordered_map<uint64_t, std::pair<float,float>>* outShifts);
+    // Put a node recorded by a Create/Delete op back at its slot, re-adopting its children
+    void restoreNode(SpiritTree& tree, const UndoOp& op);
+    // Remove the node at pos; nodes depending on it become roots. Returns the orphans.
+    std::vector<uint64_t> removeNodeAt(SpiritTree& tree, size_t pos);
+
+    // Layout scratch reused across calls (adjacency, position buffer, visited subtree)
+    TreeLayout m_layout;
+    std::vector<TreeLayout::Point> m_layoutPositions;
+    std::vector<uint32_t> m_layoutVisited;
 
 };
 
@@ -0,0 +1,47 @@
+#include "string_pool.h"
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+namespace Watercan {
+
+namespace {
+
+// Owned strings live in a deque (stable addresses on push_back); the index maps views of
+// those same strings to their pooled copy so a lookup never allocates
+struct StringPool {
+    std::mutex mutex;
+    std::deque<std::string> storage;
+    std::unordered_map<std::string_view, const std::string*> index;
+};
+
+StringPool& pool() {
+    static StringPool* p = new StringPool(); // intentionally leaked: handles outlive statics
+    return *p;
+}
+
+} // namespace
+
+const std::string& Symbol::emptyString() {
+    static const std::string* empty = new std::string();
+    return *empty;
+}
+
+const std::string* Symbol::intern(std::string_view s) {
+    if (s.empty()) return &emptyString();
+    StringPool& p = pool();
+    std::lock_guard<std::mutex> lock(p.mutex);
+    auto it = p.index.find(s);
+    if (it != p.index.end()) return it->second;
+    const std::string& owned = p.storage.emplace_back(s);
+    p.index.emplace(std::string_view(owned), &owned);
+    return &owned;
+}
+
+size_t Symbol::poolSize() {
+    StringPool& p = pool();
+    std::lock_guard<std::mutex> lock(p.mutex);
+    return p.storage.size();
+}
+
+} // namespace Watercan
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace Watercan {
+
+// Handle to an immutable string interned in a process-wide pool. Equal strings share one
+// pooled copy, so a handle is a single pointer: copying is free and comparing two handles is
+// a pointer compare. SpiritNode keeps its text fields this way because values like spirit,
+// typ and ctyp repeat on every node. Pooled strings live until exit; the pool only grows by
+// the distinct values ever seen (an edit adds its new value once). Interning is thread-safe.
+class Symbol {
+public:
+    Symbol() : m_str(&emptyString()) {}
+    Symbol(std::string_view s) : m_str(intern(s)) {}
+    Symbol(const std::string& s) : m_str(intern(s)) {}
+    Symbol(const char* s) : m_str(intern(s)) {}
+
+    const std::string& str() const { return *m_str; }
+    operator const std::string&() const { return *m_str; }
+    const char* c_str() const { return m_str->c_str(); }
+    const char* data() const { return m_str->data(); }
+    size_t size() const { return m_str->size(); }
+    bool empty() const { return m_str->empty(); }
+    std::string::const_iterator begin() const { return m_str->begin(); }
+    std::string::const_iterator end() const { return m_str->end(); }
+    size_t find(const std::string& s, size_t pos = 0) const { return m_str->find(s, pos); }
+    size_t find(const char* s, size_t pos = 0) const { return m_str->find(s, pos); }
+    void clear() { m_str = &emptyString(); }
+
+    // Pool identity (equal strings give equal keys); usable for hashing and ordering
+    const void* key() const { return m_str; }
+
+    friend bool operator==(Symbol a, Symbol b) { return a.m_str == b.m_str; }
+    friend bool operator!=(Symbol a, Symbol b) { return a.m_str != b.m_str; }
+    friend bool operator==(Symbol a, const std::string& b) { return *a.m_str == b; }
+    friend bool operator!=(Symbol a, const std::string& b) { return *a.m_str != b; }
+    friend bool operator==(const std::string& a, Symbol b) { return a == *b.m_str; }
+    friend bool operator!=(const std::string& a, Symbol b) { return a != *b.m_str; }
+    friend bool operator==(Symbol a, const char* b) { return *a.m_str == b; }
+    friend bool operator!=(Symbol a, const char* b) { return *a.m_str != b; }
+    friend bool operator==(const char* a, Symbol b) { return *b.m_str == a; }
+    friend bool operator!=(const char* a, Symbol b) { return *b.m_str != a; }
+
+    friend std::string operator+(const std::string& a, Symbol b) { return a + *b.m_str; }
+    friend std::string operator+(Symbol a, const std::string& b) { return *a.m_str + b; }
+    friend std::string operator+(const char* a, Symbol b) { return a + *b.m_str; }
+    friend std::string operator+(Symbol a, const char* b) { return *a.m_str + b; }
+
+    // Number of distinct non-empty strings interned so far
+    static size_t poolSize();
+
+private:
+    static const std::string* intern(std::string_view s);
+    static const std::string& emptyString();
+
+    const std::string* m_str;
+};
+
+} // namespace Watercan
+
+namespace std {
+template <> struct hash<Watercan::Symbol> {
+    size_t operator()(Watercan::Symbol s) const noexcept { return std::hash<const void*>()(s.key()); }
+};
+} // namespace std
@@ -0,0 +1,87 @@
+#include "tree_layout.h"
+#include "spirit_tree.h"
+#include <algorithm>
+#include <cmath>
+
+namespace Watercan {
+
+void TreeLayout::build(const SpiritTree& tree) {
+    const size_t n = tree.nodes.size();
+    m_childStart.assign(n + 1, 0);
+    m_childIndex.clear();
+
+    size_t total = 0;
+    for (const auto& node : tree.nodes) total += node.children.size();
+    m_childIndex.reserve(total);
+
+    const SpiritNode* base = tree.nodes.data();
+    for (size_t i = 0; i < n; ++i) {
+        m_childStart[i] = (uint32_t)m_childIndex.size();
+        for (uint64_t childId : tree.nodes[i].children) {
+            const SpiritNode* child = tree.findNode(childId);
+            m_childIndex.push_back(child ? (uint32_t)(child - base) : NO_NODE);
+        }
+    }
+    m_childStart[n] = (uint32_t)m_childIndex.size();
+}
+
+TreeLayout::Point TreeLayout::childPosition(float parentX, float parentY, size_t i, size_t childCount) {
+    Point p;
+    p.x = parentX;
+    p.y = parentY + NODE_SPACING_Y;  // Move up (north)
+
+    if (childCount == 2) {
+        // Keep original two-child look: left + center
+        if (i == 0) {
+            p.x = parentX - NODE_SPACING_X;  // North-West
+            p.y += DIAGONAL_Y_OFFSET;        // Slightly lower
+        }
+    } else if (childCount == 3) {
+        // Original three-child layout
+        if (i == 0) {
+            p.x = parentX - NODE_SPACING_X;  // North-West
+            p.y += DIAGONAL_Y_OFFSET;
+        } else if (i == 2) {
+            p.x = parentX + NODE_SPACING_X;  // North-East
+            p.y += DIAGONAL_Y_OFFSET;
+        }
+    } else if (childCount > 3) {
+        // Distribute children evenly centered above the parent for >3 children
+        float startX = parentX - NODE_SPACING_X * (float(childCount - 1) * 0.5f);
+        p.x = startX + (float)i * NODE_SPACING_X;
+        // Slightly lower for non-center children to preserve visual grouping
+        float centerIndex = (childCount - 1) * 0.5f;
+        if (std::fabs((float)i - centerIndex) > 0.01f) p.y += DIAGONAL_Y_OFFSET;
+    }
+    return p;
+}
+
+void TreeLayout::layoutFrom(uint32_t root, float x, float y, std::vector<Point>& positions,
+                            std::vector<uint32_t>* outVisited) const {
+    if (root >= size() || positions.size() < size()) return;
+
+    m_visited.assign(size(), 0);
+    m_stack.clear();
+    positions[root] = Point{x, y};
+    m_visited[root] = 1;
+    m_stack.push_back(root);
+
+    while (!m_stack.empty()) {
+        uint32_t node = m_stack.back();
+        m_stack.pop_back();
+        if (outVisited) outVisited->push_back(node);
+
+        const Point parent = positions[node];
+        const uint32_t begin = childBegin(node), end = childEnd(node);
+        const size_t childCount = end - begin;
+        for (uint32_t s = begin; s < end; ++s) {
+            uint32_t child = m_childIndex[s];
+            if (child == NO_NODE || m_visited[child]) continue;
+            m_visited[child] = 1;
+            positions[child] = childPosition(parent.x, parent.y, s - begin, childCount);
+            m_stack.push_back(child);
+        }
+    }
+}
+
+} // namespace Watercan
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+namespace Watercan {
+
+struct SpiritTree;
+
+// Linear-time layout for spirit trees. build() flattens every node's children into one
+// child-index adjacency (CSR: childStart/childIndex, addressed by position in tree.nodes),
+// after which layoutFrom() places a whole subtree in a single iterative pass and writes
+// the result into a plain position buffer, so callers can compare or apply positions
+// without cloning the tree.
+class TreeLayout {
+public:
+    static constexpr uint32_t NO_NODE = std::numeric_limits<uint32_t>::max();
+
+    // Layout constants (children sit north of their parent)
+    static constexpr float NODE_SPACING_Y = 100.0f;    // vertical spacing
+    static constexpr float NODE_SPACING_X = 120.0f;    // horizontal spacing for branches
+    static constexpr float DIAGONAL_Y_OFFSET = -25.0f; // NW/NE nodes are slightly lower
+
+    struct Point {
+        float x = 0.0f;
+        float y = 0.0f;
+    };
+
+    // Rebuild the adjacency for tree (children resolve through tree.findNode, so the last
+    // node wins for repeated ids; unresolvable children keep their slot as NO_NODE)
+    void build(const SpiritTree& tree);
+
+    size_t size() const { return m_childStart.empty() ? 0 : m_childStart.size() - 1; }
+    uint32_t childBegin(uint32_t node) const { return m_childStart[node]; }
+    uint32_t childEnd(uint32_t node) const { return m_childStart[node + 1]; }
+    uint32_t childAt(uint32_t slot) const { return m_childIndex[slot]; }
+
+    // Position of the i-th of childCount children of a parent at (parentX,parentY). 1-3
+    // children keep the NW/N/NE aesthetic; more are distributed evenly centered over the parent.
+    static Point childPosition(float parentX, float parentY, size_t i, size_t childCount);
+
+    // Place the subtree rooted at node index root with the root at (x,y). positions must
+    // hold one entry per node; only subtree entries are written. When outVisited is given
+    // it receives the subtree's node indices in visiting order (root first). Every node is
+    // visited at most once, so malformed (cyclic) child lists cannot loop.
+    void layoutFrom(uint32_t root, float x, float y, std::vector<Point>& positions,
+                    std::vector<uint32_t>* outVisited = nullptr) const;
+
+private:
+    std::vector<uint32_t> m_childStart;  // size() + 1 offsets into m_childIndex
+    std::vector<uint32_t> m_childIndex;  // child node index per child slot (NO_NODE if missing)
+    mutable std::vector<uint32_t> m_stack;
+    mutable std::vector<uint8_t> m_visited;
+};
+
+} // namespace Watercan
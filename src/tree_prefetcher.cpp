@@ -0,0 +1,102 @@
+#include "tree_prefetcher.h"
+#include <algorithm>
+
+namespace Watercan {
+
+TreePrefetcher::~TreePrefetcher() {
+    cancel();
+}
+
+void TreePrefetcher::setWakeCallback(std::function<void()> cb) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_wake = std::move(cb);
+}
+
+void TreePrefetcher::start(std::vector<SpiritTree> trees, unsigned threads) {
+    cancel();
+    if (trees.empty()) return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs = std::move(trees);
+        m_next = 0;
+        m_built = 0;
+        m_stop = false;
+    }
+    unsigned count = std::max(1u, std::min<unsigned>(threads, (unsigned)m_jobs.size()));
+    for (unsigned i = 0; i < count; ++i) m_threads.emplace_back(&TreePrefetcher::workerLoop, this);
+}
+
+void TreePrefetcher::cancel() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    joinWorkers();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_jobs.clear();
+    m_finished.clear();
+    m_next = 0;
+    m_built = 0;
+}
+
+void TreePrefetcher::joinWorkers() {
+    for (auto& t : m_threads) {
+        if (t.joinable()) t.join();
+    }
+    m_threads.clear();
+}
+
+bool TreePrefetcher::poll(SpiritTree& out) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_finished.empty()) return false;
+    out = std::move(m_finished.front());
+    m_finished.pop_front();
+    return true;
+}
+
+bool TreePrefetcher::progress(size_t* outDone, size_t* outTotal) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_jobs.empty() || m_built >= m_jobs.size()) return false;
+    if (outDone) *outDone = m_built;
+    if (outTotal) *outTotal = m_jobs.size();
+    return true;
+}
+
+unsigned TreePrefetcher::defaultThreadCount() {
+    unsigned hw = std::thread::hardware_concurrency();
+    return std::max(1u, std::min(4u, hw > 1 ? hw - 1 : 1u));
+}
+
+void TreePrefetcher::wake() {
+    std::function<void()> cb;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        cb = m_wake;
+    }
+    if (cb) cb();
+}
+
+void TreePrefetcher::workerLoop() {
+    // Layout scratch private to this worker
+    SpiritTreeManager scratch;
+    for (;;) {
+        SpiritTree tree;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stop || m_next >= m_jobs.size()) return;
+            tree = std::move(m_jobs[m_next++]);
+        }
+
+        scratch.prepareTree(tree);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stop) return;
+            m_finished.push_back(std::move(tree));
+            ++m_built;
+        }
+        wake();
+    }
+}
+
+} // namespace Watercan
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "spirit_tree.h"
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Watercan {
+
+// Builds and lays out spirit trees on a small pool of worker threads after a load, so
+// opening a spirit rarely has to do that work on the UI thread. Each job carries its own
+// copy of a spirit's load snapshot and every worker has its own layout scratch, so workers
+// share nothing but the queues. Finished trees wait until the UI thread adopts them
+// (SpiritTreeManager::adoptTree).
+class TreePrefetcher {
+public:
+    TreePrefetcher() = default;
+    ~TreePrefetcher();
+
+    TreePrefetcher(const TreePrefetcher&) = delete;
+    TreePrefetcher& operator=(const TreePrefetcher&) = delete;
+
+    // Called from a worker whenever a tree finished (e.g. to wake an idle UI loop)
+    void setWakeCallback(std::function<void()> cb);
+
+    // Replace any running batch with trees (spiritName and nodes set), built roughly in the
+    // given order by up to threads workers
+    void start(std::vector<SpiritTree> trees, unsigned threads);
+    // Drop queued and finished trees; returns once the workers have stopped
+    void cancel();
+
+    // Take the next finished tree; false when none is waiting
+    bool poll(SpiritTree& out);
+    // Trees finished / total of the current batch; false once the batch is complete
+    bool progress(size_t* outDone, size_t* outTotal) const;
+
+    // Workers to use on this machine (leaves a core for the UI thread, at most 4)
+    static unsigned defaultThreadCount();
+
+private:
+    void workerLoop();
+    void wake();
+    void joinWorkers();
+
+    std::vector<std::thread> m_threads;
+    mutable std::mutex m_mutex;
+    std::vector<SpiritTree> m_jobs;
+    size_t m_next = 0;                   // next job to hand out
+    std::deque<SpiritTree> m_finished;    // built, not yet taken by poll()
+    size_t m_built = 0;
+    bool m_stop = false;
+    std::function<void()> m_wake;
+};
+
+} // namespace Watercan
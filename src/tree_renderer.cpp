@@ -1,10 +1,12 @@
 #include "tree_renderer.h"
+#include "frame_profiler.h"
 #include <algorithm>
 #include <cmath>
 #include <queue>
 #include <unordered_map>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <vector>
 
 #ifndef M_PI
@@ -20,207 +22,379 @@ void TreeRenderer::updatePhysics(float deltaTime, const SpiritTree* tree) {
         if (m_collisionSuppressRemaining < 0.0f) m_collisionSuppressRemaining = 0.0f;
     }
 
+    NodePhysicsStore& ps = m_physics;
+    bool awake = false; // any body moved this step (see isAwake)
+    const bool dragActive = (m_isDraggingNode || m_isDraggingTree);
+    const uint32_t draggedSlot = (m_draggedNodeId != NO_NODE_ID) ? ps.findSlot(m_draggedNodeId) : NodePhysicsStore::NO_SLOT;
+
     // Track which nodes are currently in collision
-    std::unordered_set<uint64_t> nodesInCollision;
+    ps.clearFlagAll(NodePhysicsStore::FLAG_IN_COLLISION);
     
     // Apply collision forces between nodes (only if not suppressed)
     if (m_collisionSuppressRemaining <= 0.0f && tree && !tree->nodes.empty()) {
-        // Build list of node positions (base + offset)
-        std::vector<std::pair<uint64_t, ImVec2>> nodePositions;
-        for (const auto& node : tree->nodes) {
-            ImVec2 offset = getNodeOffset(node.id);
-            ImVec2 pos(node.x + offset.x, node.y + offset.y);
-            nodePositions.emplace_back(node.id, pos);
+        const float minDist = COLLISION_RADIUS * 2.0f;
+        const float cellSize = minDist; // one cell per collision diameter: overlaps only reach adjacent cells
+
+        // Build list of node positions (base + offset) and bucket them into a uniform grid.
+        // Frozen/dragged state is resolved once per node here rather than per pair below.
+        bindTreeSlots(tree);
+        const size_t count = tree->nodes.size();
+        m_physPositions.resize(count);
+        m_physPushable.resize(count);
+        m_physPush.assign(count, ImVec2(0.0f, 0.0f));
+        m_physPushed.assign(count, 0);
+        m_physCells.clear();
+        m_physCells.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            const SpiritNode& node = tree->nodes[i];
+            uint32_t slot = m_treeSlots[i];
+            ImVec2 pos(node.x + ps.offsetX[slot], node.y + ps.offsetY[slot]);
+            m_physPositions[i] = pos;
+            bool isDragged = (slot == draggedSlot && dragActive);
+            m_physPushable[i] = (!isDragged && !ps.hasFlag(slot, NodePhysicsStore::FLAG_FROZEN)) ? 1 : 0;
+            int32_t cx = (int32_t)floorf(pos.x / cellSize);
+            int32_t cy = (int32_t)floorf(pos.y / cellSize);
+            m_physCells.emplace_back(packCellKey(cx, cy), (uint32_t)i);
         }
-        
-        // Check each pair of nodes for collision
-        for (size_t i = 0; i < nodePositions.size(); ++i) {
-            for (size_t j = i + 1; j < nodePositions.size(); ++j) {
-                uint64_t idA = nodePositions[i].first;
-                uint64_t idB = nodePositions[j].first;
-                ImVec2 posA = nodePositions[i].second;
-                ImVec2 posB = nodePositions[j].second;
-                
-                float dx = posB.x - posA.x;
-                float dy = posB.y - posA.y;
-                float dist = sqrtf(dx * dx + dy * dy);
-                float minDist = COLLISION_RADIUS * 2.0f;
-                
-                if (dist < minDist && dist > 0.001f) {
-                    // Mark nodes as in collision
-                    nodesInCollision.insert(idA);
-                    nodesInCollision.insert(idB);
-                    
-                    // Skip frozen nodes
-                    bool aFrozen = m_frozenNodes.count(idA) > 0;
-                    bool bFrozen = m_frozenNodes.count(idB) > 0;
-                    
-                    // Nodes are overlapping, push them apart
-                    float overlap = minDist - dist;
-                    float nx = dx / dist;
-                    float ny = dy / dist;
-                    
-                    // Apply push force to both nodes
-                    float pushForce = overlap * COLLISION_STRENGTH * deltaTime;
-                    
-                    // Don't push the node being dragged or frozen nodes
-                    if (!(idA == m_draggedNodeId && (m_isDraggingNode || m_isDraggingTree)) && !aFrozen) {
-                        m_nodeOffsets[idA].x -= nx * pushForce * 0.5f;
-                        m_nodeOffsets[idA].y -= ny * pushForce * 0.5f;
-                        m_nodeVelocities[idA].x -= nx * pushForce * 2.0f;
-                        m_nodeVelocities[idA].y -= ny * pushForce * 2.0f;
-                    }
-                    
-                    if (!(idB == m_draggedNodeId && (m_isDraggingNode || m_isDraggingTree)) && !bFrozen) {
-                        m_nodeOffsets[idB].x += nx * pushForce * 0.5f;
-                        m_nodeOffsets[idB].y += ny * pushForce * 0.5f;
-                        m_nodeVelocities[idB].x += nx * pushForce * 2.0f;
-                        m_nodeVelocities[idB].y += ny * pushForce * 2.0f;
+        // Sorting by packed key groups each cell's nodes into a contiguous run
+        std::sort(m_physCells.begin(), m_physCells.end());
+
+        auto testPair = [&](uint32_t a, uint32_t b) {
+            const ImVec2& posA = m_physPositions[a];
+            const ImVec2& posB = m_physPositions[b];
+            float dx = posB.x - posA.x;
+            float dy = posB.y - posA.y;
+            float distSq = dx * dx + dy * dy;
+            // Cheap reject before the sqrt: most neighbouring-cell pairs don't overlap
+            if (distSq >= minDist * minDist) return;
+            float dist = sqrtf(distSq);
+            if (dist <= 0.001f) return;
+
+            // Mark nodes as in collision
+            ps.setFlag(m_treeSlots[a], NodePhysicsStore::FLAG_IN_COLLISION);
+            ps.setFlag(m_treeSlots[b], NodePhysicsStore::FLAG_IN_COLLISION);
+
+            // Nodes are overlapping, push them apart
+            float overlap = minDist - dist;
+            float nx = dx / dist;
+            float ny = dy / dist;
+            float pushForce = overlap * COLLISION_STRENGTH * deltaTime;
+
+            // Don't push the node being dragged or frozen nodes
+            if (m_physPushable[a]) {
+                m_physPush[a].x -= nx * pushForce;
+                m_physPush[a].y -= ny * pushForce;
+                m_physPushed[a] = 1;
+            }
+            if (m_physPushable[b]) {
+                m_physPush[b].x += nx * pushForce;
+                m_physPush[b].y += ny * pushForce;
+                m_physPushed[b] = 1;
+            }
+        };
+
+        // Walk each occupied cell once: test pairs inside the cell, then against the
+        // forward half of the 3x3 neighbourhood so every neighbouring pair is seen exactly once.
+        static const int32_t kForward[4][2] = { {1, -1}, {1, 0}, {1, 1}, {0, 1} };
+        size_t runStart = 0;
+        while (runStart < m_physCells.size()) {
+            uint64_t key = m_physCells[runStart].first;
+            size_t runEnd = runStart + 1;
+            while (runEnd < m_physCells.size() && m_physCells[runEnd].first == key) ++runEnd;
+
+            for (size_t i = runStart; i < runEnd; ++i) {
+                for (size_t j = i + 1; j < runEnd; ++j) {
+                    uint32_t a = m_physCells[i].second, b = m_physCells[j].second;
+                    testPair(std::min(a, b), std::max(a, b));
+                }
+            }
+
+            int32_t cx = (int32_t)(uint32_t)(key >> 32);
+            int32_t cy = (int32_t)(uint32_t)(key & 0xFFFFFFFFu);
+            for (const auto& d : kForward) {
+                uint64_t nkey = packCellKey(cx + d[0], cy + d[1]);
+                auto lo = std::lower_bound(m_physCells.begin(), m_physCells.end(),
+                                           std::make_pair(nkey, (uint32_t)0));
+                for (auto it = lo; it != m_physCells.end() && it->first == nkey; ++it) {
+                    for (size_t i = runStart; i < runEnd; ++i) {
+                        uint32_t a = m_physCells[i].second, b = it->second;
+                        testPair(std::min(a, b), std::max(a, b));
                     }
                 }
             }
+            runStart = runEnd;
+        }
+
+        // Commit accumulated pushes (half to the offset, the rest as velocity, as before)
+        for (size_t i = 0; i < count; ++i) {
+            if (!m_physPushed[i]) continue;
+            uint32_t slot = m_treeSlots[i];
+            ps.addOffset(slot, m_physPush[i].x * 0.5f, m_physPush[i].y * 0.5f);
+            ps.velocityX[slot] += m_physPush[i].x * 2.0f;
+            ps.velocityY[slot] += m_physPush[i].y * 2.0f;
+            awake = true;
         }
     }
     
-    // Update collision time tracking and freeze nodes that have been oscillating too long
-    for (auto& [nodeId, offset] : m_nodeOffsets) {
+    // Update collision time tracking and freeze nodes that have been oscillating too long.
+    // Also build the spring mask for the integrator below in the same pass.
+    const size_t slotCount = ps.size();
+    ps.springMask.assign(slotCount, 0.0f);
+    for (uint32_t slot = 0; slot < (uint32_t)slotCount; ++slot) {
+        uint8_t fl = ps.flags[slot];
+        if (!(fl & NodePhysicsStore::FLAG_ACTIVE)) continue;
+
         // Skip dragged node
-        if (nodeId == m_draggedNodeId && (m_isDraggingNode || m_isDraggingTree)) {
-            m_collisionTime.erase(nodeId);
-            m_frozenNodes.erase(nodeId);
-            continue;
-        }
-        
-        ImVec2& velocity = m_nodeVelocities[nodeId];
-        float velocityMag = sqrtf(velocity.x * velocity.x + velocity.y * velocity.y);
-        
-        if (nodesInCollision.count(nodeId) > 0 && velocityMag < FREEZE_VELOCITY_THRESHOLD) {
-            // Node is in collision with low velocity, accumulate time
-            m_collisionTime[nodeId] += deltaTime;
-            
-            if (m_collisionTime[nodeId] >= FREEZE_TIME_THRESHOLD) {
-                // Freeze this node
-                m_frozenNodes.insert(nodeId);
-                velocity.x = 0;
-                velocity.y = 0;
+        if (slot == draggedSlot && dragActive) {
+            ps.collisionTime[slot] = 0.0f;
+            ps.clearFlag(slot, NodePhysicsStore::FLAG_FROZEN);
+        } else {
+            float vx = ps.velocityX[slot], vy = ps.velocityY[slot];
+            float velocityMag = sqrtf(vx * vx + vy * vy);
+            bool inCollision = (fl & NodePhysicsStore::FLAG_IN_COLLISION) != 0;
+
+            if (inCollision && velocityMag < FREEZE_VELOCITY_THRESHOLD) {
+                // Node is in collision with low velocity, accumulate time
+                ps.collisionTime[slot] += deltaTime;
+                if (ps.collisionTime[slot] >= FREEZE_TIME_THRESHOLD) {
+                    // Freeze this node
+                    ps.setFlag(slot, NodePhysicsStore::FLAG_FROZEN);
+                    ps.velocityX[slot] = 0.0f;
+                    ps.velocityY[slot] = 0.0f;
+                }
+            } else if (!inCollision) {
+                // Node is not in collision, reset collision time and unfreeze
+                ps.collisionTime[slot] = 0.0f;
+                ps.clearFlag(slot, NodePhysicsStore::FLAG_FROZEN);
             }
-        } else if (nodesInCollision.count(nodeId) == 0) {
-            // Node is not in collision, reset collision time and unfreeze
-            m_collisionTime.erase(nodeId);
-            m_frozenNodes.erase(nodeId);
         }
+
+        // Don't apply spring force to the node being dragged, free-floating nodes,
+        // or frozen nodes (they stay in place)
+        if (slot == draggedSlot && m_isDraggingNode) continue;
+        if (ps.flags[slot] & (NodePhysicsStore::FLAG_FREE_FLOATING | NodePhysicsStore::FLAG_FROZEN)) continue;
+        ps.springMask[slot] = 1.0f;
+        awake = true;
     }
     
-    // Apply spring physics to pull nodes back to their original positions
-    std::vector<uint64_t> toRemove;
-
+    // Apply spring physics to pull nodes back to their original positions.
     // NOTE: if position changes are done via applyBaseShift by the app
     // (oldBase - newBase stored as offset), the spring physics above will
     // bring offsets smoothly back towards zero making nodes animate.
-    
-    for (auto& [nodeId, offset] : m_nodeOffsets) {
-        // Don't apply spring force to the node being dragged
-        if (nodeId == m_draggedNodeId && m_isDraggingNode) {
-            continue;
+    ps.integrateSprings(SPRING_STIFFNESS, SPRING_DAMPING, deltaTime);
+
+    // Retire nodes that have essentially returned to rest
+    const float offsetThrSq = OFFSET_THRESHOLD * OFFSET_THRESHOLD;
+    const float velocityThrSq = VELOCITY_THRESHOLD * VELOCITY_THRESHOLD;
+    for (uint32_t slot = 0; slot < (uint32_t)slotCount; ++slot) {
+        if (ps.springMask[slot] == 0.0f) continue;
+        float ox = ps.offsetX[slot], oy = ps.offsetY[slot];
+        float vx = ps.velocityX[slot], vy = ps.velocityY[slot];
+        if (ox * ox + oy * oy < offsetThrSq && vx * vx + vy * vy < velocityThrSq) {
+            ps.clearMotion(slot);
         }
-        
-        // Don't apply spring force to free-floating nodes
-        if (m_freeFloatingNodes.count(nodeId) > 0) {
-            continue;
-        }
-        
-        // Don't apply spring force to frozen nodes (they stay in place)
-        if (m_frozenNodes.count(nodeId) > 0) {
-            continue;
+    }
+    m_physicsAwake = awake;
+}
+
+bool TreeRenderer::isAwake() const {
+    // Bodies still springing back or being pushed apart, or a pending collision re-enable
+    if (m_physicsAwake || m_collisionSuppressRemaining > 0.0f) return true;
+    // Interactions in progress (the dragged node may sit still while its neighbours move)
+    if (m_isDraggingNode || m_isDraggingTree || m_isBoxSelecting) return true;
+    // Visual effects only advance while a tree is being drawn
+    if (!m_renderedTreeLastFrame) return false;
+    if (!m_deleteAnims.empty() || !m_restoreParticles.empty() || !m_restoreGlows.empty()) return true;
+    // Red pulse rings and stretched links (snap timers) animate every frame
+    return m_redPulseDrawnLastFrame || !m_snapTimers.empty();
+}
+
+void TreeRenderer::bindTreeSlots(const SpiritTree* tree) {
+    if (!tree) { m_treeSlots.clear(); m_slotsTree = nullptr; return; }
+    const size_t count = tree->nodes.size();
+    const bool treeChanged = tree != m_slotsTree || count != m_slotsNodeCount;
+    if (!treeChanged && m_editGeneration == m_slotsGeneration) return;
+    m_slotsTree = tree;
+    m_slotsNodeCount = count;
+    m_slotsGeneration = m_editGeneration;
+    m_treeSlots.resize(count);
+    for (size_t i = 0; i < count; ++i) m_treeSlots[i] = m_physics.slotFor(tree->nodes[i].id);
+    if (treeChanged) {
+        // Box flags belong to the tree the marquee was dragged over
+        for (uint8_t& f : m_nodeFlags) f &= (uint8_t)~NODE_BOXED;
+        m_keepSlots.assign(m_treeSlots.begin(), m_treeSlots.end());
+        for (size_t s = 0; s < m_nodeFlags.size(); ++s) {
+            if (m_nodeFlags[s]) m_keepSlots.push_back((uint32_t)s);
         }
-        
-        // Get or create velocity
-        ImVec2& velocity = m_nodeVelocities[nodeId];
-        
-        // Spring force: F = -k * x (where x is offset from rest position)
-        // We want to return to offset (0,0)
-        float springForceX = -SPRING_STIFFNESS * offset.x;
-        float springForceY = -SPRING_STIFFNESS * offset.y;
-        
-        // Damping force: F = -c * v
-        float dampingForceX = -SPRING_DAMPING * velocity.x;
-        float dampingForceY = -SPRING_DAMPING * velocity.y;
-        
-        // Total acceleration (assuming unit mass)
-        float accelX = springForceX + dampingForceX;
-        float accelY = springForceY + dampingForceY;
-        
-        // Update velocity
-        velocity.x += accelX * deltaTime;
-        velocity.y += accelY * deltaTime;
-        
-        // Update position
-        offset.x += velocity.x * deltaTime;
-        offset.y += velocity.y * deltaTime;
-        
-        // Check if node has essentially returned to rest
-        float offsetMag = sqrtf(offset.x * offset.x + offset.y * offset.y);
-        float velocityMag = sqrtf(velocity.x * velocity.x + velocity.y * velocity.y);
-        
-        if (offsetMag < OFFSET_THRESHOLD && velocityMag < VELOCITY_THRESHOLD) {
-            toRemove.push_back(nodeId);
+        m_physics.releaseResting(m_keepSlots);
+    }
+    m_nodeFlags.resize(m_physics.size(), 0);
+    ++m_flagsVersion;
+}
+
+void TreeRenderer::setSelectedNodeId(uint64_t id) {
+    // If selectable set is active, enforce it strictly
+    if (id != NO_NODE_ID && !isNodeSelectable(id)) return;
+    clearSelection();
+    if (id != NO_NODE_ID) addNodeToSelection(id);
+}
+
+void TreeRenderer::clearSelection() {
+    m_selectedNodeId = NO_NODE_ID;
+    clearNodeFlag(NODE_SELECTED);
+    m_selectedNodes.clear();
+}
+
+void TreeRenderer::addNodeToSelection(uint64_t id) {
+    if (id == NO_NODE_ID || !isNodeSelectable(id)) return;
+    if (!isNodeSelected(id)) {
+        m_selectedNodes.push_back(id);
+        setNodeFlag(id, NODE_SELECTED, true);
+    }
+    m_selectedNodeId = id;
+}
+
+void TreeRenderer::removeNodeFromSelection(uint64_t id) {
+    auto it = std::find(m_selectedNodes.begin(), m_selectedNodes.end(), id);
+    if (it == m_selectedNodes.end()) return;
+    m_selectedNodes.erase(it);
+    setNodeFlag(id, NODE_SELECTED, false);
+    if (m_selectedNodes.empty()) m_selectedNodeId = NO_NODE_ID;
+    else if (m_selectedNodeId == id) m_selectedNodeId = m_selectedNodes.back();
+}
+
+size_t TreeRenderer::flagCount(uint8_t flag) const {
+    size_t count = 0;
+    for (int b = 0; b < NODE_FLAG_BITS; ++b) {
+        if (flag & (1u << b)) count += m_flagCounts[b];
+    }
+    return count;
+}
+
+void TreeRenderer::setNodeFlag(uint64_t id, uint8_t flag, bool on) {
+    // Only setting a flag gives an unseen id a slot
+    uint32_t slot = on ? m_physics.slotFor(id) : m_physics.findSlot(id);
+    if (slot == NodePhysicsStore::NO_SLOT) return;
+    if (m_nodeFlags.size() < m_physics.size()) m_nodeFlags.resize(m_physics.size(), 0);
+    const uint8_t before = m_nodeFlags[slot];
+    const uint8_t after = on ? (uint8_t)(before | flag) : (uint8_t)(before & ~flag);
+    if (after == before) return;
+    m_nodeFlags[slot] = after;
+    for (int b = 0; b < NODE_FLAG_BITS; ++b) {
+        if ((before ^ after) & (1u << b)) {
+            if (after & (1u << b)) ++m_flagCounts[b]; else --m_flagCounts[b];
         }
     }
-    
-    // Remove nodes that have returned to rest
-    for (uint64_t id : toRemove) {
-        m_nodeOffsets.erase(id);
-        m_nodeVelocities.erase(id);
+    ++m_flagsVersion;
+}
+
+void TreeRenderer::clearNodeFlag(uint8_t flag) {
+    if (flagCount(flag) == 0) return;
+    for (uint8_t& f : m_nodeFlags) f &= (uint8_t)~flag;
+    for (int b = 0; b < NODE_FLAG_BITS; ++b) {
+        if (flag & (1u << b)) m_flagCounts[b] = 0;
+    }
+    ++m_flagsVersion;
+}
+
+void TreeRenderer::hitTestBox(const SpiritTree* tree, ImVec2 origin, float minX, float minY, float maxX, float maxY) {
+    const size_t count = m_treeSlots.size();
+    if (!tree || tree->nodes.size() != count) return;
+    m_hitX.resize(count);
+    m_hitY.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        const SpiritNode& n = tree->nodes[i];
+        uint32_t slot = m_treeSlots[i];
+        m_hitX[i] = origin.x + (n.x + m_physics.offsetX[slot]) * m_zoom;
+        m_hitY[i] = origin.y - (n.y + m_physics.offsetY[slot]) * m_zoom;
+    }
+
+    // Branch-free over the packed arrays (only the flag access goes through the slot)
+    const uint8_t required = flagCount(NODE_SELECTABLE) > 0 ? NODE_SELECTABLE : 0;
+    const float* xs = m_hitX.data();
+    const float* ys = m_hitY.data();
+    const uint32_t* slots = m_treeSlots.data();
+    uint8_t* flags = m_nodeFlags.data();
+    uint8_t changed = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t& f = flags[slots[i]];
+        const uint8_t inside = (uint8_t)((xs[i] >= minX) & (xs[i] <= maxX) & (ys[i] >= minY) & (ys[i] <= maxY) &
+                                         ((f & required) == required));
+        const uint8_t next = (uint8_t)((f & ~NODE_BOXED) | (inside * NODE_BOXED));
+        changed |= (uint8_t)(next ^ f);
+        f = next;
     }
+    if (changed) ++m_flagsVersion;
+}
+
+void TreeRenderer::clearBoxFlags() {
+    uint8_t changed = 0;
+    for (uint8_t& f : m_nodeFlags) {
+        changed |= f & NODE_BOXED;
+        f &= (uint8_t)~NODE_BOXED;
+    }
+    if (changed) ++m_flagsVersion;
 }
 
 void TreeRenderer::applyBaseShift(uint64_t nodeId, float dx, float dy) {
     // Apply an immediate offset equal to oldBase - newBase so the visual world
     // position remains unchanged. The spring physics in updatePhysics will
     // then pull the offset smoothly back to zero, animating the node into place.
-    m_nodeOffsets[nodeId].x += dx;
-    m_nodeOffsets[nodeId].y += dy;
+    uint32_t slot = m_physics.slotFor(nodeId);
+    m_physics.addOffset(slot, dx, dy);
     // Kick the velocity toward the direction of the target (negative of offset)
     // to give the motion some responsiveness.
-    m_nodeVelocities[nodeId].x += -dx * 8.0f;
-    m_nodeVelocities[nodeId].y += -dy * 8.0f;
+    m_physics.velocityX[slot] += -dx * 8.0f;
+    m_physics.velocityY[slot] += -dy * 8.0f;
+    m_physicsAwake = true;
 }
 
 void TreeRenderer::thawNode(uint64_t nodeId) {
     // Remove frozen/collision bookkeeping so the node is eligible for physics again
-    m_frozenNodes.erase(nodeId);
-    m_collisionTime.erase(nodeId);
+    uint32_t slot = m_physics.slotFor(nodeId);
+    m_physics.clearFlag(slot, NodePhysicsStore::FLAG_FROZEN);
+    m_physics.collisionTime[slot] = 0.0f;
 
     // Ensure the node has a small velocity so the spring integrator wakes up and animates
-    auto it = m_nodeVelocities.find(nodeId);
-    if (it == m_nodeVelocities.end()) {
-        // Small upward nudge to make motion visible but gentle
-        m_nodeVelocities[nodeId] = ImVec2(0.08f, 0.08f);
-    } else {
-        // If velocity exists but near zero, nudge a bit
-        if (fabs(it->second.x) < 0.01f && fabs(it->second.y) < 0.01f) {
-            it->second.x = 0.08f;
-            it->second.y = 0.08f;
-        }
+    // (small upward nudge to make motion visible but gentle)
+    if (fabs(m_physics.velocityX[slot]) < 0.01f && fabs(m_physics.velocityY[slot]) < 0.01f) {
+        m_physics.velocityX[slot] = 0.08f;
+        m_physics.velocityY[slot] = 0.08f;
     }
+    m_physicsAwake = true;
 } 
 
 ImVec2 TreeRenderer::getNodeOffset(uint64_t nodeId) const {
-    auto it = m_nodeOffsets.find(nodeId);
-    if (it != m_nodeOffsets.end()) {
-        return it->second;
+    uint32_t slot = m_physics.findSlot(nodeId);
+    if (slot != NodePhysicsStore::NO_SLOT) {
+        return ImVec2(m_physics.offsetX[slot], m_physics.offsetY[slot]);
     }
     return ImVec2(0.0f, 0.0f);
 }
 
 void TreeRenderer::clearNodeOffset(uint64_t nodeId) {
-    m_nodeOffsets.erase(nodeId);
-    m_nodeVelocities.erase(nodeId);
+    uint32_t slot = m_physics.findSlot(nodeId);
+    if (slot != NodePhysicsStore::NO_SLOT) m_physics.clearMotion(slot);
     if (m_draggedNodeId == nodeId) {
         m_dragGrabOffset = ImVec2(0.0f, 0.0f);
     }
 }
 
+void TreeRenderer::setFreeFloating(uint64_t nodeId) {
+    m_physics.setFlag(m_physics.slotFor(nodeId), NodePhysicsStore::FLAG_FREE_FLOATING);
+}
+
+void TreeRenderer::clearFreeFloating(uint64_t nodeId) {
+    uint32_t slot = m_physics.findSlot(nodeId);
+    if (slot != NodePhysicsStore::NO_SLOT) m_physics.clearFlag(slot, NodePhysicsStore::FLAG_FREE_FLOATING);
+}
+
+void TreeRenderer::suppressCollisions(float seconds) {
+    m_collisionSuppressRemaining = std::max(m_collisionSuppressRemaining, seconds);
+    std::fill(m_physics.collisionTime.begin(), m_physics.collisionTime.end(), 0.0f);
+    m_physics.clearFlagAll(NodePhysicsStore::FLAG_FROZEN);
+}
+
 bool TreeRenderer::render(const SpiritTree* tree, bool createMode, ImVec2* outClickPos,
                           bool linkMode, uint64_t* outLinkTargetId,
                           uint64_t* outRightClickedNodeId,
@@ -235,6 +409,8 @@ bool TreeRenderer::render(const SpiritTree* tree, bool createMode, ImVec2* outCl
     bool actionOccurred = false;
     // Store the provided type color map for use by getNodeColor/getNodeBorderColor
     m_currentRenderTypeColors = typeColors;
+    // The map may have been edited since the last frame; resolve each typ again
+    m_typeColorCache.clear();
     // Remember whether this render is a read-only preview (affects label rendering, interactivity)
     m_currentRenderIsPreview = readOnlyPreview;
     // Prepare optional drag output placeholders (use NO_NODE_ID sentinel)
@@ -243,11 +419,15 @@ bool TreeRenderer::render(const SpiritTree* tree, bool createMode, ImVec2* outCl
     if (outDraggingTreeNodeId) *outDraggingTreeNodeId = NO_NODE_ID;
     if (outDragTreeDelta) { outDragTreeDelta->x = 0.0f; outDragTreeDelta->y = 0.0f; }
     
+    m_renderedTreeLastFrame = false;
+    m_redPulseDrawnLastFrame = false;
     if (!tree || tree->nodes.empty()) {
+        m_drawStats = DrawStats();
         ImGui::TextColored(ImVec4(0.5f, 0.5f, 0.5f, 1.0f), 
                           "Select a spirit from the list to view its tree");
         return false;
     }
+    m_renderedTreeLastFrame = true;
     
     ImVec2 canvasPos = ImGui::GetCursorScreenPos();
     ImVec2 canvasSize = ImGui::GetContentRegionAvail();
@@ -316,8 +496,8 @@ bool TreeRenderer::render(const SpiritTree* tree, bool createMode, ImVec2* outCl
             if (rightClickedNode != NO_NODE_ID && outRightClickedNodeId) {
                 *outRightClickedNodeId = rightClickedNode;
                 // When external highlighted nodes exist (reorder mode), only allow selecting highlighted nodes
-                if (!m_highlightedNodes.empty()) {
-                    if (m_highlightedNodes.count(rightClickedNode) == 0) {
+                if (flagCount(NODE_HIGHLIGHTED) > 0) {
+                    if (!isNodeHighlighted(rightClickedNode)) {
                         // don't change selection, but still report right-click so context menu can be shown
                         actionOccurred = true;
                         // skip selection change
@@ -392,13 +572,13 @@ bool TreeRenderer::render(const SpiritTree* tree, bool createMode, ImVec2* outCl
                 uint64_t clickedNode = getNodeAtPosition(tree, mousePos, origin, m_zoom);
 
                 // Special case: when selection restriction is active (reorder mode), only allow selection of selectable nodes
-                if (!m_selectableNodes.empty()) {
+                if (flagCount(NODE_SELECTABLE) > 0) {
                     // Convert click to world coords for external handlers
                     float worldX = (mousePos.x - origin.x) / m_zoom;
                     float worldY = -(mousePos.y - origin.y) / m_zoom;  // Invert Y
                     if (outClickPos) { outClickPos->x = worldX; outClickPos->y = worldY; }
 
-                    if (clickedNode != NO_NODE_ID && m_selectableNodes.count(clickedNode) > 0) {
+                    if (clickedNode != NO_NODE_ID && hasNodeFlag(clickedNode, NODE_SELECTABLE)) {
                         // Single-select the clicked allowed leaf and do not enter drag mode
                         clearSelection();
                         addNodeToSelection(clickedNode);
@@ -426,7 +606,7 @@ bool TreeRenderer::render(const SpiritTree* tree, bool createMode, ImVec2* outCl
                     } else {
                         // If the clicked node is already part of a multi-selection, keep the selection
                         // and start a grouped node drag so all selected nodes move together.
-                        if (isNodeSelected(clickedNode) && m_selectedNodes.size() > 1) {
+                        if (m_selectedNodes.size() > 1 && isNodeSelected(clickedNode)) {
                             float worldX = (mousePos.x - origin.x) / m_zoom;
                             float worldY = -(mousePos.y - origin.y) / m_zoom;  // Invert Y
 
@@ -437,8 +617,7 @@ bool TreeRenderer::render(const SpiritTree* tree, bool createMode, ImVec2* outCl
                             m_isDraggingTree = false;
 
                             // Compute grab offset so the dragged node stays under the cursor
-                            const SpiritNode* baseNode = nullptr;
-                            for (const auto& n : tree->nodes) if (n.id == clickedNode) { baseNode = &n; break; }
+                            const SpiritNode* baseNode = tree->findNode(clickedNode);
                             if (baseNode) {
                                 m_dragGrabOffset.x = baseNode->x - worldX;
                                 m_dragGrabOffset.y = baseNode->y - worldY;
@@ -463,8 +642,7 @@ bool TreeRenderer::render(const SpiritTree* tree, bool createMode, ImVec2* outCl
                             m_isDraggingTree = true;
                             m_isDraggingNode = false;
                             // Compute grab between node base and mouse world coords
-                            const SpiritNode* baseNode = nullptr;
-                            for (const auto& n : tree->nodes) if (n.id == clickedNode) { baseNode = &n; break; }
+                            const SpiritNode* baseNode = tree->findNode(clickedNode);
                             if (baseNode) {
                                 m_dragTreeGrab.x = baseNode->x - worldX;
                                 m_dragTreeGrab.y = baseNode->y - worldY;
@@ -502,8 +680,7 @@ bool TreeRenderer::render(const SpiritTree* tree, bool createMode, ImVec2* outCl
                         float desiredY = worldY + m_dragTreeGrab.y;
 
                         // Find base position for the dragged node
-                        const SpiritNode* baseNode = nullptr;
-                        for (const auto& n : tree->nodes) if (n.id == m_draggedNodeId) { baseNode = &n; break; }
+                        const SpiritNode* baseNode = tree->findNode(m_draggedNodeId);
                         if (baseNode) {
                             float dx = desiredX - baseNode->x;
                             float dy = desiredY - baseNode->y;
@@ -518,8 +695,7 @@ bool TreeRenderer::render(const SpiritTree* tree, bool createMode, ImVec2* outCl
                         float worldY = -(io.MousePos.y - origin.y) / m_zoom;  // Invert Y
 
                         // Find base position for the dragged node
-                        const SpiritNode* baseNode = nullptr;
-                        for (const auto& n : tree->nodes) if (n.id == m_draggedNodeId) { baseNode = &n; break; }
+                        const SpiritNode* baseNode = tree->findNode(m_draggedNodeId);
 
                         // Compute per-frame mouse delta in world space so other selected nodes follow
                         ImVec2 worldDelta;
@@ -532,23 +708,23 @@ bool TreeRenderer::render(const SpiritTree* tree, bool createMode, ImVec2* outCl
                             desiredOffset.x = worldX + m_dragGrabOffset.x - baseNode->x;
                             desiredOffset.y = worldY + m_dragGrabOffset.y - baseNode->y;
 
-                            m_nodeOffsets[m_draggedNodeId] = desiredOffset;
+                            uint32_t slot = m_physics.slotFor(m_draggedNodeId);
+                            m_physics.setOffset(slot, desiredOffset.x, desiredOffset.y);
                             // Zero velocity to avoid spring inertia while dragging
-                            m_nodeVelocities[m_draggedNodeId] = ImVec2(0.0f, 0.0f);
+                            m_physics.velocityX[slot] = 0.0f;
+                            m_physics.velocityY[slot] = 0.0f;
                         } else {
                             // Fallback to delta-based behavior if the base node can't be found
-                            ImVec2& offset = m_nodeOffsets[m_draggedNodeId];
-                            offset.x += worldDelta.x;
-                            offset.y += worldDelta.y;
+                            m_physics.addOffset(m_physics.slotFor(m_draggedNodeId), worldDelta.x, worldDelta.y);
                         }
 
                         // Move any other selected nodes by the same world delta so the group stays together
                         for (uint64_t sid : m_selectedNodes) {
                             if (sid == m_draggedNodeId) continue;
-                            ImVec2& off = m_nodeOffsets[sid];
-                            off.x += worldDelta.x;
-                            off.y += worldDelta.y;
-                            m_nodeVelocities[sid] = ImVec2(0.0f, 0.0f);
+                            uint32_t slot = m_physics.slotFor(sid);
+                            m_physics.addOffset(slot, worldDelta.x, worldDelta.y);
+                            m_physics.velocityX[slot] = 0.0f;
+                            m_physics.velocityY[slot] = 0.0f;
                         }
                     }
                 } else {
@@ -556,7 +732,7 @@ bool TreeRenderer::render(const SpiritTree* tree, bool createMode, ImVec2* outCl
                     if (m_isDraggingNode) {
                         // Node drag ended: report final offset
                         if (m_draggedNodeId != NO_NODE_ID) {
-                            ImVec2 finalOffset = m_nodeOffsets[m_draggedNodeId];
+                            ImVec2 finalOffset = getNodeOffset(m_draggedNodeId);
                             if (outDragReleasedNodeId) *outDragReleasedNodeId = m_draggedNodeId;
                             if (outDragFinalOffset) { outDragFinalOffset->x = finalOffset.x; outDragFinalOffset->y = finalOffset.y; }
                             // Do NOT erase offsets here; caller will commit base and then tell renderer to clear.
@@ -592,7 +768,7 @@ bool TreeRenderer::render(const SpiritTree* tree, bool createMode, ImVec2* outCl
         if (m_isDraggingNode && !ImGui::IsMouseDown(ImGuiMouseButton_Left)) {
             // Mouse left canvas while dragging - commit final offset
             if (m_draggedNodeId != NO_NODE_ID) {
-                ImVec2 finalOffset = m_nodeOffsets[m_draggedNodeId];
+                ImVec2 finalOffset = getNodeOffset(m_draggedNodeId);
                 if (outDragReleasedNodeId) *outDragReleasedNodeId = m_draggedNodeId;
                 if (outDragFinalOffset) { outDragFinalOffset->x = finalOffset.x; outDragFinalOffset->y = finalOffset.y; }
                 // Do NOT erase offsets here; caller will commit base and then tell renderer to clear.
@@ -606,27 +782,109 @@ bool TreeRenderer::render(const SpiritTree* tree, bool createMode, ImVec2* outCl
     origin.x = canvasPos.x + canvasSize.x * 0.5f + m_pan.x * m_zoom;
     origin.y = canvasPos.y + canvasSize.y * 0.75f + m_pan.y * m_zoom;
     
-    // Create node lookup
-    std::unordered_map<uint64_t, const SpiritNode*> nodeMap;
-    for (const auto& node : tree->nodes) {
-        nodeMap[node.id] = &node;
+    // Map each node index to its physics slot (only re-resolved after edits or a tree switch)
+    bindTreeSlots(tree);
+    const uint8_t* nodeFlags = m_nodeFlags.data();
+    auto offsetAt = [&](size_t i) {
+        uint32_t slot = m_treeSlots[i];
+        return ImVec2(m_physics.offsetX[slot], m_physics.offsetY[slot]);
+    };
+    
+    // Only geometry that can touch the canvas is emitted; the margin keeps labels, rings
+    // and connection curves of nodes just outside the edge from popping in late
+    const NodeDetail detail = detailForZoom(m_zoom);
+
+    // Start a new label epoch when anything the cached text depends on changed
+    float fontSize = ImGui::GetFontSize();
+    if (tree != m_labelTree || m_editGeneration != m_labelGeneration ||
+        fontSize != m_labelFontSize || readOnlyPreview != m_labelPreview) {
+        m_labelTree = tree;
+        m_labelGeneration = m_editGeneration;
+        m_labelFontSize = fontSize;
+        m_labelPreview = readOnlyPreview;
+        ++m_labelEpoch;
     }
+    if (m_labelCache.size() != tree->nodes.size()) m_labelCache.resize(tree->nodes.size());
+    const float cullMinX = canvasPos.x - NODE_CULL_MARGIN;
+    const float cullMinY = canvasPos.y - NODE_CULL_MARGIN;
+    const float cullMaxX = canvasPos.x + canvasSize.x + NODE_CULL_MARGIN;
+    const float cullMaxY = canvasPos.y + canvasSize.y + NODE_CULL_MARGIN;
+    auto screenAt = [&](const SpiritNode& n, ImVec2 off) {
+        return ImVec2(origin.x + (n.x + off.x) * m_zoom, origin.y - (n.y + off.y) * m_zoom);
+    };
+    
+    // Connection and node shape geometry is rebuilt only when something it depends on
+    // changed. Snap timers must advance every frame, and they only exist while a link is
+    // stretched past SNAP_DIST, so any running timer forces a rebuild too.
+    const GeometryKey geometryKey = geometryKeyFor(tree, origin, canvasPos, canvasSize, detail);
+    const bool reuseGeometry = m_geometryValid && geometryKey == m_geometryKey && m_snapTimers.empty();
     
     // Draw connections first (behind nodes)
-    for (const auto& node : tree->nodes) {
-        for (uint64_t childId : node.children) {
-            auto it = nodeMap.find(childId);
-            if (it != nodeMap.end()) {
-                drawConnection(drawList, node, *it->second, origin, m_zoom);
+    WATERCAN_PROFILE_SCOPE(connectionsScope, "TreeRenderer connections");
+    if (!reuseGeometry) {
+        m_linkBatch.clear();
+        m_drawStats = DrawStats();
+        for (size_t i = 0; i < tree->nodes.size(); ++i) {
+            const SpiritNode& node = tree->nodes[i];
+            if (node.children.empty()) continue;
+            ImVec2 parentOffset = offsetAt(i);
+            ImVec2 parentPos = screenAt(node, parentOffset);
+            for (uint64_t childId : node.children) {
+                const SpiritNode* child = tree->findNode(childId);
+                if (child) {
+                    size_t ci = (size_t)(child - tree->nodes.data());
+                    ImVec2 childOffset = offsetAt(ci);
+                    ImVec2 childPos = screenAt(*child, childOffset);
+                    bool visible = std::max(parentPos.x, childPos.x) >= cullMinX &&
+                                   std::min(parentPos.x, childPos.x) <= cullMaxX &&
+                                   std::max(parentPos.y, childPos.y) >= cullMinY &&
+                                   std::min(parentPos.y, childPos.y) <= cullMaxY;
+                    if (visible) {
+                        drawConnection(m_linkBatch, node, *child, parentOffset, childOffset, origin, m_zoom, detail);
+                        ++m_drawStats.connections;
+                    } else {
+                        // Off-screen links are not drawn but can still be stretched to snapping
+                        updateSnapTimer(node, *child, parentOffset, childOffset);
+                    }
+                }
             }
         }
     }
+    m_linkBatch.flushTo(drawList);
+    connectionsScope.end();
     
-    // Draw nodes
-    for (const auto& node : tree->nodes) {
-        bool isSelected = isNodeSelected(node.id);
-        drawNode(drawList, node, origin, m_zoom, isSelected);
+    // Draw nodes: effects under the node shapes, text on top of everything
+    WATERCAN_PROFILE_SCOPE(nodesScope, "TreeRenderer nodes");
+    if (!reuseGeometry) {
+        m_nodeBatch.clear();
+        m_visibleNodes.clear();
+        for (size_t i = 0; i < tree->nodes.size(); ++i) {
+            const SpiritNode& node = tree->nodes[i];
+            ImVec2 pos = screenAt(node, offsetAt(i));
+            if (pos.x < cullMinX || pos.x > cullMaxX || pos.y < cullMinY || pos.y > cullMaxY) continue;
+            m_visibleNodes.push_back((uint32_t)i);
+            drawNodeShapes(m_nodeBatch, node, pos, m_zoom, nodeFlags[m_treeSlots[i]], detail);
+        }
+        m_drawStats.nodes = m_visibleNodes.size();
+        m_geometryKey = geometryKey;
+        m_geometryValid = true;
+    }
+    m_effectBatch.clear();
+    if (flagCount(NODE_HIGHLIGHTED) > 0 || !m_nodeRedPulseStart.empty()) {
+        for (uint32_t i : m_visibleNodes) {
+            const SpiritNode& node = tree->nodes[i];
+            drawNodeEffects(m_effectBatch, node, screenAt(node, offsetAt(i)), m_zoom, nodeFlags[m_treeSlots[i]]);
+        }
+    }
+    m_effectBatch.flushTo(drawList);
+    m_nodeBatch.flushTo(drawList);
+    if (detail != NodeDetail::Dot) {
+        for (uint32_t i : m_visibleNodes) {
+            const SpiritNode& node = tree->nodes[i];
+            drawNodeText(drawList, screenAt(node, offsetAt(i)), m_zoom, detail, labelsFor(i, node));
+        }
     }
+    nodesScope.end();
     
     // Box-selection update & drawing
     if (m_isBoxSelecting) {
@@ -641,18 +899,9 @@ bool TreeRenderer::render(const SpiritTree* tree, bool createMode, ImVec2* outCl
 
         // If the drag is substantial, compute which nodes are inside the rect
         if (std::fabs(dx) > BOX_SELECT_MIN_DRAG || std::fabs(dy) > BOX_SELECT_MIN_DRAG) {
-            m_boxSelectedNodes.clear();
-            for (const auto& n : tree->nodes) {
-                ImVec2 pos;
-                if (!getNodeScreenPosition(tree, n.id, &pos)) continue;
-                if (pos.x >= minX && pos.x <= maxX && pos.y >= minY && pos.y <= maxY) {
-                    if (m_selectableNodes.empty() || m_selectableNodes.count(n.id) > 0) {
-                        m_boxSelectedNodes.insert(n.id);
-                    }
-                }
-            }
+            hitTestBox(tree, origin, minX, minY, maxX, maxY);
         } else {
-            m_boxSelectedNodes.clear();
+            clearBoxFlags();
         }
 
         // Draw rectangle (filled & border)
@@ -673,8 +922,8 @@ bool TreeRenderer::render(const SpiritTree* tree, bool createMode, ImVec2* outCl
         } else {
             bool shift = ioLocal.KeyShift;
             if (!shift) clearSelection();
-            for (uint64_t id : m_boxSelectedNodes) {
-                addNodeToSelection(id);
+            for (size_t i = 0; i < m_treeSlots.size(); ++i) {
+                if (m_nodeFlags[m_treeSlots[i]] & NODE_BOXED) addNodeToSelection(tree->nodes[i].id);
             }
         }
 
@@ -1002,24 +1251,25 @@ ImU32 TreeRenderer::getNodeFillColorForNode(const SpiritNode& node) const {
     return getNodeColor(node);
 }
 
-void TreeRenderer::startGroupDrag(const std::unordered_set<uint64_t>& nodes) {
+void TreeRenderer::startGroupDrag(const std::vector<uint64_t>& nodes) {
     if (m_groupDragging) return;
     m_groupDragging = true;
     m_groupAddedFreeFloating.clear();
     m_groupAddedFrozen.clear();
     // Freeze and mark as free-floating so they remain stiff during the drag
     for (uint64_t id : nodes) {
-        bool wasFree = (m_freeFloatingNodes.count(id) > 0);
+        uint32_t slot = m_physics.slotFor(id);
+        bool wasFree = m_physics.hasFlag(slot, NodePhysicsStore::FLAG_FREE_FLOATING);
         if (!wasFree) {
-            m_freeFloatingNodes.insert(id);
+            m_physics.setFlag(slot, NodePhysicsStore::FLAG_FREE_FLOATING);
             m_groupAddedFreeFloating.insert(id);
         }
-        bool wasFrozen = (m_frozenNodes.count(id) > 0);
+        bool wasFrozen = m_physics.hasFlag(slot, NodePhysicsStore::FLAG_FROZEN);
         if (!wasFrozen) {
-            m_frozenNodes.insert(id);
+            m_physics.setFlag(slot, NodePhysicsStore::FLAG_FROZEN);
             m_groupAddedFrozen.insert(id);
         }
-        m_collisionTime.erase(id);
+        m_physics.collisionTime[slot] = 0.0f;
     }
 }
 
@@ -1027,8 +1277,11 @@ void TreeRenderer::endGroupDrag() {
     if (!m_groupDragging) return;
     m_groupDragging = false;
     // Undo only the changes we made in startGroupDrag
-    for (uint64_t id : m_groupAddedFreeFloating) m_freeFloatingNodes.erase(id);
-    for (uint64_t id : m_groupAddedFrozen) m_frozenNodes.erase(id);
+    for (uint64_t id : m_groupAddedFreeFloating) clearFreeFloating(id);
+    for (uint64_t id : m_groupAddedFrozen) {
+        uint32_t slot = m_physics.findSlot(id);
+        if (slot != NodePhysicsStore::NO_SLOT) m_physics.clearFlag(slot, NodePhysicsStore::FLAG_FROZEN);
+    }
     m_groupAddedFreeFloating.clear();
     m_groupAddedFrozen.clear();
     // Give a brief global collision suppression so nodes can settle without immediate pushes
@@ -1051,9 +1304,7 @@ void TreeRenderer::triggerRestoreEffect(const SpiritTree* tree, uint64_t nodeId)
 
     // find node color to tint particles later
     ImU32 color = IM_COL32(255, 220, 120, 255);
-    for (const auto &n : tree->nodes) {
-        if (n.id == nodeId) { color = getNodeColor(n); break; }
-    }
+    if (const SpiritNode* n = tree->findNode(nodeId)) color = getNodeColor(*n);
     m_restoreGlowColor[nodeId] = color; // store until contraction completes
 }
 
@@ -1114,12 +1365,8 @@ void TreeRenderer::startDeleteAnimation(uint64_t nodeId, float worldX, float wor
 
 bool TreeRenderer::getNodeScreenPosition(const SpiritTree* tree, uint64_t nodeId, ImVec2* outPos) const {
     if (!tree || !outPos) return false;
-    // Build id->node map
-    std::unordered_map<uint64_t, const SpiritNode*> idToNode;
-    for (const auto &n : tree->nodes) idToNode[n.id] = &n;
-    auto it = idToNode.find(nodeId);
-    if (it == idToNode.end()) return false;
-    const SpiritNode* node = it->second;
+    const SpiritNode* node = tree->findNode(nodeId);
+    if (!node) return false;
     ImVec2 origin;
     origin.x = m_lastCanvasPos.x + m_lastCanvasSize.x * 0.5f + m_pan.x * m_zoom;
     origin.y = m_lastCanvasPos.y + m_lastCanvasSize.y * 0.75f + m_pan.y * m_zoom;
@@ -1130,46 +1377,83 @@ bool TreeRenderer::getNodeScreenPosition(const SpiritTree* tree, uint64_t nodeId
     return true;
 }
 
-void TreeRenderer::drawNode(ImDrawList* drawList, const SpiritNode& node, 
-                            ImVec2 origin, float zoom, bool isSelected) {
-    // Get node offset from dragging
-    ImVec2 offset = getNodeOffset(node.id);
+bool TreeRenderer::centerOnNode(const SpiritTree* tree, uint64_t nodeId) {
+    if (!tree) return false;
+    const SpiritNode* node = tree->findNode(nodeId);
+    if (!node) return false;
+    // The root sits at 75% of the canvas height; the node should end up at 50%
+    ImVec2 off = getNodeOffset(nodeId);
+    m_pan.x = -(node->x + off.x);
+    m_pan.y = (node->y + off.y) - m_lastCanvasSize.y * 0.25f / m_zoom;
+    return true;
+}
 
-    // If this node is externally highlighted, draw a subtle halo to emphasize it
-    bool externallyHighlighted = (m_highlightedNodes.count(node.id) > 0);
+TreeRenderer::NodeDetail TreeRenderer::detailForZoom(float zoom) {
+    if (zoom < LOD_LABEL_ZOOM) return NodeDetail::Dot;
+    if (zoom < LOD_FULL_ZOOM) return NodeDetail::Label;
+    return NodeDetail::Full;
+}
 
-    
-    // Convert node position to screen position (with offset applied)
-    // Note: y is inverted (positive y goes up in logic, but down on screen)
-    ImVec2 screenPos;
-    screenPos.x = origin.x + (node.x + offset.x) * zoom;
-    screenPos.y = origin.y - (node.y + offset.y) * zoom;  // Invert Y so "up" in tree is "up" on screen
-    
+namespace {
+
+inline uint64_t hashMix(uint64_t h, uint64_t v) {
+    h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    return h;
+}
+
+inline uint64_t floatBits(float f) {
+    uint32_t u;
+    std::memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+} // namespace
+
+TreeRenderer::GeometryKey TreeRenderer::geometryKeyFor(const SpiritTree* tree, ImVec2 origin, ImVec2 canvasPos,
+                                                       ImVec2 canvasSize, NodeDetail detail) const {
+    GeometryKey key;
+    key.tree = tree;
+    key.nodeCount = tree->nodes.size();
+    key.editGeneration = m_editGeneration;    // names, types, roots and links
+    key.layoutGeneration = m_layoutGeneration; // base positions
+    key.motionVersion = m_physics.motionVersion();
+    key.flagsVersion = m_flagsVersion;        // selection, box, offending and highlight (border colour)
+
+    uint64_t h = 0;
+    h = hashMix(h, floatBits(origin.x));
+    h = hashMix(h, floatBits(origin.y));
+    h = hashMix(h, floatBits(canvasPos.x));
+    h = hashMix(h, floatBits(canvasPos.y));
+    h = hashMix(h, floatBits(canvasSize.x));
+    h = hashMix(h, floatBits(canvasSize.y));
+    h = hashMix(h, floatBits(m_zoom));
+    h = hashMix(h, (uint64_t)detail | ((uint64_t)m_showArrows << 8) | ((uint64_t)m_currentRenderIsPreview << 9));
+
+    if (m_currentRenderTypeColors) {
+        uint64_t colors = m_currentRenderTypeColors->size();
+        for (const auto& entry : *m_currentRenderTypeColors) {
+            uint64_t c = std::hash<std::string>()(entry.first);
+            for (float f : entry.second) c = hashMix(c, floatBits(f));
+            colors += c;
+        }
+        h = hashMix(h, colors);
+    }
+    key.stateHash = h;
+    return key;
+}
+
+void TreeRenderer::drawNodeEffects(GeometryBatch& batch, const SpiritNode& node, ImVec2 screenPos, float zoom, uint8_t flags) {
     float radius = NODE_RADIUS * zoom;
-    
-    // Check for ID mismatch
-    uint32_t expectedId = fnv1a32(node.name);
-    bool idMismatch = (node.id != expectedId);
 
-    if (externallyHighlighted) {
+    // If this node is externally highlighted, draw a subtle halo to emphasize it
+    if (flags & NODE_HIGHLIGHTED) {
         // Draw a soft highlight ring behind the node with pulsing effect
         float time = (float)ImGui::GetTime();
         float pulse = (sinf(time * 5.0f) + 1.0f) * 0.5f; // 0.0 to 1.0
         float alpha = 0.3f + 0.5f * pulse; // 0.3 to 0.8
         ImU32 halo = IM_COL32(255, 220, 80, (int)(alpha * 255.0f));
-        drawList->AddCircleFilled(screenPos, radius * 1.4f, halo); // Increased radius for visibility
-        drawList->AddCircle(screenPos, radius * 1.4f, IM_COL32(255, 220, 80, (int)((alpha + 0.2f) * 255.0f)), 0, 2.0f);
-    }
-    
-    // Get colors
-    ImU32 fillColor = getNodeColor(node);
-    ImU32 borderColor = getNodeBorderColor(node);
-    
-    // Draw selection circle if selected (green if ID matches, red if mismatch)
-    if (isSelected) {
-        float selectionRadius = radius + 6.0f * zoom;
-        ImU32 selectionColor = idMismatch ? IM_COL32(255, 50, 50, 255) : IM_COL32(50, 255, 50, 255);
-        drawList->AddCircle(screenPos, selectionRadius, selectionColor, 0, 3.0f * zoom);
+        batch.addCircleFilled(screenPos, radius * 1.4f, halo); // Increased radius for visibility
+        batch.addCircle(screenPos, radius * 1.4f, IM_COL32(255, 220, 80, (int)((alpha + 0.2f) * 255.0f)), 2.0f);
     }
 
     // Red pulse indicator for validation errors (duplicate names): pulsing red ring
@@ -1183,25 +1467,55 @@ void TreeRenderer::drawNode(ImDrawList* drawList, const SpiritNode& node,
         float alpha = (0.6f) * (0.5f + 0.5f * pulse);
         float ringRadius = radius + 8.0f * zoom * (1.0f + 0.25f * pulse);
         ImU32 ringColor = IM_COL32(255, 80, 80, (int)(alpha * 255.0f));
-        drawList->AddCircle(screenPos, ringRadius, ringColor, 0, 3.0f * zoom);
+        batch.addCircle(screenPos, ringRadius, ringColor, 3.0f * zoom);
+        m_redPulseDrawnLastFrame = true;
+    }
+}
+
+void TreeRenderer::drawNodeShapes(GeometryBatch& batch, const SpiritNode& node, ImVec2 screenPos,
+                                  float zoom, uint8_t flags, NodeDetail detail) {
+    float radius = NODE_RADIUS * zoom;
+    const bool isSelected = (flags & NODE_SELECTED) != 0;
+    
+    // Get colors
+    ImU32 fillColor = getNodeColor(node);
+    ImU32 borderColor = getNodeBorderColor(node, flags);
+    
+    // Draw selection circle if selected (green if ID matches, red if mismatch)
+    if (isSelected) {
+        // Check for ID mismatch
+        uint32_t expectedId = fnv1a32(node.name);
+        bool idMismatch = (node.id != expectedId);
+        float selectionRadius = radius + 6.0f * zoom;
+        ImU32 selectionColor = idMismatch ? IM_COL32(255, 50, 50, 255) : IM_COL32(50, 255, 50, 255);
+        batch.addCircle(screenPos, selectionRadius, selectionColor, 3.0f * zoom);
     }
 
     // Box-selection highlight (when user is drawing a marquee) - show a blue ring for nodes inside the box
-    if (m_boxSelectedNodes.count(node.id) > 0 && !isSelected) {
+    if ((flags & NODE_BOXED) && !isSelected) {
         float boxRadius = radius + 6.0f * zoom;
-        drawList->AddCircle(screenPos, boxRadius, IM_COL32(100,150,255,200), 0, 2.0f * zoom);
+        batch.addCircle(screenPos, boxRadius, IM_COL32(100,150,255,200), 2.0f * zoom);
     }
     
+    bool offending = (flags & NODE_OFFENDING) != 0;
+
+    // Zoomed far out: a plain dot (plus the border of offending nodes) is all that reads
+    if (detail == NodeDetail::Dot) {
+        batch.addCircleFilled(screenPos, radius, fillColor);
+        if (offending) batch.addCircle(screenPos, radius, IM_COL32(255, 20, 20, 255), 4.0f * zoom);
+        return;
+    }
+
     // Draw node circle with shadow
     ImVec2 shadowOffset(2 * zoom, 2 * zoom);
-    drawList->AddCircleFilled(
+    batch.addCircleFilled(
         ImVec2(screenPos.x + shadowOffset.x, screenPos.y + shadowOffset.y),
         radius, IM_COL32(0, 0, 0, 80));
     
     // Main circle
-    drawList->AddCircleFilled(screenPos, radius, fillColor);
+    batch.addCircleFilled(screenPos, radius, fillColor);
     float borderThickness = 2.0f * zoom;
-    if (m_offendingNodes.count(node.id) > 0) {
+    if (offending) {
         // More vivid border for offending nodes
         borderColor = IM_COL32(255, 20, 20, 255);
         borderThickness = 4.0f * zoom;
@@ -1210,73 +1524,49 @@ void TreeRenderer::drawNode(ImDrawList* drawList, const SpiritNode& node,
     // Root node: add a subtle golden halo but keep the normal border
     if (node.dep == 0) {
         // subtle halo glow behind the border for extra visibility
-        drawList->AddCircle(screenPos, radius * 1.18f, IM_COL32(255, 220, 100, 60), 0, 2.0f * zoom);
+        batch.addCircle(screenPos, radius * 1.18f, IM_COL32(255, 220, 100, 60), 2.0f * zoom);
     }
 
-    drawList->AddCircle(screenPos, radius, borderColor, 0, borderThickness);
+    batch.addCircle(screenPos, radius, borderColor, borderThickness);
     
     // Draw AP indicator (small star/diamond) at north west of node
     if (node.isAdventurePass) {
         float starSize = 6.0f * zoom;
         ImVec2 starPos(screenPos.x - radius * 0.7f, screenPos.y - radius * 0.7f);
-        drawList->AddCircleFilled(starPos, starSize, IM_COL32(255, 215, 0, 255));
-        drawList->AddCircle(starPos, starSize, IM_COL32(200, 160, 0, 255), 0, 1.5f);
-    }
-    
-    // Draw label inside the node: in preview show typ (highlighted); otherwise show name (nm)
-    std::string label;
-    ImU32 labelColor = IM_COL32(255, 255, 255, 255);
-    if (m_currentRenderIsPreview) {
-        if (!node.type.empty()) {
-            label = node.type;
-            labelColor = IM_COL32(220, 220, 140, 255); // slightly warm highlight to indicate typ
-        } else {
-            // Fallback when typ is missing - show nm but in a distinct color so it's obvious
-            label = node.name;
-            labelColor = IM_COL32(200, 120, 120, 255);
-        }
-    } else {
-        label = node.name;
-        labelColor = IM_COL32(255, 255, 255, 255);
+        batch.addCircleFilled(starPos, starSize, IM_COL32(255, 215, 0, 255));
+        batch.addCircle(starPos, starSize, IM_COL32(200, 160, 0, 255), 1.5f);
     }
+}
 
-    if (zoom >= 0.5f && !label.empty()) {
-        ImVec2 textSize = ImGui::CalcTextSize(label.c_str());
-        ImVec2 textPos(screenPos.x - textSize.x * 0.5f, screenPos.y - textSize.y * 0.5f);
-        drawList->AddText(textPos, labelColor, label.c_str());
+void TreeRenderer::drawNodeText(ImDrawList* drawList, ImVec2 screenPos, float zoom, NodeDetail detail,
+                                const NodeLabels& labels) {
+    float radius = NODE_RADIUS * zoom;
+
+    // Draw label inside the node: in preview show typ (highlighted); otherwise show name (nm)
+    const std::string& label = labels.label();
+    if (!label.empty()) {
+        const char* labelBegin = label.data();
+        const char* labelEnd = labelBegin + label.size();
+        ImVec2 textPos(screenPos.x - labels.labelSize.x * 0.5f, screenPos.y - labels.labelSize.y * 0.5f);
+        drawList->AddText(textPos, labels.labelColor, labelBegin, labelEnd);
 
         // When zoomed in enough, display the node's object id under the nm
         // (show as 0xHEX for readability). Skip in preview mode.
         // Show node's 'id' attribute when zoomed in more (higher threshold)
         constexpr float ID_ZOOM_THRESHOLD = 1.8f; // show only when quite zoomed in
-        if (!m_currentRenderIsPreview && zoom >= ID_ZOOM_THRESHOLD) {
-            char idBuf[64];
-            // Display as decimal 'id: 12345' so it matches the node attribute users expect
-            std::snprintf(idBuf, sizeof(idBuf), "id: %llu", (unsigned long long)node.id);
-            ImVec2 idSize = ImGui::CalcTextSize(idBuf);
-            ImVec2 idPos(screenPos.x - idSize.x * 0.5f, textPos.y + textSize.y + 3.0f * zoom);
-            drawList->AddText(idPos, IM_COL32(200, 200, 210, 240), idBuf);
+        if (!labels.idText.empty() && zoom >= ID_ZOOM_THRESHOLD) {
+            ImVec2 idPos(screenPos.x - labels.idSize.x * 0.5f, textPos.y + labels.labelSize.y + 3.0f * zoom);
+            drawList->AddText(idPos, IM_COL32(200, 200, 210, 240), labels.idText.c_str());
         }
     }
     
     // Draw type indicator at south east of node
-    if (zoom >= 0.7f) {
-        std::string typeLabel;
-        bool isSeasonHeart = false;
-        if (node.type == "outfit") typeLabel = "O";
-        else if (node.type == "spirit_upgrade") typeLabel = "E";
-        else if (node.type == "music") typeLabel = "M";
-        else if (node.type == "lootbox") typeLabel = "L";
-        else if (node.type == "season_heart") { typeLabel = "H"; isSeasonHeart = true; }
-        else if (node.type == "heart") typeLabel = "H";
-        else if (node.type == "teleport_to") typeLabel = "TP";
-        else typeLabel = "?";
-        
+    if (detail == NodeDetail::Full) {
         ImVec2 labelPos(screenPos.x + radius * 1.0f, screenPos.y + radius * 1.0f);
         
         // Draw type letter - pulse to gold for season hearts
         ImU32 typeLabelColor;
-        if (isSeasonHeart) {
+        if (labels.isSeasonHeart) {
             // Gentle pulse from gray to gold using sine wave
             float time = (float)ImGui::GetTime();
             float pulse = (std::sin(time * 2.0f) + 1.0f) * 0.5f;  // 0 to 1
@@ -1288,25 +1578,107 @@ void TreeRenderer::drawNode(ImDrawList* drawList, const SpiritNode& node,
         } else {
             typeLabelColor = IM_COL32(150, 150, 150, 200);
         }
-        drawList->AddText(labelPos, typeLabelColor, typeLabel.c_str());
+        drawList->AddText(labelPos, typeLabelColor, labels.typeLetter);
         
         // Draw cost, offset by type letter width
         // White for candles, golden for season_candle
-        ImVec2 typeSize = ImGui::CalcTextSize(typeLabel.c_str());
-        std::string costStr = " " + std::to_string(node.cost);
-        ImVec2 costPos(labelPos.x + typeSize.x, labelPos.y);
-        ImU32 costColor = (node.costType == "season_candle") 
+        ImVec2 costPos(labelPos.x + labels.typeSize.x, labelPos.y);
+        ImU32 costColor = labels.seasonCandle
             ? IM_COL32(255, 215, 0, 255)   // Golden for season candles
             : IM_COL32(255, 255, 255, 255); // White for regular candles
-        drawList->AddText(costPos, costColor, costStr.c_str());
+        drawList->AddText(costPos, costColor, labels.costText.c_str());
+    }
+}
+
+const TreeRenderer::NodeLabels& TreeRenderer::labelsFor(size_t i, const SpiritNode& node) {
+    NodeLabels& labels = m_labelCache[i];
+    if (labels.epoch == m_labelEpoch) return labels;
+    labels.epoch = m_labelEpoch;
+    // Most entries survive an edit elsewhere in the tree; only re-format what changed
+    if (labels.id == node.id && labels.cost == node.cost && labels.name == node.name &&
+        labels.type == node.type && labels.costType == node.costType &&
+        labels.labelIsType == (m_currentRenderIsPreview && !node.type.empty()) &&
+        labels.idText.empty() == m_currentRenderIsPreview && labels.fontSize == m_labelFontSize) {
+        return labels;
+    }
+    buildNodeLabels(labels, node);
+    return labels;
+}
+
+void TreeRenderer::buildNodeLabels(NodeLabels& labels, const SpiritNode& node) const {
+    labels.name = node.name;
+    labels.type = node.type;
+    labels.costType = node.costType;
+    labels.id = node.id;
+    labels.cost = node.cost;
+
+    labels.labelIsType = false;
+    labels.labelColor = IM_COL32(255, 255, 255, 255);
+    if (m_currentRenderIsPreview) {
+        if (!node.type.empty()) {
+            labels.labelIsType = true;
+            labels.labelColor = IM_COL32(220, 220, 140, 255); // slightly warm highlight to indicate typ
+        } else {
+            // Fallback when typ is missing - show nm but in a distinct color so it's obvious
+            labels.labelColor = IM_COL32(200, 120, 120, 255);
+        }
+    }
+    const std::string& label = labels.label();
+    labels.fontSize = m_labelFontSize;
+    labels.labelSize = ImGui::CalcTextSize(label.data(), label.data() + label.size());
+
+    labels.idText.clear();
+    labels.idSize = ImVec2(0.0f, 0.0f);
+    if (!m_currentRenderIsPreview) {
+        char idBuf[64];
+        // Display as decimal 'id: 12345' so it matches the node attribute users expect
+        std::snprintf(idBuf, sizeof(idBuf), "id: %llu", (unsigned long long)node.id);
+        labels.idText = idBuf;
+        labels.idSize = ImGui::CalcTextSize(idBuf);
     }
+
+    labels.isSeasonHeart = false;
+    if (node.type == "outfit") labels.typeLetter = "O";
+    else if (node.type == "spirit_upgrade") labels.typeLetter = "E";
+    else if (node.type == "music") labels.typeLetter = "M";
+    else if (node.type == "lootbox") labels.typeLetter = "L";
+    else if (node.type == "season_heart") { labels.typeLetter = "H"; labels.isSeasonHeart = true; }
+    else if (node.type == "heart") labels.typeLetter = "H";
+    else if (node.type == "teleport_to") labels.typeLetter = "TP";
+    else labels.typeLetter = "?";
+    labels.typeSize = ImGui::CalcTextSize(labels.typeLetter);
+
+    labels.costText = " " + std::to_string(node.cost);
+    labels.seasonCandle = (node.costType == "season_candle");
 }
 
-void TreeRenderer::drawConnection(ImDrawList* drawList, const SpiritNode& parent, 
-                                  const SpiritNode& child, ImVec2 origin, float zoom) {
-    // Get offsets for both nodes
-    ImVec2 parentOffset = getNodeOffset(parent.id);
-    ImVec2 childOffset = getNodeOffset(child.id);
+float TreeRenderer::updateSnapTimer(const SpiritNode& parent, const SpiritNode& child,
+                                   ImVec2 parentOffset, ImVec2 childOffset) {
+    // Compute world-space distance using current offsets (so dragging affects it)
+    float worldDx = (child.x + childOffset.x) - (parent.x + parentOffset.x);
+    float worldDy = (child.y + childOffset.y) - (parent.y + parentOffset.y);
+    float worldDist = sqrtf(worldDx * worldDx + worldDy * worldDy);
+
+    // Track snap timers when beyond SNAP_DIST
+    uint64_t key = (parent.id << 32) ^ (child.id & 0xFFFFFFFFULL);
+    if (worldDist >= SNAP_DIST) {
+        float dt = ImGui::GetIO().DeltaTime;
+        m_snapTimers[key] += dt;
+        if (m_snapTimers[key] >= SNAP_HOLD) {
+            // Queue a snap event and clear timer to avoid repeat
+            m_pendingSnaps.push_back({parent.id, child.id});
+            m_snapTimers.erase(key);
+        }
+    } else if (!m_snapTimers.empty()) {
+        // Not beyond snap distance: reset any timer
+        m_snapTimers.erase(key);
+    }
+    return worldDist;
+}
+
+void TreeRenderer::drawConnection(GeometryBatch& batch, const SpiritNode& parent, 
+                                  const SpiritNode& child, ImVec2 parentOffset, ImVec2 childOffset,
+                                  ImVec2 origin, float zoom, NodeDetail detail) {
     
     // Convert positions (with offsets applied)
     ImVec2 parentPos, childPos;
@@ -1445,15 +1817,7 @@ void TreeRenderer::drawConnection(ImDrawList* drawList, const SpiritNode& parent
 
     // Snapping visualization: color shifts to red when stretched beyond a threshold
     // Distances are measured using the nodes' visual positions (base + transient offsets)
-    // Increased thresholds so snapping requires a much larger stretch
-    const float SNAP_WARNING_DIST = 240.0f; // start blending toward red (world units)
-    const float SNAP_DIST = 420.0f; // when exceeded, begin snap timer
-    const float SNAP_HOLD = 0.12f; // seconds beyond SNAP_DIST to trigger snap
-
-    // Compute world-space distance using current offsets (so dragging affects it)
-    float worldDx = (child.x + childOffset.x) - (parent.x + parentOffset.x);
-    float worldDy = (child.y + childOffset.y) - (parent.y + parentOffset.y);
-    float worldDist = sqrtf(worldDx * worldDx + worldDy * worldDy);
+    float worldDist = updateSnapTimer(parent, child, parentOffset, childOffset);
 
     float warnRatio = 0.0f;
     if (worldDist > SNAP_WARNING_DIST) warnRatio = std::clamp((worldDist - SNAP_WARNING_DIST) / (SNAP_DIST - SNAP_WARNING_DIST), 0.0f, 1.0f);
@@ -1479,21 +1843,6 @@ void TreeRenderer::drawConnection(ImDrawList* drawList, const SpiritNode& parent
         lineColor = blendColor(lineColor, red, warnRatio);
     }
 
-    // Track snap timers when beyond SNAP_DIST
-    uint64_t key = (parent.id << 32) ^ (child.id & 0xFFFFFFFFULL);
-    if (worldDist >= SNAP_DIST) {
-        float dt = ImGui::GetIO().DeltaTime;
-        m_snapTimers[key] += dt;
-        if (m_snapTimers[key] >= SNAP_HOLD) {
-            // Queue a snap event and clear timer to avoid repeat
-            m_pendingSnaps.push_back({parent.id, child.id});
-            m_snapTimers.erase(key);
-        }
-    } else {
-        // Not beyond snap distance: reset any timer
-        m_snapTimers.erase(key);
-    }
-
     // Thickness can increase slightly when stretched
     float thickness = CONNECTION_THICKNESS * zoom * (1.0f + 0.5f * tensionFactor);
 
@@ -1505,7 +1854,8 @@ void TreeRenderer::drawConnection(ImDrawList* drawList, const SpiritNode& parent
     // Place arrow base a bit behind the tip so the arrow points cleanly at the node
     ImVec2 arrowBase = ImVec2(arrowTip.x - nx * (arrowSize * 0.6f), arrowTip.y - ny * (arrowSize * 0.6f));
 
-    if (m_showArrows) {
+    // Arrow heads are too small to read at the lowest detail tier
+    if (m_showArrows && detail != NodeDetail::Dot) {
         // Leave a small hover gap between the visible line end and the arrow base
         float hoverGap = 6.0f * zoom;
         ImVec2 lineEnd = ImVec2(arrowBase.x - nx * hoverGap, arrowBase.y - ny * hoverGap);
@@ -1516,9 +1866,9 @@ void TreeRenderer::drawConnection(ImDrawList* drawList, const SpiritNode& parent
         float lineLen = sqrtf(dxLine*dxLine + dyLine*dyLine);
         if (lineLen < 1.0f) {
             ImVec2 tinyEnd = ImVec2(start.x + nx * 1.0f, start.y + ny * 1.0f);
-            drawList->AddLine(start, tinyEnd, lineColor, thickness);
+            batch.addLine(start, tinyEnd, lineColor, thickness);
         } else {
-            drawList->AddLine(start, lineEnd, lineColor, thickness);
+            batch.addLine(start, lineEnd, lineColor, thickness);
         }
 
         // Use the straight-line direction from parent to child for consistent arrow orientation
@@ -1534,7 +1884,7 @@ void TreeRenderer::drawConnection(ImDrawList* drawList, const SpiritNode& parent
         ImVec2 arrowRight(arrowTip.x - arrowDirX * arrowSize - perpX * arrowSize * 0.5f,
                           arrowTip.y - arrowDirY * arrowSize - perpY * arrowSize * 0.5f);
 
-        drawList->AddTriangleFilled(arrowTip, arrowLeft, arrowRight, lineColor);
+        batch.addTriangleFilled(arrowTip, arrowLeft, arrowRight, lineColor);
     } else {
         // No arrows: draw line all the way to the inset endpoint so it sits close to nodes
         ImVec2 lineEnd = end;
@@ -1543,60 +1893,65 @@ void TreeRenderer::drawConnection(ImDrawList* drawList, const SpiritNode& parent
         float lineLen = sqrtf(dxLine*dxLine + dyLine*dyLine);
         if (lineLen < 1.0f) {
             ImVec2 tinyEnd = ImVec2(start.x + nx * 1.0f, start.y + ny * 1.0f);
-            drawList->AddLine(start, tinyEnd, lineColor, thickness);
+            batch.addLine(start, tinyEnd, lineColor, thickness);
         } else {
-            drawList->AddLine(start, lineEnd, lineColor, thickness);
+            batch.addLine(start, lineEnd, lineColor, thickness);
         }
     }
 }
 
-ImU32 TreeRenderer::getNodeColor(const SpiritNode& node) const {
-    // If a render-time per-type color map is provided, prefer it
+const TreeRenderer::TypeColors& TreeRenderer::typeColorsFor(Symbol type) const {
+    auto cached = m_typeColorCache.find(type);
+    if (cached != m_typeColorCache.end()) return cached->second;
+
+    static const Symbol OUTFIT("outfit"), SPIRIT_UPGRADE("spirit_upgrade"), MUSIC("music"), LOOTBOX("lootbox");
+    TypeColors colors;
+    // If a render-time per-type color map is provided, prefer it (with a darker border variant)
+    const std::array<float,4>* custom = nullptr;
     if (m_currentRenderTypeColors) {
-        auto it = m_currentRenderTypeColors->find(node.type);
-        if (it != m_currentRenderTypeColors->end()) {
-            const auto &c = it->second;
-            int r = (int)(std::clamp(c[0], 0.0f, 1.0f) * 255.0f);
-            int g = (int)(std::clamp(c[1], 0.0f, 1.0f) * 255.0f);
-            int b = (int)(std::clamp(c[2], 0.0f, 1.0f) * 255.0f);
-            int a = (int)(std::clamp(c[3], 0.0f, 1.0f) * 255.0f);
-            return IM_COL32(r, g, b, a);
-        }
+        auto it = m_currentRenderTypeColors->find(type);
+        if (it != m_currentRenderTypeColors->end()) custom = &it->second;
     }
-
-    if (node.type == "outfit") {
-        return IM_COL32(100, 140, 200, 255);  // Blue
-    } else if (node.type == "spirit_upgrade") {
-        return IM_COL32(180, 120, 200, 255);  // Purple
-    } else if (node.type == "music") {
-        return IM_COL32(200, 160, 100, 255);  // Gold
-    } else if (node.type == "lootbox") {
-        return IM_COL32(200, 100, 100, 255);  // Red
+    if (custom) {
+        const auto &c = *custom;
+        int a = (int)(std::clamp(c[3], 0.0f, 1.0f) * 255.0f);
+        colors.fill = IM_COL32((int)(std::clamp(c[0], 0.0f, 1.0f) * 255.0f),
+                               (int)(std::clamp(c[1], 0.0f, 1.0f) * 255.0f),
+                               (int)(std::clamp(c[2], 0.0f, 1.0f) * 255.0f), a);
+        colors.border = IM_COL32((int)(std::clamp(c[0] * 0.85f, 0.0f, 1.0f) * 255.0f),
+                                 (int)(std::clamp(c[1] * 0.85f, 0.0f, 1.0f) * 255.0f),
+                                 (int)(std::clamp(c[2] * 0.85f, 0.0f, 1.0f) * 255.0f), a);
+        colors.custom = true;
+    } else if (type == OUTFIT) {
+        colors.fill = IM_COL32(100, 140, 200, 255);  // Blue
+    } else if (type == SPIRIT_UPGRADE) {
+        colors.fill = IM_COL32(180, 120, 200, 255);  // Purple
+    } else if (type == MUSIC) {
+        colors.fill = IM_COL32(200, 160, 100, 255);  // Gold
+    } else if (type == LOOTBOX) {
+        colors.fill = IM_COL32(200, 100, 100, 255);  // Red
+    } else {
+        colors.fill = IM_COL32(120, 120, 120, 255);  // Gray default
     }
-    return IM_COL32(120, 120, 120, 255);  // Gray default
+    return m_typeColorCache.emplace(type, colors).first->second;
 }
 
-ImU32 TreeRenderer::getNodeBorderColor(const SpiritNode& node) const {
+ImU32 TreeRenderer::getNodeColor(const SpiritNode& node) const {
+    return typeColorsFor(node.type).fill;
+}
+
+ImU32 TreeRenderer::getNodeBorderColor(const SpiritNode& node, uint8_t flags) const {
     // If this node has been externally highlighted (e.g., reorder mode), show a yellow border
-    if (m_highlightedNodes.count(node.id) > 0) {
+    if (flags & NODE_HIGHLIGHTED) {
         return IM_COL32(255, 220, 80, 255);
     }
 
-    // If a render-time per-type color map is provided, prefer a darker border variant
-    if (m_currentRenderTypeColors) {
-        auto it = m_currentRenderTypeColors->find(node.type);
-        if (it != m_currentRenderTypeColors->end()) {
-            const auto &c = it->second;
-            int r = (int)(std::clamp(c[0] * 0.85f, 0.0f, 1.0f) * 255.0f);
-            int g = (int)(std::clamp(c[1] * 0.85f, 0.0f, 1.0f) * 255.0f);
-            int b = (int)(std::clamp(c[2] * 0.85f, 0.0f, 1.0f) * 255.0f);
-            int a = (int)(std::clamp(c[3], 0.0f, 1.0f) * 255.0f);
-            return IM_COL32(r, g, b, a);
-        }
-    }
+    // A per-type color from the render-time map gets its darker border variant
+    const TypeColors& colors = typeColorsFor(node.type);
+    if (colors.custom) return colors.border;
 
     // If this node is offending, draw a strong red border
-    if (m_offendingNodes.count(node.id) > 0) {
+    if (flags & NODE_OFFENDING) {
         return IM_COL32(230, 60, 60, 255);
     }
 
@@ -1614,6 +1969,11 @@ void TreeRenderer::resetView() {
     m_zoom = 1.0f;
     m_pan = {0.0f, 0.0f};
     m_selectedNodeId = NO_NODE_ID;
+    // Trees are rebuilt on demand (and evicted trees freed), so a new tree may reuse an old
+    // address; never trust caches keyed by the previous tree pointer
+    m_labelTree = nullptr;
+    m_slotsTree = nullptr;
+    m_geometryValid = false;
 }
 
 uint64_t TreeRenderer::getNodeAtPosition(const SpiritTree* tree, ImVec2 mousePos, ImVec2 origin, float zoom) const {
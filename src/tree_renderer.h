@@ -1,10 +1,15 @@
 #pragma once
 
 #include "spirit_tree.h"
+#include "node_physics.h"
+#include "geometry_batch.h"
 #include <imgui.h>
 #include <unordered_map>
 #include <unordered_set>
 #include <array>
+#include <vector>
+#include <utility>
+#include <cstdint>
 #include <string>
 #include <limits>
 
@@ -43,12 +48,27 @@ public:
     // Update physics (call each frame for spring simulation)
     // Pass the current tree for collision detection between nodes
     void updatePhysics(float deltaTime, const SpiritTree* tree = nullptr);
+
+    // True while anything in the viewport still needs per-frame updates: physics bodies
+    // moving, drags in progress, or effects (delete/restore animations, red pulses,
+    // stretched links). When false the caller may stop redrawing until the next event.
+    bool isAwake() const;
+    
+    // Edit generation of the tree passed to render() (SpiritTreeManager::getEditGeneration).
+    // Cached label text is re-checked against the nodes whenever it changes.
+    void setEditGeneration(uint64_t generation) { m_editGeneration = generation; }
+    // Manager layout generation (SpiritTreeManager::getLayoutGeneration); cached geometry is
+    // rebuilt when it changes
+    void setLayoutGeneration(uint64_t generation) { m_layoutGeneration = generation; }
     
     // Pan and zoom controls
     void resetView();
     void setZoom(float zoom) { m_zoom = zoom; }
     float getZoom() const { return m_zoom; }
     void setPan(const ImVec2& pan) { m_pan = pan; }
+    // Pan so the node sits in the middle of the canvas (at the current zoom); false if the
+    // tree has no such node
+    bool centerOnNode(const SpiritTree* tree, uint64_t nodeId);
     
     // Special sentinel used to indicate 'no node' (distinct from a real node id which can be 0)
     static constexpr uint64_t NO_NODE_ID = std::numeric_limits<uint64_t>::max();
@@ -56,16 +76,14 @@ public:
     // Selection (supports multi-select via SHIFT)
     uint64_t getSelectedNodeId() const { return m_selectedNodeId; } // primary selected node
     // When external highlights are active (e.g., reorder mode), only allow selecting highlighted nodes
-    void setSelectedNodeId(uint64_t id) { 
-        // If selectable set is active, enforce it strictly
-        if (!m_selectableNodes.empty() && id != NO_NODE_ID && m_selectableNodes.count(id) == 0) return;
-        m_selectedNodeId = id; m_selectedNodes.clear(); if (id != NO_NODE_ID) m_selectedNodes.insert(id); }
-    void clearSelection() { m_selectedNodeId = NO_NODE_ID; m_selectedNodes.clear(); }
+    void setSelectedNodeId(uint64_t id);
+    void clearSelection();
 
-    const std::unordered_set<uint64_t>& getSelectedNodeIds() const { return m_selectedNodes; }
-    bool isNodeSelected(uint64_t id) const { return m_selectedNodes.count(id) > 0; }
-    void addNodeToSelection(uint64_t id) { if (id != NO_NODE_ID) { if (!m_selectableNodes.empty() && m_selectableNodes.count(id) == 0) return; m_selectedNodes.insert(id); m_selectedNodeId = id; } }
-    void removeNodeFromSelection(uint64_t id) { bool wasPrimary = (m_selectedNodeId == id); m_selectedNodes.erase(id); if (m_selectedNodes.empty()) m_selectedNodeId = NO_NODE_ID; else if (wasPrimary) m_selectedNodeId = *m_selectedNodes.begin(); }
+    // Selected ids in the order they were selected
+    const std::vector<uint64_t>& getSelectedNodeIds() const { return m_selectedNodes; }
+    bool isNodeSelected(uint64_t id) const { return hasNodeFlag(id, NODE_SELECTED); }
+    void addNodeToSelection(uint64_t id);
+    void removeNodeFromSelection(uint64_t id);
 
     // Public helper: query which node (if any) is located at the given screen position using the
     // renderer's last-known canvas origin and zoom. Returns NO_NODE_ID when none.
@@ -77,7 +95,7 @@ public:
     }
     
     // Reset all node offsets (return to computed positions)
-    void resetNodeOffsets() { m_nodeOffsets.clear(); m_nodeVelocities.clear(); }
+    void resetNodeOffsets() { m_physics.clearAllMotion(); }
 
     // Apply a base-position shift for a node (oldBase - newBase). This is used when the
     // computed layout changes the base coordinates of a node; applyBaseShift allows the
@@ -89,9 +107,9 @@ public:
     void clearNodeOffset(uint64_t nodeId);
 
     // Mark a node as free-floating so it doesn't snap back
-    void setFreeFloating(uint64_t nodeId) { m_freeFloatingNodes.insert(nodeId); }
-    void clearFreeFloating(uint64_t nodeId) { m_freeFloatingNodes.erase(nodeId); }
-    bool isFreeFloating(uint64_t nodeId) const { return m_freeFloatingNodes.count(nodeId) > 0; }
+    void setFreeFloating(uint64_t nodeId);
+    void clearFreeFloating(uint64_t nodeId);
+    bool isFreeFloating(uint64_t nodeId) const { return m_physics.hasFlag(m_physics.findSlot(nodeId), NodePhysicsStore::FLAG_FREE_FLOATING); }
 
     // Thaw a node so it participates in physics again (clears frozen/collision state and nudges velocity)
     void thawNode(uint64_t nodeId);
@@ -102,15 +120,71 @@ public:
 
     // Query a node fill color for a node (helper used by App when starting delete)
     ImU32 getNodeFillColorForNode(const SpiritNode& node) const; 
+
+    // What the last render() drew after culling (shown by the frame profiler)
+    struct DrawStats {
+        size_t nodes = 0;
+        size_t connections = 0;
+    };
+    const DrawStats& lastDrawStats() const { return m_drawStats; }
     
 private:
-    void drawNode(ImDrawList* drawList, const SpiritNode& node, 
-                  ImVec2 origin, float zoom, bool isSelected);
-    void drawConnection(ImDrawList* drawList, const SpiritNode& parent, 
-                        const SpiritNode& child, ImVec2 origin, float zoom);
+    // Level of detail for nodes and connections, picked from the zoom once per frame
+    enum class NodeDetail { Dot, Label, Full };
+    static NodeDetail detailForZoom(float zoom);
+
+    // Pre-formatted text of one node and its measured sizes, so a frame that edits nothing
+    // formats and measures nothing. The copied source fields detect stale entries.
+    struct NodeLabels {
+        uint32_t epoch = 0;              // m_labelEpoch this entry was last checked in
+        float fontSize = 0.0f;           // font size the sizes were measured with (0 = unbuilt)
+        Symbol name, type, costType;
+        uint64_t id = 0;
+        int cost = 0;
+
+        bool labelIsType = false;        // preview label shows typ instead of nm
+        ImU32 labelColor = 0;
+        ImVec2 labelSize;
+        std::string idText;              // "id: <decimal>", empty in previews
+        ImVec2 idSize;
+        const char* typeLetter = "?";
+        bool isSeasonHeart = false;
+        ImVec2 typeSize;
+        std::string costText;            // " <cost>", drawn after the type letter
+        bool seasonCandle = false;
+
+        const std::string& label() const { return labelIsType ? type.str() : name.str(); }
+    };
+    // Cached labels for node index i of the tree being drawn, rebuilt only when stale
+    const NodeLabels& labelsFor(size_t i, const SpiritNode& node);
+    void buildNodeLabels(NodeLabels& labels, const SpiritNode& node) const;
+
+    // Node drawing is split by layer: static shapes (rings, shadow, fill, border, AP star)
+    // go into a batch that can be reused next frame, time-driven effects (highlight halo,
+    // red pulse) into one rebuilt every frame, and text straight onto the draw list.
+    // screenPos is the node centre including its current physics offset.
+    // flags: the node's NODE_* view flags (m_nodeFlags)
+    void drawNodeShapes(GeometryBatch& batch, const SpiritNode& node, ImVec2 screenPos,
+                        float zoom, uint8_t flags, NodeDetail detail);
+    void drawNodeEffects(GeometryBatch& batch, const SpiritNode& node, ImVec2 screenPos, float zoom, uint8_t flags);
+    void drawNodeText(ImDrawList* drawList, ImVec2 screenPos, float zoom, NodeDetail detail,
+                      const NodeLabels& labels);
+    // parentOffset/childOffset: current physics offsets of the nodes being drawn
+    void drawConnection(GeometryBatch& batch, const SpiritNode& parent, 
+                        const SpiritNode& child, ImVec2 parentOffset, ImVec2 childOffset,
+                        ImVec2 origin, float zoom, NodeDetail detail);
+    // Advance the snap timer of a connection from its stretched world length; runs for
+    // culled connections too so off-screen links still snap. Returns the world length.
+    float updateSnapTimer(const SpiritNode& parent, const SpiritNode& child,
+                          ImVec2 parentOffset, ImVec2 childOffset);
     
     ImU32 getNodeColor(const SpiritNode& node) const;
-    ImU32 getNodeBorderColor(const SpiritNode& node) const;
+    ImU32 getNodeBorderColor(const SpiritNode& node, uint8_t flags) const;
+    // Fill (and custom border) color for a typ, resolved once per render call so nodes only
+    // pay a pointer-hash lookup on their interned typ
+    struct TypeColors { bool custom = false; ImU32 fill = 0; ImU32 border = 0; };
+    const TypeColors& typeColorsFor(Symbol type) const;
+    mutable std::unordered_map<Symbol, TypeColors> m_typeColorCache;
     
     // Check if mouse is over a node, returns node ID or NO_NODE_ID when none
     uint64_t getNodeAtPosition(const SpiritTree* tree, ImVec2 mousePos, ImVec2 origin, float zoom) const;    
@@ -129,7 +203,7 @@ private:
     
     // Selection state
     uint64_t m_selectedNodeId = NO_NODE_ID;
-    std::unordered_set<uint64_t> m_selectedNodes; // Multi-selection set (contains selected node ids)
+    std::vector<uint64_t> m_selectedNodes; // Multi-selection list; membership is the NODE_SELECTED flag
     
     // Node dragging state
     uint64_t m_draggedNodeId = NO_NODE_ID;
@@ -147,23 +221,111 @@ private:
     // Indicates the current render call is a read-only preview (used to alter display, e.g. show typ instead of nm)
     bool m_currentRenderIsPreview = false;
     
-    // Node offsets from original computed positions (for elastic dragging)
-    std::unordered_map<uint64_t, ImVec2> m_nodeOffsets;
-    std::unordered_map<uint64_t, ImVec2> m_nodeVelocities;
-    std::unordered_set<uint64_t> m_freeFloatingNodes;  // Nodes that don't snap back
-    std::unordered_set<uint64_t> m_frozenNodes;        // Nodes frozen due to sustained collision
-    std::unordered_map<uint64_t, float> m_collisionTime; // Time spent in collision with low velocity
+    // Per-node physics state: offsets from original computed positions (for elastic dragging),
+    // velocities, collision timers and free-floating/frozen flags, stored as dense arrays by slot
+    NodePhysicsStore m_physics;
+    // Physics slot for each index of the tree last bound via bindTreeSlots (parallel to SpiritTree::nodes)
+    std::vector<uint32_t> m_treeSlots;
+    // Tree, node count and edit generation of the last bind; ids are only resolved to slots
+    // again when one of them changes. When the tree or count changes, resting slots of the
+    // nodes no longer shown (and carrying no view flags) are released back to m_physics.
+    const SpiritTree* m_slotsTree = nullptr;
+    size_t m_slotsNodeCount = 0;
+    uint64_t m_slotsGeneration = 0;
+    std::vector<uint32_t> m_keepSlots;  // scratch for the release sweep
+    void bindTreeSlots(const SpiritTree* tree);
+
+    // View flags shared by selection, box selection, external highlights, selectable and
+    // offending nodes, indexed by physics slot (sized to m_physics), so they survive tree
+    // edits and switches and drawing reads m_nodeFlags[m_treeSlots[i]] directly.
+    enum : uint8_t {
+        NODE_SELECTED    = 1u << 0,
+        NODE_BOXED       = 1u << 1,  // inside the marquee being dragged
+        NODE_HIGHLIGHTED = 1u << 2,
+        NODE_SELECTABLE  = 1u << 3,
+        NODE_OFFENDING   = 1u << 4,
+    };
+    static constexpr int NODE_FLAG_BITS = 5;
+    std::vector<uint8_t> m_nodeFlags;
+    size_t m_flagCounts[NODE_FLAG_BITS] = {};   // slots carrying each flag (box flags aren't counted)
+    // Bumped on every change of m_nodeFlags, so the geometry cache key needs no set hashing
+    uint64_t m_flagsVersion = 0;
+    // Screen positions of the bound tree's nodes for the box hit test (parallel to nodes)
+    std::vector<float> m_hitX;
+    std::vector<float> m_hitY;
+
+    bool hasNodeFlag(uint64_t id, uint8_t flag) const {
+        uint32_t slot = m_physics.findSlot(id);
+        return slot < m_nodeFlags.size() && (m_nodeFlags[slot] & flag) != 0;
+    }
+    size_t flagCount(uint8_t flag) const;
+    void setNodeFlag(uint64_t id, uint8_t flag, bool on);
+    void clearNodeFlag(uint8_t flag);
+    // Set NODE_BOXED on every node whose centre lies in the screen rect (and is selectable
+    // while a selectable restriction is active)
+    void hitTestBox(const SpiritTree* tree, ImVec2 origin, float minX, float minY, float maxX, float maxY);
+    void clearBoxFlags();
+    // Label cache parallel to SpiritTree::nodes. m_labelEpoch advances when the tree, its edit
+    // generation, the font size or the preview flag changes; entries from an older epoch are
+    // compared against their node and re-formatted only if it actually changed.
+    std::vector<NodeLabels> m_labelCache;
+    uint32_t m_labelEpoch = 1;
+    const SpiritTree* m_labelTree = nullptr;
+    uint64_t m_labelGeneration = 0;
+    uint64_t m_editGeneration = 0;
+    uint64_t m_layoutGeneration = 0;
+    float m_labelFontSize = 0.0f;
+    bool m_labelPreview = false;
+    // Connection and node shape geometry of the last frame. It is flushed again as-is while
+    // the key (edit and layout generations, physics motion, view, selection state and
+    // colours) is unchanged; it is built from counters, never by walking the nodes.
+    // m_visibleNodes lists the node indices that passed culling for the text and effect passes.
+    GeometryBatch m_linkBatch;
+    GeometryBatch m_nodeBatch;
+    GeometryBatch m_effectBatch;
+    std::vector<uint32_t> m_visibleNodes;
+    struct GeometryKey {
+        const SpiritTree* tree = nullptr;
+        size_t nodeCount = 0;
+        uint64_t editGeneration = 0;
+        uint64_t layoutGeneration = 0;
+        uint64_t motionVersion = 0;
+        uint64_t flagsVersion = 0;
+        uint64_t stateHash = 0;   // view parameters and type colours
+        bool operator==(const GeometryKey& o) const {
+            return tree == o.tree && nodeCount == o.nodeCount && editGeneration == o.editGeneration &&
+                   layoutGeneration == o.layoutGeneration && motionVersion == o.motionVersion &&
+                   flagsVersion == o.flagsVersion && stateHash == o.stateHash;
+        }
+    };
+    GeometryKey m_geometryKey;
+    bool m_geometryValid = false;
+    GeometryKey geometryKeyFor(const SpiritTree* tree, ImVec2 origin, ImVec2 canvasPos,
+                               ImVec2 canvasSize, NodeDetail detail) const;
+    DrawStats m_drawStats;
     // Global collision suppression timer (seconds remaining) - when >0 collision checks are skipped
     float m_collisionSuppressRemaining = 0.0f;
-
-    // Nodes that are considered 'offending' (too many children). Rendered with red fill.
-    std::unordered_set<uint64_t> m_offendingNodes;
+    // Idle tracking for isAwake(): set when the last physics step moved anything (or a shift/thaw
+    // was applied since), and whether the last render drew a tree / any pulsing red ring
+    bool m_physicsAwake = false;
+    bool m_renderedTreeLastFrame = false;
+    bool m_redPulseDrawnLastFrame = false;
+
+    // Collision broadphase scratch (reused across frames to avoid per-frame allocations).
+    // Nodes are bucketed into a uniform grid of COLLISION_RADIUS*2 cells so only nodes in
+    // neighbouring cells are pair-tested. Indices refer to positions in SpiritTree::nodes.
+    std::vector<std::pair<uint64_t, uint32_t>> m_physCells; // (packed cell key, node index), sorted by key
+    std::vector<ImVec2> m_physPositions;  // world position (base + offset) per node index
+    std::vector<ImVec2> m_physPush;       // accumulated collision push per node index
+    std::vector<uint8_t> m_physPushable;  // 0 when the node is dragged or frozen
+    std::vector<uint8_t> m_physPushed;    // 1 when any push was accumulated this step
+    static uint64_t packCellKey(int32_t cx, int32_t cy) { return ((uint64_t)(uint32_t)cx << 32) | (uint64_t)(uint32_t)cy; }
 
 public:
-    // APIs to manage offending nodes
-    void setOffendingNode(uint64_t nodeId) { m_offendingNodes.insert(nodeId); }
-    void clearOffendingNode(uint64_t nodeId) { m_offendingNodes.erase(nodeId); }
-    bool isOffendingNode(uint64_t nodeId) const { return m_offendingNodes.count(nodeId) > 0; }
+    // Nodes that are considered 'offending' (too many children). Rendered with red fill.
+    void setOffendingNode(uint64_t nodeId) { setNodeFlag(nodeId, NODE_OFFENDING, true); }
+    void clearOffendingNode(uint64_t nodeId) { setNodeFlag(nodeId, NODE_OFFENDING, false); }
+    bool isOffendingNode(uint64_t nodeId) const { return hasNodeFlag(nodeId, NODE_OFFENDING); }
 
 
     
@@ -183,6 +345,20 @@ public:
     static constexpr float NODE_RADIUS = 25.0f;
     static constexpr float CONNECTION_THICKNESS = 2.0f;
 
+    // Level-of-detail zoom thresholds: below LOD_LABEL_ZOOM nodes are plain dots, below
+    // LOD_FULL_ZOOM only the label is drawn, above it the type letter and cost as well
+    static constexpr float LOD_LABEL_ZOOM = 0.5f;
+    static constexpr float LOD_FULL_ZOOM = 0.7f;
+    // Screen-space slack around the canvas for culling: covers labels wider than the node,
+    // the type/cost text and the selection/halo rings
+    static constexpr float NODE_CULL_MARGIN = 160.0f;
+
+    // Snapping: connections blend toward red past SNAP_WARNING_DIST and snap once held
+    // beyond SNAP_DIST for SNAP_HOLD seconds (world units, measured with live offsets)
+    static constexpr float SNAP_WARNING_DIST = 240.0f;
+    static constexpr float SNAP_DIST = 420.0f;
+    static constexpr float SNAP_HOLD = 0.12f;
+
     // Deletion animations (nodes that have been removed from the model but are still
     // animating on-screen as two halves)
     struct DeleteAnim {
@@ -222,9 +398,6 @@ public:
     // Trigger a restore visual effect for a given node (provide the tree so node can be located)
     void triggerRestoreEffect(const SpiritTree* tree, uint64_t nodeId);
 
-    // Highlighted nodes (used by external modes like reorder) - renderer will adjust border
-    std::unordered_set<uint64_t> m_highlightedNodes;
-
     // Red pulse state (used to indicate invalid operations like duplicate names)
     std::unordered_map<uint64_t, double> m_nodeRedPulseStart; // nodeId -> start time
 public:
@@ -232,35 +405,34 @@ public:
     void pulseNodeRed(uint64_t nodeId) { m_nodeRedPulseStart[nodeId] = ImGui::GetTime(); }
     // Set persistent red pulse state (on while the issue exists)
     void setNodeRedState(uint64_t nodeId, bool active) { if (active) m_nodeRedPulseStart[nodeId] = ImGui::GetTime(); else m_nodeRedPulseStart.erase(nodeId); }
-    // Selectable nodes (when non-empty, only these nodes may be selected)
-    std::unordered_set<uint64_t> m_selectableNodes;
-
     // Box selection state (allow users to draw a marquee to select nodes)
     bool m_isBoxSelecting = false;
     ImVec2 m_boxSelectStart = ImVec2(0.0f, 0.0f);
     ImVec2 m_boxSelectCurrent = ImVec2(0.0f, 0.0f);
-    std::unordered_set<uint64_t> m_boxSelectedNodes;
     static constexpr float BOX_SELECT_MIN_DRAG = 4.0f;
 
     // Helper to clear box selection state
-    void clearBoxSelection() { m_isBoxSelecting = false; m_boxSelectedNodes.clear(); }
+    void clearBoxSelection() { m_isBoxSelecting = false; clearBoxFlags(); }
 
     // Arrow visibility state
     bool m_showArrows = true;
 public:
-    // Allow callers to highlight specific nodes so the renderer can visually emphasize them
-    void setHighlightedNodes(const std::unordered_set<uint64_t>& nodes) { m_highlightedNodes = nodes; }
-    void clearHighlightedNodes() { m_highlightedNodes.clear(); }
-    // Restrict selection: when set, only these node ids may be selected
-    void setSelectableNodes(const std::unordered_set<uint64_t>& nodes) { m_selectableNodes = nodes; }
-    void clearSelectableNodes() { m_selectableNodes.clear(); }
+    // Allow callers to highlight specific nodes (e.g., reorder mode) so the renderer can
+    // visually emphasize them; changes are passed one node at a time
+    void setNodeHighlighted(uint64_t id, bool highlighted) { setNodeFlag(id, NODE_HIGHLIGHTED, highlighted); }
+    void clearHighlightedNodes() { clearNodeFlag(NODE_HIGHLIGHTED); }
+    bool isNodeHighlighted(uint64_t id) const { return hasNodeFlag(id, NODE_HIGHLIGHTED); }
+    // Restrict selection: while any node is marked selectable, only those may be selected
+    void setNodeSelectable(uint64_t id, bool selectable) { setNodeFlag(id, NODE_SELECTABLE, selectable); }
+    void clearSelectableNodes() { clearNodeFlag(NODE_SELECTABLE); }
+    bool isNodeSelectable(uint64_t id) const { return flagCount(NODE_SELECTABLE) == 0 || hasNodeFlag(id, NODE_SELECTABLE); }
 
     // Suppress collisions for a given amount of seconds (used after reorder)
-    void suppressCollisions(float seconds) { m_collisionSuppressRemaining = std::max(m_collisionSuppressRemaining, seconds); m_collisionTime.clear(); m_frozenNodes.clear(); }
+    void suppressCollisions(float seconds);
 
     // Group drag helpers: when multiple nodes are dragged together we temporarily
     // freeze and mark them free-floating so they stay locked together until release.
-    void startGroupDrag(const std::unordered_set<uint64_t>& nodes);
+    void startGroupDrag(const std::vector<uint64_t>& nodes);
     void endGroupDrag();
 
     // Snapping: detect stretched links and produce snap events for the app to commit
@@ -0,0 +1,129 @@
+#include "undo_history.h"
+#include <algorithm>
+
+namespace Watercan {
+
+void UndoHistory::record(const std::string& spirit, UndoOp&& op) {
+    if (!m_pending.ops.empty() && m_pending.spirit != spirit) commit();
+    if (m_pending.ops.empty()) m_pending.spirit = spirit;
+    if (!m_redo.empty()) {
+        m_redo.clear();
+        m_bytes = 0;
+        for (const auto& s : m_undo) m_bytes += s.bytes;
+    }
+    if (!m_pending.ops.empty() && mergeOp(m_pending.ops.back(), op)) return;
+    m_pending.ops.push_back(std::move(op));
+}
+
+bool UndoHistory::mergeOp(UndoOp& last, const UndoOp& op) {
+    if (last.kind != op.kind || last.nodeId != op.nodeId) return false;
+    switch (op.kind) {
+    case UndoOp::Kind::Fields:
+        last.after = op.after;
+        return true;
+    case UndoOp::Kind::MoveNode:
+    case UndoOp::Kind::MoveSubtree:
+    case UndoOp::Kind::MoveTree:
+        last.dx += op.dx;
+        last.dy += op.dy;
+        return true;
+    default:
+        return false;
+    }
+}
+
+size_t UndoHistory::stepBytes(const UndoStep& step) {
+    size_t total = sizeof(UndoStep) + step.spirit.capacity();
+    for (const auto& op : step.ops) total += op.bytes();
+    return total;
+}
+
+bool UndoHistory::commit() {
+    if (m_pending.ops.empty()) return false;
+    UndoStep step = std::move(m_pending);
+    m_pending = UndoStep();
+    step.time = std::chrono::steady_clock::now();
+
+    // A lone repeat of the previous lone op (same kind and node) continues that edit
+    if (!m_undo.empty() && step.ops.size() == 1) {
+        UndoStep& top = m_undo.back();
+        if (top.ops.size() == 1 && top.spirit == step.spirit &&
+            step.time - top.time <= MERGE_WINDOW && mergeOp(top.ops.front(), step.ops.front())) {
+            top.time = step.time;
+            return true;
+        }
+    }
+
+    step.bytes = stepBytes(step);
+    m_bytes += step.bytes;
+    m_undo.push_back(std::move(step));
+    enforceBudget();
+    return true;
+}
+
+bool UndoHistory::takeUndo(UndoStep& out) {
+    commit();
+    if (m_undo.empty()) return false;
+    out = std::move(m_undo.back());
+    m_undo.pop_back();
+    m_bytes -= out.bytes;
+    return true;
+}
+
+bool UndoHistory::takeRedo(UndoStep& out) {
+    if (m_redo.empty()) return false;
+    out = std::move(m_redo.back());
+    m_redo.pop_back();
+    m_bytes -= out.bytes;
+    return true;
+}
+
+void UndoHistory::pushRedo(UndoStep&& step) {
+    m_bytes += step.bytes;
+    m_redo.push_back(std::move(step));
+    enforceBudget();
+}
+
+void UndoHistory::pushUndo(UndoStep&& step) {
+    m_bytes += step.bytes;
+    m_undo.push_back(std::move(step));
+    enforceBudget();
+}
+
+void UndoHistory::dropSpirit(const std::string& spirit) {
+    if (m_pending.spirit == spirit) m_pending = UndoStep();
+    auto touches = [&](const UndoStep& s) { return s.spirit == spirit; };
+    m_undo.erase(std::remove_if(m_undo.begin(), m_undo.end(), touches), m_undo.end());
+    m_redo.erase(std::remove_if(m_redo.begin(), m_redo.end(), touches), m_redo.end());
+    m_bytes = 0;
+    for (const auto& s : m_undo) m_bytes += s.bytes;
+    for (const auto& s : m_redo) m_bytes += s.bytes;
+}
+
+void UndoHistory::clear() {
+    m_pending = UndoStep();
+    m_undo.clear();
+    m_redo.clear();
+    m_bytes = 0;
+}
+
+void UndoHistory::setBudget(size_t bytes) {
+    m_budget = bytes;
+    enforceBudget();
+}
+
+void UndoHistory::enforceBudget() {
+    // Oldest history goes first; the most recent step always survives so the last action
+    // can be undone even when it alone exceeds the budget
+    while (m_bytes > m_budget && m_undo.size() + m_redo.size() > 1) {
+        if (!m_undo.empty()) {
+            m_bytes -= m_undo.front().bytes;
+            m_undo.pop_front();
+        } else {
+            m_bytes -= m_redo.front().bytes;
+            m_redo.pop_front();
+        }
+    }
+}
+
+} // namespace Watercan
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+#include "string_pool.h"
+
+namespace Watercan {
+
+// The editable (non-structural) fields of a SpiritNode, as recorded by a field edit
+struct NodeFields {
+    Symbol name;
+    Symbol originalName;
+    Symbol spirit;
+    Symbol type;
+    Symbol costType;
+    int cost = 0;
+    bool isAdventurePass = false;
+    bool isNew = false;
+
+    bool operator==(const NodeFields& o) const {
+        return name == o.name && originalName == o.originalName && spirit == o.spirit &&
+               type == o.type && costType == o.costType && cost == o.cost &&
+               isAdventurePass == o.isAdventurePass && isNew == o.isNew;
+    }
+    bool operator!=(const NodeFields& o) const { return !(*this == o); }
+};
+
+// One recorded edit, holding just enough to apply it in either direction. Which members
+// are used depends on kind:
+//   Fields       nodeId, before/after
+//   MoveNode     nodeId, dx/dy (base shift of one node)
+//   MoveSubtree  nodeId, dx/dy (base shift of the subtree rooted at nodeId)
+//   MoveTree     dx/dy (base shift of every node)
+//   Layout       placements (absolute positions written by a re-layout)
+//   Link         nodeId, from/to parent, fromIndex/toIndex in those parents' child lists
+//   ChildOrder   nodeId (parent), ids/idsAfter (child list before and after)
+//   IdChange     from/to id
+//   Create       nodeId, x/y, before (fields), slot in SpiritTree::nodes, ids/idsAfter
+//                (nodes that already depended on the new id)
+//   Delete       nodeId, from (dep), x/y, before, slot, fromIndex (place among its
+//                parent's children), idsAfter (its child list), ids (nodes orphaned)
+struct UndoOp {
+    enum class Kind : uint8_t { Fields, MoveNode, MoveSubtree, MoveTree, Layout, Link,
+                                ChildOrder, IdChange, Create, Delete };
+    static constexpr uint32_t NO_INDEX = 0xFFFFFFFFu;
+
+    struct Placement {
+        uint64_t id;
+        float fromX, fromY;
+        float toX, toY;
+    };
+
+    Kind kind = Kind::Fields;
+    uint64_t nodeId = 0;
+    uint64_t from = 0;
+    uint64_t to = 0;
+    uint32_t fromIndex = NO_INDEX;
+    uint32_t toIndex = NO_INDEX;
+    uint32_t slot = 0;
+    float dx = 0.0f, dy = 0.0f;
+    float x = 0.0f, y = 0.0f;
+    NodeFields before, after;
+    std::vector<Placement> placements;
+    std::vector<uint64_t> ids;
+    std::vector<uint64_t> idsAfter;
+
+    // Approximate heap + inline footprint, charged against the history budget
+    size_t bytes() const {
+        return sizeof(UndoOp) + placements.capacity() * sizeof(Placement) +
+               (ids.capacity() + idsAfter.capacity()) * sizeof(uint64_t);
+    }
+};
+
+// Everything recorded for one user action (typically one frame), undone as a unit
+struct UndoStep {
+    std::string spirit;
+    std::vector<UndoOp> ops;
+    size_t bytes = 0;
+    std::chrono::steady_clock::time_point time;
+};
+
+// Undo/redo stacks of UndoSteps. Edits are recorded into a pending step that commit()
+// closes; a step that repeats the previous one on the same node (typing into a field,
+// nudging the same node) within MERGE_WINDOW is folded into it. The combined size of both
+// stacks is kept under a byte budget by dropping the oldest steps.
+class UndoHistory {
+public:
+    static constexpr size_t DEFAULT_BUDGET_BYTES = 32u << 20;
+
+    // Append an op to the pending step for spirit (committing a pending step of another
+    // spirit first). Recording a new edit discards the redo stack.
+    void record(const std::string& spirit, UndoOp&& op);
+    // Close the pending step; returns true if one was pushed (or merged) onto the undo stack
+    bool commit();
+
+    // Pop the most recent step (the pending one is committed first); false when empty
+    bool takeUndo(UndoStep& out);
+    bool takeRedo(UndoStep& out);
+    // Push a step that was just undone / redone onto the opposite stack
+    void pushRedo(UndoStep&& step);
+    void pushUndo(UndoStep&& step);
+
+    bool canUndo() const { return !m_pending.ops.empty() || !m_undo.empty(); }
+    bool canRedo() const { return !m_redo.empty(); }
+
+    // Forget every step touching spirit (it was reloaded, deleted or lost nodes to another)
+    void dropSpirit(const std::string& spirit);
+    void clear();
+
+    void setBudget(size_t bytes);
+    size_t budget() const { return m_budget; }
+    size_t bytesUsed() const { return m_bytes; }
+
+private:
+    static constexpr std::chrono::milliseconds MERGE_WINDOW{1000};
+
+    // Fold op into last when both describe the same continuous edit
+    static bool mergeOp(UndoOp& last, const UndoOp& op);
+    static size_t stepBytes(const UndoStep& step);
+    void enforceBudget();
+
+    UndoStep m_pending;
+    std::deque<UndoStep> m_undo;
+    std::deque<UndoStep> m_redo;
+    size_t m_bytes = 0;              // bytes held by m_undo + m_redo
+    size_t m_budget = DEFAULT_BUDGET_BYTES;
+};
+
+} // namespace Watercan